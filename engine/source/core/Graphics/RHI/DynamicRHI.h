@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "RHIResources.h"
+
 class DynamicRHI
 {
 public:
@@ -12,6 +14,19 @@ public:
     virtual void ShutDown() =0;
 
     virtual const char* GetName()=0;
-    
-    
+
+    /** Create a buffer, returns an invalid handle on failure. Can be called from any thread */
+    virtual RHIBufferHandle CreateBuffer(const RHIBufferDesc& Desc) =0;
+    /** Destroy a buffer once the GPU has finished with it, stale handles are ignored */
+    virtual void DestroyBuffer(RHIBufferHandle Handle) =0;
+
+    /** Create a texture, returns an invalid handle on failure. Can be called from any thread */
+    virtual RHITextureHandle CreateTexture(const RHITextureDesc& Desc) =0;
+    /** Destroy a texture once the GPU has finished with it, stale handles are ignored */
+    virtual void DestroyTexture(RHITextureHandle Handle) =0;
+
+    RHIResources& GetResources() { return Resources; }
+
+protected:
+    RHIResources Resources;
 };
\ No newline at end of file
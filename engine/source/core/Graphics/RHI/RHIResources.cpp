@@ -1 +1,73 @@
 ﻿#include "RHIResources.h"
+
+RHIResources::RHIResources(uint32_t MaxBuffers, uint32_t MaxTextures)
+    : Buffers(MaxBuffers)
+    , Textures(MaxTextures)
+{
+}
+
+RHIBufferHandle RHIResources::AllocateBuffer(const RHIBufferDesc& Desc)
+{
+    RHIBufferHandle Handle = Buffers.Allocate();
+    if (Handle.IsValid())
+    {
+        Buffers.Get<BufferSize>(Handle) = Desc.Size;
+        Buffers.Get<BufferUsage>(Handle) = Desc.Usage;
+    }
+    return Handle;
+}
+
+bool RHIResources::ReleaseBuffer(RHIBufferHandle Handle, const std::function<void(uint32_t)>& OnRelease)
+{
+    return Buffers.Free(Handle, [&](uint32_t Index)
+    {
+        if (OnRelease)
+        {
+            OnRelease(Index);
+        }
+    });
+}
+
+RHIBufferDesc RHIResources::GetDesc(RHIBufferHandle Handle) const
+{
+    RHIBufferDesc Desc;
+    Desc.Size = Buffers.Get<BufferSize>(Handle);
+    Desc.Usage = Buffers.Get<BufferUsage>(Handle);
+    return Desc;
+}
+
+RHITextureHandle RHIResources::AllocateTexture(const RHITextureDesc& Desc)
+{
+    RHITextureHandle Handle = Textures.Allocate();
+    if (Handle.IsValid())
+    {
+        Textures.Get<TextureWidth>(Handle) = Desc.Width;
+        Textures.Get<TextureHeight>(Handle) = Desc.Height;
+        Textures.Get<TextureMipLevels>(Handle) = Desc.MipLevels;
+        Textures.Get<TextureFormat>(Handle) = Desc.Format;
+        Textures.Get<TextureUsage>(Handle) = Desc.Usage;
+    }
+    return Handle;
+}
+
+bool RHIResources::ReleaseTexture(RHITextureHandle Handle, const std::function<void(uint32_t)>& OnRelease)
+{
+    return Textures.Free(Handle, [&](uint32_t Index)
+    {
+        if (OnRelease)
+        {
+            OnRelease(Index);
+        }
+    });
+}
+
+RHITextureDesc RHIResources::GetDesc(RHITextureHandle Handle) const
+{
+    RHITextureDesc Desc;
+    Desc.Width = Textures.Get<TextureWidth>(Handle);
+    Desc.Height = Textures.Get<TextureHeight>(Handle);
+    Desc.MipLevels = Textures.Get<TextureMipLevels>(Handle);
+    Desc.Format = Textures.Get<TextureFormat>(Handle);
+    Desc.Usage = Textures.Get<TextureUsage>(Handle);
+    return Desc;
+}
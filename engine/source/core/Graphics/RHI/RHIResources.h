@@ -1,7 +1,261 @@
 ﻿#pragma once
 
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+
+/**
+ * 32 bit handle to an RHI resource: the low bits index a slot, the high bits hold the generation the slot had when
+ * the resource was created. Destroying a resource bumps the generation, so copies of the handle kept elsewhere are
+ * recognized as stale instead of reaching whatever reuses the slot.
+ */
+template<typename Tag>
+struct TRHIHandle
+{
+    static constexpr uint32_t IndexBits = 20;
+    static constexpr uint32_t GenerationBits = 32 - IndexBits;
+    static constexpr uint32_t IndexMask = (1u << IndexBits) - 1;
+    static constexpr uint32_t GenerationMask = (1u << GenerationBits) - 1;
+
+    /** 0 is never handed out, generations start at 1 */
+    uint32_t Value = 0;
+
+    TRHIHandle() = default;
+    TRHIHandle(uint32_t Index, uint32_t Generation) : Value((Generation << IndexBits) | Index) {}
+
+    uint32_t GetIndex() const { return Value & IndexMask; }
+    uint32_t GetGeneration() const { return Value >> IndexBits; }
+    bool IsValid() const { return Value != 0; }
+
+    bool operator==(const TRHIHandle& Other) const { return Value == Other.Value; }
+    bool operator!=(const TRHIHandle& Other) const { return Value != Other.Value; }
+};
+
+struct RHIBufferTag;
+struct RHITextureTag;
+using RHIBufferHandle = TRHIHandle<RHIBufferTag>;
+using RHITextureHandle = TRHIHandle<RHITextureTag>;
+
+/**
+ * Fixed capacity slot map with one array per column (SoA), so walking one attribute of many resources touches only
+ * that attribute's cache lines. Lookups are a generation compare and an array index. Slots are allocated and freed
+ * lock-free from any thread; a slot's columns belong to the thread that allocated it until the handle is published.
+ */
+template<typename Tag, typename... Columns>
+class TRHISlotMap
+{
+public:
+    using HandleType = TRHIHandle<Tag>;
+
+    explicit TRHISlotMap(uint32_t InCapacity)
+        : Capacity(InCapacity)
+        , Generations(new std::atomic<uint32_t>[InCapacity])
+        , NextFree(new std::atomic<uint32_t>[InCapacity])
+        , ColumnData(std::unique_ptr<Columns[]>(new Columns[InCapacity]())...)
+    {
+        assert(InCapacity > 0 && InCapacity - 1 <= HandleType::IndexMask);
+        for (uint32_t Index = 0; Index < Capacity; Index++)
+        {
+            Generations[Index].store(1, std::memory_order_relaxed);
+            NextFree[Index].store(InvalidIndex, std::memory_order_relaxed);
+        }
+    }
+    TRHISlotMap(const TRHISlotMap&) = delete;
+    TRHISlotMap& operator=(const TRHISlotMap&) = delete;
+
+    /** Take a free slot, returns an invalid handle if the map is full */
+    HandleType Allocate()
+    {
+        // Freed slots are reused first, the tag in the upper half of the head guards the pop against ABA
+        uint64_t Head = FreeHead.load(std::memory_order_acquire);
+        while (static_cast<uint32_t>(Head) != InvalidIndex)
+        {
+            const uint32_t Index = static_cast<uint32_t>(Head);
+            const uint64_t Next = ((Head >> 32) + 1) << 32 | NextFree[Index].load(std::memory_order_relaxed);
+            if (FreeHead.compare_exchange_weak(Head, Next, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                LiveCount.fetch_add(1, std::memory_order_relaxed);
+                return HandleType(Index, Generations[Index].load(std::memory_order_relaxed));
+            }
+        }
+        uint32_t Index = NextUnused.load(std::memory_order_relaxed);
+        do
+        {
+            if (Index >= Capacity)
+            {
+                return HandleType();
+            }
+        } while (!NextUnused.compare_exchange_weak(Index, Index + 1, std::memory_order_relaxed));
+        LiveCount.fetch_add(1, std::memory_order_relaxed);
+        return HandleType(Index, Generations[Index].load(std::memory_order_relaxed));
+    }
+
+    /** Return a slot, false if the handle is stale or has been freed already */
+    bool Free(HandleType Handle)
+    {
+        return Free(Handle, [](uint32_t) {});
+    }
+
+    /**
+     * Return a slot, OnRelease(Index) is called after the handle has been invalidated and before the slot can be
+     * handed out again, so it is the only code touching the slot's columns at that point
+     */
+    template<typename Func>
+    bool Free(HandleType Handle, Func&& OnRelease)
+    {
+        if (!Handle.IsValid() || Handle.GetIndex() >= Capacity)
+        {
+            return false;
+        }
+        const uint32_t Index = Handle.GetIndex();
+        uint32_t Generation = Handle.GetGeneration();
+        // Generations wrap around skipping 0, so a handle can only be mistaken for a live one after GenerationMask reuses of its slot
+        uint32_t NextGeneration = Generation == HandleType::GenerationMask ? 1 : Generation + 1;
+        if (!Generations[Index].compare_exchange_strong(Generation, NextGeneration, std::memory_order_acq_rel))
+        {
+            return false;
+        }
+        OnRelease(Index);
+        LiveCount.fetch_sub(1, std::memory_order_relaxed);
+        uint64_t Head = FreeHead.load(std::memory_order_relaxed);
+        uint64_t NewHead;
+        do
+        {
+            NextFree[Index].store(static_cast<uint32_t>(Head), std::memory_order_relaxed);
+            NewHead = ((Head >> 32) + 1) << 32 | Index;
+        } while (!FreeHead.compare_exchange_weak(Head, NewHead, std::memory_order_release, std::memory_order_relaxed));
+        return true;
+    }
+
+    bool IsAlive(HandleType Handle) const
+    {
+        return Handle.IsValid() && Handle.GetIndex() < Capacity && Generations[Handle.GetIndex()].load(std::memory_order_acquire) == Handle.GetGeneration();
+    }
+
+    /** Column value of a live resource, O(1) */
+    template<size_t Column>
+    auto& Get(HandleType Handle)
+    {
+        assert(IsAlive(Handle));
+        return std::get<Column>(ColumnData)[Handle.GetIndex()];
+    }
+    template<size_t Column>
+    const auto& Get(HandleType Handle) const
+    {
+        assert(IsAlive(Handle));
+        return std::get<Column>(ColumnData)[Handle.GetIndex()];
+    }
+
+    uint32_t GetCapacity() const { return Capacity; }
+    uint32_t GetLiveCount() const { return LiveCount.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t InvalidIndex = ~0u;
+
+    const uint32_t Capacity;
+    std::unique_ptr<std::atomic<uint32_t>[]> Generations;
+    std::unique_ptr<std::atomic<uint32_t>[]> NextFree;
+    std::tuple<std::unique_ptr<Columns[]>...> ColumnData;
+    /** Index of the first free slot in the low half, ABA tag in the high half */
+    std::atomic<uint64_t> FreeHead{ InvalidIndex };
+    /** Slots above this have never been handed out */
+    std::atomic<uint32_t> NextUnused{ 0 };
+    std::atomic<uint32_t> LiveCount{ 0 };
+};
+
+namespace RHIBufferUsage
+{
+    enum Flags : uint32_t
+    {
+        Vertex = 0x1,
+        Index = 0x2,
+        Uniform = 0x4,
+        Storage = 0x8,
+        TransferSrc = 0x10,
+        TransferDst = 0x20,
+        /** Persistently mapped host visible memory instead of device local memory */
+        HostVisible = 0x40,
+    };
+}
+
+namespace RHITextureUsage
+{
+    enum Flags : uint32_t
+    {
+        Sampled = 0x1,
+        Storage = 0x2,
+        ColorAttachment = 0x4,
+        DepthStencilAttachment = 0x8,
+        TransferSrc = 0x10,
+        TransferDst = 0x20,
+    };
+}
+
+enum class RHIFormat : uint32_t
+{
+    Unknown = 0,
+    R8G8B8A8_UNORM,
+    R8G8B8A8_SRGB,
+    B8G8R8A8_UNORM,
+    R16G16B16A16_SFLOAT,
+    R32G32B32A32_SFLOAT,
+    D32_SFLOAT,
+    D24_UNORM_S8_UINT,
+};
+
+struct RHIBufferDesc
+{
+    uint64_t Size = 0;
+    uint32_t Usage = 0;
+};
+
+struct RHITextureDesc
+{
+    uint32_t Width = 1;
+    uint32_t Height = 1;
+    uint32_t MipLevels = 1;
+    RHIFormat Format = RHIFormat::Unknown;
+    uint32_t Usage = 0;
+};
+
+/**
+ * Registry of the resources created through the RHI. It owns the handles and the API independent metadata, RHI
+ * implementations keep their native objects in arrays of GetCapacity() entries indexed by the handle's slot.
+ */
 class RHIResources
 {
 public:
-    
+    using BufferSlotMap = TRHISlotMap<RHIBufferTag, uint64_t, uint32_t>;
+    enum BufferColumn { BufferSize, BufferUsage };
+
+    using TextureSlotMap = TRHISlotMap<RHITextureTag, uint32_t, uint32_t, uint32_t, RHIFormat, uint32_t>;
+    enum TextureColumn { TextureWidth, TextureHeight, TextureMipLevels, TextureFormat, TextureUsage };
+
+    explicit RHIResources(uint32_t MaxBuffers = 1u << 16, uint32_t MaxTextures = 1u << 14);
+
+    /** Take a handle and store the metadata, invalid if the registry is full. Safe to call from any thread */
+    RHIBufferHandle AllocateBuffer(const RHIBufferDesc& Desc);
+    /**
+     * Invalidate the handle, false if it was stale already
+     * @param OnRelease (Optional) Called with the slot index before the slot can be reused, to take the native objects out of it
+     */
+    bool ReleaseBuffer(RHIBufferHandle Handle, const std::function<void(uint32_t)>& OnRelease = nullptr);
+    bool IsAlive(RHIBufferHandle Handle) const { return Buffers.IsAlive(Handle); }
+    RHIBufferDesc GetDesc(RHIBufferHandle Handle) const;
+
+    RHITextureHandle AllocateTexture(const RHITextureDesc& Desc);
+    bool ReleaseTexture(RHITextureHandle Handle, const std::function<void(uint32_t)>& OnRelease = nullptr);
+    bool IsAlive(RHITextureHandle Handle) const { return Textures.IsAlive(Handle); }
+    RHITextureDesc GetDesc(RHITextureHandle Handle) const;
+
+    BufferSlotMap& GetBuffers() { return Buffers; }
+    TextureSlotMap& GetTextures() { return Textures; }
+
+private:
+    BufferSlotMap Buffers;
+    TextureSlotMap Textures;
 };
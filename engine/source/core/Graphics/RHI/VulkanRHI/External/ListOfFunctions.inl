@@ -166,6 +166,14 @@ VK_DEVICE_LEVEL_FUNCTION( vkDestroyFence )
 // Tutorial 05
 VK_DEVICE_LEVEL_FUNCTION( vkCmdCopyBuffer )
 
+VK_DEVICE_LEVEL_FUNCTION( vkResetCommandPool )
+VK_DEVICE_LEVEL_FUNCTION( vkCreateQueryPool )
+VK_DEVICE_LEVEL_FUNCTION( vkDestroyQueryPool )
+VK_DEVICE_LEVEL_FUNCTION( vkCmdResetQueryPool )
+VK_DEVICE_LEVEL_FUNCTION( vkCmdWriteTimestamp )
+VK_DEVICE_LEVEL_FUNCTION( vkGetQueryPoolResults )
+VK_DEVICE_LEVEL_FUNCTION( vkQueueWaitIdle )
+
 // Tutorial 06
 VK_DEVICE_LEVEL_FUNCTION( vkCreateImage )
 VK_DEVICE_LEVEL_FUNCTION( vkGetImageMemoryRequirements )
@@ -182,4 +190,8 @@ VK_DEVICE_LEVEL_FUNCTION( vkDestroyDescriptorSetLayout )
 VK_DEVICE_LEVEL_FUNCTION( vkDestroySampler )
 VK_DEVICE_LEVEL_FUNCTION( vkDestroyImage )
 
+VK_DEVICE_LEVEL_FUNCTION( vkCreatePipelineCache )
+VK_DEVICE_LEVEL_FUNCTION( vkDestroyPipelineCache )
+VK_DEVICE_LEVEL_FUNCTION( vkGetPipelineCacheData )
+
 #undef VK_DEVICE_LEVEL_FUNCTION
\ No newline at end of file
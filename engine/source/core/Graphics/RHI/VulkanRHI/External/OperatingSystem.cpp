@@ -102,6 +102,7 @@ namespace EngineBase {
       MSG message;
       bool loop = true;
       bool resize = false;
+      std::chrono::high_resolution_clock::time_point resize_time;
       bool result = true;
 
       while( loop ) {
@@ -111,6 +112,7 @@ namespace EngineBase {
             // Resize
           case WM_USER + 1:
             resize = true;
+            resize_time = std::chrono::high_resolution_clock::now();
             break;
             // Close
           case WM_USER + 2:
@@ -121,7 +123,8 @@ namespace EngineBase {
           DispatchMessage( &message );
         } else {
           // Resize
-          if( resize ) {
+          // Bursts of resize events only rebuild the swap chain once, for the final size
+          if( resize && (std::chrono::high_resolution_clock::now() - resize_time >= project.GetResizeDebounce()) ) {
             resize = false;
             if( !project.OnWindowSizeChanged() ) {
               result = false;
@@ -221,6 +224,7 @@ namespace EngineBase {
       xcb_generic_event_t *event;
       bool loop = true;
       bool resize = false;
+      std::chrono::high_resolution_clock::time_point resize_time;
       bool result = true;
 
       while( loop ) {
@@ -238,6 +242,7 @@ namespace EngineBase {
               if( ((configure_event->width > 0) && (width != configure_event->width)) ||
                 ((configure_event->height > 0) && (height != configure_event->height)) ) {
                 resize = true;
+                resize_time = std::chrono::high_resolution_clock::now();
                 width = configure_event->width;
                 height = configure_event->height;
               }
@@ -257,7 +262,8 @@ namespace EngineBase {
           free( event );
         } else {
           // Draw
-          if( resize ) {
+          // Bursts of resize events only rebuild the swap chain once, for the final size
+          if( resize && (std::chrono::high_resolution_clock::now() - resize_time >= project.GetResizeDebounce()) ) {
             resize = false;
             if( !project.OnWindowSizeChanged() ) {
               result = false;
@@ -325,6 +331,7 @@ namespace EngineBase {
       XEvent event;
       bool loop = true;
       bool resize = false;
+      std::chrono::high_resolution_clock::time_point resize_time;
       bool result = true;
 
       while( loop ) {
@@ -341,6 +348,7 @@ namespace EngineBase {
                 width = event.xconfigure.width;
                 height = event.xconfigure.height;
                 resize = true;
+                resize_time = std::chrono::high_resolution_clock::now();
               }
             }
             break;
@@ -358,7 +366,8 @@ namespace EngineBase {
           }
         } else {
           // Draw
-          if( resize ) {
+          // Bursts of resize events only rebuild the swap chain once, for the final size
+          if( resize && (std::chrono::high_resolution_clock::now() - resize_time >= project.GetResizeDebounce()) ) {
             resize = false;
             if( !project.OnWindowSizeChanged() ) {
               result = false;
@@ -35,6 +35,7 @@
 
 #include <cstring>
 #include <iostream>
+#include <chrono>
 
 namespace EngineBase {
 
@@ -68,8 +69,14 @@ namespace EngineBase {
         return CanRender;
       }
 
+      // Time without further resize events before the window size counts as settled
+      virtual std::chrono::milliseconds GetResizeDebounce() const final {
+        return ResizeDebounce;
+      }
+
       ProjectBase() :
-        CanRender( false ) {
+        CanRender( false ),
+        ResizeDebounce( 100 ) {
       }
 
       virtual ~ProjectBase() {
@@ -77,6 +84,7 @@ namespace EngineBase {
 
     protected:
       bool CanRender;
+      std::chrono::milliseconds ResizeDebounce;
     };
 
     // ************************************************************ //
@@ -21,6 +21,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "VulkanInitializers.hpp"
+#include "VulkanHostAllocator.h"
 
 namespace EngineBase {
 
@@ -465,7 +466,7 @@ namespace EngineBase {
 		moduleCreateInfo.pCode = (uint32_t*)shaderCode;
 		moduleCreateInfo.flags = 0;
 
-		VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
+		VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Pipeline), &shaderModule));
 
 		delete[] shaderCode;
 
@@ -492,7 +493,7 @@ namespace EngineBase {
 			moduleCreateInfo.codeSize = size;
 			moduleCreateInfo.pCode = (uint32_t*)shaderCode;
 
-			VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
+			VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Pipeline), &shaderModule));
 
 			delete[] shaderCode;
 
@@ -0,0 +1,286 @@
+/*
+* Pipeline barrier batcher
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanBarrierBatcher.h"
+#include "VulkanDevice.h"
+#include <atomic>
+
+namespace vks
+{
+	namespace
+	{
+		constexpr VkAccessFlags2 writeAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+		constexpr ImageLayoutAccess allAccess = { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT };
+		constexpr ImageLayoutAccess depthStencilAttachmentAccess = {
+			VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+		};
+		constexpr ImageLayoutAccess depthStencilReadOnlyAccess = {
+			VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+		};
+
+		// Indexed by the core layouts, which are numbered from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_PREINITIALIZED
+		constexpr ImageLayoutAccess coreLayoutAccess[] = {
+			// Undefined, there is nothing to wait for
+			{ VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE },
+			// General
+			allAccess,
+			// Color attachment
+			{ VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT },
+			depthStencilAttachmentAccess,
+			depthStencilReadOnlyAccess,
+			// Shader read only
+			{
+				VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT
+			},
+			// Transfer source and destination
+			{ VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT },
+			{ VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT },
+			// Preinitialized, written by the host
+			{ VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_WRITE_BIT },
+		};
+		static_assert(sizeof(coreLayoutAccess) / sizeof(coreLayoutAccess[0]) == VK_IMAGE_LAYOUT_PREINITIALIZED + 1, "One entry per core layout");
+
+		// Field order of BarrierStatistics
+		constexpr size_t statisticsFieldCount = sizeof(BarrierStatistics) / sizeof(uint64_t);
+		std::atomic<uint64_t> frameStatistics[statisticsFieldCount];
+		std::atomic<uint64_t> lastFrameStatistics[statisticsFieldCount];
+
+		void count(const BarrierStatistics& statistics)
+		{
+			const uint64_t* values = reinterpret_cast<const uint64_t*>(&statistics);
+			for (size_t i = 0; i < statisticsFieldCount; i++) {
+				if (values[i]) {
+					frameStatistics[i].fetch_add(values[i], std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// Stages that only exist in synchronization2 are widened to the legacy stages containing them
+		VkPipelineStageFlags legacyStages(VkPipelineStageFlags2 stages, VkPipelineStageFlags none)
+		{
+			VkPipelineStageFlags legacy = static_cast<VkPipelineStageFlags>(stages & 0xFFFFFFFFull);
+			if (stages & (VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT)) {
+				legacy |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+			}
+			if (stages & (VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT)) {
+				legacy |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+			}
+			if (stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT) {
+				// Tessellation and geometry stages may not be enabled
+				legacy |= VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT;
+			}
+			return legacy ? legacy : none;
+		}
+
+		VkAccessFlags legacyAccess(VkAccessFlags2 access)
+		{
+			VkAccessFlags legacy = static_cast<VkAccessFlags>(access & 0xFFFFFFFFull);
+			if (access & (VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT)) {
+				legacy |= VK_ACCESS_SHADER_READ_BIT;
+			}
+			if (access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) {
+				legacy |= VK_ACCESS_SHADER_WRITE_BIT;
+			}
+			return legacy;
+		}
+	}
+
+	ImageLayoutAccess getImageLayoutAccess(VkImageLayout layout)
+	{
+		if (layout <= VK_IMAGE_LAYOUT_PREINITIALIZED) {
+			return coreLayoutAccess[layout];
+		}
+		switch (layout) {
+		case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_STENCIL_ATTACHMENT_OPTIMAL:
+		case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL:
+		case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL:
+		case VK_IMAGE_LAYOUT_STENCIL_ATTACHMENT_OPTIMAL:
+			return depthStencilAttachmentAccess;
+		case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL:
+		case VK_IMAGE_LAYOUT_STENCIL_READ_ONLY_OPTIMAL:
+			return depthStencilReadOnlyAccess;
+		case VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL:
+			return {
+				depthStencilReadOnlyAccess.stages | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+				depthStencilReadOnlyAccess.access | VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT
+			};
+		case VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL:
+			return {
+				VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | depthStencilAttachmentAccess.stages,
+				VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | depthStencilAttachmentAccess.access
+			};
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+		case VK_IMAGE_LAYOUT_SHARED_PRESENT_KHR:
+			// Presentation is ordered by semaphores, the stage only has to chain with whatever stage the acquire semaphore is waited on
+			return { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE };
+		default:
+			return allAccess;
+		}
+	}
+
+	BarrierBatcher::BarrierBatcher(VulkanDevice* device) : device(device)
+	{
+	}
+
+	void BarrierBatcher::imageBarrier(VkImage image, const VkImageSubresourceRange& subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout)
+	{
+		const ImageLayoutAccess src = getImageLayoutAccess(oldLayout);
+		const ImageLayoutAccess dst = getImageLayoutAccess(newLayout);
+		// Only writes have to be made available, reads in the old layout just have to finish before the transition
+		imageBarrier(image, subresourceRange, oldLayout, newLayout, src.stages, src.access & writeAccessMask, dst.stages, dst.access);
+	}
+
+	void BarrierBatcher::imageBarrier(VkImage image, const VkImageSubresourceRange& subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess)
+	{
+		VkImageMemoryBarrier2 barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier.srcStageMask = srcStages;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstStageMask = dstStages;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = subresourceRange;
+		imageBarriers.push_back(barrier);
+	}
+
+	void BarrierBatcher::bufferBarrier(VkBuffer buffer, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess, VkDeviceSize offset, VkDeviceSize size)
+	{
+		VkBufferMemoryBarrier2 barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+		barrier.srcStageMask = srcStages;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstStageMask = dstStages;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = buffer;
+		barrier.offset = offset;
+		barrier.size = size;
+		bufferBarriers.push_back(barrier);
+	}
+
+	void BarrierBatcher::memoryBarrier(VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess)
+	{
+		VkMemoryBarrier2 barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+		barrier.srcStageMask = srcStages;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstStageMask = dstStages;
+		barrier.dstAccessMask = dstAccess;
+		memoryBarriers.push_back(barrier);
+	}
+
+	void BarrierBatcher::flush(VkCommandBuffer commandBuffer)
+	{
+		if (empty()) {
+			return;
+		}
+		BarrierStatistics statistics;
+		statistics.imageBarriers = imageBarriers.size();
+		statistics.bufferBarriers = bufferBarriers.size();
+		statistics.memoryBarriers = memoryBarriers.size();
+		statistics.pipelineBarriers = 1;
+		count(statistics);
+
+		if (device->synchronization2Supported) {
+			VkDependencyInfo dependencyInfo{};
+			dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+			dependencyInfo.memoryBarrierCount = static_cast<uint32_t>(memoryBarriers.size());
+			dependencyInfo.pMemoryBarriers = memoryBarriers.data();
+			dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+			dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+			dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+			dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+			device->fpCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+		} else {
+			flushLegacy(commandBuffer);
+		}
+		imageBarriers.clear();
+		bufferBarriers.clear();
+		memoryBarriers.clear();
+	}
+
+	void BarrierBatcher::flushLegacy(VkCommandBuffer commandBuffer)
+	{
+		// A legacy barrier has one pair of stage masks, every barrier waits for the stages of all others
+		VkPipelineStageFlags2 srcStages = 0;
+		VkPipelineStageFlags2 dstStages = 0;
+		std::vector<VkMemoryBarrier> legacyMemoryBarriers;
+		legacyMemoryBarriers.reserve(memoryBarriers.size());
+		for (const VkMemoryBarrier2& barrier : memoryBarriers) {
+			VkMemoryBarrier legacy{};
+			legacy.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			legacy.srcAccessMask = legacyAccess(barrier.srcAccessMask);
+			legacy.dstAccessMask = legacyAccess(barrier.dstAccessMask);
+			legacyMemoryBarriers.push_back(legacy);
+			srcStages |= barrier.srcStageMask;
+			dstStages |= barrier.dstStageMask;
+		}
+		std::vector<VkBufferMemoryBarrier> legacyBufferBarriers;
+		legacyBufferBarriers.reserve(bufferBarriers.size());
+		for (const VkBufferMemoryBarrier2& barrier : bufferBarriers) {
+			VkBufferMemoryBarrier legacy{};
+			legacy.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			legacy.srcAccessMask = legacyAccess(barrier.srcAccessMask);
+			legacy.dstAccessMask = legacyAccess(barrier.dstAccessMask);
+			legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+			legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+			legacy.buffer = barrier.buffer;
+			legacy.offset = barrier.offset;
+			legacy.size = barrier.size;
+			legacyBufferBarriers.push_back(legacy);
+			srcStages |= barrier.srcStageMask;
+			dstStages |= barrier.dstStageMask;
+		}
+		std::vector<VkImageMemoryBarrier> legacyImageBarriers;
+		legacyImageBarriers.reserve(imageBarriers.size());
+		for (const VkImageMemoryBarrier2& barrier : imageBarriers) {
+			VkImageMemoryBarrier legacy{};
+			legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			legacy.srcAccessMask = legacyAccess(barrier.srcAccessMask);
+			legacy.dstAccessMask = legacyAccess(barrier.dstAccessMask);
+			legacy.oldLayout = barrier.oldLayout;
+			legacy.newLayout = barrier.newLayout;
+			legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+			legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+			legacy.image = barrier.image;
+			legacy.subresourceRange = barrier.subresourceRange;
+			legacyImageBarriers.push_back(legacy);
+			srcStages |= barrier.srcStageMask;
+			dstStages |= barrier.dstStageMask;
+		}
+		vkCmdPipelineBarrier(commandBuffer, legacyStages(srcStages, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), legacyStages(dstStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT), 0,
+			static_cast<uint32_t>(legacyMemoryBarriers.size()), legacyMemoryBarriers.data(),
+			static_cast<uint32_t>(legacyBufferBarriers.size()), legacyBufferBarriers.data(),
+			static_cast<uint32_t>(legacyImageBarriers.size()), legacyImageBarriers.data());
+	}
+
+	void BarrierBatcher::nextFrame()
+	{
+		for (size_t i = 0; i < statisticsFieldCount; i++) {
+			lastFrameStatistics[i].store(frameStatistics[i].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+
+	BarrierStatistics BarrierBatcher::getFrameStatistics()
+	{
+		BarrierStatistics statistics;
+		uint64_t* values = reinterpret_cast<uint64_t*>(&statistics);
+		for (size_t i = 0; i < statisticsFieldCount; i++) {
+			values[i] = lastFrameStatistics[i].load(std::memory_order_relaxed);
+		}
+		return statistics;
+	}
+}
@@ -0,0 +1,78 @@
+/*
+* Pipeline barrier batcher
+*
+* Collects image, buffer and memory barriers and records them with a single pipeline barrier command. Stage and access
+* masks of layout transitions come from a table of the work that uses an image in each layout instead of waiting on
+* all commands. With synchronization2 every barrier keeps its own masks, otherwise the batch is recorded as one legacy
+* barrier with the combined stages. Barrier and command counts are kept per frame.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <cstdint>
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	struct BarrierStatistics
+	{
+		uint64_t imageBarriers = 0;
+		uint64_t bufferBarriers = 0;
+		uint64_t memoryBarriers = 0;
+		/** @brief Pipeline barrier commands the barriers were recorded with */
+		uint64_t pipelineBarriers = 0;
+	};
+
+	/** @brief Stages and accesses of the work that uses an image in a given layout */
+	struct ImageLayoutAccess
+	{
+		VkPipelineStageFlags2 stages;
+		VkAccessFlags2 access;
+	};
+
+	/** @brief Looks up the precomputed stages and accesses of a layout, unknown layouts map to all commands and memory accesses */
+	ImageLayoutAccess getImageLayoutAccess(VkImageLayout layout);
+
+	class BarrierBatcher
+	{
+	public:
+		explicit BarrierBatcher(VulkanDevice* device);
+		BarrierBatcher(const BarrierBatcher&) = delete;
+		BarrierBatcher& operator=(const BarrierBatcher&) = delete;
+
+		/**
+		* Layout transition with the stage and access masks of both layouts taken from the layout table
+		* @note The table includes graphics stages, use the overload with explicit masks on compute and transfer queues
+		*/
+		void imageBarrier(VkImage image, const VkImageSubresourceRange& subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout);
+		void imageBarrier(VkImage image, const VkImageSubresourceRange& subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess);
+		/**
+		* Buffer barrier
+		* @param (Optional) size Defaults to the rest of the buffer
+		*/
+		void bufferBarrier(VkBuffer buffer, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		void memoryBarrier(VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess);
+
+		bool empty() const { return imageBarriers.empty() && bufferBarriers.empty() && memoryBarriers.empty(); }
+		/** @brief Record the collected barriers with one pipeline barrier command and start a new batch, does nothing if the batch is empty */
+		void flush(VkCommandBuffer commandBuffer);
+
+		/** @brief Close the current frame's counts, call once per frame */
+		static void nextFrame();
+		/** @brief Counts of the last frame closed by nextFrame() */
+		static BarrierStatistics getFrameStatistics();
+
+	private:
+		VulkanDevice* device;
+		std::vector<VkImageMemoryBarrier2> imageBarriers;
+		std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+		std::vector<VkMemoryBarrier2> memoryBarriers;
+
+		void flushLegacy(VkCommandBuffer commandBuffer);
+	};
+}
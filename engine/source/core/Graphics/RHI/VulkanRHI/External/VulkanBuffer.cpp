@@ -1,5 +1,9 @@
 #include "VulkanBuffer.h"
+#include "Tools.h"
+#include "VulkanHostAllocator.h"
+#include "VulkanInitializers.hpp"
 #include <cassert>
+#include <cstring>
 
 namespace vks
 {
@@ -13,7 +17,17 @@ namespace vks
 	*/
 	VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset)
 	{
-		return vkMapMemory(device, memory, offset, size, 0, &mapped);
+		// Host visible blocks of the allocator are persistently mapped
+		if (allocation.mapped)
+		{
+			mapped = static_cast<uint8_t*>(allocation.mapped) + offset;
+			return VK_SUCCESS;
+		}
+		if (size == VK_WHOLE_SIZE && allocation.valid())
+		{
+			size = allocation.size - offset;
+		}
+		return vkMapMemory(device, memory, allocation.offset + offset, size, 0, &mapped);
 	}
 
 	/**
@@ -25,7 +39,10 @@ namespace vks
 	{
 		if (mapped)
 		{
-			vkUnmapMemory(device, memory);
+			if (!allocation.mapped)
+			{
+				vkUnmapMemory(device, memory);
+			}
 			mapped = nullptr;
 		}
 	}
@@ -39,7 +56,7 @@ namespace vks
 	*/
 	VkResult Buffer::bind(VkDeviceSize offset)
 	{
-		return vkBindBufferMemory(device, buffer, memory, offset);
+		return vkBindBufferMemory(device, buffer, memory, allocation.offset + offset);
 	}
 
 	/**
@@ -84,8 +101,8 @@ namespace vks
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
+		mappedRange.offset = allocation.offset + offset;
+		mappedRange.size = (size == VK_WHOLE_SIZE && allocation.valid()) ? allocation.size - offset : size;
 		return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
 	}
 
@@ -104,8 +121,8 @@ namespace vks
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
+		mappedRange.offset = allocation.offset + offset;
+		mappedRange.size = (size == VK_WHOLE_SIZE && allocation.valid()) ? allocation.size - offset : size;
 		return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
 	}
 
@@ -116,11 +133,99 @@ namespace vks
 	{
 		if (buffer)
 		{
-			vkDestroyBuffer(device, buffer, nullptr);
+			vkDestroyBuffer(device, buffer, allocationCallbacks(HostAllocationScope::Resource));
+		}
+		if (allocation.valid())
+		{
+			allocation.free();
+		}
+		else if (memory)
+		{
+			vkFreeMemory(device, memory, allocationCallbacks(HostAllocationScope::Device));
+		}
+		buffer = VK_NULL_HANDLE;
+		memory = VK_NULL_HANDLE;
+		mapped = nullptr;
+	}
+
+	/**
+	* Release the buffer once the GPU has finished the frames that may still use it
+	*
+	* @param deletionQueue Queue the buffer and its memory are handed to
+	*/
+	void Buffer::destroy(DeletionQueue& deletionQueue)
+	{
+		RetiredResources retired;
+		if (buffer)
+		{
+			retired.buffers.push_back(buffer);
 		}
-		if (memory)
+		if (allocation.valid())
 		{
-			vkFreeMemory(device, memory, nullptr);
+			retired.allocations.push_back(allocation);
+			allocation = Allocation{};
 		}
+		else if (memory)
+		{
+			retired.memory.push_back(memory);
+		}
+		deletionQueue.retire(std::move(retired));
+		buffer = VK_NULL_HANDLE;
+		memory = VK_NULL_HANDLE;
+		mapped = nullptr;
+	}
+
+	/**
+	* Check if the buffer lives in a block the defragmenter is emptying
+	*
+	* @note Device local buffers can only be moved if they have been created with transfer source and destination usage
+	*/
+	bool Buffer::needsRelocation() const
+	{
+		if (!allocation.allocator || !allocation.allocator->isCompacting(allocation))
+		{
+			return false;
+		}
+		const VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		return allocation.mapped || ((usageFlags & transferUsage) == transferUsage);
+	}
+
+	/**
+	* Move the buffer to new memory, host visible buffers are copied on the host, all others on the GPU
+	*
+	* @param commandBuffer Command buffer the copy is recorded to
+	* @param retired Receives the old buffer handle and allocation
+	*/
+	void Buffer::relocate(VkCommandBuffer commandBuffer, RetiredResources& retired)
+	{
+		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
+		VkBuffer newBuffer;
+		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &newBuffer));
+		vks::Allocation newAllocation;
+		VkMemoryAllocateFlags allocateFlags = (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+		VK_CHECK_RESULT(allocation.allocator->allocateBufferMemory(newBuffer, memoryPropertyFlags, &newAllocation, allocation.category, allocateFlags));
+
+		if (allocation.mapped && newAllocation.mapped)
+		{
+			memcpy(newAllocation.mapped, allocation.mapped, size);
+		}
+		else
+		{
+			VkBufferCopy copyRegion = { 0, 0, size };
+			vkCmdCopyBuffer(commandBuffer, buffer, newBuffer, 1, &copyRegion);
+		}
+
+		const VkDeviceSize mappedOffset = (mapped && allocation.mapped) ? static_cast<uint8_t*>(mapped) - static_cast<uint8_t*>(allocation.mapped) : 0;
+		retired.buffers.push_back(buffer);
+		retired.allocations.push_back(allocation);
+		buffer = newBuffer;
+		allocation = newAllocation;
+		memory = allocation.memory;
+		if (mapped)
+		{
+			mapped = static_cast<uint8_t*>(allocation.mapped) + mappedOffset;
+		}
+		descriptor.buffer = buffer;
+		descriptorVersion++;
 	}
 }
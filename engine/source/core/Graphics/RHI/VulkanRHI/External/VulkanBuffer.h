@@ -1,5 +1,7 @@
 #pragma once
 #include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanDefragmenter.h"
 
 namespace vks
 {
@@ -7,11 +9,13 @@ namespace vks
 	* @brief Encapsulates access to a Vulkan buffer backed up by device memory
 	* @note To be filled by an external source like the VulkanDevice
 	*/
-	struct Buffer
+	struct Buffer : public Relocatable
 	{
 		VkDevice device;
 		VkBuffer buffer = VK_NULL_HANDLE;
 		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Range of the (shared) device memory block backing this buffer */
+		vks::Allocation allocation;
 		VkDescriptorBufferInfo descriptor;
 		VkDeviceSize size = 0;
 		VkDeviceSize alignment = 0;
@@ -20,6 +24,11 @@ namespace vks
 		VkBufferUsageFlags usageFlags;
 		/** @brief Memory property flags to be filled by external source at buffer creation (to query at some later point) */
 		VkMemoryPropertyFlags memoryPropertyFlags;
+		/**
+		* Incremented when the defragmenter moves the buffer, descriptor sets written with the old descriptor have to be replaced by newly written ones
+		* @note Sets bound by frames in flight must not be updated, retire them to a deletion queue together with the old buffer
+		*/
+		uint32_t descriptorVersion = 0;
 		VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 		void unmap();
 		VkResult bind(VkDeviceSize offset = 0);
@@ -28,5 +37,11 @@ namespace vks
 		VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 		VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 		void destroy();
+		/** @brief Hand the buffer and its memory to a deletion queue, for buffers that frames still in flight may read */
+		void destroy(DeletionQueue& deletionQueue);
+
+		bool needsRelocation() const override;
+		VkDeviceSize getRelocationSize() const override { return size; }
+		void relocate(VkCommandBuffer commandBuffer, RetiredResources& retired) override;
 	};
 }
\ No newline at end of file
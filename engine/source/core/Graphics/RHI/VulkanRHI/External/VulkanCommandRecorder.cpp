@@ -0,0 +1,343 @@
+/*
+* State tracking command recorder
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanCommandRecorder.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace vks
+{
+	namespace
+	{
+		// Field order of CommandRecorderStatistics
+		constexpr size_t statisticsFieldCount = sizeof(CommandRecorderStatistics) / sizeof(uint64_t);
+		std::atomic<uint64_t> totalStatistics[statisticsFieldCount];
+	}
+
+	CommandRecorder::CommandRecorder(VkCommandBuffer commandBuffer) : commandBuffer(commandBuffer)
+	{
+		invalidate();
+	}
+
+	CommandRecorder::~CommandRecorder()
+	{
+		addToTotals();
+	}
+
+	void CommandRecorder::reset(VkCommandBuffer commandBuffer)
+	{
+		addToTotals();
+		this->commandBuffer = commandBuffer;
+		invalidate();
+	}
+
+	void CommandRecorder::invalidate()
+	{
+		for (BindPointState& bindPointState : bindPoints) {
+			bindPointState.pipeline = VK_NULL_HANDLE;
+			bindPointState.sets.clear();
+		}
+		vertexBindings.clear();
+		indexBuffer = VK_NULL_HANDLE;
+		validDynamicState = 0;
+		pushConstantLayout = VK_NULL_HANDLE;
+		pushConstantStages.fill(0);
+	}
+
+	void CommandRecorder::bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline, bool keepsDynamicState)
+	{
+		BindPointState* bindPointState = getBindPoint(bindPoint);
+		if (bindPointState && bindPointState->pipeline == pipeline) {
+			elided(statistics.elidedPipelines);
+			return;
+		}
+		vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
+		recorded();
+		if (bindPointState) {
+			bindPointState->pipeline = pipeline;
+		}
+		// State the pipeline doesn't declare as dynamic is overwritten by its static values
+		if (bindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS && !keepsDynamicState) {
+			validDynamicState = 0;
+		}
+	}
+
+	void CommandRecorder::bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount, const VkDescriptorSet* sets, uint32_t dynamicOffsetCount, const uint32_t* dynamicOffsets)
+	{
+		BindPointState* bindPointState = getBindPoint(bindPoint);
+		if (!bindPointState) {
+			vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, firstSet, setCount, sets, dynamicOffsetCount, dynamicOffsets);
+			recorded();
+			return;
+		}
+		std::vector<BoundSet>& boundSets = bindPointState->sets;
+		auto matches = [&](uint32_t index, const uint32_t* offsets, uint32_t offsetCount) {
+			const uint32_t slot = firstSet + index;
+			if (slot >= boundSets.size()) {
+				return false;
+			}
+			const BoundSet& bound = boundSets[slot];
+			return bound.layout == layout && bound.set == sets[index] && bound.dynamicOffsets.size() == offsetCount
+				&& std::equal(bound.dynamicOffsets.begin(), bound.dynamicOffsets.end(), offsets);
+		};
+
+		// How dynamic offsets are split between several sets depends on their layouts, so those calls are only elided as a whole
+		const bool splitOffsets = dynamicOffsetCount > 0 && setCount > 1;
+		uint32_t first = 0;
+		uint32_t last = setCount;
+		if (setCount == 1) {
+			if (matches(0, dynamicOffsets, dynamicOffsetCount)) {
+				elided(statistics.elidedDescriptorSets);
+				return;
+			}
+		} else if (!splitOffsets) {
+			// Sets at either end that are bound already are trimmed from the call
+			while (first < last && matches(first, nullptr, 0)) {
+				first++;
+			}
+			while (last > first && matches(last - 1, nullptr, 0)) {
+				last--;
+			}
+			if (first == last) {
+				elided(statistics.elidedDescriptorSets);
+				return;
+			}
+		}
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, firstSet + first, last - first, sets + first, dynamicOffsetCount, dynamicOffsets);
+		recorded();
+
+		// Sets bound with another layout may have been disturbed, without knowing whether the layouts are compatible they are forgotten
+		for (BoundSet& bound : boundSets) {
+			if (bound.layout != layout) {
+				bound = BoundSet();
+			}
+		}
+		if (boundSets.size() < firstSet + setCount) {
+			boundSets.resize(firstSet + setCount);
+		}
+		for (uint32_t i = first; i < last; i++) {
+			BoundSet& bound = boundSets[firstSet + i];
+			if (splitOffsets) {
+				bound = BoundSet();
+				continue;
+			}
+			bound.layout = layout;
+			bound.set = sets[i];
+			bound.dynamicOffsets.assign(dynamicOffsets, dynamicOffsets + dynamicOffsetCount);
+		}
+	}
+
+	void CommandRecorder::bindVertexBuffers(uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* buffers, const VkDeviceSize* offsets)
+	{
+		uint32_t first = 0;
+		uint32_t last = bindingCount;
+		auto matches = [&](uint32_t index) {
+			const uint32_t binding = firstBinding + index;
+			return binding < vertexBindings.size() && vertexBindings[binding].buffer == buffers[index] && vertexBindings[binding].offset == offsets[index];
+		};
+		while (first < last && matches(first)) {
+			first++;
+		}
+		while (last > first && matches(last - 1)) {
+			last--;
+		}
+		if (first == last) {
+			elided(statistics.elidedVertexBuffers);
+			return;
+		}
+		vkCmdBindVertexBuffers(commandBuffer, firstBinding + first, last - first, buffers + first, offsets + first);
+		recorded();
+		if (vertexBindings.size() < firstBinding + bindingCount) {
+			vertexBindings.resize(firstBinding + bindingCount);
+		}
+		for (uint32_t i = first; i < last; i++) {
+			vertexBindings[firstBinding + i] = { buffers[i], offsets[i] };
+		}
+	}
+
+	void CommandRecorder::bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType)
+	{
+		if (indexBuffer == buffer && indexOffset == offset && this->indexType == indexType) {
+			elided(statistics.elidedIndexBuffers);
+			return;
+		}
+		vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+		recorded();
+		indexBuffer = buffer;
+		indexOffset = offset;
+		this->indexType = indexType;
+	}
+
+	void CommandRecorder::setViewport(const VkViewport& viewport)
+	{
+		if ((validDynamicState & Viewport) && memcmp(&this->viewport, &viewport, sizeof(VkViewport)) == 0) {
+			elided(statistics.elidedDynamicState);
+			return;
+		}
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		recorded();
+		this->viewport = viewport;
+		validDynamicState |= Viewport;
+	}
+
+	void CommandRecorder::setScissor(const VkRect2D& scissor)
+	{
+		if ((validDynamicState & Scissor) && memcmp(&this->scissor, &scissor, sizeof(VkRect2D)) == 0) {
+			elided(statistics.elidedDynamicState);
+			return;
+		}
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		recorded();
+		this->scissor = scissor;
+		validDynamicState |= Scissor;
+	}
+
+	void CommandRecorder::setLineWidth(float lineWidth)
+	{
+		if ((validDynamicState & LineWidth) && this->lineWidth == lineWidth) {
+			elided(statistics.elidedDynamicState);
+			return;
+		}
+		vkCmdSetLineWidth(commandBuffer, lineWidth);
+		recorded();
+		this->lineWidth = lineWidth;
+		validDynamicState |= LineWidth;
+	}
+
+	void CommandRecorder::setDepthBias(float constantFactor, float clamp, float slopeFactor)
+	{
+		if ((validDynamicState & DepthBias) && depthBias[0] == constantFactor && depthBias[1] == clamp && depthBias[2] == slopeFactor) {
+			elided(statistics.elidedDynamicState);
+			return;
+		}
+		vkCmdSetDepthBias(commandBuffer, constantFactor, clamp, slopeFactor);
+		recorded();
+		depthBias[0] = constantFactor;
+		depthBias[1] = clamp;
+		depthBias[2] = slopeFactor;
+		validDynamicState |= DepthBias;
+	}
+
+	void CommandRecorder::setBlendConstants(const float blendConstants[4])
+	{
+		if ((validDynamicState & BlendConstants) && std::equal(blendConstants, blendConstants + 4, this->blendConstants)) {
+			elided(statistics.elidedDynamicState);
+			return;
+		}
+		vkCmdSetBlendConstants(commandBuffer, blendConstants);
+		recorded();
+		std::copy(blendConstants, blendConstants + 4, this->blendConstants);
+		validDynamicState |= BlendConstants;
+	}
+
+	void CommandRecorder::setStencilReference(VkStencilFaceFlags faceMask, uint32_t reference)
+	{
+		const bool front = (faceMask & VK_STENCIL_FACE_FRONT_BIT) != 0;
+		const bool back = (faceMask & VK_STENCIL_FACE_BACK_BIT) != 0;
+		const bool frontSet = !front || ((validDynamicState & StencilFrontReference) && stencilReference[0] == reference);
+		const bool backSet = !back || ((validDynamicState & StencilBackReference) && stencilReference[1] == reference);
+		if (frontSet && backSet) {
+			elided(statistics.elidedDynamicState);
+			return;
+		}
+		vkCmdSetStencilReference(commandBuffer, faceMask, reference);
+		recorded();
+		if (front) {
+			stencilReference[0] = reference;
+			validDynamicState |= StencilFrontReference;
+		}
+		if (back) {
+			stencilReference[1] = reference;
+			validDynamicState |= StencilBackReference;
+		}
+	}
+
+	void CommandRecorder::pushConstants(VkPipelineLayout layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* values)
+	{
+		const bool tracked = offset + size <= maxPushConstantSize;
+		if (tracked && layout == pushConstantLayout) {
+			const bool sameStages = std::all_of(pushConstantStages.begin() + offset, pushConstantStages.begin() + offset + size, [stageFlags](VkShaderStageFlags stages) { return stages == stageFlags; });
+			if (sameStages && memcmp(pushConstantData.data() + offset, values, size) == 0) {
+				elided(statistics.elidedPushConstants);
+				return;
+			}
+		}
+		vkCmdPushConstants(commandBuffer, layout, stageFlags, offset, size, values);
+		recorded();
+		if (layout != pushConstantLayout) {
+			pushConstantLayout = layout;
+			pushConstantStages.fill(0);
+		}
+		if (tracked) {
+			std::fill(pushConstantStages.begin() + offset, pushConstantStages.begin() + offset + size, stageFlags);
+			memcpy(pushConstantData.data() + offset, values, size);
+		} else {
+			pushConstantStages.fill(0);
+		}
+	}
+
+	void CommandRecorder::draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+	{
+		vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+		recorded();
+	}
+
+	void CommandRecorder::drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+	{
+		vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+		recorded();
+	}
+
+	void CommandRecorder::executeCommands(uint32_t commandBufferCount, const VkCommandBuffer* commandBuffers)
+	{
+		vkCmdExecuteCommands(commandBuffer, commandBufferCount, commandBuffers);
+		recorded();
+		invalidate();
+	}
+
+	CommandRecorderStatistics CommandRecorder::getTotalStatistics()
+	{
+		uint64_t values[statisticsFieldCount];
+		for (size_t i = 0; i < statisticsFieldCount; i++) {
+			values[i] = totalStatistics[i].load();
+		}
+		CommandRecorderStatistics statistics;
+		memcpy(&statistics, values, sizeof(statistics));
+		return statistics;
+	}
+
+	void CommandRecorder::resetTotalStatistics()
+	{
+		for (std::atomic<uint64_t>& value : totalStatistics) {
+			value.store(0);
+		}
+	}
+
+	CommandRecorder::BindPointState* CommandRecorder::getBindPoint(VkPipelineBindPoint bindPoint)
+	{
+		switch (bindPoint) {
+		case VK_PIPELINE_BIND_POINT_GRAPHICS:
+			return &bindPoints[0];
+		case VK_PIPELINE_BIND_POINT_COMPUTE:
+			return &bindPoints[1];
+		default:
+			return nullptr;
+		}
+	}
+
+	void CommandRecorder::addToTotals()
+	{
+		uint64_t values[statisticsFieldCount];
+		memcpy(values, &statistics, sizeof(statistics));
+		for (size_t i = 0; i < statisticsFieldCount; i++) {
+			if (values[i] > 0) {
+				totalStatistics[i].fetch_add(values[i]);
+			}
+		}
+		statistics = CommandRecorderStatistics();
+	}
+}
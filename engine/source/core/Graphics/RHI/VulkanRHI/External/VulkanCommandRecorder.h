@@ -0,0 +1,144 @@
+/*
+* State tracking command recorder
+*
+* Thin wrapper around a command buffer that shadows the bound pipelines, descriptor sets, vertex and index buffers,
+* dynamic state and push constants, and drops commands that would set what is already set. Elided commands are
+* counted per recorder and process wide, so the savings can be measured on real content.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace vks
+{
+	struct CommandRecorderStatistics
+	{
+		/** @brief Commands passed on to the command buffer */
+		uint64_t recorded = 0;
+		/** @brief Commands dropped because they would not have changed any state */
+		uint64_t elided = 0;
+		uint64_t elidedPipelines = 0;
+		uint64_t elidedDescriptorSets = 0;
+		uint64_t elidedVertexBuffers = 0;
+		uint64_t elidedIndexBuffers = 0;
+		uint64_t elidedDynamicState = 0;
+		uint64_t elidedPushConstants = 0;
+	};
+
+	class CommandRecorder
+	{
+	public:
+		explicit CommandRecorder(VkCommandBuffer commandBuffer = VK_NULL_HANDLE);
+		/** @brief Adds the recorder's statistics to the process wide totals */
+		~CommandRecorder();
+		CommandRecorder(const CommandRecorder&) = delete;
+		CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+		/** @brief Start recording to another command buffer, nothing is assumed to be bound in it */
+		void reset(VkCommandBuffer commandBuffer);
+		/**
+		* Forget all shadowed state
+		* @note Call after recording to the command buffer directly or after vkCmdExecuteCommands, both leave the bound state unknown
+		*/
+		void invalidate();
+		VkCommandBuffer getCommandBuffer() const { return commandBuffer; }
+
+		/**
+		* Bind a pipeline
+		* @param (Optional) keepsDynamicState True if the pipeline declares every state set through the recorder as dynamic, otherwise binding it discards the shadowed dynamic state
+		*/
+		void bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline, bool keepsDynamicState = false);
+		/** @brief Bind descriptor sets, sets already bound with the same layout and dynamic offsets are skipped */
+		void bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount, const VkDescriptorSet* sets, uint32_t dynamicOffsetCount = 0, const uint32_t* dynamicOffsets = nullptr);
+		void bindVertexBuffers(uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* buffers, const VkDeviceSize* offsets);
+		void bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+		void setViewport(const VkViewport& viewport);
+		void setScissor(const VkRect2D& scissor);
+		void setLineWidth(float lineWidth);
+		void setDepthBias(float constantFactor, float clamp, float slopeFactor);
+		void setBlendConstants(const float blendConstants[4]);
+		void setStencilReference(VkStencilFaceFlags faceMask, uint32_t reference);
+		/** @brief Update push constants, skipped if every byte of the range already holds the value for the same layout and stages */
+		void pushConstants(VkPipelineLayout layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* values);
+
+		/** @brief Draw commands are passed through, they only exist so call sites don't have to mix the recorder and the raw command buffer */
+		void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
+		void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+		/** @brief Execute secondary command buffers, the state they leave behind is unknown so everything shadowed is invalidated */
+		void executeCommands(uint32_t commandBufferCount, const VkCommandBuffer* commandBuffers);
+
+		/** @brief Counts since the recorder was created or last reset */
+		const CommandRecorderStatistics& getStatistics() const { return statistics; }
+		/** @brief Totals of all recorders that have been destroyed or reset so far */
+		static CommandRecorderStatistics getTotalStatistics();
+		static void resetTotalStatistics();
+
+	private:
+		/** @brief Upper bound of the push constant range the recorder shadows, larger ranges are always recorded */
+		static constexpr uint32_t maxPushConstantSize = 256;
+		/** @brief Graphics and compute */
+		static constexpr uint32_t bindPointCount = 2;
+
+		struct BoundSet
+		{
+			VkPipelineLayout layout = VK_NULL_HANDLE;
+			VkDescriptorSet set = VK_NULL_HANDLE;
+			std::vector<uint32_t> dynamicOffsets;
+		};
+		struct BindPointState
+		{
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			std::vector<BoundSet> sets;
+		};
+		struct VertexBinding
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0;
+		};
+		enum DynamicState : uint32_t
+		{
+			Viewport = 0x1,
+			Scissor = 0x2,
+			LineWidth = 0x4,
+			DepthBias = 0x8,
+			BlendConstants = 0x10,
+			StencilFrontReference = 0x20,
+			StencilBackReference = 0x40,
+		};
+
+		VkCommandBuffer commandBuffer;
+		CommandRecorderStatistics statistics;
+
+		std::array<BindPointState, bindPointCount> bindPoints;
+		std::vector<VertexBinding> vertexBindings;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkDeviceSize indexOffset = 0;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+		/** @brief DynamicState bits of the values below that are known */
+		uint32_t validDynamicState = 0;
+		VkViewport viewport{};
+		VkRect2D scissor{};
+		float lineWidth = 0.0f;
+		float depthBias[3] = {};
+		float blendConstants[4] = {};
+		uint32_t stencilReference[2] = {};
+
+		VkPipelineLayout pushConstantLayout = VK_NULL_HANDLE;
+		/** @brief Stages each byte was last pushed for, 0 if unknown */
+		std::array<VkShaderStageFlags, maxPushConstantSize> pushConstantStages;
+		std::array<uint8_t, maxPushConstantSize> pushConstantData;
+
+		/** @brief Shadow state of a bind point, null for bind points that are passed through untracked */
+		BindPointState* getBindPoint(VkPipelineBindPoint bindPoint);
+		void recorded() { statistics.recorded++; }
+		void elided(uint64_t& counter) { statistics.elided++; counter++; }
+		void addToTotals();
+	};
+}
@@ -0,0 +1,117 @@
+/*
+* Incremental device memory defragmenter
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanDefragmenter.h"
+#include "VulkanDevice.h"
+#include "VulkanInitializers.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace vks
+{
+	Defragmenter::Defragmenter(VulkanDevice* device, VkQueue queue) : device(device), queue(queue)
+	{
+		assert(device && device->memoryAllocator);
+	}
+
+	Defragmenter::~Defragmenter()
+	{
+		if (active)
+		{
+			end();
+		}
+	}
+
+	void Defragmenter::registerResource(Relocatable* resource)
+	{
+		resources.push_back(resource);
+	}
+
+	void Defragmenter::unregisterResource(Relocatable* resource)
+	{
+		resources.erase(std::remove(resources.begin(), resources.end(), resource), resources.end());
+	}
+
+	bool Defragmenter::begin(float maxBlockUsage)
+	{
+		if (active)
+		{
+			return true;
+		}
+		if (device->memoryAllocator->beginCompaction(maxBlockUsage) == 0)
+		{
+			device->memoryAllocator->endCompaction();
+			return false;
+		}
+		active = true;
+		statistics.passes++;
+		return true;
+	}
+
+	void Defragmenter::end()
+	{
+		// Blocks that still hold unregistered resources stay in use as regular blocks
+		statistics.blocksFreed += device->memoryAllocator->endCompaction();
+		active = false;
+	}
+
+	bool Defragmenter::step()
+	{
+		if (!active)
+		{
+			return false;
+		}
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		RetiredResources retired;
+		VkDeviceSize bytesMoved = 0;
+		for (Relocatable* resource : resources)
+		{
+			if (bytesMoved >= bytesPerStep)
+			{
+				break;
+			}
+			if (!resource->needsRelocation())
+			{
+				continue;
+			}
+			if (commandBuffer == VK_NULL_HANDLE)
+			{
+				commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			}
+			resource->relocate(commandBuffer, retired);
+			bytesMoved += resource->getRelocationSize();
+			statistics.resourcesMoved++;
+		}
+
+		if (commandBuffer == VK_NULL_HANDLE)
+		{
+			// Everything registered has been moved out of the blocks being compacted
+			end();
+			return false;
+		}
+
+		// Make the copies visible to whatever reads the moved resources next
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		device->flushCommandBuffer(commandBuffer, queue);
+
+		// Frames recorded before the move may still read the old objects
+		if (device->deletionQueue)
+		{
+			device->deletionQueue->retire(std::move(retired));
+		}
+		else
+		{
+			retired.release(device->logicalDevice);
+		}
+		statistics.bytesMoved += bytesMoved;
+		statistics.steps++;
+		return true;
+	}
+}
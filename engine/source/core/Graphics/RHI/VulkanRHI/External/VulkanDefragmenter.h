@@ -0,0 +1,89 @@
+/*
+* Incremental device memory defragmenter
+*
+* Empties sparsely used blocks of the memory allocator over several frames by recreating the resources that live
+* in them in other blocks and copying their contents on the GPU. Descriptor sets referencing the old objects are never
+* updated, as frames in flight may still bind them. Owners of the moved resources write new sets instead and retire the old ones.
+* Emptied blocks are released back to the driver.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanDeletionQueue.h"
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	/** @brief Resource whose memory can be moved by the defragmenter */
+	class Relocatable
+	{
+	public:
+		virtual ~Relocatable() {}
+
+		/** @brief True if any memory of the resource lives in a block that is being compacted */
+		virtual bool needsRelocation() const = 0;
+		/** @brief Number of bytes a relocation copies */
+		virtual VkDeviceSize getRelocationSize() const = 0;
+		/**
+		* Recreate the resource in new memory and record the copy of its contents
+		* @note Descriptor sets written for the old objects are left untouched, the resource flags that they have to be replaced (e.g. with a descriptor version)
+		*
+		* @param commandBuffer Command buffer the copies are recorded to
+		* @param retired Receives the replaced objects, they must not be touched by the resource anymore
+		*/
+		virtual void relocate(VkCommandBuffer commandBuffer, RetiredResources& retired) = 0;
+	};
+
+	struct DefragmentationStatistics
+	{
+		uint32_t passes = 0;
+		uint32_t steps = 0;
+		uint32_t resourcesMoved = 0;
+		VkDeviceSize bytesMoved = 0;
+		uint32_t blocksFreed = 0;
+	};
+
+	class Defragmenter
+	{
+	public:
+		Defragmenter(VulkanDevice* device, VkQueue queue);
+		~Defragmenter();
+
+		void registerResource(Relocatable* resource);
+		void unregisterResource(Relocatable* resource);
+
+		/**
+		* Start a defragmentation pass
+		* @param (Optional) maxBlockUsage Blocks with at most this fraction of their size in use are emptied
+		* @return False if there is nothing to compact
+		*/
+		bool begin(float maxBlockUsage = 0.5f);
+		/**
+		* Move up to bytesPerStep bytes of resources, meant to be called once per frame while a pass is active
+		* @note Has to be called before the frame's command buffers are recorded, frames in flight keep reading the old objects until the deletion queue releases them
+		* @return True if resources have been moved, command buffers referencing them have to be recorded again
+		*/
+		bool step();
+		bool isActive() const { return active; }
+
+		const DefragmentationStatistics& getStatistics() const { return statistics; }
+
+		/** @brief Number of bytes copied per step, bounds the time a step adds to a frame */
+		VkDeviceSize bytesPerStep = 16 * 1024 * 1024;
+
+	private:
+		VulkanDevice* device;
+		VkQueue queue;
+		std::vector<Relocatable*> resources;
+		bool active = false;
+		DefragmentationStatistics statistics;
+
+		void end();
+	};
+}
@@ -0,0 +1,186 @@
+/*
+* Deferred resource destruction
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanDeletionQueue.h"
+#include "VulkanHostAllocator.h"
+#include "Tools.h"
+#include <cassert>
+#include <iterator>
+
+namespace vks
+{
+	void RetiredResources::release(VkDevice device)
+	{
+		for (VkPipeline pipeline : pipelines) {
+			vkDestroyPipeline(device, pipeline, allocationCallbacks(HostAllocationScope::Pipeline));
+		}
+		for (VkDescriptorPool descriptorPool : descriptorPools) {
+			vkDestroyDescriptorPool(device, descriptorPool, allocationCallbacks(HostAllocationScope::Descriptor));
+		}
+		for (VkSampler sampler : samplers) {
+			vkDestroySampler(device, sampler, allocationCallbacks(HostAllocationScope::Descriptor));
+		}
+		for (VkImageView imageView : imageViews) {
+			vkDestroyImageView(device, imageView, allocationCallbacks(HostAllocationScope::Resource));
+		}
+		for (VkImage image : images) {
+			vkDestroyImage(device, image, allocationCallbacks(HostAllocationScope::Resource));
+		}
+		for (VkBuffer buffer : buffers) {
+			vkDestroyBuffer(device, buffer, allocationCallbacks(HostAllocationScope::Resource));
+		}
+		for (Allocation& allocation : allocations) {
+			allocation.free();
+		}
+		for (VkDeviceMemory deviceMemory : memory) {
+			vkFreeMemory(device, deviceMemory, allocationCallbacks(HostAllocationScope::Device));
+		}
+		for (std::function<void()>& callback : callbacks) {
+			callback();
+		}
+		pipelines.clear();
+		descriptorPools.clear();
+		samplers.clear();
+		imageViews.clear();
+		images.clear();
+		buffers.clear();
+		allocations.clear();
+		memory.clear();
+		callbacks.clear();
+	}
+
+	void RetiredResources::append(RetiredResources&& other)
+	{
+		auto move = [](auto& dst, auto& src) {
+			dst.insert(dst.end(), std::make_move_iterator(src.begin()), std::make_move_iterator(src.end()));
+			src.clear();
+		};
+		move(buffers, other.buffers);
+		move(images, other.images);
+		move(imageViews, other.imageViews);
+		move(samplers, other.samplers);
+		move(pipelines, other.pipelines);
+		move(descriptorPools, other.descriptorPools);
+		move(allocations, other.allocations);
+		move(memory, other.memory);
+		move(callbacks, other.callbacks);
+	}
+
+	bool RetiredResources::empty() const
+	{
+		return buffers.empty() && images.empty() && imageViews.empty() && samplers.empty() && pipelines.empty() && descriptorPools.empty() && allocations.empty() && memory.empty() && callbacks.empty();
+	}
+
+	DeletionQueue::DeletionQueue(VkDevice device, uint32_t framesInFlight) : device(device), framesInFlight(framesInFlight)
+	{
+		assert(framesInFlight > 0);
+	}
+
+	DeletionQueue::~DeletionQueue()
+	{
+		flush();
+	}
+
+	void DeletionQueue::retire(RetiredResources&& resources)
+	{
+		if (resources.empty()) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		// Everything retired within one frame goes into the same batch
+		if (frameBatches.empty() || frameBatches.back().frame != frame) {
+			frameBatches.emplace_back();
+			frameBatches.back().frame = frame;
+		}
+		frameBatches.back().resources.append(std::move(resources));
+	}
+
+	void DeletionQueue::retire(RetiredResources&& resources, VkSemaphore timelineSemaphore, uint64_t value)
+	{
+		if (resources.empty()) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		timelineBatches.emplace_back();
+		Batch& batch = timelineBatches.back();
+		batch.timelineSemaphore = timelineSemaphore;
+		batch.value = value;
+		batch.resources = std::move(resources);
+	}
+
+	void DeletionQueue::nextFrame()
+	{
+		std::vector<RetiredResources> completed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			frame++;
+			// The fence of the frame framesInFlight frames back has been waited for, so its batch isn't in use anymore
+			while (!frameBatches.empty() && frameBatches.front().frame + framesInFlight <= frame) {
+				completed.push_back(std::move(frameBatches.front().resources));
+				frameBatches.pop_front();
+			}
+			collectTimelineBatches(completed);
+		}
+		release(completed);
+	}
+
+	void DeletionQueue::collect()
+	{
+		std::vector<RetiredResources> completed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			collectTimelineBatches(completed);
+		}
+		release(completed);
+	}
+
+	void DeletionQueue::flush()
+	{
+		std::vector<RetiredResources> completed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (Batch& batch : frameBatches) {
+				completed.push_back(std::move(batch.resources));
+			}
+			for (Batch& batch : timelineBatches) {
+				completed.push_back(std::move(batch.resources));
+			}
+			frameBatches.clear();
+			timelineBatches.clear();
+		}
+		release(completed);
+	}
+
+	size_t DeletionQueue::getPendingCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return frameBatches.size() + timelineBatches.size();
+	}
+
+	void DeletionQueue::collectTimelineBatches(std::vector<RetiredResources>& completed)
+	{
+		for (size_t i = 0; i < timelineBatches.size();) {
+			Batch& batch = timelineBatches[i];
+			uint64_t value = 0;
+			VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device, batch.timelineSemaphore, &value));
+			if (value >= batch.value) {
+				completed.push_back(std::move(batch.resources));
+				timelineBatches[i] = std::move(timelineBatches.back());
+				timelineBatches.pop_back();
+			} else {
+				i++;
+			}
+		}
+	}
+
+	void DeletionQueue::release(std::vector<RetiredResources>& completed)
+	{
+		// Destroyed outside of the lock, callbacks may retire further objects
+		for (RetiredResources& resources : completed) {
+			resources.release(device);
+		}
+	}
+}
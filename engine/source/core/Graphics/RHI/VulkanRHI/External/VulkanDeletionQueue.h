@@ -0,0 +1,98 @@
+/*
+* Deferred resource destruction
+*
+* Objects that may still be referenced by command buffers in flight are handed to the queue instead of being destroyed,
+* tagged with the current frame or a timeline semaphore value. They are destroyed once the GPU has passed that point,
+* so resources can be released mid-session without waiting for the device to become idle.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+	/** @brief Objects destroyed together once the GPU no longer uses them */
+	struct RetiredResources
+	{
+		std::vector<VkBuffer> buffers;
+		std::vector<VkImage> images;
+		std::vector<VkImageView> imageViews;
+		std::vector<VkSampler> samplers;
+		std::vector<VkPipeline> pipelines;
+		std::vector<VkDescriptorPool> descriptorPools;
+		std::vector<Allocation> allocations;
+		/** @brief Dedicated memory not taken from the allocator */
+		std::vector<VkDeviceMemory> memory;
+		/** @brief Other releases that have to wait for the GPU, like giving back a range of a sub-allocator */
+		std::vector<std::function<void()>> callbacks;
+
+		void release(VkDevice device);
+		void append(RetiredResources&& other);
+		bool empty() const;
+	};
+
+	class DeletionQueue
+	{
+	public:
+		/**
+		* @param device Device the objects belong to
+		* @param framesInFlight Number of frames the application records ahead of the GPU
+		*/
+		DeletionQueue(VkDevice device, uint32_t framesInFlight);
+		/** @brief Destroys everything still queued, the device has to be idle */
+		~DeletionQueue();
+		DeletionQueue(const DeletionQueue&) = delete;
+		DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+		/** @brief Destroy objects once the GPU has finished the current frame, can be called from any thread */
+		void retire(RetiredResources&& resources);
+		/** @brief Destroy objects once a timeline semaphore has reached a value, for objects used outside of the frame loop */
+		void retire(RetiredResources&& resources, VkSemaphore timelineSemaphore, uint64_t value);
+
+		/**
+		* Advance to the next frame and destroy the objects the GPU is done with
+		* @note Call once per frame after waiting for the fence of the frame in flight whose resources are reused, objects retired framesInFlight frames ago are destroyed
+		*/
+		void nextFrame();
+		/** @brief Destroy the objects whose timeline value has been reached without advancing the frame */
+		void collect();
+		/** @brief Destroy everything, the device has to be idle */
+		void flush();
+
+		uint64_t getFrame() const { return frame; }
+		/** @brief True once nextFrame() has advanced far enough that objects used up to the given frame are no longer in use */
+		bool isFrameComplete(uint64_t frame) const { return frame + framesInFlight <= this->frame; }
+		/** @brief Number of batches waiting for the GPU */
+		size_t getPendingCount();
+
+	private:
+		struct Batch
+		{
+			uint64_t frame = 0;
+			VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+			uint64_t value = 0;
+			RetiredResources resources;
+		};
+
+		VkDevice device;
+		uint32_t framesInFlight;
+		std::mutex mutex;
+		/** @brief Written under the mutex, atomic so the frame can be read without it */
+		std::atomic<uint64_t> frame{ 0 };
+		/** @brief Batches tagged with a frame, oldest first */
+		std::deque<Batch> frameBatches;
+		std::vector<Batch> timelineBatches;
+
+		void collectTimelineBatches(std::vector<RetiredResources>& completed);
+		void release(std::vector<RetiredResources>& completed);
+	};
+}
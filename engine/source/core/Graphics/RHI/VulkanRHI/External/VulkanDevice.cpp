@@ -17,6 +17,24 @@
 
 namespace vks
 {
+	/** @brief Guess what a buffer is used for from its usage flags, only used for memory usage reporting */
+	static MemoryCategory bufferMemoryCategory(VkBufferUsageFlags usageFlags)
+	{
+		if (usageFlags & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT))
+		{
+			return MemoryCategory::Geometry;
+		}
+		if (usageFlags & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+		{
+			return MemoryCategory::Uniform;
+		}
+		if (usageFlags == VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+		{
+			return MemoryCategory::Staging;
+		}
+		return MemoryCategory::Other;
+	}
+
 	/**
 	* Default constructor
 	*
@@ -55,6 +73,20 @@ namespace vks
 				}
 			}
 		}
+
+		// Integrated and CPU implementations share one memory pool between host and device, uploading to device local memory through a staging copy would only double the traffic
+		if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+		{
+			const VkMemoryPropertyFlags unifiedFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+			{
+				if ((memoryProperties.memoryTypes[i].propertyFlags & unifiedFlags) == unifiedFlags)
+				{
+					unifiedMemory = true;
+					break;
+				}
+			}
+		}
 	}
 
 	/**
@@ -64,13 +96,46 @@ namespace vks
 	*/
 	VulkanDevice::~VulkanDevice()
 	{
+		if (uploadManager)
+		{
+			delete uploadManager;
+		}
+		if (stagingRing)
+		{
+			delete stagingRing;
+		}
+		// Hands over whatever is still queued before the objects it references go away
+		for (auto& queueSubmitter : queueSubmitters)
+		{
+			delete queueSubmitter.second;
+		}
+		if (deletionQueue)
+		{
+			delete deletionQueue;
+		}
+		if (memoryAllocator)
+		{
+			delete memoryAllocator;
+		}
+		if (commandBufferPools)
+		{
+			delete commandBufferPools;
+		}
+		if (fencePool)
+		{
+			delete fencePool;
+		}
+		if (semaphorePool)
+		{
+			delete semaphorePool;
+		}
 		if (commandPool)
 		{
-			vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+			vkDestroyCommandPool(logicalDevice, commandPool, allocationCallbacks(HostAllocationScope::Command));
 		}
 		if (logicalDevice)
 		{
-			vkDestroyDevice(logicalDevice, nullptr);
+			vkDestroyDevice(logicalDevice, allocationCallbacks(HostAllocationScope::Device));
 		}
 	}
 
@@ -224,6 +289,9 @@ namespace vks
 		}
 
 		// Dedicated transfer queue
+		uint32_t transferQueueIndex = 0;
+		bool exclusiveTransferQueue = false;
+		const float sharedQueuePriorities[2] = { defaultQueuePriority, defaultQueuePriority };
 		if (requestedQueueTypes & VK_QUEUE_TRANSFER_BIT)
 		{
 			queueFamilyIndices.transfer = getQueueFamilyIndex(VK_QUEUE_TRANSFER_BIT);
@@ -236,6 +304,21 @@ namespace vks
 				queueInfo.queueCount = 1;
 				queueInfo.pQueuePriorities = &defaultQueuePriority;
 				queueCreateInfos.push_back(queueInfo);
+				exclusiveTransferQueue = true;
+			}
+			else if (queueFamilyProperties[queueFamilyIndices.transfer].queueCount > 1)
+			{
+				// The family is shared with graphics or compute, request a second queue of it so uploads don't have to be synchronized with their submissions
+				for (VkDeviceQueueCreateInfo& queueInfo : queueCreateInfos)
+				{
+					if (queueInfo.queueFamilyIndex == queueFamilyIndices.transfer)
+					{
+						queueInfo.queueCount = 2;
+						queueInfo.pQueuePriorities = sharedQueuePriorities;
+					}
+				}
+				transferQueueIndex = 1;
+				exclusiveTransferQueue = true;
 			}
 		}
 		else
@@ -258,6 +341,109 @@ namespace vks
 		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 		deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
+		// Enable timeline semaphores if present, the upload manager signals its progress with them
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+		timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		if (properties.apiVersion >= VK_API_VERSION_1_2 || extensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+		{
+			VkPhysicalDeviceFeatures2 supportedFeatures{};
+			supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supportedFeatures.pNext = &timelineSemaphoreFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+			if (timelineSemaphoreFeatures.timelineSemaphore)
+			{
+				// The caller's chain may already contain a struct with the feature, which must then be set there instead
+				bool chained = false;
+				for (VkBaseOutStructure* next = static_cast<VkBaseOutStructure*>(pNextChain); next; next = next->pNext)
+				{
+					if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES)
+					{
+						reinterpret_cast<VkPhysicalDeviceVulkan12Features*>(next)->timelineSemaphore = VK_TRUE;
+						chained = true;
+					}
+					else if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES)
+					{
+						reinterpret_cast<VkPhysicalDeviceTimelineSemaphoreFeatures*>(next)->timelineSemaphore = VK_TRUE;
+						chained = true;
+					}
+				}
+				if (!chained)
+				{
+					timelineSemaphoreFeatures.pNext = pNextChain;
+					pNextChain = &timelineSemaphoreFeatures;
+				}
+				if (properties.apiVersion < VK_API_VERSION_1_2)
+				{
+					deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+				}
+				timelineSemaphoreSupported = true;
+			}
+		}
+
+		// Enable synchronization2 if present, barrier batches are then recorded with per barrier stage masks
+		VkPhysicalDeviceSynchronization2Features synchronization2Features{};
+		synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+		if (properties.apiVersion >= VK_API_VERSION_1_3 || extensionSupported(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+		{
+			VkPhysicalDeviceFeatures2 supportedFeatures{};
+			supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supportedFeatures.pNext = &synchronization2Features;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+			if (synchronization2Features.synchronization2)
+			{
+				bool chained = false;
+				for (VkBaseOutStructure* next = static_cast<VkBaseOutStructure*>(pNextChain); next; next = next->pNext)
+				{
+					if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES)
+					{
+						reinterpret_cast<VkPhysicalDeviceVulkan13Features*>(next)->synchronization2 = VK_TRUE;
+						chained = true;
+					}
+					else if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES)
+					{
+						reinterpret_cast<VkPhysicalDeviceSynchronization2Features*>(next)->synchronization2 = VK_TRUE;
+						chained = true;
+					}
+				}
+				if (!chained)
+				{
+					synchronization2Features.pNext = pNextChain;
+					pNextChain = &synchronization2Features;
+				}
+				if (properties.apiVersion < VK_API_VERSION_1_3)
+				{
+					deviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+				}
+				synchronization2Supported = true;
+			}
+		}
+
+#if defined(VK_EXT_host_image_copy)
+		// Enable host image copies if present, the feature struct is put in front of the caller's chain
+		VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures{};
+		hostImageCopyFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+		if (extensionSupported(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME))
+		{
+			VkPhysicalDeviceFeatures2 supportedFeatures{};
+			supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supportedFeatures.pNext = &hostImageCopyFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+			if (hostImageCopyFeatures.hostImageCopy)
+			{
+				hostImageCopyFeatures.pNext = pNextChain;
+				pNextChain = &hostImageCopyFeatures;
+				deviceExtensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+				// Dependencies that are core in Vulkan 1.3
+				if (properties.apiVersion < VK_API_VERSION_1_3)
+				{
+					deviceExtensions.push_back(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME);
+					deviceExtensions.push_back(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME);
+				}
+				hostImageCopySupported = true;
+			}
+		}
+#endif
+
 		// If a pNext(Chain) has been passed, we need to add it to the device creation info
 		VkPhysicalDeviceFeatures2 physicalDeviceFeatures2{};
 		if (pNextChain) {
@@ -275,6 +461,13 @@ namespace vks
 			enableDebugMarkers = true;
 		}
 
+		// Enable the memory budget extension if it is present so heap budgets reflect the usage of all processes
+		if (extensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+		{
+			deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			memoryBudgetSupported = true;
+		}
+
 		if (deviceExtensions.size() > 0)
 		{
 			for (const char* enabledExtension : deviceExtensions)
@@ -290,18 +483,174 @@ namespace vks
 
 		this->enabledFeatures = enabledFeatures;
 
-		VkResult result = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &logicalDevice);
+		VkResult result = vkCreateDevice(physicalDevice, &deviceCreateInfo, allocationCallbacks(HostAllocationScope::Device), &logicalDevice);
 		if (result != VK_SUCCESS)
 		{
 			return result;
 		}
 
+		if (synchronization2Supported)
+		{
+			// Core name first, drivers only exposing the extension return null for it
+			fpCmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdPipelineBarrier2"));
+			if (!fpCmdPipelineBarrier2)
+			{
+				fpCmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdPipelineBarrier2KHR"));
+			}
+			synchronization2Supported = fpCmdPipelineBarrier2 != nullptr;
+		}
+
+#if defined(VK_EXT_host_image_copy)
+		if (hostImageCopySupported)
+		{
+			fpCopyMemoryToImageEXT = reinterpret_cast<PFN_vkCopyMemoryToImageEXT>(vkGetDeviceProcAddr(logicalDevice, "vkCopyMemoryToImageEXT"));
+			fpTransitionImageLayoutEXT = reinterpret_cast<PFN_vkTransitionImageLayoutEXT>(vkGetDeviceProcAddr(logicalDevice, "vkTransitionImageLayoutEXT"));
+			VkPhysicalDeviceHostImageCopyPropertiesEXT hostImageCopyProperties{};
+			hostImageCopyProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+			VkPhysicalDeviceProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties2.pNext = &hostImageCopyProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			hostImageCopyLayouts.resize(hostImageCopyProperties.copyDstLayoutCount);
+			hostImageCopyProperties.pCopyDstLayouts = hostImageCopyLayouts.data();
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			hostImageCopySupported = fpCopyMemoryToImageEXT && fpTransitionImageLayoutEXT;
+		}
+#endif
+
 		// Create a default command pool for graphics command buffers
 		commandPool = createCommandPool(queueFamilyIndices.graphics);
 
+		// Recycled command buffers and synchronization objects for one-off and per-frame submissions
+		commandBufferPools = new vks::CommandBufferPools(logicalDevice);
+		fencePool = new vks::FencePool(logicalDevice);
+		semaphorePool = new vks::SemaphorePool(logicalDevice);
+
+		// All buffer and image memory is sub-allocated from larger blocks
+		memoryAllocator = new vks::MemoryAllocator(this);
+
+		// Destruction of objects that frames in flight may still reference is deferred until the GPU is done with them
+		deletionQueue = new vks::DeletionQueue(logicalDevice, framesInFlight);
+
+		// Shared staging memory for all texture and buffer uploads
+		stagingRing = new vks::StagingRing(this, stagingRingSize);
+
+		// Uploads from any thread are recorded onto the transfer queue, provided it doesn't have to be shared with other submissions
+		if (timelineSemaphoreSupported && exclusiveTransferQueue)
+		{
+			VkQueue transferQueue;
+			vkGetDeviceQueue(logicalDevice, queueFamilyIndices.transfer, transferQueueIndex, &transferQueue);
+			uploadManager = new vks::UploadManager(this, transferQueue, queueFamilyIndices.transfer, uploadRingSize);
+		}
+
 		return result;
 	}
 
+	/**
+	* Get the memory properties for device local resources that are written once by the host (geometry, static buffers)
+	*
+	* @return Device local, plus host visible and coherent on unified memory devices so the data can be written in place
+	*/
+	VkMemoryPropertyFlags VulkanDevice::getStaticMemoryFlags() const
+	{
+		if (unifiedMemory)
+		{
+			return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		}
+		return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	}
+
+	/**
+	* Get the usage flag an optimal tiled image needs to be uploaded with UploadBatch::uploadImage
+	*
+	* @param format Format of the image
+	* @param imageLayout Layout the image is used in after the upload
+	*
+	* @return VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT if the image can be written from the host, VK_IMAGE_USAGE_TRANSFER_DST_BIT otherwise
+	*/
+	VkImageUsageFlags VulkanDevice::getImageUploadUsage(VkFormat format, VkImageLayout imageLayout) const
+	{
+#if defined(VK_EXT_host_image_copy)
+		if (hostImageCopySupported && std::find(hostImageCopyLayouts.begin(), hostImageCopyLayouts.end(), imageLayout) != hostImageCopyLayouts.end())
+		{
+			VkFormatProperties3 formatProperties3{};
+			formatProperties3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+			VkFormatProperties2 formatProperties2{};
+			formatProperties2.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+			formatProperties2.pNext = &formatProperties3;
+			vkGetPhysicalDeviceFormatProperties2(physicalDevice, format, &formatProperties2);
+			if (formatProperties3.optimalTilingFeatures & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT)
+			{
+				return VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+			}
+		}
+#else
+		(void)format;
+		(void)imageLayout;
+#endif
+		return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+
+	/** @brief True if an image created with the given usage is uploaded from the host instead of through the staging ring */
+	bool VulkanDevice::isHostImageUpload(VkImageUsageFlags imageUsageFlags) const
+	{
+#if defined(VK_EXT_host_image_copy)
+		return hostImageCopySupported && (imageUsageFlags & VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT);
+#else
+		(void)imageUsageFlags;
+		return false;
+#endif
+	}
+
+	/**
+	* Write image data from host memory and transition the image from undefined to its final layout, no commands are recorded
+	*
+	* @param data Source data, region buffer offsets are relative to this pointer
+	* @param image Destination image, has to be created with the usage returned by getImageUploadUsage()
+	* @param regions Copy regions
+	* @param subresourceRange Subresources the layout transition applies to
+	* @param imageLayout Layout the image is used in after the upload
+	*/
+	void VulkanDevice::copyMemoryToImage(const void* data, VkImage image, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& subresourceRange, VkImageLayout imageLayout)
+	{
+#if defined(VK_EXT_host_image_copy)
+		assert(hostImageCopySupported);
+		VkHostImageLayoutTransitionInfoEXT transitionInfo{};
+		transitionInfo.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT;
+		transitionInfo.image = image;
+		transitionInfo.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		transitionInfo.newLayout = imageLayout;
+		transitionInfo.subresourceRange = subresourceRange;
+		VK_CHECK_RESULT(fpTransitionImageLayoutEXT(logicalDevice, 1, &transitionInfo));
+
+		std::vector<VkMemoryToImageCopyEXT> copies(regions.size());
+		for (size_t i = 0; i < regions.size(); i++)
+		{
+			copies[i].sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+			copies[i].pHostPointer = static_cast<const uint8_t*>(data) + regions[i].bufferOffset;
+			copies[i].memoryRowLength = regions[i].bufferRowLength;
+			copies[i].memoryImageHeight = regions[i].bufferImageHeight;
+			copies[i].imageSubresource = regions[i].imageSubresource;
+			copies[i].imageOffset = regions[i].imageOffset;
+			copies[i].imageExtent = regions[i].imageExtent;
+		}
+		VkCopyMemoryToImageInfoEXT copyInfo{};
+		copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT;
+		copyInfo.dstImage = image;
+		copyInfo.dstImageLayout = imageLayout;
+		copyInfo.regionCount = static_cast<uint32_t>(copies.size());
+		copyInfo.pRegions = copies.data();
+		VK_CHECK_RESULT(fpCopyMemoryToImageEXT(logicalDevice, &copyInfo));
+#else
+		(void)data;
+		(void)image;
+		(void)regions;
+		(void)subresourceRange;
+		(void)imageLayout;
+		assert(false && "VK_EXT_host_image_copy is not available in these Vulkan headers");
+#endif
+	}
+
 	/**
 	* Create a buffer on the device
 	*
@@ -309,55 +658,39 @@ namespace vks
 	* @param memoryPropertyFlags Memory properties for this buffer (i.e. device local, host visible, coherent)
 	* @param size Size of the buffer in byes
 	* @param buffer Pointer to the buffer handle acquired by the function
-	* @param memory Pointer to the memory handle acquired by the function
+	* @param allocation Pointer to the memory allocation acquired by the function
 	* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
 	*
 	* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
 	*/
-	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory, void* data)
+	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, vks::Allocation* allocation, void* data)
 	{
 		// Create the buffer handle
 		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
 		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, buffer));
+		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, allocationCallbacks(HostAllocationScope::Resource), buffer));
 
-		// Create the memory backing up the buffer handle
-		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		vkGetBufferMemoryRequirements(logicalDevice, *buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		// Find a memory type index that fits the properties of the buffer
-		memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
+		// Sub-allocate the memory backing up the buffer handle and attach it to the buffer object
 		// If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
-		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-		if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-			memAlloc.pNext = &allocFlagsInfo;
-		}
-		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, memory));
+		VkMemoryAllocateFlags allocateFlags = (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+		VK_CHECK_RESULT(memoryAllocator->allocateBufferMemory(*buffer, memoryPropertyFlags, allocation, bufferMemoryCategory(usageFlags), allocateFlags));
 
-		// If a pointer to the buffer data has been passed, map the buffer and copy over the data
+		// If a pointer to the buffer data has been passed, copy it into the (persistently mapped) allocation
 		if (data != nullptr)
 		{
-			void* mapped;
-			VK_CHECK_RESULT(vkMapMemory(logicalDevice, *memory, 0, size, 0, &mapped));
-			memcpy(mapped, data, size);
+			assert(allocation->mapped);
+			memcpy(allocation->mapped, data, size);
 			// If host coherency hasn't been requested, do a manual flush to make writes visible
 			if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
 			{
 				VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
-				mappedRange.memory = *memory;
-				mappedRange.offset = 0;
-				mappedRange.size = size;
+				mappedRange.memory = allocation->memory;
+				mappedRange.offset = allocation->offset;
+				mappedRange.size = allocation->size;
 				vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedRange);
 			}
-			vkUnmapMemory(logicalDevice, *memory);
 		}
 
-		// Attach the memory to the buffer object
-		VK_CHECK_RESULT(vkBindBufferMemory(logicalDevice, *buffer, *memory, 0));
-
 		return VK_SUCCESS;
 	}
 
@@ -378,23 +711,14 @@ namespace vks
 
 		// Create the buffer handle
 		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
-		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, &buffer->buffer));
+		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &buffer->buffer));
 
-		// Create the memory backing up the buffer handle
+		// Sub-allocate the memory backing up the buffer handle, binding happens at the end
 		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		// Find a memory type index that fits the properties of the buffer
-		memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		// If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
-		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-		if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-			memAlloc.pNext = &allocFlagsInfo;
-		}
-		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
+		VkMemoryAllocateFlags allocateFlags = (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+		VK_CHECK_RESULT(memoryAllocator->allocateBufferMemory(buffer->buffer, memoryPropertyFlags, &buffer->allocation, bufferMemoryCategory(usageFlags), allocateFlags, false));
+		buffer->memory = buffer->allocation.memory;
 
 		buffer->alignment = memReqs.alignment;
 		buffer->size = size;
@@ -466,7 +790,7 @@ namespace vks
 		cmdPoolInfo.queueFamilyIndex = queueFamilyIndex;
 		cmdPoolInfo.flags = createFlags;
 		VkCommandPool cmdPool;
-		VK_CHECK_RESULT(vkCreateCommandPool(logicalDevice, &cmdPoolInfo, nullptr, &cmdPool));
+		VK_CHECK_RESULT(vkCreateCommandPool(logicalDevice, &cmdPoolInfo, allocationCallbacks(HostAllocationScope::Command), &cmdPool));
 		return cmdPool;
 	}
 
@@ -493,9 +817,25 @@ namespace vks
 		return cmdBuffer;
 	}
 
+	/**
+	* Get a command buffer for the graphics queue family from the calling thread's command pool
+	*
+	* @param level Level of the command buffer (primary or secondary)
+	* @param (Optional) begin If true, recording on the command buffer will be started (vkBeginCommandBuffer) (Defaults to false)
+	*
+	* @note The command buffer is reused from a previous flushCommandBuffer() if possible and must be recorded on the calling thread
+	*
+	* @return A handle to the command buffer
+	*/
 	VkCommandBuffer VulkanDevice::createCommandBuffer(VkCommandBufferLevel level, bool begin)
 	{
-		return createCommandBuffer(level, commandPool, begin);
+		VkCommandBuffer cmdBuffer = commandBufferPools->acquire(queueFamilyIndices.graphics, level);
+		if (begin)
+		{
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
+		}
+		return cmdBuffer;
 	}
 
 	/**
@@ -518,27 +858,67 @@ namespace vks
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 
-		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-		// Create fence to ensure that the command buffer has finished executing
-		VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-		VkFence fence;
-		VK_CHECK_RESULT(vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence));
-		// Submit to the queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+		// Take a fence from the pool to ensure that the command buffer has finished executing
+		VkFence fence = fencePool->acquire();
+		// Submit to the queue through its submission thread
+		vks::QueueSubmission submission;
+		submission.commandBuffers.push_back(commandBuffer);
+		submission.fence = fence;
+		getQueueSubmitter(queue)->submit(std::move(submission));
 		// Wait for the fence to signal that command buffer has finished executing
 		VK_CHECK_RESULT(vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
-		vkDestroyFence(logicalDevice, fence, nullptr);
+		fencePool->release(fence);
 		if (free)
 		{
 			vkFreeCommandBuffers(logicalDevice, pool, 1, &commandBuffer);
 		}
 	}
 
+	/**
+	* Finish recording of a command buffer from createCommandBuffer() without a pool and submit it to a queue
+	*
+	* @param commandBuffer Command buffer to flush
+	* @param queue Queue of the graphics queue family to submit the command buffer to
+	* @param free (Optional) Give the command buffer back to the thread's command pool for reuse once it has finished executing (Defaults to true)
+	*/
 	void VulkanDevice::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free)
 	{
-		return flushCommandBuffer(commandBuffer, queue, commandPool, free);
+		if (commandBuffer == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		VkFence fence = fencePool->acquire();
+		vks::QueueSubmission submission;
+		submission.commandBuffers.push_back(commandBuffer);
+		submission.fence = fence;
+		getQueueSubmitter(queue)->submit(std::move(submission));
+		VK_CHECK_RESULT(vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
+		fencePool->release(fence);
+		if (free)
+		{
+			commandBufferPools->release(commandBuffer);
+		}
+	}
+
+	/**
+	* Get the submission thread of a queue, all submissions to a queue have to go through it as queue access must be externally synchronized
+	*
+	* @param queue Queue of this device
+	*
+	* @return Submitter owning the queue, created on first use
+	*/
+	vks::QueueSubmitter* VulkanDevice::getQueueSubmitter(VkQueue queue)
+	{
+		std::lock_guard<std::mutex> lock(queueSubmitterMutex);
+		vks::QueueSubmitter*& queueSubmitter = queueSubmitters[queue];
+		if (!queueSubmitter)
+		{
+			queueSubmitter = new vks::QueueSubmitter(queue);
+		}
+		return queueSubmitter;
 	}
 
 	/**
@@ -11,9 +11,17 @@
 #pragma once
 
 #include "VulkanBuffer.h"
+#include "VulkanStagingRing.h"
+#include "VulkanUploadManager.h"
+#include "VulkanSyncPools.h"
+#include "VulkanDeletionQueue.h"
+#include "VulkanQueueSubmitter.h"
+#include "VulkanHostAllocator.h"
 #include <algorithm>
 #include <assert.h>
 #include <exception>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -37,10 +45,42 @@ namespace vks
 		std::vector<VkQueueFamilyProperties> queueFamilyProperties;
 		/** @brief List of extensions supported by the device */
 		std::vector<std::string> supportedExtensions;
+		/** @brief Sub-allocator all buffer and image memory of this device is taken from */
+		vks::MemoryAllocator* memoryAllocator = nullptr;
+		/** @brief Persistently mapped staging buffer all uploads go through */
+		vks::StagingRing* stagingRing = nullptr;
+		/** @brief Size of the staging ring, has to be set before the logical device is created */
+		VkDeviceSize stagingRingSize = 64 * 1024 * 1024;
+		/** @brief Asynchronous uploads on the transfer queue, only created if timeline semaphores are supported */
+		vks::UploadManager* uploadManager = nullptr;
+		/** @brief Size of the upload manager's staging ring, has to be set before the logical device is created */
+		VkDeviceSize uploadRingSize = 32 * 1024 * 1024;
+		/** @brief Objects released while command buffers in flight may still use them, destroyed once the GPU has passed their frame */
+		vks::DeletionQueue* deletionQueue = nullptr;
+		/** @brief Number of frames recorded ahead of the GPU, has to be set before the logical device is created */
+		uint32_t framesInFlight = 2;
 		/** @brief Default command pool for the graphics queue family index */
 		VkCommandPool commandPool = VK_NULL_HANDLE;
+		/** @brief Per-thread command pools for each queue family, command buffers are reset and reused instead of being freed */
+		vks::CommandBufferPools* commandBufferPools = nullptr;
+		/** @brief Fences used for submissions, recycled once they have signaled */
+		vks::FencePool* fencePool = nullptr;
+		/** @brief Binary and timeline semaphores for submissions */
+		vks::SemaphorePool* semaphorePool = nullptr;
 		/** @brief Set to true when the debug marker extension is detected */
 		bool enableDebugMarkers = false;
+		/** @brief Set to true when VK_EXT_memory_budget has been enabled */
+		bool memoryBudgetSupported = false;
+		/** @brief Set on integrated and CPU devices with memory that is both device local and host visible, static data is then written in place instead of staged */
+		bool unifiedMemory = false;
+		/** @brief Set to true when VK_EXT_host_image_copy has been enabled, images can then be written by the host without a command buffer */
+		bool hostImageCopySupported = false;
+		/** @brief Set to true when timeline semaphores have been enabled */
+		bool timelineSemaphoreSupported = false;
+		/** @brief Set to true when synchronization2 has been enabled and vkCmdPipelineBarrier2 could be loaded */
+		bool synchronization2Supported = false;
+		/** @brief vkCmdPipelineBarrier2 or its KHR alias, null without synchronization2 */
+		PFN_vkCmdPipelineBarrier2KHR fpCmdPipelineBarrier2 = nullptr;
 		/** @brief Contains queue family indices */
 		struct
 		{
@@ -56,8 +96,8 @@ namespace vks
 		~VulkanDevice();
 		uint32_t        getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, VkBool32* memTypeFound = nullptr) const;
 		uint32_t        getQueueFamilyIndex(VkQueueFlagBits queueFlags) const;
-		VkResult        createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char*> enabledExtensions, void* pNextChain, bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
-		VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory, void* data = nullptr);
+		VkResult        createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char*> enabledExtensions, void* pNextChain, bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+		VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer* buffer, vks::Allocation* allocation, void* data = nullptr);
 		VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer* buffer, VkDeviceSize size, void* data = nullptr);
 		void            copyBuffer(vks::Buffer* src, vks::Buffer* dst, VkQueue queue, VkBufferCopy* copyRegion = nullptr);
 		VkCommandPool   createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
@@ -65,7 +105,23 @@ namespace vks
 		VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, bool begin = false);
 		void            flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool pool, bool free = true);
 		void            flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true);
+		vks::QueueSubmitter* getQueueSubmitter(VkQueue queue);
 		bool            extensionSupported(std::string extension);
 		VkFormat        getSupportedDepthFormat(bool checkSamplingSupport);
+		VkMemoryPropertyFlags getStaticMemoryFlags() const;
+		VkImageUsageFlags getImageUploadUsage(VkFormat format, VkImageLayout imageLayout) const;
+		bool            isHostImageUpload(VkImageUsageFlags imageUsageFlags) const;
+		void            copyMemoryToImage(const void* data, VkImage image, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& subresourceRange, VkImageLayout imageLayout);
+
+	private:
+		/** @brief Submission threads, one per queue that has been submitted to through the device */
+		std::unordered_map<VkQueue, vks::QueueSubmitter*> queueSubmitters;
+		std::mutex queueSubmitterMutex;
+#if defined(VK_EXT_host_image_copy)
+		PFN_vkCopyMemoryToImageEXT fpCopyMemoryToImageEXT = nullptr;
+		PFN_vkTransitionImageLayoutEXT fpTransitionImageLayoutEXT = nullptr;
+		/** @brief Layouts images can be in while they are written from the host */
+		std::vector<VkImageLayout> hostImageCopyLayouts;
+#endif
 	};
 }        // namespace vks
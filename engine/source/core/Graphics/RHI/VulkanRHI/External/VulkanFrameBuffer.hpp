@@ -9,7 +9,10 @@
 #pragma once
 
 #include <algorithm>
+#include <iomanip>
+#include <iostream>
 #include <iterator>
+#include <map>
 #include <vector>
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
@@ -24,11 +27,16 @@ namespace vks
 	struct FramebufferAttachment
 	{
 		VkImage image;
-		VkDeviceMemory memory;
+		/** @brief Memory owned by the attachment, invalid if the attachment aliases memory of an AttachmentAliasPool */
+		vks::Allocation allocation;
 		VkImageView view;
 		VkFormat format;
 		VkImageSubresourceRange subresourceRange;
 		VkAttachmentDescription description;
+		/** @brief Attachment is only used within its render pass and may be backed by lazily allocated memory */
+		bool transient = false;
+		bool lazilyAllocated = false;
+		bool aliased = false;
 
 		/**
 		* @brief Returns true if the attachment has a depth component
@@ -82,6 +90,174 @@ namespace vks
 		VkFormat format;
 		VkImageUsageFlags usage;
 		VkSampleCountFlagBits imageSampleCount = VK_SAMPLE_COUNT_1_BIT;
+		/**
+		* @brief Contents are neither loaded nor stored (e.g. depth or G-buffer targets only read within their pass)
+		* @note Transient attachments can't be sampled, they get VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT and lazily allocated memory where the device offers it
+		*/
+		bool transient = false;
+		/**
+		* @brief First and last pass of the frame the attachment is used in
+		* @note Attachments with a bounded lifetime share memory through the framebuffer's AttachmentAliasPool with attachments whose lifetime doesn't overlap
+		*/
+		uint32_t firstPass = 0;
+		uint32_t lastPass = UINT32_MAX;
+	};
+
+	/** @brief Memory used by a set of attachments compared to giving each attachment its own allocation */
+	struct AttachmentMemoryStatistics
+	{
+		uint32_t attachmentCount = 0;
+		uint32_t lazilyAllocatedCount = 0;
+		uint32_t aliasedCount = 0;
+		/** @brief Bytes the attachments would take with one allocation each */
+		VkDeviceSize requiredBytes = 0;
+		/** @brief Bytes actually allocated for the attachments, lazily allocated memory is not counted */
+		VkDeviceSize committedBytes = 0;
+
+		VkDeviceSize savedBytes() const { return requiredBytes - std::min(requiredBytes, committedBytes); }
+
+		void add(const AttachmentMemoryStatistics& other)
+		{
+			attachmentCount += other.attachmentCount;
+			lazilyAllocatedCount += other.lazilyAllocatedCount;
+			aliasedCount += other.aliasedCount;
+			requiredBytes += other.requiredBytes;
+			committedBytes += other.committedBytes;
+		}
+
+		void subtract(const AttachmentMemoryStatistics& other)
+		{
+			attachmentCount -= other.attachmentCount;
+			lazilyAllocatedCount -= other.lazilyAllocatedCount;
+			aliasedCount -= other.aliasedCount;
+			requiredBytes -= other.requiredBytes;
+			committedBytes -= other.committedBytes;
+		}
+
+		void print(std::ostream& stream) const
+		{
+			const double MiB = 1024.0 * 1024.0;
+			stream << attachmentCount << " attachments (" << lazilyAllocatedCount << " lazily allocated, " << aliasedCount << " aliased), "
+				<< std::fixed << std::setprecision(1) << requiredBytes / MiB << " MiB required, " << committedBytes / MiB << " MiB committed, "
+				<< savedBytes() / MiB << " MiB saved";
+		}
+	};
+
+	/**
+	* @brief Device memory shared by framebuffer attachments whose lifetimes within a frame don't overlap
+	* @note Has to outlive all framebuffers using it. The contents of an aliased attachment are undefined at the start of its first pass
+	*/
+	class AttachmentAliasPool
+	{
+	public:
+		explicit AttachmentAliasPool(vks::VulkanDevice* vulkanDevice) : vulkanDevice(vulkanDevice)
+		{
+			assert(vulkanDevice);
+		}
+
+		~AttachmentAliasPool()
+		{
+			for (auto& slot : slots)
+			{
+				slot.allocation.free();
+			}
+		}
+
+		/**
+		* Bind an attachment image to memory that is not in use during its lifetime
+		*
+		* @param image Image to bind
+		* @param memReqs Memory requirements of the image
+		* @param firstPass First pass of the frame the image is used in
+		* @param lastPass Last pass of the frame the image is used in
+		*
+		* @return Bytes of new memory that had to be allocated, zero if memory of another attachment has been reused
+		*/
+		VkDeviceSize bind(VkImage image, const VkMemoryRequirements& memReqs, uint32_t firstPass, uint32_t lastPass)
+		{
+			for (auto& slot : slots)
+			{
+				const bool compatible = (memReqs.memoryTypeBits & (1u << slot.allocation.memoryTypeIndex)) && (slot.allocation.size >= memReqs.size) && (slot.allocation.offset % memReqs.alignment == 0);
+				const bool overlaps = std::any_of(slot.lifetimes.begin(), slot.lifetimes.end(), [&](const Lifetime& lifetime) {
+					return firstPass <= lifetime.lastPass && lifetime.firstPass <= lastPass;
+				});
+				if (compatible && !overlaps)
+				{
+					VK_CHECK_RESULT(vkBindImageMemory(vulkanDevice->logicalDevice, image, slot.allocation.memory, slot.allocation.offset));
+					slot.lifetimes.push_back({ image, firstPass, lastPass });
+					return 0;
+				}
+			}
+			Slot slot;
+			VK_CHECK_RESULT(vulkanDevice->memoryAllocator->allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vks::AllocationType::Optimal, &slot.allocation, 0, vks::MemoryCategory::Attachment));
+			VK_CHECK_RESULT(vkBindImageMemory(vulkanDevice->logicalDevice, image, slot.allocation.memory, slot.allocation.offset));
+			slot.lifetimes.push_back({ image, firstPass, lastPass });
+			slots.push_back(slot);
+			return slot.allocation.size;
+		}
+
+		/** @brief Remove an image bound with bind(), memory no other image uses anymore is freed */
+		void release(VkImage image)
+		{
+			for (auto it = slots.begin(); it != slots.end(); ++it)
+			{
+				auto& lifetimes = it->lifetimes;
+				auto lifetime = std::find_if(lifetimes.begin(), lifetimes.end(), [image](const Lifetime& l) { return l.image == image; });
+				if (lifetime != lifetimes.end())
+				{
+					lifetimes.erase(lifetime);
+					if (lifetimes.empty())
+					{
+						it->allocation.free();
+						slots.erase(it);
+					}
+					return;
+				}
+			}
+		}
+
+		/** @brief Account attachments of a framebuffer to the statistics of their resolution */
+		void addStatistics(uint32_t width, uint32_t height, const AttachmentMemoryStatistics& statistics)
+		{
+			resolutions[{ width, height }].add(statistics);
+		}
+
+		void removeStatistics(uint32_t width, uint32_t height, const AttachmentMemoryStatistics& statistics)
+		{
+			resolutions[{ width, height }].subtract(statistics);
+		}
+
+		void printStatistics()
+		{
+			std::cout << "Attachment memory (" << slots.size() << " shared ranges):" << std::endl;
+			for (auto& resolution : resolutions)
+			{
+				if (resolution.second.attachmentCount == 0)
+				{
+					continue;
+				}
+				std::cout << "  " << resolution.first.first << "x" << resolution.first.second << ": ";
+				resolution.second.print(std::cout);
+				std::cout << std::endl;
+			}
+		}
+
+	private:
+		struct Lifetime
+		{
+			VkImage image;
+			uint32_t firstPass;
+			uint32_t lastPass;
+		};
+		struct Slot
+		{
+			vks::Allocation allocation;
+			std::vector<Lifetime> lifetimes;
+		};
+
+		vks::VulkanDevice* vulkanDevice;
+		std::vector<Slot> slots;
+		std::map<std::pair<uint32_t, uint32_t>, AttachmentMemoryStatistics> resolutions;
 	};
 
 	/**
@@ -91,6 +267,9 @@ namespace vks
 	{
 	private:
 		vks::VulkanDevice *vulkanDevice;
+		vks::AttachmentAliasPool *aliasPool;
+		/** @brief Memory statistics per attachment resolution, so they can be taken out of the alias pool's statistics again */
+		std::map<std::pair<uint32_t, uint32_t>, vks::AttachmentMemoryStatistics> memoryStatistics;
 	public:
 		uint32_t width, height;
 		VkFramebuffer framebuffer;
@@ -102,11 +281,13 @@ namespace vks
 		* Default constructor
 		*
 		* @param vulkanDevice Pointer to a valid VulkanDevice
+		* @param aliasPool (Optional) Pool attachments with a bounded lifetime share their memory through
 		*/
-		Framebuffer(vks::VulkanDevice *vulkanDevice)
+		Framebuffer(vks::VulkanDevice *vulkanDevice, vks::AttachmentAliasPool *aliasPool = nullptr)
 		{
 			assert(vulkanDevice);
 			this->vulkanDevice = vulkanDevice;
+			this->aliasPool = aliasPool;
 		}
 
 		/**
@@ -115,15 +296,26 @@ namespace vks
 		~Framebuffer()
 		{
 			assert(vulkanDevice);
-			for (auto attachment : attachments)
+			for (auto& attachment : attachments)
+			{
+				vkDestroyImageView(vulkanDevice->logicalDevice, attachment.view, allocationCallbacks(HostAllocationScope::Resource));
+				if (attachment.aliased)
+				{
+					aliasPool->release(attachment.image);
+				}
+				vkDestroyImage(vulkanDevice->logicalDevice, attachment.image, allocationCallbacks(HostAllocationScope::Resource));
+				attachment.allocation.free();
+			}
+			if (aliasPool)
 			{
-				vkDestroyImage(vulkanDevice->logicalDevice, attachment.image, nullptr);
-				vkDestroyImageView(vulkanDevice->logicalDevice, attachment.view, nullptr);
-				vkFreeMemory(vulkanDevice->logicalDevice, attachment.memory, nullptr);
+				for (auto& statistics : memoryStatistics)
+				{
+					aliasPool->removeStatistics(statistics.first.first, statistics.first.second, statistics.second);
+				}
 			}
-			vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
-			vkDestroyRenderPass(vulkanDevice->logicalDevice, renderPass, nullptr);
-			vkDestroyFramebuffer(vulkanDevice->logicalDevice, framebuffer, nullptr);
+			vkDestroySampler(vulkanDevice->logicalDevice, sampler, allocationCallbacks(HostAllocationScope::Descriptor));
+			vkDestroyRenderPass(vulkanDevice->logicalDevice, renderPass, allocationCallbacks(HostAllocationScope::Pipeline));
+			vkDestroyFramebuffer(vulkanDevice->logicalDevice, framebuffer, allocationCallbacks(HostAllocationScope::Resource));
 		}
 
 		/**
@@ -175,17 +367,54 @@ namespace vks
 			image.samples = createinfo.imageSampleCount;
 			image.tiling = VK_IMAGE_TILING_OPTIMAL;
 			image.usage = createinfo.usage;
+			if (createinfo.transient)
+			{
+				// Transient attachments are never sampled or copied, so they can live in tile memory only
+				assert(!(createinfo.usage & (VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT)));
+				image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+				attachment.transient = true;
+			}
 
-			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 			VkMemoryRequirements memReqs;
 
 			// Create image for this attachment
-			VK_CHECK_RESULT(vkCreateImage(vulkanDevice->logicalDevice, &image, nullptr, &attachment.image));
+			VK_CHECK_RESULT(vkCreateImage(vulkanDevice->logicalDevice, &image, allocationCallbacks(HostAllocationScope::Resource), &attachment.image));
 			vkGetImageMemoryRequirements(vulkanDevice->logicalDevice, attachment.image, &memReqs);
-			memAlloc.allocationSize = memReqs.size;
-			memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(vulkanDevice->logicalDevice, &memAlloc, nullptr, &attachment.memory));
-			VK_CHECK_RESULT(vkBindImageMemory(vulkanDevice->logicalDevice, attachment.image, attachment.memory, 0));
+
+			vks::AttachmentMemoryStatistics statistics;
+			statistics.attachmentCount = 1;
+			statistics.requiredBytes = memReqs.size;
+
+			VkBool32 lazyMemoryFound = VK_FALSE;
+			if (createinfo.transient)
+			{
+				vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemoryFound);
+			}
+			if (lazyMemoryFound)
+			{
+				// Only backed by physical memory if the implementation needs to spill the attachment out of tile memory
+				VK_CHECK_RESULT(vulkanDevice->memoryAllocator->allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, vks::AllocationType::Optimal, &attachment.allocation, 0, vks::MemoryCategory::Attachment));
+				VK_CHECK_RESULT(vkBindImageMemory(vulkanDevice->logicalDevice, attachment.image, attachment.allocation.memory, attachment.allocation.offset));
+				attachment.lazilyAllocated = true;
+				statistics.lazilyAllocatedCount = 1;
+			}
+			else if (aliasPool && createinfo.lastPass != UINT32_MAX)
+			{
+				statistics.committedBytes = aliasPool->bind(attachment.image, memReqs, createinfo.firstPass, createinfo.lastPass);
+				attachment.aliased = true;
+				statistics.aliasedCount = (statistics.committedBytes == 0) ? 1 : 0;
+			}
+			else
+			{
+				VK_CHECK_RESULT(vulkanDevice->memoryAllocator->allocateImageMemory(attachment.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &attachment.allocation, vks::MemoryCategory::Attachment));
+				statistics.committedBytes = attachment.allocation.size;
+			}
+
+			memoryStatistics[{ createinfo.width, createinfo.height }].add(statistics);
+			if (aliasPool)
+			{
+				aliasPool->addStatistics(createinfo.width, createinfo.height, statistics);
+			}
 
 			attachment.subresourceRange = {};
 			attachment.subresourceRange.aspectMask = aspectMask;
@@ -199,7 +428,7 @@ namespace vks
 			//todo: workaround for depth+stencil attachments
 			imageView.subresourceRange.aspectMask = (attachment.hasDepth()) ? VK_IMAGE_ASPECT_DEPTH_BIT : aspectMask;
 			imageView.image = attachment.image;
-			VK_CHECK_RESULT(vkCreateImageView(vulkanDevice->logicalDevice, &imageView, nullptr, &attachment.view));
+			VK_CHECK_RESULT(vkCreateImageView(vulkanDevice->logicalDevice, &imageView, allocationCallbacks(HostAllocationScope::Resource), &attachment.view));
 
 			// Fill attachment description
 			attachment.description = {};
@@ -226,6 +455,31 @@ namespace vks
 			return static_cast<uint32_t>(attachments.size() - 1);
 		}
 
+		/** @brief Memory used by all attachments of this framebuffer */
+		vks::AttachmentMemoryStatistics getMemoryStatistics() const
+		{
+			vks::AttachmentMemoryStatistics total;
+			for (auto& statistics : memoryStatistics)
+			{
+				total.add(statistics.second);
+			}
+			return total;
+		}
+
+		/** @brief Print the memory used and saved by transient and aliased attachments, per attachment resolution */
+		void printMemoryStatistics() const
+		{
+			std::cout << "Framebuffer " << width << "x" << height << ": ";
+			getMemoryStatistics().print(std::cout);
+			std::cout << std::endl;
+			for (auto& statistics : memoryStatistics)
+			{
+				std::cout << "  " << statistics.first.first << "x" << statistics.first.second << ": ";
+				statistics.second.print(std::cout);
+				std::cout << std::endl;
+			}
+		}
+
 		/**
 		* Creates a default sampler for sampling from any of the framebuffer attachments
 		* Applications are free to create their own samplers for different use cases 
@@ -250,7 +504,7 @@ namespace vks
 			samplerInfo.minLod = 0.0f;
 			samplerInfo.maxLod = 1.0f;
 			samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-			return vkCreateSampler(vulkanDevice->logicalDevice, &samplerInfo, nullptr, &sampler);
+			return vkCreateSampler(vulkanDevice->logicalDevice, &samplerInfo, allocationCallbacks(HostAllocationScope::Descriptor), &sampler);
 		}
 
 		/**
@@ -333,7 +587,7 @@ namespace vks
 			renderPassInfo.pSubpasses = &subpass;
 			renderPassInfo.dependencyCount = 2;
 			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(vulkanDevice->logicalDevice, &renderPassInfo, nullptr, &renderPass));
+			VK_CHECK_RESULT(vkCreateRenderPass(vulkanDevice->logicalDevice, &renderPassInfo, allocationCallbacks(HostAllocationScope::Pipeline), &renderPass));
 
 			std::vector<VkImageView> attachmentViews;
 			for (auto attachment : attachments)
@@ -359,7 +613,7 @@ namespace vks
 			framebufferInfo.width = width;
 			framebufferInfo.height = height;
 			framebufferInfo.layers = maxLayers;
-			VK_CHECK_RESULT(vkCreateFramebuffer(vulkanDevice->logicalDevice, &framebufferInfo, nullptr, &framebuffer));
+			VK_CHECK_RESULT(vkCreateFramebuffer(vulkanDevice->logicalDevice, &framebufferInfo, allocationCallbacks(HostAllocationScope::Resource), &framebuffer));
 
 			return VK_SUCCESS;
 		}
@@ -0,0 +1,105 @@
+/*
+* Per-frame transient ring buffer
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanFrameRingBuffer.h"
+#include "VulkanDevice.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace vks
+{
+	namespace
+	{
+		// Alignment used when the caller does not ask for one, enough for any vertex or index format
+		const VkDeviceSize DEFAULT_ALIGNMENT = 16;
+	}
+
+	FrameRingBuffer::FrameRingBuffer(VulkanDevice* device, VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usageFlags)
+		: device(device), frameCount(frameCount)
+	{
+		assert(device);
+		assert(frameCount > 0);
+		uniformAlignment = std::max<VkDeviceSize>(device->properties.limits.minUniformBufferOffsetAlignment, DEFAULT_ALIGNMENT);
+		if (usageFlags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+			uniformAlignment = std::max(uniformAlignment, device->properties.limits.minStorageBufferOffsetAlignment);
+		}
+		// Keep every region start aligned so offsets handed out in different frames follow the same pattern
+		this->frameSize = (frameSize + uniformAlignment - 1) & ~(uniformAlignment - 1);
+		VK_CHECK_RESULT(device->createBuffer(usageFlags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->frameSize * frameCount, &buffer, &allocation));
+		assert(allocation.mapped);
+		fences.resize(frameCount, VK_NULL_HANDLE);
+	}
+
+	FrameRingBuffer::~FrameRingBuffer()
+	{
+		if (buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(device->logicalDevice, buffer, allocationCallbacks(HostAllocationScope::Resource));
+		}
+		allocation.free();
+	}
+
+	void FrameRingBuffer::beginFrame()
+	{
+		VkFence& fence = fences[frameIndex];
+		if (fence != VK_NULL_HANDLE) {
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+			fence = VK_NULL_HANDLE;
+		}
+		head.store(0, std::memory_order_relaxed);
+	}
+
+	void FrameRingBuffer::endFrame(VkFence fence)
+	{
+		peakBytes = std::max(peakBytes, head.load(std::memory_order_relaxed));
+		fences[frameIndex] = fence;
+		frameIndex = (frameIndex + 1) % frameCount;
+	}
+
+	RingAllocation FrameRingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		RingAllocation result;
+		if (alignment == 0) {
+			alignment = DEFAULT_ALIGNMENT;
+		}
+		VkDeviceSize current = head.load(std::memory_order_relaxed);
+		VkDeviceSize offset;
+		do {
+			offset = (current + alignment - 1) / alignment * alignment;
+			if (offset + size > frameSize) {
+				std::cerr << "Frame ring buffer exhausted: requested " << size << " bytes, " << (frameSize - current) << " of " << frameSize << " left" << std::endl;
+				return result;
+			}
+		} while (!head.compare_exchange_weak(current, offset + size, std::memory_order_relaxed));
+
+		result.buffer = buffer;
+		result.offset = frameSize * frameIndex + offset;
+		result.size = size;
+		result.mapped = static_cast<uint8_t*>(allocation.mapped) + result.offset;
+		return result;
+	}
+
+	RingAllocation FrameRingBuffer::allocateUniform(VkDeviceSize size)
+	{
+		assert(size <= device->properties.limits.maxUniformBufferRange);
+		return allocate(size, uniformAlignment);
+	}
+
+	RingAllocation FrameRingBuffer::upload(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+	{
+		RingAllocation result = allocate(size, alignment);
+		if (result.valid()) {
+			memcpy(result.mapped, data, static_cast<size_t>(size));
+		}
+		return result;
+	}
+
+	VkDescriptorBufferInfo FrameRingBuffer::descriptor(VkDeviceSize range) const
+	{
+		return { buffer, 0, range };
+	}
+}
@@ -0,0 +1,100 @@
+/*
+* Per-frame transient ring buffer
+*
+* One persistently mapped buffer split into a fixed region per frame in flight. Each region is a linear allocator
+* for data that only lives for one frame (uniforms, transient vertex/index data, debug geometry) and is reclaimed
+* as a whole once the fence of the frame that used it has signaled.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	/** @brief Sub-range of the ring buffer that is valid until the frame it was allocated in has finished on the GPU */
+	struct RingAllocation
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		/** @brief Offset from the start of the ring buffer, to be used as dynamic offset or bind offset */
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		bool valid() const { return buffer != VK_NULL_HANDLE; }
+		uint32_t dynamicOffset() const { return static_cast<uint32_t>(offset); }
+	};
+
+	class FrameRingBuffer
+	{
+	public:
+		/**
+		* Create the ring buffer
+		*
+		* @param device Device to create the buffer on
+		* @param frameSize Number of bytes available to each frame
+		* @param frameCount Number of frames that may be in flight at the same time
+		* @param usageFlags Usage of the ring buffer, defaults to everything transient per-frame data is used for
+		*/
+		FrameRingBuffer(VulkanDevice* device, VkDeviceSize frameSize, uint32_t frameCount = 2, VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		~FrameRingBuffer();
+
+		/**
+		* Start a new frame and reclaim its region
+		* @note Waits for the fence passed to endFrame() the last time this region was used, so call it before that fence is reset
+		*/
+		void beginFrame();
+		/**
+		* Finish the current frame
+		* @param fence Fence that signals once the GPU has consumed everything allocated this frame
+		*/
+		void endFrame(VkFence fence);
+
+		/** @brief Allocate a sub-range of the current frame's region, returns an invalid allocation if the region is exhausted */
+		RingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+		/** @brief Allocate a sub-range that can be bound as (dynamic) uniform buffer */
+		RingAllocation allocateUniform(VkDeviceSize size);
+		/** @brief Allocate a sub-range and copy data into it */
+		RingAllocation upload(const void* data, VkDeviceSize size, VkDeviceSize alignment = 0);
+		template<typename T> RingAllocation pushUniform(const T& data)
+		{
+			RingAllocation allocation = allocateUniform(sizeof(T));
+			if (allocation.valid()) {
+				memcpy(allocation.mapped, &data, sizeof(T));
+			}
+			return allocation;
+		}
+
+		/** @brief Descriptor for binding the ring buffer as dynamic uniform buffer, range is the largest block a shader reads per draw */
+		VkDescriptorBufferInfo descriptor(VkDeviceSize range) const;
+
+		VkBuffer getBuffer() const { return buffer; }
+		uint32_t getFrameIndex() const { return frameIndex; }
+		VkDeviceSize getFrameSize() const { return frameSize; }
+		/** @brief Bytes handed out in the current frame (including alignment padding) */
+		VkDeviceSize getUsedBytes() const { return head.load(std::memory_order_relaxed); }
+		/** @brief Highest number of bytes any frame has used so far */
+		VkDeviceSize getPeakBytes() const { return peakBytes; }
+
+	private:
+		VulkanDevice* device;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation allocation;
+		VkDeviceSize frameSize;
+		VkDeviceSize uniformAlignment;
+		uint32_t frameCount;
+		uint32_t frameIndex = 0;
+		/** @brief Fence guarding each region, VK_NULL_HANDLE while the region is not in use by the GPU */
+		std::vector<VkFence> fences;
+		/** @brief Allocation head within the current region, atomic so command buffers can be recorded on multiple threads */
+		std::atomic<VkDeviceSize> head{ 0 };
+		VkDeviceSize peakBytes = 0;
+	};
+}
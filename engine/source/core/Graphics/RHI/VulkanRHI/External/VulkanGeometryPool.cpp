@@ -0,0 +1,191 @@
+/*
+* Shared vertex and index buffers
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanGeometryPool.h"
+#include "VulkanDevice.h"
+#include "VulkanDeletionQueue.h"
+#include "VulkanCommandRecorder.h"
+#include "Tools.h"
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+
+namespace vks
+{
+	GeometryPool::RangeAllocator::RangeAllocator(uint32_t capacity) : capacity(capacity)
+	{
+		freeRanges[0] = capacity;
+	}
+
+	bool GeometryPool::RangeAllocator::allocate(uint32_t count, uint32_t* offset)
+	{
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			if (it->second >= count)
+			{
+				*offset = it->first;
+				const uint32_t remaining = it->second - count;
+				freeRanges.erase(it);
+				if (remaining > 0)
+				{
+					freeRanges[*offset + count] = remaining;
+				}
+				used += count;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void GeometryPool::RangeAllocator::free(uint32_t offset, uint32_t count)
+	{
+		used -= count;
+		auto next = freeRanges.lower_bound(offset);
+		// Merge with the following free range
+		if (next != freeRanges.end() && offset + count == next->first)
+		{
+			count += next->second;
+			next = freeRanges.erase(next);
+		}
+		// Merge with the preceding free range
+		if (next != freeRanges.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				previous->second += count;
+				return;
+			}
+		}
+		freeRanges.emplace_hint(next, offset, count);
+	}
+
+	GeometryPool::GeometryPool(VulkanDevice* device, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, VkBufferUsageFlags usageFlags)
+		: device(device), vertexStride(vertexStride), vertexRanges(vertexCapacity), indexRanges(indexCapacity)
+	{
+		assert(device && vertexCapacity > 0 && indexCapacity > 0);
+		// Transfer source allows models to read their geometry back, on unified memory the pool is also host visible and written in place
+		usageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | usageFlags, device->getStaticMemoryFlags(), static_cast<VkDeviceSize>(vertexCapacity) * vertexStride, &vertexBuffer, &vertexAllocation));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | usageFlags, device->getStaticMemoryFlags(), static_cast<VkDeviceSize>(indexCapacity) * sizeof(uint32_t), &indexBuffer, &indexAllocation));
+	}
+
+	GeometryPool::~GeometryPool()
+	{
+		if (device->deletionQueue)
+		{
+			RetiredResources retired;
+			retired.buffers.push_back(vertexBuffer);
+			retired.allocations.push_back(vertexAllocation);
+			retired.buffers.push_back(indexBuffer);
+			retired.allocations.push_back(indexAllocation);
+			device->deletionQueue->retire(std::move(retired));
+			return;
+		}
+		vkDestroyBuffer(device->logicalDevice, vertexBuffer, allocationCallbacks(HostAllocationScope::Resource));
+		vertexAllocation.free();
+		vkDestroyBuffer(device->logicalDevice, indexBuffer, allocationCallbacks(HostAllocationScope::Resource));
+		indexAllocation.free();
+	}
+
+	bool GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount, GeometryRange* range)
+	{
+		assert(vertexCount > 0 && indexCount > 0);
+		std::lock_guard<std::mutex> lock(mutex);
+		reclaimRetiredRanges();
+		uint32_t firstVertex, firstIndex;
+		if (!vertexRanges.allocate(vertexCount, &firstVertex))
+		{
+			return false;
+		}
+		if (!indexRanges.allocate(indexCount, &firstIndex))
+		{
+			vertexRanges.free(firstVertex, vertexCount);
+			return false;
+		}
+		range->firstVertex = firstVertex;
+		range->vertexCount = vertexCount;
+		range->firstIndex = firstIndex;
+		range->indexCount = indexCount;
+		return true;
+	}
+
+	void GeometryPool::free(GeometryRange& range)
+	{
+		if (!range.valid())
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		vertexRanges.free(range.firstVertex, range.vertexCount);
+		indexRanges.free(range.firstIndex, range.indexCount);
+		range = GeometryRange();
+	}
+
+	void GeometryPool::retire(GeometryRange& range)
+	{
+		if (!range.valid())
+		{
+			return;
+		}
+		if (!device->deletionQueue)
+		{
+			free(range);
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		retiredRanges.push_back({ range, device->deletionQueue->getFrame() });
+		range = GeometryRange();
+	}
+
+	void GeometryPool::reclaimRetiredRanges()
+	{
+		for (size_t i = 0; i < retiredRanges.size();)
+		{
+			const RetiredRange& retired = retiredRanges[i];
+			if (device->deletionQueue->isFrameComplete(retired.frame))
+			{
+				vertexRanges.free(retired.range.firstVertex, retired.range.vertexCount);
+				indexRanges.free(retired.range.firstIndex, retired.range.indexCount);
+				retiredRanges[i] = retiredRanges.back();
+				retiredRanges.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	void GeometryPool::bind(VkCommandBuffer commandBuffer) const
+	{
+		const VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	void GeometryPool::bind(CommandRecorder& recorder) const
+	{
+		const VkDeviceSize offsets[1] = { 0 };
+		recorder.bindVertexBuffers(0, 1, &vertexBuffer, offsets);
+		recorder.bindIndexBuffer(indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	uint32_t GeometryPool::getHeapIndex() const
+	{
+		return device->memoryProperties.memoryTypes[vertexAllocation.memoryTypeIndex].heapIndex;
+	}
+
+	void GeometryPool::printStatistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const double MiB = 1024.0 * 1024.0;
+		std::cout << std::fixed << std::setprecision(1)
+			<< "Geometry pool: vertices " << static_cast<VkDeviceSize>(vertexRanges.getUsed()) * vertexStride / MiB << " of " << static_cast<VkDeviceSize>(vertexRanges.getCapacity()) * vertexStride / MiB << " MiB (" << vertexRanges.getFreeRangeCount() << " free ranges), "
+			<< "indices " << static_cast<VkDeviceSize>(indexRanges.getUsed()) * sizeof(uint32_t) / MiB << " of " << static_cast<VkDeviceSize>(indexRanges.getCapacity()) * sizeof(uint32_t) / MiB << " MiB (" << indexRanges.getFreeRangeCount() << " free ranges)" << std::endl;
+	}
+}
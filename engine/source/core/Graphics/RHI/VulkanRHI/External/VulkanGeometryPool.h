@@ -0,0 +1,114 @@
+/*
+* Shared vertex and index buffers
+*
+* Geometry of many models is sub-allocated from one large device local vertex buffer and one index buffer, so a
+* whole scene can be drawn after binding them once. Ranges are handed out in units of vertices and indices,
+* freed ranges are merged with their neighbours and reused.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include <map>
+#include <vector>
+#include <mutex>
+
+namespace vks
+{
+	struct VulkanDevice;
+	class CommandRecorder;
+
+	/** @brief Part of a geometry pool owned by one model */
+	struct GeometryRange
+	{
+		uint32_t firstVertex = 0;
+		uint32_t vertexCount = 0;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		bool valid() const { return vertexCount > 0; }
+	};
+
+	class GeometryPool
+	{
+	public:
+		/**
+		* Create the shared buffers
+		*
+		* @param device Device the buffers are created on
+		* @param vertexStride Size of one vertex in bytes
+		* @param vertexCapacity Number of vertices the pool can hold
+		* @param indexCapacity Number of 32 bit indices the pool can hold
+		* @param (Optional) usageFlags Additional usage flags of both buffers (e.g. to access them from shaders)
+		*/
+		GeometryPool(VulkanDevice* device, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, VkBufferUsageFlags usageFlags = 0);
+		/** @brief Hands the buffers to the device's deletion queue if it has one, as frames in flight may still draw from them, otherwise the device has to be idle */
+		~GeometryPool();
+		GeometryPool(const GeometryPool&) = delete;
+		GeometryPool& operator=(const GeometryPool&) = delete;
+
+		/**
+		* Reserve room for the geometry of a model
+		* @return False if the pool has no free range large enough for either the vertices or the indices
+		*/
+		bool allocate(uint32_t vertexCount, uint32_t indexCount, GeometryRange* range);
+		/** @brief Return a range to the pool, draws using it must have completed */
+		void free(GeometryRange& range);
+		/** @brief Return a range that frames in flight may still draw from, it is reused once the device's deletion queue has passed the current frame */
+		void retire(GeometryRange& range);
+
+		/** @brief Bind the vertex and index buffer, every model allocated from the pool can be drawn afterwards */
+		void bind(VkCommandBuffer commandBuffer) const;
+		void bind(CommandRecorder& recorder) const;
+
+		VkBuffer getVertexBuffer() const { return vertexBuffer; }
+		VkBuffer getIndexBuffer() const { return indexBuffer; }
+		/** @brief Memory of the buffers, mapped if the pool lives in host visible memory */
+		const Allocation& getVertexAllocation() const { return vertexAllocation; }
+		const Allocation& getIndexAllocation() const { return indexAllocation; }
+		uint32_t getVertexStride() const { return vertexStride; }
+		VkDeviceSize getVertexOffset(const GeometryRange& range) const { return static_cast<VkDeviceSize>(range.firstVertex) * vertexStride; }
+		VkDeviceSize getIndexOffset(const GeometryRange& range) const { return static_cast<VkDeviceSize>(range.firstIndex) * sizeof(uint32_t); }
+		uint32_t getHeapIndex() const;
+
+		void printStatistics();
+
+	private:
+		/** @brief First fit allocator over element ranges, free ranges are kept sorted by offset to merge neighbours */
+		class RangeAllocator
+		{
+		public:
+			explicit RangeAllocator(uint32_t capacity);
+			bool allocate(uint32_t count, uint32_t* offset);
+			void free(uint32_t offset, uint32_t count);
+			uint32_t getUsed() const { return used; }
+			uint32_t getCapacity() const { return capacity; }
+			size_t getFreeRangeCount() const { return freeRanges.size(); }
+		private:
+			std::map<uint32_t, uint32_t> freeRanges;
+			uint32_t capacity;
+			uint32_t used = 0;
+		};
+
+		VulkanDevice* device;
+		uint32_t vertexStride;
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		Allocation vertexAllocation;
+		Allocation indexAllocation;
+		RangeAllocator vertexRanges;
+		RangeAllocator indexRanges;
+		struct RetiredRange
+		{
+			GeometryRange range;
+			uint64_t frame;
+		};
+		/** @brief Ranges given back by retire(), kept by the pool instead of the deletion queue so none can outlive it */
+		std::vector<RetiredRange> retiredRanges;
+		std::mutex mutex;
+
+		void reclaimRetiredRanges();
+	};
+}
@@ -0,0 +1,382 @@
+/*
+* Host allocation callbacks for the Vulkan driver
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanHostAllocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+	namespace
+	{
+		// Size classes are powers of two from 16 bytes to 4 KiB, larger requests go to the process heap
+		const uint32_t SIZE_CLASS_COUNT = 9;
+		const size_t MIN_CLASS_SIZE = 16;
+		const size_t MAX_CLASS_SIZE = MIN_CLASS_SIZE << (SIZE_CLASS_COUNT - 1);
+		const uint8_t LARGE_CLASS = 0xFF;
+		// Blocks of a size class are carved from slabs of this size, slabs are kept for the lifetime of the process
+		const size_t SLAB_SIZE = 64 * 1024;
+		// Each thread keeps up to CACHE_CAPACITY free blocks per size class and moves CACHE_BATCH at a time from and to the shared pool
+		const uint32_t CACHE_CAPACITY = 64;
+		const uint32_t CACHE_BATCH = 32;
+
+		/** @brief Stored in front of every allocation, so free and reallocation know where it came from */
+		struct Header
+		{
+			uint64_t size;
+			uint16_t offset;
+			uint8_t sizeClass;
+			uint8_t scope;
+			uint32_t reserved;
+		};
+		static_assert(sizeof(Header) == MIN_CLASS_SIZE, "Header has to fill exactly one minimum alignment unit");
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		struct SizeClassPool
+		{
+			std::mutex mutex;
+			FreeBlock* freeList = nullptr;
+			std::vector<void*> slabs;
+		};
+
+		struct ScopeCounters
+		{
+			std::atomic<size_t> currentBytes{ 0 };
+			std::atomic<size_t> peakBytes{ 0 };
+			std::atomic<size_t> internalBytes{ 0 };
+			std::atomic<uint64_t> allocationCount{ 0 };
+			std::atomic<uint64_t> liveAllocations{ 0 };
+		};
+
+		struct State
+		{
+			SizeClassPool pools[SIZE_CLASS_COUNT];
+			ScopeCounters counters[static_cast<uint32_t>(HostAllocationScope::Count)];
+			VkAllocationCallbacks callbacks[static_cast<uint32_t>(HostAllocationScope::Count)];
+			bool enabled = true;
+		};
+
+		State& state();
+
+		/** @brief Free blocks owned by one thread, handed back to the shared pools when the thread exits */
+		struct ThreadCache
+		{
+			FreeBlock* lists[SIZE_CLASS_COUNT] = {};
+			uint32_t counts[SIZE_CLASS_COUNT] = {};
+
+			~ThreadCache()
+			{
+				for (uint32_t sizeClass = 0; sizeClass < SIZE_CLASS_COUNT; sizeClass++)
+				{
+					release(sizeClass, counts[sizeClass]);
+				}
+			}
+
+			void release(uint32_t sizeClass, uint32_t count)
+			{
+				if (count == 0)
+				{
+					return;
+				}
+				FreeBlock* first = lists[sizeClass];
+				FreeBlock* last = first;
+				for (uint32_t i = 1; i < count; i++)
+				{
+					last = last->next;
+				}
+				lists[sizeClass] = last->next;
+				counts[sizeClass] -= count;
+
+				SizeClassPool& pool = state().pools[sizeClass];
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				last->next = pool.freeList;
+				pool.freeList = first;
+			}
+
+			void refill(uint32_t sizeClass)
+			{
+				const size_t blockSize = MIN_CLASS_SIZE << sizeClass;
+				SizeClassPool& pool = state().pools[sizeClass];
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				if (!pool.freeList)
+				{
+					uint8_t* slab = static_cast<uint8_t*>(std::malloc(SLAB_SIZE));
+					if (!slab)
+					{
+						return;
+					}
+					pool.slabs.push_back(slab);
+					for (size_t offset = SLAB_SIZE; offset >= blockSize; offset -= blockSize)
+					{
+						FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + offset - blockSize);
+						block->next = pool.freeList;
+						pool.freeList = block;
+					}
+				}
+				for (uint32_t i = 0; i < CACHE_BATCH && pool.freeList; i++)
+				{
+					FreeBlock* block = pool.freeList;
+					pool.freeList = block->next;
+					block->next = lists[sizeClass];
+					lists[sizeClass] = block;
+					counts[sizeClass]++;
+				}
+			}
+		};
+
+		thread_local ThreadCache threadCache;
+
+		uint32_t getSizeClass(size_t size)
+		{
+			uint32_t sizeClass = 0;
+			while ((MIN_CLASS_SIZE << sizeClass) < size)
+			{
+				sizeClass++;
+			}
+			return sizeClass;
+		}
+
+		void* allocateBlock(uint32_t sizeClass)
+		{
+			ThreadCache& cache = threadCache;
+			if (!cache.lists[sizeClass])
+			{
+				cache.refill(sizeClass);
+				if (!cache.lists[sizeClass])
+				{
+					return nullptr;
+				}
+			}
+			FreeBlock* block = cache.lists[sizeClass];
+			cache.lists[sizeClass] = block->next;
+			cache.counts[sizeClass]--;
+			return block;
+		}
+
+		void freeBlock(void* memory, uint32_t sizeClass)
+		{
+			ThreadCache& cache = threadCache;
+			FreeBlock* block = static_cast<FreeBlock*>(memory);
+			block->next = cache.lists[sizeClass];
+			cache.lists[sizeClass] = block;
+			cache.counts[sizeClass]++;
+			if (cache.counts[sizeClass] > CACHE_CAPACITY)
+			{
+				cache.release(sizeClass, CACHE_BATCH);
+			}
+		}
+
+		ScopeCounters& counters(void* userData)
+		{
+			return state().counters[static_cast<uint32_t>(reinterpret_cast<uintptr_t>(userData))];
+		}
+
+		void addBytes(ScopeCounters& scopeCounters, size_t size)
+		{
+			const size_t current = scopeCounters.currentBytes.fetch_add(size) + size;
+			size_t peak = scopeCounters.peakBytes.load();
+			while (current > peak && !scopeCounters.peakBytes.compare_exchange_weak(peak, current))
+			{
+			}
+		}
+
+		void* VKAPI_PTR allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope /*allocationScope*/)
+		{
+			// Blocks are at least 16 byte aligned, the header goes right in front of the returned pointer
+			alignment = std::max(alignment, MIN_CLASS_SIZE);
+			assert(alignment <= UINT16_MAX / 2);
+			const size_t total = size + sizeof(Header) + (alignment - MIN_CLASS_SIZE);
+			uint8_t sizeClass = LARGE_CLASS;
+			void* raw;
+			if (total <= MAX_CLASS_SIZE)
+			{
+				sizeClass = static_cast<uint8_t>(getSizeClass(total));
+				raw = allocateBlock(sizeClass);
+			}
+			else
+			{
+				raw = std::malloc(total);
+			}
+			if (!raw)
+			{
+				return nullptr;
+			}
+
+			const uintptr_t address = (reinterpret_cast<uintptr_t>(raw) + sizeof(Header) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+			Header* header = reinterpret_cast<Header*>(address) - 1;
+			header->size = size;
+			header->offset = static_cast<uint16_t>(address - reinterpret_cast<uintptr_t>(raw));
+			header->sizeClass = sizeClass;
+			header->scope = static_cast<uint8_t>(reinterpret_cast<uintptr_t>(userData));
+
+			ScopeCounters& scopeCounters = counters(userData);
+			addBytes(scopeCounters, size);
+			scopeCounters.allocationCount++;
+			scopeCounters.liveAllocations++;
+			return reinterpret_cast<void*>(address);
+		}
+
+		void VKAPI_PTR free(void* /*userData*/, void* memory)
+		{
+			if (!memory)
+			{
+				return;
+			}
+			Header* header = static_cast<Header*>(memory) - 1;
+			// Memory may be freed with the callbacks of another scope, so the counters are taken from the header
+			ScopeCounters& scopeCounters = state().counters[header->scope];
+			scopeCounters.currentBytes -= static_cast<size_t>(header->size);
+			scopeCounters.liveAllocations--;
+
+			void* raw = static_cast<uint8_t*>(memory) - header->offset;
+			if (header->sizeClass == LARGE_CLASS)
+			{
+				std::free(raw);
+			}
+			else
+			{
+				freeBlock(raw, header->sizeClass);
+			}
+		}
+
+		void* VKAPI_PTR reallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope allocationScope)
+		{
+			if (!original)
+			{
+				return allocate(userData, size, alignment, allocationScope);
+			}
+			if (size == 0)
+			{
+				free(userData, original);
+				return nullptr;
+			}
+
+			Header* header = static_cast<Header*>(original) - 1;
+			// Grow or shrink in place if the block still fits and is aligned as requested
+			if (header->sizeClass != LARGE_CLASS && (MIN_CLASS_SIZE << header->sizeClass) - header->offset >= size && reinterpret_cast<uintptr_t>(original) % std::max(alignment, MIN_CLASS_SIZE) == 0)
+			{
+				ScopeCounters& scopeCounters = state().counters[header->scope];
+				scopeCounters.currentBytes -= static_cast<size_t>(header->size);
+				addBytes(scopeCounters, size);
+				header->size = size;
+				return original;
+			}
+
+			void* memory = allocate(userData, size, alignment, allocationScope);
+			if (memory)
+			{
+				memcpy(memory, original, std::min(static_cast<size_t>(header->size), size));
+				free(userData, original);
+			}
+			return memory;
+		}
+
+		void VKAPI_PTR internalAllocation(void* userData, size_t size, VkInternalAllocationType /*allocationType*/, VkSystemAllocationScope /*allocationScope*/)
+		{
+			counters(userData).internalBytes += size;
+		}
+
+		void VKAPI_PTR internalFree(void* userData, size_t size, VkInternalAllocationType /*allocationType*/, VkSystemAllocationScope /*allocationScope*/)
+		{
+			counters(userData).internalBytes -= size;
+		}
+
+		State& state()
+		{
+			// Never destroyed, thread caches may hand back blocks during static destruction
+			static State* instance = []() {
+				State* newState = new State();
+				for (uint32_t scope = 0; scope < static_cast<uint32_t>(HostAllocationScope::Count); scope++)
+				{
+					VkAllocationCallbacks& callbacks = newState->callbacks[scope];
+					callbacks.pUserData = reinterpret_cast<void*>(static_cast<uintptr_t>(scope));
+					callbacks.pfnAllocation = allocate;
+					callbacks.pfnReallocation = reallocate;
+					callbacks.pfnFree = free;
+					callbacks.pfnInternalAllocation = internalAllocation;
+					callbacks.pfnInternalFree = internalFree;
+				}
+				return newState;
+			}();
+			return *instance;
+		}
+	}
+
+	const char* hostAllocationScopeName(HostAllocationScope scope)
+	{
+		switch (scope)
+		{
+		case HostAllocationScope::Instance: return "instance";
+		case HostAllocationScope::Device: return "device";
+		case HostAllocationScope::Pipeline: return "pipeline";
+		case HostAllocationScope::Descriptor: return "descriptor";
+		case HostAllocationScope::Command: return "command";
+		case HostAllocationScope::Resource: return "resource";
+		default: return "unknown";
+		}
+	}
+
+	const VkAllocationCallbacks* HostAllocator::callbacks(HostAllocationScope scope)
+	{
+		State& current = state();
+		return current.enabled ? &current.callbacks[static_cast<uint32_t>(scope)] : nullptr;
+	}
+
+	void HostAllocator::setEnabled(bool enabled)
+	{
+		state().enabled = enabled;
+	}
+
+	bool HostAllocator::isEnabled()
+	{
+		return state().enabled;
+	}
+
+	HostAllocationStatistics HostAllocator::getStatistics(HostAllocationScope scope)
+	{
+		const ScopeCounters& scopeCounters = state().counters[static_cast<uint32_t>(scope)];
+		HostAllocationStatistics statistics;
+		statistics.currentBytes = scopeCounters.currentBytes.load();
+		statistics.peakBytes = scopeCounters.peakBytes.load();
+		statistics.internalBytes = scopeCounters.internalBytes.load();
+		statistics.allocationCount = scopeCounters.allocationCount.load();
+		statistics.liveAllocations = scopeCounters.liveAllocations.load();
+		return statistics;
+	}
+
+	void HostAllocator::printStatistics()
+	{
+		const double KiB = 1024.0;
+		size_t slabCount = 0;
+		for (SizeClassPool& pool : state().pools)
+		{
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			slabCount += pool.slabs.size();
+		}
+		std::cout << "Driver host memory (" << slabCount << " pool slabs, " << slabCount * SLAB_SIZE / KiB << " KiB):" << std::endl;
+		for (uint32_t scope = 0; scope < static_cast<uint32_t>(HostAllocationScope::Count); scope++)
+		{
+			const HostAllocationStatistics statistics = getStatistics(static_cast<HostAllocationScope>(scope));
+			std::cout << std::fixed << std::setprecision(1)
+				<< "  " << hostAllocationScopeName(static_cast<HostAllocationScope>(scope)) << ": "
+				<< statistics.currentBytes / KiB << " KiB in " << statistics.liveAllocations << " allocations, "
+				<< "peak " << statistics.peakBytes / KiB << " KiB, "
+				<< statistics.internalBytes / KiB << " KiB internal, "
+				<< statistics.allocationCount << " allocations total" << std::endl;
+		}
+	}
+}
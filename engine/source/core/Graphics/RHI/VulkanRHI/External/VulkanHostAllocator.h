@@ -0,0 +1,73 @@
+/*
+* Host allocation callbacks for the Vulkan driver
+*
+* Host memory the driver allocates for Vulkan objects is taken from size class pools with thread local caches
+* instead of the process heap, and counted per object category so it shows up in the engine's statistics.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace vks
+{
+	/** @brief Category of Vulkan objects the driver's host memory is accounted to */
+	enum class HostAllocationScope : uint32_t
+	{
+		/** @brief Instance and instance level objects (surfaces, debug messengers) */
+		Instance = 0,
+		/** @brief Device, device memory and swapchain */
+		Device,
+		/** @brief Pipelines, pipeline layouts and caches, shader modules and render passes */
+		Pipeline,
+		/** @brief Descriptor pools, set layouts and samplers */
+		Descriptor,
+		/** @brief Command pools and synchronization objects */
+		Command,
+		/** @brief Buffers, images, views and framebuffers */
+		Resource,
+		Count
+	};
+
+	const char* hostAllocationScopeName(HostAllocationScope scope);
+
+	struct HostAllocationStatistics
+	{
+		/** @brief Bytes currently allocated through the callbacks */
+		size_t currentBytes = 0;
+		size_t peakBytes = 0;
+		/** @brief Bytes the driver reported to have allocated itself (pfnInternalAllocation) */
+		size_t internalBytes = 0;
+		uint64_t allocationCount = 0;
+		uint64_t liveAllocations = 0;
+	};
+
+	class HostAllocator
+	{
+	public:
+		/**
+		* Get the allocation callbacks for a category of objects
+		* @return Callbacks to pass to vkCreate* and the matching vkDestroy* call, nullptr if the host allocator is disabled
+		*/
+		static const VkAllocationCallbacks* callbacks(HostAllocationScope scope);
+		/**
+		* Route driver allocations through the engine (default) or the driver's own allocator
+		* @note Has to be set before the first Vulkan object is created, objects must be destroyed with the callbacks they were created with
+		*/
+		static void setEnabled(bool enabled);
+		static bool isEnabled();
+
+		static HostAllocationStatistics getStatistics(HostAllocationScope scope);
+		static void printStatistics();
+	};
+
+	/** @brief Shorthand for HostAllocator::callbacks() */
+	inline const VkAllocationCallbacks* allocationCallbacks(HostAllocationScope scope)
+	{
+		return HostAllocator::callbacks(scope);
+	}
+}
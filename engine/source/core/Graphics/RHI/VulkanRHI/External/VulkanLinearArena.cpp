@@ -0,0 +1,173 @@
+/*
+* Linear arena for transient CPU allocations
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanLinearArena.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#if defined(BH_TRACK_HEAP_ALLOCATIONS)
+namespace
+{
+	std::atomic<uint64_t> heapAllocationCount{ 0 };
+}
+
+// Replacing the global operators counts every allocation of the process, array and nothrow forms forward to these
+void* operator new(size_t size)
+{
+	heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = std::malloc(size > 0 ? size : 1))
+	{
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+#endif
+
+namespace vks
+{
+	LinearArena::LinearArena(size_t chunkSize) : chunkSize(chunkSize)
+	{
+	}
+
+	LinearArena::~LinearArena()
+	{
+		for (Chunk& chunk : chunks)
+		{
+			std::free(chunk.data);
+		}
+	}
+
+	LinearArena& LinearArena::threadLocal()
+	{
+		thread_local LinearArena arena;
+		return arena;
+	}
+
+	void LinearArena::addChunk(size_t minSize)
+	{
+		Chunk chunk;
+		chunk.size = std::max(chunkSize, minSize);
+		chunk.data = static_cast<uint8_t*>(std::malloc(chunk.size));
+		if (!chunk.data)
+		{
+			throw std::bad_alloc();
+		}
+		chunkAllocations++;
+		chunks.insert(chunks.begin() + (chunks.empty() ? 0 : current + 1), chunk);
+	}
+
+	size_t LinearArena::alignOffset(size_t chunk, size_t offset, size_t alignment) const
+	{
+		const uintptr_t address = reinterpret_cast<uintptr_t>(chunks[chunk].data) + offset;
+		return offset + ((alignment - address % alignment) % alignment);
+	}
+
+	void* LinearArena::allocate(size_t size, size_t alignment)
+	{
+		assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+		if (chunks.empty())
+		{
+			addChunk(size + alignment);
+		}
+		else if (alignOffset(current, offset, alignment) + size > chunks[current].size)
+		{
+			// Continue in the next chunk, chunks kept from earlier frames are reused if they are large enough
+			if (current + 1 >= chunks.size() || chunks[current + 1].size < size + alignment)
+			{
+				addChunk(size + alignment);
+			}
+			current++;
+			offset = 0;
+		}
+		const size_t alignedOffset = alignOffset(current, offset, alignment);
+		offset = alignedOffset + size;
+		peakUsed = std::max(peakUsed, getUsed());
+		return chunks[current].data + alignedOffset;
+	}
+
+	LinearArena::Marker LinearArena::getMarker() const
+	{
+		Marker marker;
+		marker.chunk = current;
+		marker.offset = offset;
+		return marker;
+	}
+
+	void LinearArena::rewind(const Marker& marker)
+	{
+		assert(marker.chunk < current || (marker.chunk == current && marker.offset <= offset));
+		current = marker.chunk;
+		offset = marker.offset;
+	}
+
+	void LinearArena::reset()
+	{
+		if (chunks.size() > 1)
+		{
+			// Replace the chunks with a single one that holds everything the busiest frame so far needed
+			for (Chunk& chunk : chunks)
+			{
+				std::free(chunk.data);
+			}
+			chunks.clear();
+			current = 0;
+			addChunk(peakUsed);
+		}
+		current = 0;
+		offset = 0;
+	}
+
+	size_t LinearArena::getUsed() const
+	{
+		size_t used = offset;
+		for (size_t i = 0; i < current; i++)
+		{
+			used += chunks[i].size;
+		}
+		return used;
+	}
+
+	size_t LinearArena::getCapacity() const
+	{
+		size_t capacity = 0;
+		for (const Chunk& chunk : chunks)
+		{
+			capacity += chunk.size;
+		}
+		return capacity;
+	}
+
+	uint64_t getHeapAllocationCount()
+	{
+#if defined(BH_TRACK_HEAP_ALLOCATIONS)
+		return heapAllocationCount.load(std::memory_order_relaxed);
+#else
+		return 0;
+#endif
+	}
+
+	bool isHeapAllocationTrackingEnabled()
+	{
+#if defined(BH_TRACK_HEAP_ALLOCATIONS)
+		return true;
+#else
+		return false;
+#endif
+	}
+}
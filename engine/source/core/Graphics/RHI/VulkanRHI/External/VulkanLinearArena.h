@@ -0,0 +1,122 @@
+/*
+* Linear arena for transient CPU allocations
+*
+* Hands out memory by bumping an offset into large chunks and releases everything at once, either by resetting the
+* arena (once per frame) or by rewinding to a marker when a scope ends. Every thread has its own arena, so no locking
+* is needed. Containers can draw from an arena through ArenaAllocator.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vks
+{
+	class LinearArena
+	{
+	public:
+		/** @brief Position in the arena, everything allocated after it is released by rewind() */
+		struct Marker
+		{
+			size_t chunk = 0;
+			size_t offset = 0;
+		};
+
+		explicit LinearArena(size_t chunkSize = 256 * 1024);
+		~LinearArena();
+		LinearArena(const LinearArena&) = delete;
+		LinearArena& operator=(const LinearArena&) = delete;
+
+		/** @brief Arena of the calling thread */
+		static LinearArena& threadLocal();
+
+		void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+		/** @brief Uninitialized storage for count objects of type T */
+		template<typename T>
+		T* allocate(size_t count)
+		{
+			return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+		}
+
+		Marker getMarker() const;
+		void rewind(const Marker& marker);
+		/**
+		* Release all allocations, meant to be called once per frame
+		* @note If the last frame needed more than one chunk they are merged into one, so the next frame fits without allocating
+		*/
+		void reset();
+
+		/** @brief Bytes handed out since the last reset */
+		size_t getUsed() const;
+		size_t getCapacity() const;
+		/** @brief Number of chunks requested from the heap over the lifetime of the arena */
+		uint64_t getChunkAllocations() const { return chunkAllocations; }
+
+	private:
+		struct Chunk
+		{
+			uint8_t* data;
+			size_t size;
+		};
+		std::vector<Chunk> chunks;
+		size_t current = 0;
+		size_t offset = 0;
+		size_t chunkSize;
+		size_t peakUsed = 0;
+		uint64_t chunkAllocations = 0;
+
+		void addChunk(size_t minSize);
+		size_t alignOffset(size_t chunk, size_t offset, size_t alignment) const;
+	};
+
+	/** @brief Rewinds an arena to where it was when the scope was entered */
+	class ArenaScope
+	{
+	public:
+		explicit ArenaScope(LinearArena& arena = LinearArena::threadLocal()) : arena(arena), marker(arena.getMarker()) {}
+		~ArenaScope() { arena.rewind(marker); }
+		ArenaScope(const ArenaScope&) = delete;
+		ArenaScope& operator=(const ArenaScope&) = delete;
+
+		LinearArena& arena;
+
+	private:
+		LinearArena::Marker marker;
+	};
+
+	/** @brief STL allocator drawing from a linear arena, deallocation is a no-op */
+	template<typename T>
+	class ArenaAllocator
+	{
+	public:
+		using value_type = T;
+
+		ArenaAllocator(LinearArena& arena = LinearArena::threadLocal()) : arena(&arena) {}
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+		T* allocate(size_t count) { return arena->allocate<T>(count); }
+		void deallocate(T*, size_t) {}
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+		LinearArena* arena;
+	};
+
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+	/**
+	* Number of general heap allocations (operator new) made by the process so far
+	* @note Only counted if the engine is built with BH_TRACK_HEAP_ALLOCATIONS defined, 0 otherwise
+	*/
+	uint64_t getHeapAllocationCount();
+	bool isHeapAllocationTrackingEnabled();
+}
@@ -0,0 +1,821 @@
+/*
+* Vulkan device memory sub-allocator
+*
+* Hands out sub-ranges of large VkDeviceMemory blocks instead of calling vkAllocateMemory for every resource.
+* Every memory type has its own pools and each block is managed with a two-level segregated fit (TLSF) free list.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanMemoryAllocator.h"
+#include "VulkanDevice.h"
+#include "Tools.h"
+#include "VulkanInitializers.hpp"
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace vks
+{
+	namespace
+	{
+		// Number of second level subdivisions of each power of two size class
+		const uint32_t SL_INDEX_COUNT_LOG2 = 5;
+		const uint32_t SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2;
+		// All sizes below this share first level index 0 and are split linearly
+		const uint32_t SMALL_SIZE_LOG2 = 8;
+		const VkDeviceSize SMALL_SIZE = VkDeviceSize(1) << SMALL_SIZE_LOG2;
+		// Enough first level classes for blocks of up to 2^48 bytes
+		const uint32_t FL_INDEX_COUNT = 48 - SMALL_SIZE_LOG2 + 1;
+		// Free space smaller than this stays attached to the allocation instead of becoming its own range
+		const VkDeviceSize MIN_SPLIT_SIZE = 16;
+
+		inline uint32_t lowestBit(uint64_t mask)
+		{
+			assert(mask != 0);
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward64(&index, mask);
+			return static_cast<uint32_t>(index);
+#else
+			return static_cast<uint32_t>(__builtin_ctzll(mask));
+#endif
+		}
+
+		inline uint32_t highestBit(uint64_t value)
+		{
+			assert(value != 0);
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanReverse64(&index, value);
+			return static_cast<uint32_t>(index);
+#else
+			return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+		}
+
+		inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		const char* allocationTypeName(AllocationType type)
+		{
+			return type == AllocationType::Optimal ? "optimal images" : "buffers/linear";
+		}
+	}
+
+	/** @brief Physically contiguous range inside a block, either free or handed out as an allocation */
+	struct MemoryChunk
+	{
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		MemoryChunk* prevPhysical = nullptr;
+		MemoryChunk* nextPhysical = nullptr;
+		MemoryChunk* prevFree = nullptr;
+		MemoryChunk* nextFree = nullptr;
+		bool free = true;
+	};
+
+	/**
+	* @brief One VkDeviceMemory allocation that is split into chunks
+	* @note Adjacent free chunks are always merged, so a free chunk never has a free physical neighbour
+	*/
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		AllocationType type = AllocationType::Linear;
+		uint8_t* mapped = nullptr;
+		bool dedicated = false;
+		/** @brief Block is being emptied by a defragmentation pass, no new allocations are placed in it */
+		bool compacting = false;
+		uint32_t allocationCount = 0;
+		VkDeviceSize freeBytes = 0;
+		MemoryChunk* firstChunk = nullptr;
+
+		uint64_t flBitmap = 0;
+		uint32_t slBitmap[FL_INDEX_COUNT] = {};
+		MemoryChunk* freeLists[FL_INDEX_COUNT][SL_INDEX_COUNT] = {};
+
+		void init()
+		{
+			firstChunk = new MemoryChunk();
+			firstChunk->size = size;
+			freeBytes = size;
+			insertFree(firstChunk);
+		}
+
+		void release()
+		{
+			MemoryChunk* chunk = firstChunk;
+			while (chunk)
+			{
+				MemoryChunk* next = chunk->nextPhysical;
+				delete chunk;
+				chunk = next;
+			}
+			firstChunk = nullptr;
+		}
+
+		static void mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+		{
+			if (size < SMALL_SIZE)
+			{
+				fl = 0;
+				sl = static_cast<uint32_t>(size / (SMALL_SIZE / SL_INDEX_COUNT));
+			}
+			else
+			{
+				uint32_t msb = highestBit(size);
+				sl = static_cast<uint32_t>(size >> (msb - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+				fl = msb - SMALL_SIZE_LOG2 + 1;
+			}
+		}
+
+		void insertFree(MemoryChunk* chunk)
+		{
+			uint32_t fl, sl;
+			mapping(chunk->size, fl, sl);
+			chunk->free = true;
+			chunk->prevFree = nullptr;
+			chunk->nextFree = freeLists[fl][sl];
+			if (chunk->nextFree)
+			{
+				chunk->nextFree->prevFree = chunk;
+			}
+			freeLists[fl][sl] = chunk;
+			flBitmap |= uint64_t(1) << fl;
+			slBitmap[fl] |= 1u << sl;
+		}
+
+		void removeFree(MemoryChunk* chunk)
+		{
+			uint32_t fl, sl;
+			mapping(chunk->size, fl, sl);
+			if (chunk->prevFree)
+			{
+				chunk->prevFree->nextFree = chunk->nextFree;
+			}
+			if (chunk->nextFree)
+			{
+				chunk->nextFree->prevFree = chunk->prevFree;
+			}
+			if (freeLists[fl][sl] == chunk)
+			{
+				freeLists[fl][sl] = chunk->nextFree;
+				if (!freeLists[fl][sl])
+				{
+					slBitmap[fl] &= ~(1u << sl);
+					if (!slBitmap[fl])
+					{
+						flBitmap &= ~(uint64_t(1) << fl);
+					}
+				}
+			}
+			chunk->prevFree = nullptr;
+			chunk->nextFree = nullptr;
+		}
+
+		/** @brief Good-fit search: returns a free chunk that is guaranteed to hold at least size bytes */
+		MemoryChunk* findFree(VkDeviceSize size)
+		{
+			// Round up to the start of the next list so every chunk in the resulting list is big enough
+			if (size >= SMALL_SIZE)
+			{
+				size += (VkDeviceSize(1) << (highestBit(size) - SL_INDEX_COUNT_LOG2)) - 1;
+			}
+			else
+			{
+				size += (SMALL_SIZE / SL_INDEX_COUNT) - 1;
+			}
+			uint32_t fl, sl;
+			mapping(size, fl, sl);
+			if (fl >= FL_INDEX_COUNT)
+			{
+				return nullptr;
+			}
+			uint32_t slMap = slBitmap[fl] & (~0u << sl);
+			if (!slMap)
+			{
+				const uint64_t flMap = flBitmap & (~uint64_t(0) << (fl + 1));
+				if (!flMap)
+				{
+					return nullptr;
+				}
+				fl = lowestBit(flMap);
+				slMap = slBitmap[fl];
+			}
+			sl = lowestBit(slMap);
+			return freeLists[fl][sl];
+		}
+
+		MemoryChunk* allocate(VkDeviceSize allocSize, VkDeviceSize alignment)
+		{
+			MemoryChunk* chunk = findFree(allocSize + alignment - 1);
+			if (!chunk)
+			{
+				return nullptr;
+			}
+			removeFree(chunk);
+
+			// Leading space needed for alignment becomes a free range of its own
+			const VkDeviceSize alignedOffset = alignUp(chunk->offset, alignment);
+			const VkDeviceSize padding = alignedOffset - chunk->offset;
+			if (padding > 0)
+			{
+				MemoryChunk* pad = new MemoryChunk();
+				pad->offset = chunk->offset;
+				pad->size = padding;
+				pad->prevPhysical = chunk->prevPhysical;
+				pad->nextPhysical = chunk;
+				if (chunk->prevPhysical)
+				{
+					chunk->prevPhysical->nextPhysical = pad;
+				}
+				else
+				{
+					firstChunk = pad;
+				}
+				chunk->prevPhysical = pad;
+				chunk->offset = alignedOffset;
+				chunk->size -= padding;
+				insertFree(pad);
+			}
+
+			// Return the unused tail to the free lists
+			if (chunk->size - allocSize >= MIN_SPLIT_SIZE)
+			{
+				MemoryChunk* tail = new MemoryChunk();
+				tail->offset = chunk->offset + allocSize;
+				tail->size = chunk->size - allocSize;
+				tail->prevPhysical = chunk;
+				tail->nextPhysical = chunk->nextPhysical;
+				if (chunk->nextPhysical)
+				{
+					chunk->nextPhysical->prevPhysical = tail;
+				}
+				chunk->nextPhysical = tail;
+				chunk->size = allocSize;
+				insertFree(tail);
+			}
+
+			chunk->free = false;
+			freeBytes -= chunk->size;
+			allocationCount++;
+			return chunk;
+		}
+
+		void free(MemoryChunk* chunk)
+		{
+			assert(!chunk->free);
+			freeBytes += chunk->size;
+			allocationCount--;
+
+			MemoryChunk* prev = chunk->prevPhysical;
+			if (prev && prev->free)
+			{
+				removeFree(prev);
+				prev->size += chunk->size;
+				prev->nextPhysical = chunk->nextPhysical;
+				if (chunk->nextPhysical)
+				{
+					chunk->nextPhysical->prevPhysical = prev;
+				}
+				delete chunk;
+				chunk = prev;
+			}
+			MemoryChunk* next = chunk->nextPhysical;
+			if (next && next->free)
+			{
+				removeFree(next);
+				chunk->size += next->size;
+				chunk->nextPhysical = next->nextPhysical;
+				if (next->nextPhysical)
+				{
+					next->nextPhysical->prevPhysical = chunk;
+				}
+				delete next;
+			}
+			insertFree(chunk);
+		}
+	};
+
+	const char* memoryCategoryName(MemoryCategory category)
+	{
+		switch (category)
+		{
+		case MemoryCategory::Texture: return "textures";
+		case MemoryCategory::Geometry: return "vertex/index";
+		case MemoryCategory::Uniform: return "uniforms";
+		case MemoryCategory::Attachment: return "attachments";
+		case MemoryCategory::Staging: return "staging";
+		default: return "other";
+		}
+	}
+
+	/**
+	* Release this allocation back to the allocator it was taken from
+	*/
+	void Allocation::free()
+	{
+		if (allocator)
+		{
+			allocator->free(this);
+		}
+	}
+
+	/**
+	* Create an allocator for the given device
+	*
+	* @param device Vulkan device the memory is allocated from
+	* @param (Optional) preferredBlockSize Size of the blocks that are sub-allocated (defaults to 0, which picks a size based on the heap size)
+	*/
+	MemoryAllocator::MemoryAllocator(VulkanDevice* device, VkDeviceSize preferredBlockSize)
+	{
+		assert(device);
+		this->device = device;
+		this->preferredBlockSize = preferredBlockSize;
+		for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++)
+		{
+			heapUsage[i] = 0;
+			for (auto& usage : categoryUsage[i])
+			{
+				usage = 0;
+			}
+		}
+	}
+
+	MemoryAllocator::~MemoryAllocator()
+	{
+		for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+		{
+			for (Pool& pool : pools[i])
+			{
+				for (MemoryBlock* block : pool.blocks)
+				{
+					destroyBlock(block);
+				}
+				pool.blocks.clear();
+			}
+		}
+	}
+
+	VkDeviceSize MemoryAllocator::getBlockSize(uint32_t memoryTypeIndex) const
+	{
+		if (preferredBlockSize > 0)
+		{
+			return preferredBlockSize;
+		}
+		// Small heaps (e.g. the 256 MiB device local + host visible heap on many discrete GPUs) get smaller blocks
+		const uint32_t heapIndex = device->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+		const VkDeviceSize heapSize = device->memoryProperties.memoryHeaps[heapIndex].size;
+		const VkDeviceSize largeBlockSize = 256ull * 1024 * 1024;
+		return heapSize <= 1024ull * 1024 * 1024 ? heapSize / 8 : largeBlockSize;
+	}
+
+	MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryTypeIndex, AllocationType type, VkDeviceSize size, bool dedicated, VkMemoryAllocateFlags allocateFlags, VkResult* result)
+	{
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = size;
+		memAlloc.memoryTypeIndex = memoryTypeIndex;
+		VkMemoryAllocateFlagsInfo allocFlagsInfo{};
+		if (allocateFlags)
+		{
+			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+			allocFlagsInfo.flags = allocateFlags;
+			memAlloc.pNext = &allocFlagsInfo;
+		}
+		VkDeviceMemory memory;
+		*result = vkAllocateMemory(device->logicalDevice, &memAlloc, allocationCallbacks(HostAllocationScope::Device), &memory);
+		if (*result != VK_SUCCESS)
+		{
+			return nullptr;
+		}
+
+		heapUsage[getHeapIndex(memoryTypeIndex)] += size;
+
+		MemoryBlock* block = new MemoryBlock();
+		block->memory = memory;
+		block->size = size;
+		block->memoryTypeIndex = memoryTypeIndex;
+		block->type = type;
+		block->dedicated = dedicated;
+		// Host visible blocks stay mapped for their whole lifetime
+		if (device->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			void* mapped;
+			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+			block->mapped = static_cast<uint8_t*>(mapped);
+		}
+		if (!dedicated)
+		{
+			block->init();
+		}
+		return block;
+	}
+
+	void MemoryAllocator::destroyBlock(MemoryBlock* block)
+	{
+		if (block->mapped)
+		{
+			vkUnmapMemory(device->logicalDevice, block->memory);
+		}
+		vkFreeMemory(device->logicalDevice, block->memory, allocationCallbacks(HostAllocationScope::Device));
+		heapUsage[getHeapIndex(block->memoryTypeIndex)] -= block->size;
+		block->release();
+		delete block;
+	}
+
+	/**
+	* Allocate a range of device memory
+	*
+	* @param memReqs Memory requirements of the resource (size, alignment, memory type bits)
+	* @param memoryPropertyFlags Memory properties the allocation requires (i.e. device local, host visible, coherent)
+	* @param type Kind of resource the memory is bound to, selects the pool so buffers and optimal images never share a block
+	* @param allocation Pointer to the allocation that is filled on success
+	* @param (Optional) allocateFlags Memory allocate flags (e.g. device address), allocations with flags get their own VkDeviceMemory
+	* @param (Optional) category What the memory is used for, only used for usage reporting
+	*
+	* @return VK_SUCCESS or the error returned by vkAllocateMemory if no block could be created
+	*/
+	VkResult MemoryAllocator::allocate(const VkMemoryRequirements& memReqs, VkMemoryPropertyFlags memoryPropertyFlags, AllocationType type, Allocation* allocation, VkMemoryAllocateFlags allocateFlags, MemoryCategory category)
+	{
+		assert(allocation);
+		const uint32_t memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
+		const VkMemoryPropertyFlags typeFlags = device->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+		VkDeviceSize alignment = std::max<VkDeviceSize>(memReqs.alignment, 1);
+		VkDeviceSize size = memReqs.size;
+		// Flushes and invalidates of non-coherent memory work on whole atoms, so keep allocations atom aligned
+		if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		{
+			const VkDeviceSize atomSize = device->properties.limits.nonCoherentAtomSize;
+			alignment = std::max(alignment, atomSize);
+			size = alignUp(size, atomSize);
+		}
+
+		VkResult result = allocateFromPool(memoryTypeIndex, size, alignment, type, allocation, allocateFlags);
+		// Give the owner of the handler (e.g. a residency manager) a chance to make room, the pool lock is not held here
+		while (result == VK_ERROR_OUT_OF_DEVICE_MEMORY)
+		{
+			OutOfMemoryHandler handler;
+			{
+				std::lock_guard<std::mutex> lock(handlerMutex);
+				handler = outOfMemoryHandler;
+			}
+			if (!handler || !handler(getHeapIndex(memoryTypeIndex), size))
+			{
+				break;
+			}
+			result = allocateFromPool(memoryTypeIndex, size, alignment, type, allocation, allocateFlags);
+		}
+		if (result == VK_SUCCESS)
+		{
+			allocation->category = category;
+			categoryUsage[getHeapIndex(memoryTypeIndex)][static_cast<uint32_t>(category)] += allocation->size;
+		}
+		return result;
+	}
+
+	VkResult MemoryAllocator::allocateFromPool(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceSize alignment, AllocationType type, Allocation* allocation, VkMemoryAllocateFlags allocateFlags)
+	{
+		Pool& pool = pools[memoryTypeIndex][static_cast<uint32_t>(type)];
+		const VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+		VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+
+		std::lock_guard<std::mutex> lock(pool.mutex);
+
+		if ((allocateFlags == 0) && (size <= blockSize / 2))
+		{
+			MemoryBlock* block = nullptr;
+			MemoryChunk* chunk = nullptr;
+			// Newer blocks are tried first, they are the most likely to have room
+			for (auto it = pool.blocks.rbegin(); it != pool.blocks.rend() && !chunk; ++it)
+			{
+				if (!(*it)->compacting && (*it)->freeBytes >= size)
+				{
+					block = *it;
+					chunk = block->allocate(size, alignment);
+				}
+			}
+			// Otherwise add a new block, falling back to smaller ones if the heap is running low
+			for (VkDeviceSize newBlockSize = blockSize; !chunk && newBlockSize >= size + alignment; newBlockSize /= 2)
+			{
+				block = createBlock(memoryTypeIndex, type, newBlockSize, false, 0, &result);
+				if (block)
+				{
+					pool.blocks.push_back(block);
+					chunk = block->allocate(size, alignment);
+				}
+				else if (result != VK_ERROR_OUT_OF_DEVICE_MEMORY && result != VK_ERROR_OUT_OF_HOST_MEMORY)
+				{
+					break;
+				}
+			}
+			if (!chunk)
+			{
+				return result;
+			}
+			allocation->memory = block->memory;
+			allocation->offset = chunk->offset;
+			allocation->size = chunk->size;
+			allocation->memoryTypeIndex = memoryTypeIndex;
+			allocation->mapped = block->mapped ? block->mapped + chunk->offset : nullptr;
+			allocation->allocator = this;
+			allocation->block = block;
+			allocation->chunk = chunk;
+			return VK_SUCCESS;
+		}
+
+		// Large resources and resources needing special allocate flags get a dedicated allocation
+		MemoryBlock* block = createBlock(memoryTypeIndex, type, size, true, allocateFlags, &result);
+		if (!block)
+		{
+			return result;
+		}
+		pool.dedicatedCount++;
+		pool.dedicatedBytes += size;
+		allocation->memory = block->memory;
+		allocation->offset = 0;
+		allocation->size = size;
+		allocation->memoryTypeIndex = memoryTypeIndex;
+		allocation->mapped = block->mapped;
+		allocation->allocator = this;
+		allocation->block = block;
+		allocation->chunk = nullptr;
+		return VK_SUCCESS;
+	}
+
+	/**
+	* Allocate memory for a buffer and (optionally) bind it
+	*
+	* @param buffer Buffer to allocate memory for
+	* @param memoryPropertyFlags Memory properties for this buffer (i.e. device local, host visible, coherent)
+	* @param allocation Pointer to the allocation that is filled on success
+	* @param (Optional) category What the buffer is used for, only used for usage reporting
+	* @param (Optional) allocateFlags Memory allocate flags (e.g. VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT)
+	* @param (Optional) bind If true, the memory is bound to the buffer (defaults to true)
+	*
+	* @return VkResult of the allocation and bind calls
+	*/
+	VkResult MemoryAllocator::allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, MemoryCategory category, VkMemoryAllocateFlags allocateFlags, bool bind)
+	{
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(device->logicalDevice, buffer, &memReqs);
+		VkResult result = allocate(memReqs, memoryPropertyFlags, AllocationType::Linear, allocation, allocateFlags, category);
+		if (result == VK_SUCCESS && bind)
+		{
+			result = vkBindBufferMemory(device->logicalDevice, buffer, allocation->memory, allocation->offset);
+		}
+		return result;
+	}
+
+	/**
+	* Allocate memory for an image and (optionally) bind it
+	*
+	* @param image Image to allocate memory for
+	* @param memoryPropertyFlags Memory properties for this image
+	* @param allocation Pointer to the allocation that is filled on success
+	* @param (Optional) category What the image is used for, only used for usage reporting
+	* @param (Optional) tiling Tiling the image has been created with, selects the linear or optimal pool (defaults to VK_IMAGE_TILING_OPTIMAL)
+	* @param (Optional) bind If true, the memory is bound to the image (defaults to true)
+	*
+	* @return VkResult of the allocation and bind calls
+	*/
+	VkResult MemoryAllocator::allocateImageMemory(VkImage image, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, MemoryCategory category, VkImageTiling tiling, bool bind)
+	{
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		const AllocationType type = (tiling == VK_IMAGE_TILING_LINEAR) ? AllocationType::Linear : AllocationType::Optimal;
+		VkResult result = allocate(memReqs, memoryPropertyFlags, type, allocation, 0, category);
+		if (result == VK_SUCCESS && bind)
+		{
+			result = vkBindImageMemory(device->logicalDevice, image, allocation->memory, allocation->offset);
+		}
+		return result;
+	}
+
+	/**
+	* Return an allocation to its pool
+	*
+	* @note Empty blocks are released, except for one per pool that is kept to avoid allocation churn
+	*/
+	void MemoryAllocator::free(Allocation* allocation)
+	{
+		if (!allocation || !allocation->block)
+		{
+			return;
+		}
+		MemoryBlock* block = allocation->block;
+		Pool& pool = pools[block->memoryTypeIndex][static_cast<uint32_t>(block->type)];
+		categoryUsage[getHeapIndex(block->memoryTypeIndex)][static_cast<uint32_t>(allocation->category)] -= allocation->size;
+		{
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			if (block->dedicated)
+			{
+				pool.dedicatedCount--;
+				pool.dedicatedBytes -= block->size;
+				destroyBlock(block);
+			}
+			else
+			{
+				block->free(allocation->chunk);
+				if (block->allocationCount == 0 && block->compacting)
+				{
+					// Emptied by defragmentation, released right away instead of being kept around for reuse
+					pool.blocks.erase(std::find(pool.blocks.begin(), pool.blocks.end(), block));
+					destroyBlock(block);
+					compactedBlockCount++;
+				}
+				else if (block->allocationCount == 0)
+				{
+					const bool otherEmpty = std::any_of(pool.blocks.begin(), pool.blocks.end(), [block](MemoryBlock* other) {
+						return other != block && other->allocationCount == 0;
+					});
+					if (otherEmpty)
+					{
+						pool.blocks.erase(std::find(pool.blocks.begin(), pool.blocks.end(), block));
+						destroyBlock(block);
+					}
+				}
+			}
+		}
+		*allocation = Allocation();
+	}
+
+	/**
+	* Select the blocks a defragmentation pass should empty
+	*
+	* @param maxBlockUsage Blocks with at most this fraction of their size in use are emptied
+	*
+	* @return Number of blocks selected
+	*/
+	uint32_t MemoryAllocator::beginCompaction(float maxBlockUsage)
+	{
+		uint32_t selected = 0;
+		for (auto& memoryTypePools : pools)
+		{
+			for (Pool& pool : memoryTypePools)
+			{
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				if (pool.blocks.size() < 2)
+				{
+					continue;
+				}
+				// The fullest block always stays as target, so a pass can't just shuffle everything around
+				std::vector<MemoryBlock*> blocks(pool.blocks);
+				std::sort(blocks.begin(), blocks.end(), [](const MemoryBlock* a, const MemoryBlock* b) { return (a->size - a->freeBytes) * b->size < (b->size - b->freeBytes) * a->size; });
+				blocks.pop_back();
+				for (MemoryBlock* block : blocks)
+				{
+					if (static_cast<float>(block->size - block->freeBytes) <= maxBlockUsage * static_cast<float>(block->size))
+					{
+						block->compacting = true;
+						selected++;
+					}
+				}
+			}
+		}
+		compactedBlockCount = 0;
+		return selected;
+	}
+
+	/**
+	* Finish a defragmentation pass, blocks that still have allocations become regular blocks again
+	*
+	* @return Number of blocks released since beginCompaction()
+	*/
+	uint32_t MemoryAllocator::endCompaction()
+	{
+		for (auto& memoryTypePools : pools)
+		{
+			for (Pool& pool : memoryTypePools)
+			{
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				for (MemoryBlock* block : pool.blocks)
+				{
+					block->compacting = false;
+				}
+			}
+		}
+		return compactedBlockCount.exchange(0);
+	}
+
+	bool MemoryAllocator::isCompacting(const Allocation& allocation) const
+	{
+		return allocation.block && allocation.block->compacting;
+	}
+
+	void MemoryAllocator::setOutOfMemoryHandler(OutOfMemoryHandler handler)
+	{
+		std::lock_guard<std::mutex> lock(handlerMutex);
+		outOfMemoryHandler = handler;
+	}
+
+	VkDeviceSize MemoryAllocator::getHeapUsage(uint32_t heapIndex) const
+	{
+		return heapUsage[heapIndex].load();
+	}
+
+	VkDeviceSize MemoryAllocator::getCategoryUsage(uint32_t heapIndex, MemoryCategory category) const
+	{
+		return categoryUsage[heapIndex][static_cast<uint32_t>(category)].load();
+	}
+
+	uint32_t MemoryAllocator::getHeapIndex(uint32_t memoryTypeIndex) const
+	{
+		return device->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	}
+
+	/**
+	* Gather usage and fragmentation statistics for every pool that currently holds memory
+	*/
+	std::vector<PoolStatistics> MemoryAllocator::getStatistics()
+	{
+		std::vector<PoolStatistics> statistics;
+		for (uint32_t i = 0; i < device->memoryProperties.memoryTypeCount; i++)
+		{
+			for (uint32_t t = 0; t < 2; t++)
+			{
+				Pool& pool = pools[i][t];
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				if (pool.blocks.empty() && pool.dedicatedCount == 0)
+				{
+					continue;
+				}
+				PoolStatistics stats{};
+				stats.memoryTypeIndex = i;
+				stats.type = static_cast<AllocationType>(t);
+				stats.blockCount = static_cast<uint32_t>(pool.blocks.size());
+				stats.dedicatedCount = pool.dedicatedCount;
+				stats.dedicatedBytes = pool.dedicatedBytes;
+				stats.allocationCount = pool.dedicatedCount;
+				stats.usedBytes = pool.dedicatedBytes;
+				VkDeviceSize freeBytes = 0;
+				for (MemoryBlock* block : pool.blocks)
+				{
+					stats.blockBytes += block->size;
+					stats.allocationCount += block->allocationCount;
+					stats.usedBytes += block->size - block->freeBytes;
+					freeBytes += block->freeBytes;
+					for (MemoryChunk* chunk = block->firstChunk; chunk; chunk = chunk->nextPhysical)
+					{
+						if (chunk->free)
+						{
+							stats.freeRangeCount++;
+							stats.largestFreeRange = std::max(stats.largestFreeRange, chunk->size);
+						}
+					}
+				}
+				if (freeBytes > 0)
+				{
+					stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(freeBytes);
+				}
+				statistics.push_back(stats);
+			}
+		}
+		return statistics;
+	}
+
+	void MemoryAllocator::printStatistics()
+	{
+		const double MiB = 1024.0 * 1024.0;
+		std::cout << "Device memory pools:" << std::endl;
+		for (const PoolStatistics& stats : getStatistics())
+		{
+			std::cout << std::fixed << std::setprecision(1)
+				<< "  type " << stats.memoryTypeIndex << " (" << allocationTypeName(stats.type) << "): "
+				<< stats.blockCount << " blocks (" << stats.blockBytes / MiB << " MiB), "
+				<< stats.dedicatedCount << " dedicated (" << stats.dedicatedBytes / MiB << " MiB), "
+				<< stats.allocationCount << " allocations, "
+				<< stats.usedBytes / MiB << " MiB used, "
+				<< stats.freeRangeCount << " free ranges, largest " << stats.largestFreeRange / MiB << " MiB, "
+				<< "fragmentation " << stats.fragmentation * 100.0f << "%" << std::endl;
+		}
+		std::cout << "Device memory heaps:" << std::endl;
+		for (uint32_t heapIndex = 0; heapIndex < device->memoryProperties.memoryHeapCount; heapIndex++)
+		{
+			if (getHeapUsage(heapIndex) == 0)
+			{
+				continue;
+			}
+			std::cout << std::fixed << std::setprecision(1)
+				<< "  heap " << heapIndex << ": " << getHeapUsage(heapIndex) / MiB << " MiB of " << device->memoryProperties.memoryHeaps[heapIndex].size / MiB << " MiB allocated";
+			for (uint32_t category = 0; category < static_cast<uint32_t>(MemoryCategory::Count); category++)
+			{
+				const VkDeviceSize usage = getCategoryUsage(heapIndex, static_cast<MemoryCategory>(category));
+				if (usage > 0)
+				{
+					std::cout << ", " << memoryCategoryName(static_cast<MemoryCategory>(category)) << " " << usage / MiB << " MiB";
+				}
+			}
+			std::cout << std::endl;
+		}
+	}
+}
@@ -0,0 +1,143 @@
+/*
+* Vulkan device memory sub-allocator
+*
+* Hands out sub-ranges of large VkDeviceMemory blocks instead of calling vkAllocateMemory for every resource.
+* Every memory type has its own pools and each block is managed with a two-level segregated fit (TLSF) free list.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+	class MemoryAllocator;
+	struct MemoryBlock;
+	struct MemoryChunk;
+
+	/**
+	* @brief Kind of resource an allocation is made for
+	* @note Linear resources (buffers, linear images) and optimal images are kept in separate pools, so neighbouring ranges can never violate bufferImageGranularity
+	*/
+	enum class AllocationType : uint32_t
+	{
+		Linear = 0,
+		Optimal = 1
+	};
+
+	/** @brief What an allocation is used for, memory usage is tracked per category and heap */
+	enum class MemoryCategory : uint32_t
+	{
+		Other = 0,
+		Texture,
+		Geometry,
+		Uniform,
+		Attachment,
+		Staging,
+		Count
+	};
+
+	const char* memoryCategoryName(MemoryCategory category);
+
+	/**
+	* @brief Sub-range of a device memory block handed out by the MemoryAllocator
+	* @note memory and offset are what has to be passed to vkBind*Memory, mapped is only set for host visible memory types
+	*/
+	struct Allocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		MemoryCategory category = MemoryCategory::Other;
+		/** @brief Host pointer to the start of this allocation if the block is persistently mapped */
+		void* mapped = nullptr;
+		MemoryAllocator* allocator = nullptr;
+		MemoryBlock* block = nullptr;
+		MemoryChunk* chunk = nullptr;
+		bool valid() const { return memory != VK_NULL_HANDLE; }
+		void free();
+	};
+
+	/** @brief Usage and fragmentation numbers for one memory type / allocation type pool */
+	struct PoolStatistics
+	{
+		uint32_t memoryTypeIndex = 0;
+		AllocationType type = AllocationType::Linear;
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+		uint32_t freeRangeCount = 0;
+		VkDeviceSize blockBytes = 0;
+		VkDeviceSize dedicatedBytes = 0;
+		VkDeviceSize usedBytes = 0;
+		VkDeviceSize largestFreeRange = 0;
+		/** @brief 0.0 if all free space is one contiguous range, approaching 1.0 the more scattered it is */
+		float fragmentation = 0.0f;
+	};
+
+	class MemoryAllocator
+	{
+	public:
+		explicit MemoryAllocator(VulkanDevice* device, VkDeviceSize preferredBlockSize = 0);
+		~MemoryAllocator();
+
+		/**
+		* @brief Called when a heap runs out of memory, gets the heap index and the size of the failed request
+		* @return True if memory has been released and the allocation should be retried
+		*/
+		typedef std::function<bool(uint32_t heapIndex, VkDeviceSize size)> OutOfMemoryHandler;
+
+		VkResult allocate(const VkMemoryRequirements& memReqs, VkMemoryPropertyFlags memoryPropertyFlags, AllocationType type, Allocation* allocation, VkMemoryAllocateFlags allocateFlags = 0, MemoryCategory category = MemoryCategory::Other);
+		VkResult allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, MemoryCategory category = MemoryCategory::Other, VkMemoryAllocateFlags allocateFlags = 0, bool bind = true);
+		VkResult allocateImageMemory(VkImage image, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, MemoryCategory category = MemoryCategory::Other, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL, bool bind = true);
+		void free(Allocation* allocation);
+
+		void setOutOfMemoryHandler(OutOfMemoryHandler handler);
+
+		uint32_t beginCompaction(float maxBlockUsage);
+		uint32_t endCompaction();
+		/** @brief True if the allocation lives in a block the current defragmentation pass is emptying */
+		bool isCompacting(const Allocation& allocation) const;
+
+		/** @brief Bytes of VkDeviceMemory currently allocated from a heap */
+		VkDeviceSize getHeapUsage(uint32_t heapIndex) const;
+		/** @brief Bytes handed out to allocations of a category from a heap */
+		VkDeviceSize getCategoryUsage(uint32_t heapIndex, MemoryCategory category) const;
+		uint32_t getHeapIndex(uint32_t memoryTypeIndex) const;
+
+		std::vector<PoolStatistics> getStatistics();
+		void printStatistics();
+
+	private:
+		struct Pool
+		{
+			std::mutex mutex;
+			std::vector<MemoryBlock*> blocks;
+			uint32_t dedicatedCount = 0;
+			VkDeviceSize dedicatedBytes = 0;
+		};
+
+		VulkanDevice* device;
+		VkDeviceSize preferredBlockSize;
+		Pool pools[VK_MAX_MEMORY_TYPES][2];
+		std::atomic<VkDeviceSize> heapUsage[VK_MAX_MEMORY_HEAPS];
+		std::atomic<VkDeviceSize> categoryUsage[VK_MAX_MEMORY_HEAPS][static_cast<uint32_t>(MemoryCategory::Count)];
+		std::mutex handlerMutex;
+		OutOfMemoryHandler outOfMemoryHandler;
+		std::atomic<uint32_t> compactedBlockCount{ 0 };
+
+		VkResult allocateFromPool(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceSize alignment, AllocationType type, Allocation* allocation, VkMemoryAllocateFlags allocateFlags);
+
+		VkDeviceSize getBlockSize(uint32_t memoryTypeIndex) const;
+		MemoryBlock* createBlock(uint32_t memoryTypeIndex, AllocationType type, VkDeviceSize size, bool dedicated, VkMemoryAllocateFlags allocateFlags, VkResult* result);
+		void destroyBlock(MemoryBlock* block);
+	};
+}
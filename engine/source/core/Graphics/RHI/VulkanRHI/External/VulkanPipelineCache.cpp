@@ -0,0 +1,427 @@
+/*
+* Pipeline state object cache
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanPipelineCache.h"
+#include "VulkanHostAllocator.h"
+#include "Tools.h"
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace vks
+{
+	namespace
+	{
+		constexpr uint32_t fileMagic = 0x43504842; // "BHPC"
+		constexpr uint32_t fileVersion = 1;
+
+		/** @brief Written in front of the VkPipelineCache data, the data is only used on the device and driver it was saved on */
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint32_t driverVersion;
+			uint32_t reserved;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+			uint64_t dataSize;
+			uint64_t dataHash;
+		};
+
+		/** @brief FNV-1a */
+		struct Hasher
+		{
+			uint64_t value = 0xcbf29ce484222325ull;
+
+			void bytes(const void* data, size_t size)
+			{
+				const uint8_t* bytes = static_cast<const uint8_t*>(data);
+				for (size_t i = 0; i < size; i++) {
+					value ^= bytes[i];
+					value *= 0x100000001b3ull;
+				}
+			}
+			template<typename T> void add(const T& field)
+			{
+				bytes(&field, sizeof(T));
+			}
+			template<typename T> void array(const T* fields, uint32_t count)
+			{
+				add(count);
+				if (fields && count) {
+					bytes(fields, sizeof(T) * count);
+				}
+			}
+			void string(const char* string)
+			{
+				if (string) {
+					bytes(string, strlen(string) + 1);
+				}
+			}
+		};
+
+		bool isDynamic(const VkPipelineDynamicStateCreateInfo* dynamicState, VkDynamicState state)
+		{
+			if (dynamicState) {
+				for (uint32_t i = 0; i < dynamicState->dynamicStateCount; i++) {
+					if (dynamicState->pDynamicStates[i] == state) {
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		uint64_t hashData(const void* data, size_t size)
+		{
+			Hasher hasher;
+			hasher.bytes(data, size);
+			return hasher.value;
+		}
+
+		double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+	}
+
+	PipelineCache::PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path, const PipelineCacheFunctions& functions, uint32_t capacity)
+		: device(device), properties(properties), path(path), functions(functions)
+	{
+		if (!this->functions.createPipelineCache) {
+			this->functions.createPipelineCache = vkCreatePipelineCache;
+		}
+		if (!this->functions.destroyPipelineCache) {
+			this->functions.destroyPipelineCache = vkDestroyPipelineCache;
+		}
+		if (!this->functions.getPipelineCacheData) {
+			this->functions.getPipelineCacheData = vkGetPipelineCacheData;
+		}
+		if (!this->functions.createGraphicsPipelines) {
+			this->functions.createGraphicsPipelines = vkCreateGraphicsPipelines;
+		}
+		if (!this->functions.destroyPipeline) {
+			this->functions.destroyPipeline = vkDestroyPipeline;
+		}
+
+		uint64_t slotCount = 1;
+		while (slotCount < capacity) {
+			slotCount <<= 1;
+		}
+		slots.reset(new Slot[slotCount]);
+		slotMask = slotCount - 1;
+
+		load();
+	}
+
+	PipelineCache::~PipelineCache()
+	{
+		if (unsavedPipelines.load() > 0) {
+			save();
+		}
+		for (uint64_t i = 0; i <= slotMask; i++) {
+			VkPipeline pipeline = slots[i].pipeline.load();
+			if (pipeline != VK_NULL_HANDLE) {
+				functions.destroyPipeline(device, pipeline, allocationCallbacks(HostAllocationScope::Pipeline));
+			}
+		}
+		for (auto& entry : overflow) {
+			if (entry.second != VK_NULL_HANDLE) {
+				functions.destroyPipeline(device, entry.second, allocationCallbacks(HostAllocationScope::Pipeline));
+			}
+		}
+		if (pipelineCache != VK_NULL_HANDLE) {
+			functions.destroyPipelineCache(device, pipelineCache, allocationCallbacks(HostAllocationScope::Pipeline));
+		}
+	}
+
+	void PipelineCache::load()
+	{
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		std::vector<char> data;
+		if (!path.empty()) {
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			if (file.is_open()) {
+				data.resize(static_cast<size_t>(file.tellg()));
+				file.seekg(0, std::ios::beg);
+				file.read(data.data(), data.size());
+				if (!file) {
+					data.clear();
+				}
+			}
+		}
+
+		const void* initialData = nullptr;
+		size_t initialDataSize = 0;
+		if (data.size() >= sizeof(FileHeader)) {
+			FileHeader header;
+			memcpy(&header, data.data(), sizeof(FileHeader));
+			const char* cacheData = data.data() + sizeof(FileHeader);
+			const size_t cacheDataSize = data.size() - sizeof(FileHeader);
+			bool valid = header.magic == fileMagic && header.version == fileVersion &&
+				header.vendorID == properties.vendorID && header.deviceID == properties.deviceID && header.driverVersion == properties.driverVersion &&
+				memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+				header.dataSize == cacheDataSize && header.dataHash == hashData(cacheData, cacheDataSize);
+			// The driver's own header has to agree as well, a driver handed data it didn't write may not notice
+			if (valid && cacheDataSize >= sizeof(VkPipelineCacheHeaderVersionOne)) {
+				VkPipelineCacheHeaderVersionOne cacheHeader;
+				memcpy(&cacheHeader, cacheData, sizeof(cacheHeader));
+				valid = cacheHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && cacheHeader.vendorID == properties.vendorID && cacheHeader.deviceID == properties.deviceID &&
+					memcmp(cacheHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+			}
+			if (valid) {
+				initialData = cacheData;
+				initialDataSize = cacheDataSize;
+			} else {
+				std::cout << "Pipeline cache \"" << path << "\" was written for another device or driver, starting with an empty cache\n";
+			}
+		}
+
+		VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
+		pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		pipelineCacheCreateInfo.initialDataSize = initialDataSize;
+		pipelineCacheCreateInfo.pInitialData = initialData;
+		VK_CHECK_RESULT(functions.createPipelineCache(device, &pipelineCacheCreateInfo, allocationCallbacks(HostAllocationScope::Pipeline), &pipelineCache));
+		loadedBytes = initialDataSize;
+		loadMs = millisecondsSince(start);
+	}
+
+	bool PipelineCache::save()
+	{
+		if (path.empty() || pipelineCache == VK_NULL_HANDLE) {
+			return false;
+		}
+		size_t dataSize = 0;
+		if (functions.getPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+			return false;
+		}
+		std::vector<char> data(sizeof(FileHeader) + dataSize);
+		if (functions.getPipelineCacheData(device, pipelineCache, &dataSize, data.data() + sizeof(FileHeader)) != VK_SUCCESS) {
+			return false;
+		}
+		data.resize(sizeof(FileHeader) + dataSize);
+
+		FileHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = fileMagic;
+		header.version = fileVersion;
+		header.vendorID = properties.vendorID;
+		header.deviceID = properties.deviceID;
+		header.driverVersion = properties.driverVersion;
+		memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.dataSize = dataSize;
+		header.dataHash = hashData(data.data() + sizeof(FileHeader), dataSize);
+		memcpy(data.data(), &header, sizeof(header));
+
+		// Written next to the file and then moved over it, so an interrupted save leaves the previous data intact
+		const std::string temporaryPath = path + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open() || !file.write(data.data(), data.size())) {
+				return false;
+			}
+		}
+		std::remove(path.c_str());
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+			return false;
+		}
+		unsavedPipelines = 0;
+		return true;
+	}
+
+	uint64_t PipelineCache::hash(const VkGraphicsPipelineCreateInfo& createInfo)
+	{
+		Hasher hasher;
+		hasher.add(createInfo.flags);
+
+		for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(createInfo.pNext); next; next = next->pNext) {
+			hasher.add(next->sType);
+			if (next->sType == VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO) {
+				// Takes the place of the render pass with dynamic rendering
+				const VkPipelineRenderingCreateInfo* rendering = reinterpret_cast<const VkPipelineRenderingCreateInfo*>(next);
+				hasher.add(rendering->viewMask);
+				hasher.array(rendering->pColorAttachmentFormats, rendering->colorAttachmentCount);
+				hasher.add(rendering->depthAttachmentFormat);
+				hasher.add(rendering->stencilAttachmentFormat);
+			}
+		}
+
+		hasher.add(createInfo.stageCount);
+		for (uint32_t i = 0; i < createInfo.stageCount; i++) {
+			const VkPipelineShaderStageCreateInfo& stage = createInfo.pStages[i];
+			hasher.add(stage.flags);
+			hasher.add(stage.stage);
+			hasher.add(stage.module);
+			hasher.string(stage.pName);
+			if (stage.pSpecializationInfo) {
+				const VkSpecializationInfo& specialization = *stage.pSpecializationInfo;
+				for (uint32_t j = 0; j < specialization.mapEntryCount; j++) {
+					hasher.add(specialization.pMapEntries[j].constantID);
+					hasher.add(specialization.pMapEntries[j].offset);
+					hasher.add(specialization.pMapEntries[j].size);
+				}
+				hasher.add(specialization.dataSize);
+				hasher.bytes(specialization.pData, specialization.dataSize);
+			}
+		}
+
+		const VkPipelineDynamicStateCreateInfo* dynamicState = createInfo.pDynamicState;
+		if (dynamicState) {
+			hasher.array(dynamicState->pDynamicStates, dynamicState->dynamicStateCount);
+		}
+
+		if (const VkPipelineVertexInputStateCreateInfo* vertexInput = createInfo.pVertexInputState) {
+			hasher.array(vertexInput->pVertexBindingDescriptions, vertexInput->vertexBindingDescriptionCount);
+			hasher.array(vertexInput->pVertexAttributeDescriptions, vertexInput->vertexAttributeDescriptionCount);
+		}
+		if (const VkPipelineInputAssemblyStateCreateInfo* inputAssembly = createInfo.pInputAssemblyState) {
+			hasher.add(inputAssembly->topology);
+			hasher.add(inputAssembly->primitiveRestartEnable);
+		}
+		if (const VkPipelineTessellationStateCreateInfo* tessellation = createInfo.pTessellationState) {
+			hasher.add(tessellation->patchControlPoints);
+		}
+		if (const VkPipelineViewportStateCreateInfo* viewport = createInfo.pViewportState) {
+			// Static viewports and scissors are baked into the pipeline, dynamic ones may point at anything
+			hasher.add(viewport->viewportCount);
+			hasher.add(viewport->scissorCount);
+			if (!isDynamic(dynamicState, VK_DYNAMIC_STATE_VIEWPORT)) {
+				hasher.array(viewport->pViewports, viewport->viewportCount);
+			}
+			if (!isDynamic(dynamicState, VK_DYNAMIC_STATE_SCISSOR)) {
+				hasher.array(viewport->pScissors, viewport->scissorCount);
+			}
+		}
+		if (const VkPipelineRasterizationStateCreateInfo* rasterization = createInfo.pRasterizationState) {
+			hasher.add(rasterization->depthClampEnable);
+			hasher.add(rasterization->rasterizerDiscardEnable);
+			hasher.add(rasterization->polygonMode);
+			hasher.add(rasterization->cullMode);
+			hasher.add(rasterization->frontFace);
+			hasher.add(rasterization->depthBiasEnable);
+			hasher.add(rasterization->depthBiasConstantFactor);
+			hasher.add(rasterization->depthBiasClamp);
+			hasher.add(rasterization->depthBiasSlopeFactor);
+			hasher.add(rasterization->lineWidth);
+		}
+		if (const VkPipelineMultisampleStateCreateInfo* multisample = createInfo.pMultisampleState) {
+			hasher.add(multisample->rasterizationSamples);
+			hasher.add(multisample->sampleShadingEnable);
+			hasher.add(multisample->minSampleShading);
+			hasher.array(multisample->pSampleMask, (static_cast<uint32_t>(multisample->rasterizationSamples) + 31) / 32);
+			hasher.add(multisample->alphaToCoverageEnable);
+			hasher.add(multisample->alphaToOneEnable);
+		}
+		if (const VkPipelineDepthStencilStateCreateInfo* depthStencil = createInfo.pDepthStencilState) {
+			hasher.add(depthStencil->depthTestEnable);
+			hasher.add(depthStencil->depthWriteEnable);
+			hasher.add(depthStencil->depthCompareOp);
+			hasher.add(depthStencil->depthBoundsTestEnable);
+			hasher.add(depthStencil->stencilTestEnable);
+			hasher.add(depthStencil->front);
+			hasher.add(depthStencil->back);
+			hasher.add(depthStencil->minDepthBounds);
+			hasher.add(depthStencil->maxDepthBounds);
+		}
+		if (const VkPipelineColorBlendStateCreateInfo* colorBlend = createInfo.pColorBlendState) {
+			hasher.add(colorBlend->logicOpEnable);
+			hasher.add(colorBlend->logicOp);
+			hasher.array(colorBlend->pAttachments, colorBlend->attachmentCount);
+			if (!isDynamic(dynamicState, VK_DYNAMIC_STATE_BLEND_CONSTANTS)) {
+				hasher.add(colorBlend->blendConstants);
+			}
+		}
+
+		hasher.add(createInfo.layout);
+		hasher.add(createInfo.renderPass);
+		hasher.add(createInfo.subpass);
+		hasher.add(createInfo.basePipelineHandle);
+		hasher.add(createInfo.basePipelineIndex);
+		// 0 marks free slots
+		return hasher.value ? hasher.value : 1;
+	}
+
+	VkPipeline PipelineCache::create(const VkGraphicsPipelineCreateInfo& createInfo)
+	{
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VK_CHECK_RESULT(functions.createGraphicsPipelines(device, pipelineCache, 1, &createInfo, allocationCallbacks(HostAllocationScope::Pipeline), &pipeline));
+		creationMicroseconds += static_cast<uint64_t>(millisecondsSince(start) * 1000.0);
+		misses++;
+		unsavedPipelines++;
+		return pipeline;
+	}
+
+	VkPipeline PipelineCache::getGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo)
+	{
+		const uint64_t key = hash(createInfo);
+		// Linear probing, slots are claimed once and never released so a lookup can stop at the first free slot
+		for (uint64_t probe = 0, index = key & slotMask; probe <= slotMask; probe++, index = (index + 1) & slotMask) {
+			Slot& slot = slots[index];
+			uint64_t current = slot.key.load(std::memory_order_acquire);
+			if (current == 0 && slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+				VkPipeline pipeline = create(createInfo);
+				slot.pipeline.store(pipeline, std::memory_order_relaxed);
+				slot.ready.store(true, std::memory_order_release);
+				return pipeline;
+			}
+			if (current == key) {
+				while (!slot.ready.load(std::memory_order_acquire)) {
+					std::this_thread::yield();
+				}
+				hits++;
+				return slot.pipeline.load(std::memory_order_relaxed);
+			}
+		}
+
+		// The table is full
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		auto existing = overflow.find(key);
+		if (existing != overflow.end()) {
+			hits++;
+			return existing->second;
+		}
+		VkPipeline pipeline = create(createInfo);
+		overflow[key] = pipeline;
+		return pipeline;
+	}
+
+	VkPipeline PipelineCache::find(uint64_t hash) const
+	{
+		for (uint64_t probe = 0, index = hash & slotMask; probe <= slotMask; probe++, index = (index + 1) & slotMask) {
+			const Slot& slot = slots[index];
+			const uint64_t current = slot.key.load(std::memory_order_acquire);
+			if (current == 0) {
+				return VK_NULL_HANDLE;
+			}
+			if (current == hash) {
+				return slot.ready.load(std::memory_order_acquire) ? slot.pipeline.load(std::memory_order_relaxed) : VK_NULL_HANDLE;
+			}
+		}
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		auto existing = overflow.find(hash);
+		return existing != overflow.end() ? existing->second : VK_NULL_HANDLE;
+	}
+
+	PipelineCacheStatistics PipelineCache::getStatistics() const
+	{
+		PipelineCacheStatistics statistics;
+		statistics.hits = hits.load();
+		statistics.misses = misses.load();
+		statistics.creationMs = creationMicroseconds.load() / 1000.0;
+		statistics.loadMs = loadMs;
+		statistics.warm = loadedBytes > 0;
+		statistics.loadedBytes = loadedBytes;
+		return statistics;
+	}
+}
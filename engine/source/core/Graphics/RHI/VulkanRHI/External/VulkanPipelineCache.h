@@ -0,0 +1,119 @@
+/*
+* Pipeline state object cache
+*
+* Graphics pipelines are keyed by a hash of their complete create info: shader stages and specialization constants,
+* vertex layout, fixed function state, dynamic state, layout and render pass. Looking up a pipeline that exists never
+* takes a lock. Pipelines are compiled through a VkPipelineCache that is saved to disk and only reused by the same
+* vendor, device and driver version, so a warm start skips most of the driver's shader compilation.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace vks
+{
+	/** @brief Entry points used by the cache, null members fall back to the functions exported by the loader */
+	struct PipelineCacheFunctions
+	{
+		PFN_vkCreatePipelineCache createPipelineCache = nullptr;
+		PFN_vkDestroyPipelineCache destroyPipelineCache = nullptr;
+		PFN_vkGetPipelineCacheData getPipelineCacheData = nullptr;
+		PFN_vkCreateGraphicsPipelines createGraphicsPipelines = nullptr;
+		PFN_vkDestroyPipeline destroyPipeline = nullptr;
+	};
+
+	struct PipelineCacheStatistics
+	{
+		/** @brief Lookups that found an existing pipeline, including ones that waited for another thread to create it */
+		uint64_t hits = 0;
+		/** @brief Lookups that had to create the pipeline */
+		uint64_t misses = 0;
+		/** @brief Time spent creating pipelines, compare cold and warm starts with it */
+		double creationMs = 0.0;
+		/** @brief Time spent reading the cache file and creating the VkPipelineCache */
+		double loadMs = 0.0;
+		/** @brief Set if the VkPipelineCache was created from data saved by an earlier run */
+		bool warm = false;
+		size_t loadedBytes = 0;
+	};
+
+	class PipelineCache
+	{
+	public:
+		/**
+		* Create the cache, loading the saved VkPipelineCache data if it was written for this device and driver
+		* @param properties Properties of the physical device, the saved data is discarded if vendor, device or driver version differ
+		* @param (Optional) path File the VkPipelineCache data is loaded from and saved to, empty keeps everything in memory
+		* @param (Optional) functions Device level entry points for applications that load them themselves
+		* @param (Optional) capacity Pipelines the lock-free table holds, rounded up to a power of two, further pipelines are kept in a locked map
+		*/
+		PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path = "", const PipelineCacheFunctions& functions = PipelineCacheFunctions(), uint32_t capacity = 4096);
+		/** @brief Saves the cache data if pipelines have been created since it was loaded and destroys all pipelines, the device has to be done with them */
+		~PipelineCache();
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache& operator=(const PipelineCache&) = delete;
+
+		/** @brief Handle to pass to pipeline creation that bypasses the PSO table, e.g. compute pipelines */
+		VkPipelineCache getHandle() const { return pipelineCache; }
+
+		/**
+		* Hash of everything that determines the compiled pipeline
+		* @note Shader modules and render passes are hashed by handle, extension structs other than VkPipelineRenderingCreateInfo only by type
+		*/
+		static uint64_t hash(const VkGraphicsPipelineCreateInfo& createInfo);
+		/**
+		* Return the pipeline for the create info, creating it on first use
+		* @note Safe to call from several threads, a thread asking for a pipeline that another one is creating waits for it instead of compiling it twice
+		*/
+		VkPipeline getGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo);
+		/** @brief Pipeline with the given hash, VK_NULL_HANDLE if it doesn't exist or is still being created */
+		VkPipeline find(uint64_t hash) const;
+
+		/** @brief Write the VkPipelineCache data to the file the cache was created with */
+		bool save();
+
+		PipelineCacheStatistics getStatistics() const;
+
+	private:
+		struct Slot
+		{
+			/** @brief 0 while the slot is free, set once by the thread that creates the pipeline */
+			std::atomic<uint64_t> key{ 0 };
+			std::atomic<VkPipeline> pipeline{ VK_NULL_HANDLE };
+			/** @brief Set after pipeline has been stored, the pipeline stays null if creation failed */
+			std::atomic<bool> ready{ false };
+		};
+
+		VkDevice device;
+		VkPhysicalDeviceProperties properties;
+		std::string path;
+		PipelineCacheFunctions functions;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+		std::unique_ptr<Slot[]> slots;
+		uint64_t slotMask;
+		/** @brief Pipelines that didn't fit into the table */
+		std::unordered_map<uint64_t, VkPipeline> overflow;
+		mutable std::mutex overflowMutex;
+
+		std::atomic<uint64_t> hits{ 0 };
+		std::atomic<uint64_t> misses{ 0 };
+		std::atomic<uint64_t> creationMicroseconds{ 0 };
+		/** @brief Misses since the data was loaded or saved */
+		std::atomic<uint64_t> unsavedPipelines{ 0 };
+		double loadMs = 0.0;
+		size_t loadedBytes = 0;
+
+		void load();
+		VkPipeline create(const VkGraphicsPipelineCreateInfo& createInfo);
+	};
+}
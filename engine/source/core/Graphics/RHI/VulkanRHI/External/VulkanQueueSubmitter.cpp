@@ -0,0 +1,268 @@
+/*
+* Queue submission thread
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanQueueSubmitter.h"
+#include "Tools.h"
+#include <cassert>
+
+namespace vks
+{
+	QueueSubmitter::QueueSubmitter(VkQueue queue, VkQueue presentQueue, const QueueFunctions& functions)
+		: queue(queue), presentQueue(presentQueue != VK_NULL_HANDLE ? presentQueue : queue), functions(functions), head(&stub), tail(&stub)
+	{
+		if (!this->functions.queueSubmit) {
+			this->functions.queueSubmit = vkQueueSubmit;
+		}
+		if (!this->functions.queuePresent) {
+			this->functions.queuePresent = vkQueuePresentKHR;
+		}
+		if (!this->functions.queueWaitIdle) {
+			this->functions.queueWaitIdle = vkQueueWaitIdle;
+		}
+		thread = std::thread(&QueueSubmitter::threadLoop, this);
+	}
+
+	QueueSubmitter::~QueueSubmitter()
+	{
+		flush();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		workAvailable.notify_one();
+		thread.join();
+	}
+
+	void QueueSubmitter::submit(QueueSubmission&& submission)
+	{
+		Work* work = new Work();
+		work->type = WorkType::Submit;
+		work->submission = std::move(submission);
+		push(work);
+	}
+
+	void QueueSubmitter::present(PresentRequest&& request)
+	{
+		Work* work = new Work();
+		work->type = WorkType::Present;
+		work->present = std::move(request);
+		push(work);
+	}
+
+	void QueueSubmitter::flush()
+	{
+		waitFor(WorkType::Flush);
+	}
+
+	void QueueSubmitter::waitIdle()
+	{
+		waitFor(WorkType::WaitIdle);
+	}
+
+	PresentResults QueueSubmitter::takePresentResults()
+	{
+		std::lock_guard<std::mutex> lock(presentResultMutex);
+		PresentResults results = presentResults;
+		presentResults = PresentResults();
+		return results;
+	}
+
+	QueueSubmitterStatistics QueueSubmitter::getStatistics()
+	{
+		QueueSubmitterStatistics statistics;
+		statistics.submissions = submissionCount.load();
+		statistics.submitCalls = submitCallCount.load();
+		statistics.presents = presentCount.load();
+		return statistics;
+	}
+
+	void QueueSubmitter::push(Work* work)
+	{
+		// Counted first, so the submission thread doesn't go to sleep while the push below is still in progress
+		pendingCount.fetch_add(1);
+		work->next.store(nullptr, std::memory_order_relaxed);
+		Work* previous = head.exchange(work, std::memory_order_acq_rel);
+		previous->next.store(work, std::memory_order_release);
+		if (sleeping.load()) {
+			// Taking the lock makes sure the thread is either waiting already or will see the pending work
+			std::lock_guard<std::mutex> lock(mutex);
+			workAvailable.notify_one();
+		}
+	}
+
+	QueueSubmitter::Work* QueueSubmitter::pop()
+	{
+		Work* current = tail;
+		Work* next = current->next.load(std::memory_order_acquire);
+		if (current == &stub) {
+			if (!next) {
+				return nullptr;
+			}
+			tail = next;
+			current = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (next) {
+			tail = next;
+			return current;
+		}
+		if (current != head.load(std::memory_order_acquire)) {
+			// A producer has exchanged head but not linked its node yet
+			return nullptr;
+		}
+		// current is the last node, put the stub behind it so it can be handed out
+		stub.next.store(nullptr, std::memory_order_relaxed);
+		Work* previous = head.exchange(&stub, std::memory_order_acq_rel);
+		previous->next.store(&stub, std::memory_order_release);
+		next = current->next.load(std::memory_order_acquire);
+		if (next) {
+			tail = next;
+			return current;
+		}
+		return nullptr;
+	}
+
+	void QueueSubmitter::waitFor(WorkType type)
+	{
+		bool done = false;
+		Work* work = new Work();
+		work->type = type;
+		work->done = &done;
+		push(work);
+		std::unique_lock<std::mutex> lock(mutex);
+		workDone.wait(lock, [&] { return done; });
+	}
+
+	void QueueSubmitter::threadLoop()
+	{
+		std::vector<Work*> batch;
+		while (true) {
+			Work* work = pop();
+			if (!work) {
+				if (pendingCount.load() > 0) {
+					// A push is halfway done
+					std::this_thread::yield();
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(mutex);
+				sleeping.store(true);
+				workAvailable.wait(lock, [this] { return stop || pendingCount.load() > 0; });
+				sleeping.store(false);
+				if (stop && pendingCount.load() == 0) {
+					return;
+				}
+				continue;
+			}
+
+			if (work->type == WorkType::Submit) {
+				batch.push_back(work);
+				// A fence covers everything in its vkQueueSubmit call, so a fenced submission ends the batch
+				bool moreQueued = pendingCount.load() > batch.size();
+				if (work->submission.fence == VK_NULL_HANDLE && moreQueued) {
+					continue;
+				}
+				submitBatch(batch);
+				continue;
+			}
+
+			// Presents and flushes must see everything queued before them handed over
+			submitBatch(batch);
+			switch (work->type) {
+			case WorkType::Present:
+				presentImage(work);
+				break;
+			case WorkType::WaitIdle:
+				VK_CHECK_RESULT(functions.queueWaitIdle(queue));
+				if (presentQueue != queue) {
+					VK_CHECK_RESULT(functions.queueWaitIdle(presentQueue));
+				}
+				break;
+			default:
+				break;
+			}
+			bool* done = work->done;
+			delete work;
+			pendingCount.fetch_sub(1);
+			if (done) {
+				std::lock_guard<std::mutex> lock(mutex);
+				*done = true;
+				workDone.notify_all();
+			}
+		}
+	}
+
+	void QueueSubmitter::submitBatch(std::vector<Work*>& batch)
+	{
+		if (batch.empty()) {
+			return;
+		}
+		std::vector<VkSubmitInfo> submitInfos(batch.size());
+		std::vector<VkTimelineSemaphoreSubmitInfo> timelineInfos(batch.size());
+		for (size_t i = 0; i < batch.size(); i++) {
+			const QueueSubmission& submission = batch[i]->submission;
+			VkSubmitInfo& submitInfo = submitInfos[i];
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.commandBufferCount = static_cast<uint32_t>(submission.commandBuffers.size());
+			submitInfo.pCommandBuffers = submission.commandBuffers.data();
+			submitInfo.waitSemaphoreCount = static_cast<uint32_t>(submission.waitSemaphores.size());
+			submitInfo.pWaitSemaphores = submission.waitSemaphores.data();
+			submitInfo.pWaitDstStageMask = submission.waitStages.data();
+			submitInfo.signalSemaphoreCount = static_cast<uint32_t>(submission.signalSemaphores.size());
+			submitInfo.pSignalSemaphores = submission.signalSemaphores.data();
+			if (!submission.waitValues.empty() || !submission.signalValues.empty()) {
+				VkTimelineSemaphoreSubmitInfo& timelineInfo = timelineInfos[i];
+				timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+				timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(submission.waitValues.size());
+				timelineInfo.pWaitSemaphoreValues = submission.waitValues.data();
+				timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(submission.signalValues.size());
+				timelineInfo.pSignalSemaphoreValues = submission.signalValues.data();
+				submitInfo.pNext = &timelineInfo;
+			}
+		}
+		// Only the last submission of a batch can carry a fence
+		VkFence fence = batch.back()->submission.fence;
+		VK_CHECK_RESULT(functions.queueSubmit(queue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), fence));
+
+		submissionCount.fetch_add(batch.size());
+		submitCallCount.fetch_add(1);
+		for (Work* work : batch) {
+			delete work;
+		}
+		pendingCount.fetch_sub(batch.size());
+		batch.clear();
+	}
+
+	void QueueSubmitter::presentImage(Work* work)
+	{
+		const PresentRequest& request = work->present;
+		VkPresentInfoKHR presentInfo{};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &request.swapchain;
+		presentInfo.pImageIndices = &request.imageIndex;
+		if (request.waitSemaphore != VK_NULL_HANDLE) {
+			presentInfo.waitSemaphoreCount = 1;
+			presentInfo.pWaitSemaphores = &request.waitSemaphore;
+		}
+		VkResult result;
+		{
+			std::lock_guard<std::mutex> lock(presentMutex);
+			result = functions.queuePresent(presentQueue, &presentInfo);
+		}
+		{
+			std::lock_guard<std::mutex> lock(presentResultMutex);
+			presentResults.count++;
+			presentResults.last = result;
+			if (result != VK_SUCCESS) {
+				presentResults.failure = result;
+			}
+		}
+		presentCount.fetch_add(1);
+		if (request.onPresented) {
+			request.onPresented(result);
+		}
+	}
+}
@@ -0,0 +1,155 @@
+/*
+* Queue submission thread
+*
+* A thread that owns a queue (and optionally the queue presents go to) and is the only one calling vkQueueSubmit and
+* vkQueuePresentKHR on it. Other threads hand their work over through a lock-free multi-producer queue, so neither
+* driver submission overhead nor a present blocking for vblank stalls them. Submissions that are pending at the same
+* time are coalesced into a single vkQueueSubmit call.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vks
+{
+	/** @brief Work for one VkSubmitInfo, the vectors are owned by the submitter once handed over */
+	struct QueueSubmission
+	{
+		std::vector<VkCommandBuffer> commandBuffers;
+		std::vector<VkSemaphore> waitSemaphores;
+		/** @brief One stage mask per wait semaphore */
+		std::vector<VkPipelineStageFlags> waitStages;
+		/** @brief Empty, or one value per wait semaphore if any of them is a timeline semaphore */
+		std::vector<uint64_t> waitValues;
+		std::vector<VkSemaphore> signalSemaphores;
+		/** @brief Empty, or one value per signal semaphore if any of them is a timeline semaphore */
+		std::vector<uint64_t> signalValues;
+		/** @brief Signaled once this and all submissions handed over before it have completed */
+		VkFence fence = VK_NULL_HANDLE;
+	};
+
+	struct PresentRequest
+	{
+		VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+		uint32_t imageIndex = 0;
+		VkSemaphore waitSemaphore = VK_NULL_HANDLE;
+		/** @brief (Optional) Called on the submission thread with the result of vkQueuePresentKHR */
+		std::function<void(VkResult)> onPresented;
+	};
+
+	/** @brief Entry points used by the submission thread, null members fall back to the functions exported by the loader */
+	struct QueueFunctions
+	{
+		PFN_vkQueueSubmit queueSubmit = nullptr;
+		PFN_vkQueuePresentKHR queuePresent = nullptr;
+		PFN_vkQueueWaitIdle queueWaitIdle = nullptr;
+	};
+
+	/** @brief Results of the presents issued since the last QueueSubmitter::takePresentResults() call */
+	struct PresentResults
+	{
+		/** @brief Number of presents issued */
+		uint64_t count = 0;
+		/** @brief Most recent result other than VK_SUCCESS, VK_SUCCESS if there was none */
+		VkResult failure = VK_SUCCESS;
+		/** @brief Result of the most recent present, only meaningful if count isn't zero */
+		VkResult last = VK_SUCCESS;
+	};
+
+	struct QueueSubmitterStatistics
+	{
+		/** @brief Submissions handed over */
+		uint64_t submissions = 0;
+		/** @brief vkQueueSubmit calls they have been coalesced into */
+		uint64_t submitCalls = 0;
+		uint64_t presents = 0;
+	};
+
+	class QueueSubmitter
+	{
+	public:
+		/**
+		* Start the submission thread
+		* @param queue Queue the thread submits to, no other thread may access it afterwards
+		* @param (Optional) presentQueue Queue presents go to, defaults to queue
+		* @param (Optional) functions Entry points to use instead of the loader's exports
+		*/
+		explicit QueueSubmitter(VkQueue queue, VkQueue presentQueue = VK_NULL_HANDLE, const QueueFunctions& functions = QueueFunctions());
+		/** @brief Hands over all pending work and stops the thread */
+		~QueueSubmitter();
+		QueueSubmitter(const QueueSubmitter&) = delete;
+		QueueSubmitter& operator=(const QueueSubmitter&) = delete;
+
+		/** @brief Queue a submission, can be called from any thread and never blocks on the driver */
+		void submit(QueueSubmission&& submission);
+		/** @brief Queue a present, it is issued after everything submitted before it */
+		void present(PresentRequest&& request);
+		/** @brief Block until all work queued by the calling thread so far has been handed to the driver */
+		void flush();
+		/** @brief Block until all queued work has been handed to the driver and the queues are idle */
+		void waitIdle();
+
+		/** @brief Results of the presents issued since the last call, a count of zero means no present has been reported */
+		PresentResults takePresentResults();
+		/**
+		* Lock while calling vkAcquireNextImageKHR on a swap chain presented through this submitter
+		* @note Acquire and present both require external synchronization of the swap chain
+		*/
+		std::mutex& getPresentMutex() { return presentMutex; }
+		QueueSubmitterStatistics getStatistics();
+
+	private:
+		enum class WorkType { Submit, Present, Flush, WaitIdle };
+		struct Work
+		{
+			std::atomic<Work*> next{ nullptr };
+			WorkType type = WorkType::Submit;
+			QueueSubmission submission;
+			PresentRequest present;
+			/** @brief Set by the submission thread once a flush has been reached */
+			bool* done = nullptr;
+		};
+
+		VkQueue queue;
+		VkQueue presentQueue;
+		QueueFunctions functions;
+		std::thread thread;
+
+		/** @brief Intrusive MPSC queue: producers exchange head, the submission thread consumes from tail */
+		std::atomic<Work*> head;
+		Work* tail;
+		Work stub;
+		/** @brief Work pushed but not processed yet */
+		std::atomic<uint64_t> pendingCount{ 0 };
+
+		std::mutex mutex;
+		std::condition_variable workAvailable;
+		std::condition_variable workDone;
+		std::atomic<bool> sleeping{ false };
+		bool stop = false;
+
+		std::mutex presentMutex;
+		std::mutex presentResultMutex;
+		PresentResults presentResults;
+		std::atomic<uint64_t> submissionCount{ 0 };
+		std::atomic<uint64_t> submitCallCount{ 0 };
+		std::atomic<uint64_t> presentCount{ 0 };
+
+		void push(Work* work);
+		Work* pop();
+		void waitFor(WorkType type);
+		void threadLoop();
+		void submitBatch(std::vector<Work*>& batch);
+		void presentImage(Work* work);
+	};
+}
@@ -16,13 +16,35 @@
 
 #include "VulkanRHI.h"
 #include "VulkanFunctions.h"
+#include "VulkanHostAllocator.h"
+#include "VulkanQueueSubmitter.h"
+#include "VulkanBarrierBatcher.h"
+#include "VulkanPipelineCache.h"
+#include "VulkanDeletionQueue.h"
 
 namespace EngineBase {
 
   VulkanRHI::VulkanRHI() :
     VulkanLibrary(),
     Window(),
-    Vulkan() {
+    Vulkan(),
+    FramesInFlight( 2 ),
+    FrameResources(),
+    CurrentFrame( 0 ),
+    FrameNumber( 0 ),
+    RetiredSwapChains(),
+    Submitter( nullptr ),
+    PipelineCachePath( "pipeline_cache.bin" ),
+    PipelineStateCache( nullptr ),
+    ResourceDeletionQueue( nullptr ),
+    SwapChainSuboptimal( false ),
+    SuboptimalSince(),
+    TimestampQueryPool( VK_NULL_HANDLE ),
+    TimestampPeriod( 0.0f ),
+    FrameTiming(),
+    FrameStart(),
+    TimedFrames( 0 ),
+    TimingSum() {
   }
 
   bool VulkanRHI::PrepareVulkan( OS::WindowParameters parameters )
@@ -56,21 +78,32 @@ namespace EngineBase {
     if( !GetDeviceQueue() ) {
       return false;
     }
+    if( !CreatePipelineCache() ) {
+      return false;
+    }
+    if( !CreateDeletionQueue() ) {
+      return false;
+    }
     if( !CreateSwapChain() ) {
       return false;
     }
+    if( !CreateFrameResources() ) {
+      return false;
+    }
     return true;
   }
 
   bool VulkanRHI::OnWindowSizeChanged() {
-    if( Vulkan.Device != VK_NULL_HANDLE ) {
-      vkDeviceWaitIdle( Vulkan.Device );
-    }
+    // Frames in flight keep running, the swap chain objects they use are retired instead of destroyed
+    bool recreate_framebuffers = !Framebuffers.empty();
 
     ChildClear();
 
     if( CreateSwapChain() ) {
       if( CanRender ) {
+        if( recreate_framebuffers && !CreateFrameBuffers() ) {
+          return false;
+        }
         return ChildOnWindowSizeChanged();
       }
       return true;
@@ -108,7 +141,7 @@ namespace EngineBase {
       GetGraphicsQueue().FamilyIndex                              // uint32_t                       queueFamilyIndex
       };
 
-      if (vkCreateCommandPool(GetDevice(), &cmd_pool_create_info, nullptr, &GraphicsCommandPool) != VK_SUCCESS) {
+      if (vkCreateCommandPool(GetDevice(), &cmd_pool_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Command ), &GraphicsCommandPool) != VK_SUCCESS) {
           return false;
       }
       return true;
@@ -189,7 +222,7 @@ namespace EngineBase {
         nullptr                                       // const VkSubpassDependency     *pDependencies
       };
 
-      if (vkCreateRenderPass(GetDevice(), &render_pass_create_info, nullptr, &RenderPass) != VK_SUCCESS) {
+      if (vkCreateRenderPass(GetDevice(), &render_pass_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Pipeline ), &RenderPass) != VK_SUCCESS) {
           std::cout << "Could not create render pass!" << std::endl;
           return false;
       }
@@ -210,12 +243,12 @@ namespace EngineBase {
             RenderPass,                          // VkRenderPass                   renderPass
             1,                                          // uint32_t                       attachmentCount
             &swap_chain_images[i].View,                 // const VkImageView             *pAttachments
-            300,                                        // uint32_t                       width
-            300,                                        // uint32_t                       height
+            GetSwapChain().Extent.width,                // uint32_t                       width
+            GetSwapChain().Extent.height,               // uint32_t                       height
             1                                           // uint32_t                       layers
           };
 
-          if (vkCreateFramebuffer(GetDevice(), &framebuffer_create_info, nullptr, &Framebuffers[i]) != VK_SUCCESS) {
+          if (vkCreateFramebuffer(GetDevice(), &framebuffer_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Resource ), &Framebuffers[i]) != VK_SUCCESS) {
               std::cout << "Could not create a framebuffer!" << std::endl;
               return false;
           }
@@ -223,6 +256,307 @@ namespace EngineBase {
       return true;
   }
 
+  bool VulkanRHI::CreateFrameResources() {
+    FrameResources.resize( FramesInFlight );
+    CurrentFrame = 0;
+
+    for( size_t i = 0; i < FrameResources.size(); ++i ) {
+      FrameResourcesParameters &frame = FrameResources[i];
+
+      // Every frame has a pool of its own, so it can be reset as a whole once the frame's fence has signaled
+      VkCommandPoolCreateInfo cmd_pool_create_info = {
+        VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,     // VkStructureType                sType
+        nullptr,                                        // const void                    *pNext
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,           // VkCommandPoolCreateFlags       flags
+        GetGraphicsQueue().FamilyIndex                  // uint32_t                       queueFamilyIndex
+      };
+      if( vkCreateCommandPool( GetDevice(), &cmd_pool_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Command ), &frame.CommandPool ) != VK_SUCCESS ) {
+        std::cout << "Could not create frame command pool!" << std::endl;
+        return false;
+      }
+
+      VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, // VkStructureType                sType
+        nullptr,                                        // const void                    *pNext
+        frame.CommandPool,                              // VkCommandPool                  commandPool
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY,                // VkCommandBufferLevel           level
+        1                                               // uint32_t                       bufferCount
+      };
+      if( vkAllocateCommandBuffers( GetDevice(), &command_buffer_allocate_info, &frame.CommandBuffer ) != VK_SUCCESS ) {
+        std::cout << "Could not allocate frame command buffer!" << std::endl;
+        return false;
+      }
+
+      VkSemaphoreCreateInfo semaphore_create_info = {
+        VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,        // VkStructureType                sType
+        nullptr,                                        // const void*                    pNext
+        0                                               // VkSemaphoreCreateFlags         flags
+      };
+      if( (vkCreateSemaphore( GetDevice(), &semaphore_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Command ), &frame.ImageAvailableSemaphore ) != VK_SUCCESS) ||
+          (vkCreateSemaphore( GetDevice(), &semaphore_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Command ), &frame.FinishedRenderingSemaphore ) != VK_SUCCESS) ) {
+        std::cout << "Could not create frame semaphores!" << std::endl;
+        return false;
+      }
+
+      // Created signaled, so the first wait on a frame that has never been submitted returns immediately
+      VkFenceCreateInfo fence_create_info = {
+        VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,            // VkStructureType                sType
+        nullptr,                                        // const void                    *pNext
+        VK_FENCE_CREATE_SIGNALED_BIT                    // VkFenceCreateFlags             flags
+      };
+      if( vkCreateFence( GetDevice(), &fence_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Command ), &frame.Fence ) != VK_SUCCESS ) {
+        std::cout << "Could not create frame fence!" << std::endl;
+        return false;
+      }
+    }
+
+    // Two timestamps per frame measure how long the GPU spent on it
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties( GetPhysicalDevice(), &device_properties );
+    if( device_properties.limits.timestampComputeAndGraphics ) {
+      VkQueryPoolCreateInfo query_pool_create_info = {
+        VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,       // VkStructureType                sType
+        nullptr,                                        // const void                    *pNext
+        0,                                              // VkQueryPoolCreateFlags         flags
+        VK_QUERY_TYPE_TIMESTAMP,                        // VkQueryType                    queryType
+        2 * FramesInFlight,                             // uint32_t                       queryCount
+        0                                               // VkQueryPipelineStatisticFlags  pipelineStatistics
+      };
+      if( vkCreateQueryPool( GetDevice(), &query_pool_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Resource ), &TimestampQueryPool ) != VK_SUCCESS ) {
+        std::cout << "Could not create timestamp query pool, GPU times are not measured!" << std::endl;
+        TimestampQueryPool = VK_NULL_HANDLE;
+      }
+      TimestampPeriod = device_properties.limits.timestampPeriod;
+    }
+
+    FrameStart = std::chrono::high_resolution_clock::now();
+    return true;
+  }
+
+  void VulkanRHI::DestroyFrameResources() {
+    for( size_t i = 0; i < FrameResources.size(); ++i ) {
+      FrameResourcesParameters &frame = FrameResources[i];
+      if( frame.Fence != VK_NULL_HANDLE ) {
+        vkDestroyFence( GetDevice(), frame.Fence, vks::allocationCallbacks( vks::HostAllocationScope::Command ) );
+      }
+      if( frame.ImageAvailableSemaphore != VK_NULL_HANDLE ) {
+        vkDestroySemaphore( GetDevice(), frame.ImageAvailableSemaphore, vks::allocationCallbacks( vks::HostAllocationScope::Command ) );
+      }
+      if( frame.FinishedRenderingSemaphore != VK_NULL_HANDLE ) {
+        vkDestroySemaphore( GetDevice(), frame.FinishedRenderingSemaphore, vks::allocationCallbacks( vks::HostAllocationScope::Command ) );
+      }
+      if( frame.CommandPool != VK_NULL_HANDLE ) {
+        vkDestroyCommandPool( GetDevice(), frame.CommandPool, vks::allocationCallbacks( vks::HostAllocationScope::Command ) );
+      }
+    }
+    FrameResources.clear();
+
+    if( TimestampQueryPool != VK_NULL_HANDLE ) {
+      vkDestroyQueryPool( GetDevice(), TimestampQueryPool, vks::allocationCallbacks( vks::HostAllocationScope::Resource ) );
+      TimestampQueryPool = VK_NULL_HANDLE;
+    }
+  }
+
+  VkResult VulkanRHI::BeginFrame( uint32_t &image_index ) {
+    FrameResourcesParameters &frame = FrameResources[CurrentFrame];
+
+    // Only blocks if the GPU is still working on the frame that used these resources FramesInFlight frames ago
+    std::chrono::high_resolution_clock::time_point wait_start = std::chrono::high_resolution_clock::now();
+    if( vkWaitForFences( GetDevice(), 1, &frame.Fence, VK_FALSE, 1000000000 ) != VK_SUCCESS ) {
+      std::cout << "Waiting for fence takes too long!" << std::endl;
+      return VK_TIMEOUT;
+    }
+    UpdateFrameTiming( frame, std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - wait_start ).count() );
+
+    VkResult result;
+    {
+      // The submission thread may be presenting to the same swap chain
+      std::lock_guard<std::mutex> lock( Submitter->getPresentMutex() );
+      result = vkAcquireNextImageKHR( GetDevice(), GetSwapChain().Handle, UINT64_MAX, frame.ImageAvailableSemaphore, VK_NULL_HANDLE, &image_index );
+    }
+    switch( result ) {
+      case VK_SUCCESS:
+      case VK_SUBOPTIMAL_KHR:
+        break;
+      case VK_ERROR_OUT_OF_DATE_KHR:
+        // The fence stays signaled as nothing gets submitted for this frame
+        return OnWindowSizeChanged() ? VK_NOT_READY : VK_ERROR_OUT_OF_DATE_KHR;
+      default:
+        std::cout << "Problem occurred during swap chain image acquisition!" << std::endl;
+        return result;
+    }
+
+    // Only frames that get submitted are counted, retirement assumes frame N - FramesInFlight has finished once frame N begins
+    FrameNumber++;
+    vks::BarrierBatcher::nextFrame();
+    // Retirements are tied to the same count, a frame that is never submitted must not release what other frames still use
+    ResourceDeletionQueue->nextFrame();
+    DestroyRetiredSwapChains( false );
+
+    vkResetFences( GetDevice(), 1, &frame.Fence );
+    vkResetCommandPool( GetDevice(), frame.CommandPool, 0 );
+
+    VkCommandBufferBeginInfo cmd_buffer_begin_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,      // VkStructureType                        sType
+      nullptr,                                          // const void                            *pNext
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,      // VkCommandBufferUsageFlags              flags
+      nullptr                                           // const VkCommandBufferInheritanceInfo  *pInheritanceInfo
+    };
+    vkBeginCommandBuffer( frame.CommandBuffer, &cmd_buffer_begin_info );
+
+    if( TimestampQueryPool != VK_NULL_HANDLE ) {
+      vkCmdResetQueryPool( frame.CommandBuffer, TimestampQueryPool, 2 * CurrentFrame, 2 );
+      vkCmdWriteTimestamp( frame.CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TimestampQueryPool, 2 * CurrentFrame );
+    }
+    return VK_SUCCESS;
+  }
+
+  bool VulkanRHI::EndFrame( uint32_t image_index ) {
+    FrameResourcesParameters &frame = FrameResources[CurrentFrame];
+
+    if( TimestampQueryPool != VK_NULL_HANDLE ) {
+      vkCmdWriteTimestamp( frame.CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TimestampQueryPool, 2 * CurrentFrame + 1 );
+    }
+    if( vkEndCommandBuffer( frame.CommandBuffer ) != VK_SUCCESS ) {
+      std::cout << "Could not record command buffer!" << std::endl;
+      return false;
+    }
+
+    // Submit and present are issued by the submission thread, so a present waiting for vblank doesn't hold up the next frame
+    vks::QueueSubmission submission;
+    submission.commandBuffers.push_back( frame.CommandBuffer );
+    submission.waitSemaphores.push_back( frame.ImageAvailableSemaphore );
+    submission.waitStages.push_back( VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT );
+    submission.signalSemaphores.push_back( frame.FinishedRenderingSemaphore );
+    submission.fence = frame.Fence;
+    Submitter->submit( std::move( submission ) );
+    frame.TimestampsWritten = TimestampQueryPool != VK_NULL_HANDLE;
+
+    vks::PresentRequest present_request;
+    present_request.swapchain = Vulkan.SwapChain.Handle;
+    present_request.imageIndex = image_index;
+    present_request.waitSemaphore = frame.FinishedRenderingSemaphore;
+    Submitter->present( std::move( present_request ) );
+
+    // Results arrive asynchronously, so this reports on the presents issued since the last frame, usually none or one
+    vks::PresentResults results = Submitter->takePresentResults();
+
+    // The next frame is recorded into the next set of resources while the GPU is still busy with this one
+    CurrentFrame = (CurrentFrame + 1) % FramesInFlight;
+
+    switch( results.failure ) {
+      case VK_SUCCESS:
+        // Only a present that has actually been reported as optimal ends the debounce period, not a frame without reports
+        if( results.count > 0 ) {
+          SwapChainSuboptimal = false;
+        }
+        break;
+      case VK_SUBOPTIMAL_KHR: {
+          // The latest present was optimal again, a later suboptimal result starts a new debounce period
+          if( results.last == VK_SUCCESS ) {
+            SwapChainSuboptimal = false;
+            break;
+          }
+          // Still presentable, so during an interactive resize the swap chain is only rebuilt once the size has settled
+          std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+          if( !SwapChainSuboptimal ) {
+            SwapChainSuboptimal = true;
+            SuboptimalSince = now;
+          } else if( now - SuboptimalSince >= GetResizeDebounce() ) {
+            return OnWindowSizeChanged();
+          }
+        }
+        break;
+      case VK_ERROR_OUT_OF_DATE_KHR:
+        return OnWindowSizeChanged();
+      default:
+        std::cout << "Problem occurred during image presentation!" << std::endl;
+        return false;
+    }
+    return true;
+  }
+
+  uint32_t VulkanRHI::GetCurrentFrameIndex() const {
+    return CurrentFrame;
+  }
+
+  const FrameResourcesParameters& VulkanRHI::GetCurrentFrameResources() const {
+    return FrameResources[CurrentFrame];
+  }
+
+  const FrameTimingParameters& VulkanRHI::GetFrameTiming() const {
+    return FrameTiming;
+  }
+
+  bool VulkanRHI::WaitForFrames() {
+    std::vector<VkFence> fences;
+    for( size_t i = 0; i < FrameResources.size(); ++i ) {
+      if( FrameResources[i].Fence != VK_NULL_HANDLE ) {
+        fences.push_back( FrameResources[i].Fence );
+      }
+    }
+    if( fences.empty() ) {
+      return true;
+    }
+    if( vkWaitForFences( GetDevice(), static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX ) != VK_SUCCESS ) {
+      std::cout << "Could not wait for frames in flight!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void VulkanRHI::DestroyRetiredSwapChains( bool all ) {
+    size_t kept = 0;
+    for( size_t i = 0; i < RetiredSwapChains.size(); ++i ) {
+      if( all || (RetiredSwapChains[i].Frame + FramesInFlight <= FrameNumber) ) {
+        for( size_t j = 0; j < RetiredSwapChains[i].Framebuffers.size(); ++j ) {
+          vkDestroyFramebuffer( Vulkan.Device, RetiredSwapChains[i].Framebuffers[j], vks::allocationCallbacks( vks::HostAllocationScope::Resource ) );
+        }
+        for( size_t j = 0; j < RetiredSwapChains[i].Views.size(); ++j ) {
+          vkDestroyImageView( Vulkan.Device, RetiredSwapChains[i].Views[j], vks::allocationCallbacks( vks::HostAllocationScope::Resource ) );
+        }
+        if( RetiredSwapChains[i].Handle != VK_NULL_HANDLE ) {
+          vkDestroySwapchainKHR( Vulkan.Device, RetiredSwapChains[i].Handle, vks::allocationCallbacks( vks::HostAllocationScope::Device ) );
+        }
+      } else {
+        RetiredSwapChains[kept++] = RetiredSwapChains[i];
+      }
+    }
+    RetiredSwapChains.resize( kept );
+  }
+
+  void VulkanRHI::UpdateFrameTiming( FrameResourcesParameters &frame, double cpu_wait_ms ) {
+    std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+    double frame_ms = std::chrono::duration<double, std::milli>( now - FrameStart ).count();
+    FrameStart = now;
+
+    // The frame's fence has signaled, so the timestamps of the last submission using these resources are available
+    double gpu_ms = 0.0;
+    if( frame.TimestampsWritten ) {
+      uint64_t timestamps[2] = {};
+      if( vkGetQueryPoolResults( GetDevice(), TimestampQueryPool, 2 * CurrentFrame, 2, sizeof( timestamps ), timestamps, sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT ) == VK_SUCCESS ) {
+        gpu_ms = static_cast<double>(timestamps[1] - timestamps[0]) * TimestampPeriod / 1000000.0;
+      }
+    }
+
+    TimingSum.FrameMs += frame_ms;
+    TimingSum.CpuWaitMs += cpu_wait_ms;
+    TimingSum.GpuMs += gpu_ms;
+    TimedFrames++;
+    if( TimingSum.FrameMs < 1000.0 ) {
+      return;
+    }
+
+    FrameTiming.FrameMs = TimingSum.FrameMs / TimedFrames;
+    FrameTiming.CpuWaitMs = TimingSum.CpuWaitMs / TimedFrames;
+    FrameTiming.GpuMs = TimingSum.GpuMs / TimedFrames;
+    // Share of the GPU's work that ran while the CPU was recording other frames instead of waiting for it
+    FrameTiming.OverlapPercent = (FrameTiming.GpuMs > 0.0) ? 100.0 * std::max( 0.0, FrameTiming.GpuMs - FrameTiming.CpuWaitMs ) / FrameTiming.GpuMs : 0.0;
+
+    TimingSum = FrameTimingParameters();
+    TimedFrames = 0;
+  }
+
   bool VulkanRHI::LoadVulkanLibrary() {
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
     VulkanLibrary = LoadLibrary( "vulkan-1.dll" );
@@ -320,7 +654,7 @@ namespace EngineBase {
       extensions.data()                               // const char * const        *ppEnabledExtensionNames
     };
 
-    if( vkCreateInstance( &instance_create_info, nullptr, &Vulkan.Instance ) != VK_SUCCESS ) {
+    if( vkCreateInstance( &instance_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Instance ), &Vulkan.Instance ) != VK_SUCCESS ) {
       std::cout << "Could not create Vulkan instance!" << std::endl;
       return false;
     }
@@ -349,7 +683,7 @@ namespace EngineBase {
       Window.Handle                                     // HWND                             hwnd
     };
 
-    if( vkCreateWin32SurfaceKHR( Vulkan.Instance, &surface_create_info, nullptr, &Vulkan.PresentationSurface ) == VK_SUCCESS ) {
+    if( vkCreateWin32SurfaceKHR( Vulkan.Instance, &surface_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Instance ), &Vulkan.PresentationSurface ) == VK_SUCCESS ) {
       return true;
     }
 
@@ -362,7 +696,7 @@ namespace EngineBase {
       Window.Handle                                     // xcb_window_t                     window
     };
 
-    if( vkCreateXcbSurfaceKHR( Vulkan.Instance, &surface_create_info, nullptr, &Vulkan.PresentationSurface ) == VK_SUCCESS ) {
+    if( vkCreateXcbSurfaceKHR( Vulkan.Instance, &surface_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Instance ), &Vulkan.PresentationSurface ) == VK_SUCCESS ) {
       return true;
     }
 
@@ -374,7 +708,7 @@ namespace EngineBase {
       Window.DisplayPtr,                                // Display                       *dpy
       Window.Handle                                     // Window                         window
     };
-    if( vkCreateXlibSurfaceKHR( Vulkan.Instance, &surface_create_info, nullptr, &Vulkan.PresentationSurface ) == VK_SUCCESS ) {
+    if( vkCreateXlibSurfaceKHR( Vulkan.Instance, &surface_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Instance ), &Vulkan.PresentationSurface ) == VK_SUCCESS ) {
       return true;
     }
 
@@ -452,7 +786,7 @@ namespace EngineBase {
       nullptr                                           // const VkPhysicalDeviceFeatures    *pEnabledFeatures
     };
 
-    if( vkCreateDevice( Vulkan.PhysicalDevice, &device_create_info, nullptr, &Vulkan.Device ) != VK_SUCCESS ) {
+    if( vkCreateDevice( Vulkan.PhysicalDevice, &device_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Device ), &Vulkan.Device ) != VK_SUCCESS ) {
       std::cout << "Could not create Vulkan device!" << std::endl;
       return false;
     }
@@ -570,22 +904,66 @@ namespace EngineBase {
   bool VulkanRHI::GetDeviceQueue() {
     vkGetDeviceQueue( Vulkan.Device, Vulkan.GraphicsQueue.FamilyIndex, 0, &Vulkan.GraphicsQueue.Handle );
     vkGetDeviceQueue( Vulkan.Device, Vulkan.PresentQueue.FamilyIndex, 0, &Vulkan.PresentQueue.Handle );
+
+    // From here on only the submission thread accesses the queues
+    vks::QueueFunctions queue_functions;
+    queue_functions.queueSubmit = vkQueueSubmit;
+    queue_functions.queuePresent = vkQueuePresentKHR;
+    queue_functions.queueWaitIdle = vkQueueWaitIdle;
+    Submitter = new vks::QueueSubmitter( Vulkan.GraphicsQueue.Handle, Vulkan.PresentQueue.Handle, queue_functions );
+    return true;
+  }
+
+  bool VulkanRHI::CreatePipelineCache() {
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties( GetPhysicalDevice(), &device_properties );
+
+    vks::PipelineCacheFunctions pipeline_cache_functions;
+    pipeline_cache_functions.createPipelineCache = vkCreatePipelineCache;
+    pipeline_cache_functions.destroyPipelineCache = vkDestroyPipelineCache;
+    pipeline_cache_functions.getPipelineCacheData = vkGetPipelineCacheData;
+    pipeline_cache_functions.createGraphicsPipelines = vkCreateGraphicsPipelines;
+    pipeline_cache_functions.destroyPipeline = vkDestroyPipeline;
+    PipelineStateCache = new vks::PipelineCache( GetDevice(), device_properties, PipelineCachePath, pipeline_cache_functions );
     return true;
   }
 
+  vks::PipelineCache* VulkanRHI::GetPipelineCache() const {
+    return PipelineStateCache;
+  }
+
+  bool VulkanRHI::CreateDeletionQueue() {
+    ResourceDeletionQueue = new vks::DeletionQueue( GetDevice(), FramesInFlight );
+    return true;
+  }
+
+  vks::DeletionQueue* VulkanRHI::GetDeletionQueue() const {
+    return ResourceDeletionQueue;
+  }
+
   bool VulkanRHI::CreateSwapChain() {
     CanRender = false;
+    SwapChainSuboptimal = false;
 
-    if( Vulkan.Device != VK_NULL_HANDLE ) {
-      vkDeviceWaitIdle( Vulkan.Device );
+    // Presents of the old swap chain have to be issued before it is passed as oldSwapchain, their results no longer matter
+    if( Submitter != nullptr ) {
+      Submitter->flush();
+      Submitter->takePresentResults();
     }
 
+    // Frames in flight may still render into the old images, so their views and framebuffers are destroyed
+    // once those frames have finished
+    RetiredSwapChainParameters retired_objects;
+    retired_objects.Frame = FrameNumber;
     for( size_t i = 0; i < Vulkan.SwapChain.Images.size(); ++i ) {
       if( Vulkan.SwapChain.Images[i].View != VK_NULL_HANDLE ) {
-        vkDestroyImageView( GetDevice(), Vulkan.SwapChain.Images[i].View, nullptr );
-        Vulkan.SwapChain.Images[i].View = VK_NULL_HANDLE;
+        retired_objects.Views.push_back( Vulkan.SwapChain.Images[i].View );
       }
     }
+    retired_objects.Framebuffers.swap( Framebuffers );
+    if( !retired_objects.Views.empty() || !retired_objects.Framebuffers.empty() ) {
+      RetiredSwapChains.push_back( retired_objects );
+    }
     Vulkan.SwapChain.Images.clear();
 
     VkSurfaceCapabilitiesKHR surface_capabilities;
@@ -661,12 +1039,16 @@ namespace EngineBase {
       old_swap_chain                                // VkSwapchainKHR                 oldSwapchain
     };
 
-    if( vkCreateSwapchainKHR( Vulkan.Device, &swap_chain_create_info, nullptr, &Vulkan.SwapChain.Handle ) != VK_SUCCESS ) {
+    if( vkCreateSwapchainKHR( Vulkan.Device, &swap_chain_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Device ), &Vulkan.SwapChain.Handle ) != VK_SUCCESS ) {
       std::cout << "Could not create swap chain!" << std::endl;
       return false;
     }
     if( old_swap_chain != VK_NULL_HANDLE ) {
-      vkDestroySwapchainKHR( Vulkan.Device, old_swap_chain, nullptr );
+      // Presents of the old images may still be queued, so it is destroyed once the frames in flight have cycled through
+      RetiredSwapChainParameters retired;
+      retired.Handle = old_swap_chain;
+      retired.Frame = FrameNumber;
+      RetiredSwapChains.push_back( retired );
     }
 
     Vulkan.SwapChain.Format = desired_format.format;
@@ -717,7 +1099,7 @@ namespace EngineBase {
         }
       };
 
-      if( vkCreateImageView( GetDevice(), &image_view_create_info, nullptr, &Vulkan.SwapChain.Images[i].View ) != VK_SUCCESS ) {
+      if( vkCreateImageView( GetDevice(), &image_view_create_info, vks::allocationCallbacks( vks::HostAllocationScope::Resource ), &Vulkan.SwapChain.Images[i].View ) != VK_SUCCESS ) {
         std::cout << "Could not create image view for framebuffer!" << std::endl;
         return false;
       }
@@ -853,26 +1235,46 @@ namespace EngineBase {
 
   VulkanRHI::~VulkanRHI() {
     if( Vulkan.Device != VK_NULL_HANDLE ) {
+      // Issues everything that is still queued
+      delete Submitter;
+      Submitter = nullptr;
+
       vkDeviceWaitIdle( Vulkan.Device );
 
+      if( PipelineStateCache != nullptr ) {
+        delete PipelineStateCache;
+        PipelineStateCache = nullptr;
+      }
+
+      // Destroys everything still queued, the device is idle
+      delete ResourceDeletionQueue;
+      ResourceDeletionQueue = nullptr;
+
+      DestroyFrameResources();
+      DestroyRetiredSwapChains( true );
+
+      for( size_t i = 0; i < Framebuffers.size(); ++i ) {
+        vkDestroyFramebuffer( GetDevice(), Framebuffers[i], vks::allocationCallbacks( vks::HostAllocationScope::Resource ) );
+      }
+
       for( size_t i = 0; i < Vulkan.SwapChain.Images.size(); ++i ) {
         if( Vulkan.SwapChain.Images[i].View != VK_NULL_HANDLE ) {
-          vkDestroyImageView( GetDevice(), Vulkan.SwapChain.Images[i].View, nullptr );
+          vkDestroyImageView( GetDevice(), Vulkan.SwapChain.Images[i].View, vks::allocationCallbacks( vks::HostAllocationScope::Resource ) );
         }
       }
 
       if( Vulkan.SwapChain.Handle != VK_NULL_HANDLE ) {
-        vkDestroySwapchainKHR( Vulkan.Device, Vulkan.SwapChain.Handle, nullptr );
+        vkDestroySwapchainKHR( Vulkan.Device, Vulkan.SwapChain.Handle, vks::allocationCallbacks( vks::HostAllocationScope::Device ) );
       }
-      vkDestroyDevice( Vulkan.Device, nullptr );
+      vkDestroyDevice( Vulkan.Device, vks::allocationCallbacks( vks::HostAllocationScope::Device ) );
     }
 
     if( Vulkan.PresentationSurface != VK_NULL_HANDLE ) {
-      vkDestroySurfaceKHR( Vulkan.Instance, Vulkan.PresentationSurface, nullptr );
+      vkDestroySurfaceKHR( Vulkan.Instance, Vulkan.PresentationSurface, vks::allocationCallbacks( vks::HostAllocationScope::Instance ) );
     }
 
     if( Vulkan.Instance != VK_NULL_HANDLE ) {
-      vkDestroyInstance( Vulkan.Instance, nullptr );
+      vkDestroyInstance( Vulkan.Instance, vks::allocationCallbacks( vks::HostAllocationScope::Instance ) );
     }
 
     if( VulkanLibrary ) {
@@ -18,9 +18,18 @@
 #define VULKAN_COMMON_HEADER
 
 #include <vector>
+#include <chrono>
+#include <algorithm>
+#include <string>
 #include "vulkan.h"
 #include "OperatingSystem.h"
 
+namespace vks {
+  class QueueSubmitter;
+  class PipelineCache;
+  class DeletionQueue;
+}
+
 namespace EngineBase {
 
   // ************************************************************ //
@@ -110,6 +119,68 @@ namespace EngineBase {
     }
   };
 
+  // ************************************************************ //
+  // FrameResourcesParameters                                     //
+  //                                                              //
+  // Resources owned by one frame in flight                       //
+  // ************************************************************ //
+  struct FrameResourcesParameters {
+    VkCommandPool                 CommandPool;
+    VkCommandBuffer               CommandBuffer;
+    VkSemaphore                   ImageAvailableSemaphore;
+    VkSemaphore                   FinishedRenderingSemaphore;
+    VkFence                       Fence;
+    bool                          TimestampsWritten;
+
+    FrameResourcesParameters() :
+      CommandPool( VK_NULL_HANDLE ),
+      CommandBuffer( VK_NULL_HANDLE ),
+      ImageAvailableSemaphore( VK_NULL_HANDLE ),
+      FinishedRenderingSemaphore( VK_NULL_HANDLE ),
+      Fence( VK_NULL_HANDLE ),
+      TimestampsWritten( false ) {
+    }
+  };
+
+  // ************************************************************ //
+  // FrameTimingParameters                                        //
+  //                                                              //
+  // CPU and GPU times of the most recent frames                  //
+  // ************************************************************ //
+  struct FrameTimingParameters {
+    double                        FrameMs;
+    double                        CpuWaitMs;
+    double                        GpuMs;
+    double                        OverlapPercent;
+
+    FrameTimingParameters() :
+      FrameMs( 0.0 ),
+      CpuWaitMs( 0.0 ),
+      GpuMs( 0.0 ),
+      OverlapPercent( 0.0 ) {
+    }
+  };
+
+  // ************************************************************ //
+  // RetiredSwapChainParameters                                   //
+  //                                                              //
+  // Swap chain objects replaced on resize, kept until the frames //
+  // in flight that may still use them have finished              //
+  // ************************************************************ //
+  struct RetiredSwapChainParameters {
+    VkSwapchainKHR                Handle;
+    std::vector<VkImageView>      Views;
+    std::vector<VkFramebuffer>    Framebuffers;
+    uint64_t                      Frame;
+
+    RetiredSwapChainParameters() :
+      Handle( VK_NULL_HANDLE ),
+      Views(),
+      Framebuffers(),
+      Frame( 0 ) {
+    }
+  };
+
   // ************************************************************ //
   // VulkanCommonParameters                                       //
   //                                                              //
@@ -164,6 +235,22 @@ namespace EngineBase {
 
      bool CreateFrameBuffers();
 
+     // Frames in flight, each with its own command pool, semaphores and fence
+     bool CreateFrameResources();
+     void DestroyFrameResources();
+     VkResult BeginFrame( uint32_t &image_index );
+     bool EndFrame( uint32_t image_index );
+     uint32_t                          GetCurrentFrameIndex() const;
+     const FrameResourcesParameters&   GetCurrentFrameResources() const;
+     // Averages over the last second of frames, updated once a second
+     const FrameTimingParameters&      GetFrameTiming() const;
+     // Waits for the frames in flight only, instead of the whole device
+     bool WaitForFrames();
+     // Its getStatistics() compares the creation time of a cold start with the next, warm one, read it before the RHI is destroyed
+     vks::PipelineCache*               GetPipelineCache() const;
+     // Objects of this device that frames in flight may still use are retired here, BeginFrame() destroys them once their frame has finished
+     vks::DeletionQueue*               GetDeletionQueue() const;
+
   public:
     OS::LibraryHandle       VulkanLibrary;
     OS::WindowParameters    Window;
@@ -179,9 +266,12 @@ namespace EngineBase {
      bool                          CheckPhysicalDeviceProperties( VkPhysicalDevice physical_device, uint32_t &graphics_queue_family_index, uint32_t &present_queue_family_index );
      bool                          LoadDeviceLevelEntryPoints();
      bool                          GetDeviceQueue();
+     bool                          CreatePipelineCache();
+     bool                          CreateDeletionQueue();
      bool                          CreateSwapChain();
      bool                          CreateSwapChainImageViews();
     virtual bool                  ChildOnWindowSizeChanged() = 0;
+    // Called on resize while frames may still be in flight, objects they use have to be released through WaitForFrames() first
     virtual  void                  ChildClear() = 0;
 
     bool                          CheckExtensionAvailability( const char *extension_name, const std::vector<VkExtensionProperties> &available_extensions );
@@ -191,15 +281,39 @@ namespace EngineBase {
     VkImageUsageFlags             GetSwapChainUsageFlags( VkSurfaceCapabilitiesKHR &surface_capabilities );
     VkSurfaceTransformFlagBitsKHR GetSwapChainTransform( VkSurfaceCapabilitiesKHR &surface_capabilities );
     VkPresentModeKHR              GetSwapChainPresentMode( std::vector<VkPresentModeKHR> &present_modes );
+    void                          UpdateFrameTiming( FrameResourcesParameters &frame, double cpu_wait_ms );
+    void                          DestroyRetiredSwapChains( bool all );
 
 
     VkRenderPass                        RenderPass;
     std::vector<VkFramebuffer>          Framebuffers;
     VkPipeline                          GraphicsPipeline;
-    VkSemaphore                         ImageAvailableSemaphore;
-    VkSemaphore                         RenderingFinishedSemaphore;
     VkCommandPool                       GraphicsCommandPool;
     std::vector<VkCommandBuffer>        GraphicsCommandBuffers;
+
+    // Has to be set before PrepareVulkan(), per-frame data of the application needs the same number of copies
+    uint32_t                            FramesInFlight;
+    std::vector<FrameResourcesParameters> FrameResources;
+    uint32_t                            CurrentFrame;
+    uint64_t                            FrameNumber;
+    std::vector<RetiredSwapChainParameters> RetiredSwapChains;
+    // Owns the graphics and present queue, submits and presents are handed to it so the frame loop never blocks on the driver
+    vks::QueueSubmitter                *Submitter;
+    // Has to be set before PrepareVulkan(), empty keeps compiled pipelines in memory only
+    std::string                         PipelineCachePath;
+    // Pipelines by state, the driver's pipeline cache is saved to PipelineCachePath on shutdown
+    vks::PipelineCache                 *PipelineStateCache;
+    // Created with FramesInFlight and advanced by BeginFrame()
+    vks::DeletionQueue                 *ResourceDeletionQueue;
+    // Set once a present reports VK_SUBOPTIMAL_KHR, the swap chain is rebuilt if it is still reported after the resize debounce time
+    bool                                SwapChainSuboptimal;
+    std::chrono::high_resolution_clock::time_point  SuboptimalSince;
+    VkQueryPool                         TimestampQueryPool;
+    float                               TimestampPeriod;
+    FrameTimingParameters               FrameTiming;
+    std::chrono::high_resolution_clock::time_point  FrameStart;
+    uint32_t                            TimedFrames;
+    FrameTimingParameters               TimingSum;
   };
 
 } // namespace ApiWithoutSecrets
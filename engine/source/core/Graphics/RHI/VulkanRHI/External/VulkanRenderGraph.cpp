@@ -0,0 +1,903 @@
+/*
+* Render graph
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanRenderGraph.h"
+#include "VulkanDevice.h"
+#include "VulkanHostAllocator.h"
+#include "VulkanInitializers.hpp"
+#include "Tools.h"
+#include <algorithm>
+#include <cassert>
+
+namespace vks
+{
+	namespace
+	{
+		const uint32_t noResource = UINT32_MAX;
+		const VkAccessFlags writeAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		bool isDepthFormat(VkFormat format)
+		{
+			switch (format) {
+			case VK_FORMAT_D16_UNORM:
+			case VK_FORMAT_X8_D24_UNORM_PACK32:
+			case VK_FORMAT_D32_SFLOAT:
+			case VK_FORMAT_D16_UNORM_S8_UINT:
+			case VK_FORMAT_D24_UNORM_S8_UINT:
+			case VK_FORMAT_D32_SFLOAT_S8_UINT:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool hasStencil(VkFormat format)
+		{
+			return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+		}
+
+		VkImageAspectFlags aspectMask(VkFormat format)
+		{
+			if (!isDepthFormat(format)) {
+				return VK_IMAGE_ASPECT_COLOR_BIT;
+			}
+			return VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+		}
+
+		bool isWrite(RenderGraphAccess access)
+		{
+			switch (access) {
+			case RenderGraphAccess::ColorAttachment:
+			case RenderGraphAccess::DepthStencilAttachment:
+			case RenderGraphAccess::StorageImageWrite:
+			case RenderGraphAccess::StorageBufferWrite:
+			case RenderGraphAccess::TransferDst:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		VkImageUsageFlags imageUsage(RenderGraphAccess access)
+		{
+			switch (access) {
+			case RenderGraphAccess::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+			case RenderGraphAccess::DepthStencilAttachment:
+			case RenderGraphAccess::DepthStencilReadOnly: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			case RenderGraphAccess::SampledImage: return VK_IMAGE_USAGE_SAMPLED_BIT;
+			case RenderGraphAccess::StorageImageRead:
+			case RenderGraphAccess::StorageImageWrite: return VK_IMAGE_USAGE_STORAGE_BIT;
+			case RenderGraphAccess::TransferSrc: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			case RenderGraphAccess::TransferDst: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			default: return 0;
+			}
+		}
+
+		VkBufferUsageFlags bufferUsage(RenderGraphAccess access)
+		{
+			switch (access) {
+			case RenderGraphAccess::UniformBuffer: return VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+			case RenderGraphAccess::StorageBufferRead:
+			case RenderGraphAccess::StorageBufferWrite: return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			case RenderGraphAccess::VertexBuffer: return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+			case RenderGraphAccess::IndexBuffer: return VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+			case RenderGraphAccess::IndirectBuffer: return VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+			case RenderGraphAccess::TransferSrc: return VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+			case RenderGraphAccess::TransferDst: return VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			default: return 0;
+			}
+		}
+
+		void hashCombine(uint64_t& hash, uint64_t value)
+		{
+			// FNV-1a over the bytes of the value
+			for (uint32_t i = 0; i < 8; i++) {
+				hash ^= (value >> (i * 8)) & 0xff;
+				hash *= 0x100000001b3ull;
+			}
+		}
+	}
+
+	VkImage RenderGraphContext::getImage(RenderGraphResource resource) const
+	{
+		return graph.resources[resource.index].imageHandle;
+	}
+
+	VkImageView RenderGraphContext::getImageView(RenderGraphResource resource) const
+	{
+		return graph.resources[resource.index].view;
+	}
+
+	VkBuffer RenderGraphContext::getBuffer(RenderGraphResource resource) const
+	{
+		return graph.resources[resource.index].buffer;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RenderGraphResource resource, RenderGraphAccess access, VkPipelineStageFlags stages)
+	{
+		assert(resource.valid() && !isWrite(access));
+		graph.passes[pass].uses.push_back({ resource.index, access, stages, false });
+		return *this;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RenderGraphResource resource, RenderGraphAccess access, VkPipelineStageFlags stages)
+	{
+		assert(resource.valid() && isWrite(access));
+		graph.passes[pass].uses.push_back({ resource.index, access, stages, true });
+		return *this;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::colorAttachment(RenderGraphResource resource, const VkClearColorValue* clearValue)
+	{
+		assert(resource.valid() && graph.resources[resource.index].image);
+		Pass& graphPass = graph.passes[pass];
+		graphPass.uses.push_back({ resource.index, RenderGraphAccess::ColorAttachment, 0, true });
+		Attachment attachment = { resource.index, clearValue != nullptr, {} };
+		if (clearValue) {
+			attachment.clearValue.color = *clearValue;
+		}
+		graphPass.colorAttachments.push_back(attachment);
+		return *this;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::depthAttachment(RenderGraphResource resource, const VkClearDepthStencilValue* clearValue, bool readOnly)
+	{
+		assert(resource.valid() && graph.resources[resource.index].image);
+		assert(!(readOnly && clearValue));
+		Pass& graphPass = graph.passes[pass];
+		graphPass.uses.push_back({ resource.index, readOnly ? RenderGraphAccess::DepthStencilReadOnly : RenderGraphAccess::DepthStencilAttachment, 0, !readOnly });
+		graphPass.depthAttachment = { resource.index, clearValue != nullptr, {} };
+		if (clearValue) {
+			graphPass.depthAttachment.clearValue.depthStencil = *clearValue;
+		}
+		graphPass.depthReadOnly = readOnly;
+		return *this;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffects()
+	{
+		graph.passes[pass].sideEffects = true;
+		return *this;
+	}
+
+	RenderGraph::RenderGraph(VulkanDevice* device) : device(device), barrierBatcher(device)
+	{
+	}
+
+	RenderGraph::~RenderGraph()
+	{
+		releaseCompiled();
+	}
+
+	void RenderGraph::reset()
+	{
+		passes.clear();
+		resources.clear();
+	}
+
+	RenderGraphResource RenderGraph::createImage(const std::string& name, const RenderGraphImageDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.image = true;
+		resource.imported = false;
+		resource.imageDesc = desc;
+		resources.push_back(resource);
+		return { static_cast<uint32_t>(resources.size() - 1) };
+	}
+
+	RenderGraphResource RenderGraph::createBuffer(const std::string& name, const RenderGraphBufferDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.image = false;
+		resource.imported = false;
+		resource.size = desc.size;
+		resources.push_back(resource);
+		return { static_cast<uint32_t>(resources.size() - 1) };
+	}
+
+	RenderGraphResource RenderGraph::importImage(const std::string& name, VkImage image, VkImageView view, const RenderGraphImageDesc& desc, VkImageLayout initialLayout, VkImageLayout finalLayout)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.image = true;
+		resource.imported = true;
+		resource.imageDesc = desc;
+		resource.initialLayout = initialLayout;
+		resource.finalLayout = finalLayout;
+		resource.imageHandle = image;
+		resource.view = view;
+		resources.push_back(resource);
+		return { static_cast<uint32_t>(resources.size() - 1) };
+	}
+
+	RenderGraphResource RenderGraph::importBuffer(const std::string& name, VkBuffer buffer, VkDeviceSize size)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.image = false;
+		resource.imported = true;
+		resource.size = size;
+		resource.buffer = buffer;
+		resources.push_back(resource);
+		return { static_cast<uint32_t>(resources.size() - 1) };
+	}
+
+	void RenderGraph::markOutput(RenderGraphResource resource)
+	{
+		resources[resource.index].output = true;
+	}
+
+	RenderGraph::PassBuilder RenderGraph::addPass(const std::string& name, RenderGraphPassType type, ExecuteFunction execute)
+	{
+		Pass pass;
+		pass.name = name;
+		pass.type = type;
+		pass.execute = std::move(execute);
+		passes.push_back(std::move(pass));
+		return PassBuilder(*this, static_cast<uint32_t>(passes.size() - 1));
+	}
+
+	void RenderGraph::compile()
+	{
+		statistics.declaredPasses = static_cast<uint32_t>(passes.size());
+		const uint64_t hash = hashTopology();
+		if (compiled && hash == compiledHash) {
+			attachTransients();
+			return;
+		}
+		releaseCompiled();
+
+		std::vector<uint32_t> order = cullPasses();
+		statistics.culledPasses = static_cast<uint32_t>(passes.size() - order.size());
+		transients.assign(resources.size(), TransientResource());
+		std::vector<uint32_t> aliasPredecessor;
+		createTransients(order, aliasPredecessor);
+		attachTransients();
+		buildSchedule(order, aliasPredecessor);
+
+		compiledHash = hash;
+		compiled = true;
+		statistics.compilations++;
+	}
+
+	void RenderGraph::execute(VkCommandBuffer commandBuffer)
+	{
+		assert(compiled);
+		RenderGraphContext context(*this);
+		context.commandBuffer = commandBuffer;
+		std::vector<VkClearValue> clearValues;
+		for (CompiledPass& compiledPass : schedule) {
+			recordBarriers(commandBuffer, compiledPass.barriers);
+			Pass& pass = passes[compiledPass.pass];
+			if (compiledPass.renderPass == VK_NULL_HANDLE) {
+				context.renderPass = VK_NULL_HANDLE;
+				context.renderArea = { 0, 0 };
+				pass.execute(context);
+				continue;
+			}
+			// Clear values aren't part of the topology, they are taken from this frame's declaration
+			clearValues.clear();
+			for (const Attachment& attachment : pass.colorAttachments) {
+				clearValues.push_back(attachment.clearValue);
+			}
+			if (pass.depthAttachment.resource != noResource) {
+				clearValues.push_back(pass.depthAttachment.clearValue);
+			}
+			VkRenderPassBeginInfo beginInfo = vks::initializers::renderPassBeginInfo();
+			beginInfo.renderPass = compiledPass.renderPass;
+			beginInfo.framebuffer = getFramebuffer(compiledPass);
+			beginInfo.renderArea.extent = compiledPass.extent;
+			beginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+			beginInfo.pClearValues = clearValues.data();
+			vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			context.renderPass = compiledPass.renderPass;
+			context.renderArea = compiledPass.extent;
+			pass.execute(context);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		recordBarriers(commandBuffer, finalBarriers);
+	}
+
+	void RenderGraph::releaseFramebuffers()
+	{
+		std::vector<VkFramebuffer> framebuffers;
+		for (CompiledPass& compiledPass : schedule) {
+			for (auto& entry : compiledPass.framebuffers) {
+				framebuffers.push_back(entry.second);
+			}
+			compiledPass.framebuffers.clear();
+		}
+		if (framebuffers.empty()) {
+			return;
+		}
+		RetiredResources retired;
+		VkDevice logicalDevice = device->logicalDevice;
+		retired.callbacks.push_back([logicalDevice, framebuffers]() {
+			for (VkFramebuffer framebuffer : framebuffers) {
+				vkDestroyFramebuffer(logicalDevice, framebuffer, allocationCallbacks(HostAllocationScope::Resource));
+			}
+		});
+		retire(std::move(retired));
+	}
+
+	uint64_t RenderGraph::hashTopology() const
+	{
+		// Everything compile() derives its output from, except the handles of imported resources and clear values
+		uint64_t hash = 0xcbf29ce484222325ull;
+		hashCombine(hash, resources.size());
+		for (const Resource& resource : resources) {
+			hashCombine(hash, (resource.image ? 1 : 0) | (resource.imported ? 2 : 0) | (resource.output ? 4 : 0));
+			hashCombine(hash, resource.imageDesc.format);
+			hashCombine(hash, (static_cast<uint64_t>(resource.imageDesc.extent.width) << 32) | resource.imageDesc.extent.height);
+			hashCombine(hash, (static_cast<uint64_t>(resource.imageDesc.mipLevels) << 32) | resource.imageDesc.samples);
+			hashCombine(hash, resource.size);
+			hashCombine(hash, (static_cast<uint64_t>(resource.initialLayout) << 32) | resource.finalLayout);
+		}
+		hashCombine(hash, passes.size());
+		for (const Pass& pass : passes) {
+			hashCombine(hash, static_cast<uint64_t>(pass.type) | (pass.sideEffects ? 0x100 : 0) | (pass.depthReadOnly ? 0x200 : 0));
+			hashCombine(hash, pass.uses.size());
+			for (const ResourceUse& use : pass.uses) {
+				hashCombine(hash, (static_cast<uint64_t>(use.resource) << 32) | static_cast<uint64_t>(use.access));
+				hashCombine(hash, use.stages);
+			}
+			hashCombine(hash, pass.colorAttachments.size());
+			for (const Attachment& attachment : pass.colorAttachments) {
+				hashCombine(hash, (static_cast<uint64_t>(attachment.resource) << 1) | (attachment.clear ? 1 : 0));
+			}
+			hashCombine(hash, (static_cast<uint64_t>(pass.depthAttachment.resource) << 1) | (pass.depthAttachment.clear ? 1 : 0));
+		}
+		return hash;
+	}
+
+	void RenderGraph::releaseCompiled()
+	{
+		RetiredResources retired;
+		std::vector<VkRenderPass> renderPasses;
+		std::vector<VkFramebuffer> framebuffers;
+		for (CompiledPass& compiledPass : schedule) {
+			if (compiledPass.renderPass != VK_NULL_HANDLE) {
+				renderPasses.push_back(compiledPass.renderPass);
+			}
+			for (auto& entry : compiledPass.framebuffers) {
+				framebuffers.push_back(entry.second);
+			}
+		}
+		if (!renderPasses.empty() || !framebuffers.empty()) {
+			VkDevice logicalDevice = device->logicalDevice;
+			retired.callbacks.push_back([logicalDevice, renderPasses, framebuffers]() {
+				for (VkFramebuffer framebuffer : framebuffers) {
+					vkDestroyFramebuffer(logicalDevice, framebuffer, allocationCallbacks(HostAllocationScope::Resource));
+				}
+				for (VkRenderPass renderPass : renderPasses) {
+					vkDestroyRenderPass(logicalDevice, renderPass, allocationCallbacks(HostAllocationScope::Pipeline));
+				}
+			});
+		}
+		for (TransientResource& transient : transients) {
+			if (transient.view != VK_NULL_HANDLE) {
+				retired.imageViews.push_back(transient.view);
+			}
+			if (transient.image != VK_NULL_HANDLE) {
+				retired.images.push_back(transient.image);
+			}
+			if (transient.buffer != VK_NULL_HANDLE) {
+				retired.buffers.push_back(transient.buffer);
+			}
+		}
+		retired.allocations.insert(retired.allocations.end(), aliasedMemory.begin(), aliasedMemory.end());
+		retire(std::move(retired));
+
+		schedule.clear();
+		transients.clear();
+		aliasedMemory.clear();
+		finalBarriers = BarrierBatch();
+		compiled = false;
+	}
+
+	std::vector<uint32_t> RenderGraph::cullPasses() const
+	{
+		// Walk backwards from the outputs, a pass is live if it writes something a live pass or the application still needs
+		std::vector<bool> needed(resources.size());
+		for (size_t i = 0; i < resources.size(); i++) {
+			needed[i] = resources[i].output || resources[i].imported;
+		}
+		std::vector<bool> live(passes.size());
+		for (size_t p = passes.size(); p-- > 0;) {
+			const Pass& pass = passes[p];
+			bool keep = pass.sideEffects;
+			for (const ResourceUse& use : pass.uses) {
+				keep = keep || (use.write && needed[use.resource]);
+			}
+			if (!keep) {
+				continue;
+			}
+			live[p] = true;
+			// A cleared attachment replaces the contents, so earlier writes are only needed if an earlier live pass reads them
+			for (const Attachment& attachment : pass.colorAttachments) {
+				if (attachment.clear) {
+					needed[attachment.resource] = false;
+				}
+			}
+			if (pass.depthAttachment.resource != noResource && pass.depthAttachment.clear) {
+				needed[pass.depthAttachment.resource] = false;
+			}
+			// Everything else, including writes that may only touch part of a resource, depends on the previous contents
+			for (const ResourceUse& use : pass.uses) {
+				const bool clearedColor = use.access == RenderGraphAccess::ColorAttachment && std::any_of(pass.colorAttachments.begin(), pass.colorAttachments.end(), [&](const Attachment& attachment) { return attachment.resource == use.resource && attachment.clear; });
+				const bool clearedDepth = use.access == RenderGraphAccess::DepthStencilAttachment && pass.depthAttachment.clear;
+				if (!clearedColor && !clearedDepth) {
+					needed[use.resource] = true;
+				}
+			}
+		}
+		std::vector<uint32_t> order;
+		for (uint32_t p = 0; p < passes.size(); p++) {
+			if (live[p]) {
+				order.push_back(p);
+			}
+		}
+		return order;
+	}
+
+	void RenderGraph::createTransients(const std::vector<uint32_t>& order, std::vector<uint32_t>& aliasPredecessor)
+	{
+		const uint32_t resourceCount = static_cast<uint32_t>(resources.size());
+		std::vector<uint32_t> firstUse(resourceCount, noResource);
+		std::vector<uint32_t> lastUse(resourceCount, 0);
+		std::vector<uint32_t> usage(resourceCount, 0);
+		for (uint32_t position = 0; position < order.size(); position++) {
+			for (const ResourceUse& use : passes[order[position]].uses) {
+				firstUse[use.resource] = std::min(firstUse[use.resource], position);
+				lastUse[use.resource] = position;
+				usage[use.resource] |= resources[use.resource].image ? imageUsage(use.access) : bufferUsage(use.access);
+			}
+		}
+
+		struct Candidate
+		{
+			uint32_t resource;
+			VkMemoryRequirements requirements;
+		};
+		std::vector<Candidate> candidates;
+		for (uint32_t r = 0; r < resourceCount; r++) {
+			const Resource& resource = resources[r];
+			if (resource.imported || firstUse[r] == noResource) {
+				continue;
+			}
+			Candidate candidate = { r, {} };
+			if (resource.image) {
+				VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
+				imageInfo.imageType = VK_IMAGE_TYPE_2D;
+				imageInfo.format = resource.imageDesc.format;
+				imageInfo.extent = { resource.imageDesc.extent.width, resource.imageDesc.extent.height, 1 };
+				imageInfo.mipLevels = resource.imageDesc.mipLevels;
+				imageInfo.arrayLayers = 1;
+				imageInfo.samples = resource.imageDesc.samples;
+				imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+				imageInfo.usage = usage[r];
+				imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, allocationCallbacks(HostAllocationScope::Resource), &transients[r].image));
+				vkGetImageMemoryRequirements(device->logicalDevice, transients[r].image, &candidate.requirements);
+			} else {
+				VkBufferCreateInfo bufferInfo = vks::initializers::bufferCreateInfo(usage[r], resource.size);
+				VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferInfo, allocationCallbacks(HostAllocationScope::Resource), &transients[r].buffer));
+				vkGetBufferMemoryRequirements(device->logicalDevice, transients[r].buffer, &candidate.requirements);
+			}
+			candidates.push_back(candidate);
+		}
+
+		// Largest first, each resource goes into the first block of the same kind whose residents' lifetimes don't overlap its own
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.requirements.size > b.requirements.size; });
+		struct Block
+		{
+			bool image;
+			VkMemoryRequirements requirements;
+			std::vector<uint32_t> residents;
+		};
+		std::vector<Block> blocks;
+		std::vector<uint32_t> blockOf(resourceCount, noResource);
+		for (const Candidate& candidate : candidates) {
+			const uint32_t r = candidate.resource;
+			uint32_t blockIndex = noResource;
+			for (uint32_t b = 0; b < blocks.size() && blockIndex == noResource; b++) {
+				const Block& block = blocks[b];
+				if (block.image != resources[r].image || (block.requirements.memoryTypeBits & candidate.requirements.memoryTypeBits) == 0) {
+					continue;
+				}
+				const bool overlaps = std::any_of(block.residents.begin(), block.residents.end(), [&](uint32_t other) { return firstUse[r] <= lastUse[other] && firstUse[other] <= lastUse[r]; });
+				if (!overlaps) {
+					blockIndex = b;
+				}
+			}
+			if (blockIndex == noResource) {
+				blocks.push_back({ resources[r].image, candidate.requirements, {} });
+				blockIndex = static_cast<uint32_t>(blocks.size() - 1);
+			}
+			Block& block = blocks[blockIndex];
+			block.requirements.size = std::max(block.requirements.size, candidate.requirements.size);
+			block.requirements.alignment = std::max(block.requirements.alignment, candidate.requirements.alignment);
+			block.requirements.memoryTypeBits &= candidate.requirements.memoryTypeBits;
+			block.residents.push_back(r);
+			blockOf[r] = blockIndex;
+		}
+
+		statistics.transientResources = static_cast<uint32_t>(candidates.size());
+		statistics.aliasedBlocks = static_cast<uint32_t>(blocks.size());
+		statistics.transientMemory = 0;
+		aliasPredecessor.assign(resourceCount, noResource);
+		for (Block& block : blocks) {
+			Allocation allocation;
+			VK_CHECK_RESULT(device->memoryAllocator->allocate(block.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, block.image ? AllocationType::Optimal : AllocationType::Linear, &allocation, 0, MemoryCategory::Attachment));
+			aliasedMemory.push_back(allocation);
+			statistics.transientMemory += block.requirements.size;
+			for (uint32_t r : block.residents) {
+				if (block.image) {
+					VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, transients[r].image, allocation.memory, allocation.offset));
+					const RenderGraphImageDesc& desc = resources[r].imageDesc;
+					VkImageViewCreateInfo viewInfo = vks::initializers::imageViewCreateInfo();
+					viewInfo.image = transients[r].image;
+					viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+					viewInfo.format = desc.format;
+					viewInfo.subresourceRange = { aspectMask(desc.format), 0, desc.mipLevels, 0, 1 };
+					// Depth/stencil views used for sampling only see the depth aspect
+					if (isDepthFormat(desc.format)) {
+						viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+					}
+					VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, allocationCallbacks(HostAllocationScope::Resource), &transients[r].view));
+				} else {
+					VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, transients[r].buffer, allocation.memory, allocation.offset));
+				}
+				// The previous resident of the memory has to be done with it before this one's first use
+				for (uint32_t other : block.residents) {
+					if (lastUse[other] < firstUse[r] && (aliasPredecessor[r] == noResource || lastUse[other] > lastUse[aliasPredecessor[r]])) {
+						aliasPredecessor[r] = other;
+					}
+				}
+			}
+		}
+	}
+
+	void RenderGraph::buildSchedule(const std::vector<uint32_t>& order, const std::vector<uint32_t>& aliasPredecessor)
+	{
+		const uint32_t resourceCount = static_cast<uint32_t>(resources.size());
+		std::vector<uint32_t> lastUse(resourceCount, 0);
+		for (uint32_t position = 0; position < order.size(); position++) {
+			for (const ResourceUse& use : passes[order[position]].uses) {
+				lastUse[use.resource] = position;
+			}
+		}
+
+		std::vector<ResourceState> states(resourceCount);
+		std::vector<bool> seen(resourceCount, false);
+		for (uint32_t r = 0; r < resourceCount; r++) {
+			const Resource& resource = resources[r];
+			if (!resource.imported) {
+				continue;
+			}
+			// Work submitted before the graph is only known to have happened, so the first use waits for all of it
+			ResourceState& state = states[r];
+			state.layout = resource.image ? resource.initialLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+			state.initialized = !resource.image || resource.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+			state.writeStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			state.writeAccess = state.initialized ? VK_ACCESS_MEMORY_WRITE_BIT : 0;
+		}
+
+		statistics.imageBarriers = 0;
+		statistics.bufferBarriers = 0;
+		for (uint32_t position = 0; position < order.size(); position++) {
+			const Pass& pass = passes[order[position]];
+			CompiledPass compiledPass;
+			compiledPass.pass = order[position];
+
+			// Uses of the same resource within a pass are merged into one, conflicting layouts fall back to general
+			std::vector<std::pair<uint32_t, AccessState>> merged;
+			for (const ResourceUse& use : pass.uses) {
+				AccessState access = getAccessState(use.access, use.stages, pass.type);
+				auto existing = std::find_if(merged.begin(), merged.end(), [&](const std::pair<uint32_t, AccessState>& entry) { return entry.first == use.resource; });
+				if (existing == merged.end()) {
+					merged.push_back({ use.resource, access });
+					continue;
+				}
+				existing->second.stages |= access.stages;
+				existing->second.access |= access.access;
+				existing->second.write = existing->second.write || access.write;
+				if (existing->second.layout != access.layout) {
+					existing->second.layout = VK_IMAGE_LAYOUT_GENERAL;
+				}
+			}
+
+			// Load and store ops, from the state before this pass
+			std::vector<uint32_t> attachments;
+			std::vector<bool> clears;
+			for (const Attachment& attachment : pass.colorAttachments) {
+				attachments.push_back(attachment.resource);
+				clears.push_back(attachment.clear);
+			}
+			if (pass.depthAttachment.resource != noResource) {
+				attachments.push_back(pass.depthAttachment.resource);
+				clears.push_back(pass.depthAttachment.clear);
+			}
+			std::vector<VkAttachmentLoadOp> loadOps;
+			std::vector<VkAttachmentStoreOp> storeOps;
+			std::vector<bool> discard(resourceCount, false);
+			for (size_t i = 0; i < attachments.size(); i++) {
+				const uint32_t r = attachments[i];
+				const bool defined = states[r].initialized;
+				loadOps.push_back(clears[i] ? VK_ATTACHMENT_LOAD_OP_CLEAR : (defined ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE));
+				const bool readLater = lastUse[r] > position || resources[r].imported || resources[r].output;
+				storeOps.push_back(readLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE);
+				discard[r] = loadOps.back() != VK_ATTACHMENT_LOAD_OP_LOAD;
+			}
+
+			BarrierBatch& batch = compiledPass.barriers;
+			for (auto& entry : merged) {
+				const uint32_t r = entry.first;
+				const AccessState& use = entry.second;
+				ResourceState& state = states[r];
+				if (!seen[r]) {
+					seen[r] = true;
+					// Memory shared with an earlier transient is still in use by that resource's last accesses
+					if (aliasPredecessor.size() > r && aliasPredecessor[r] != noResource) {
+						const ResourceState& previous = states[aliasPredecessor[r]];
+						state.writeStages = previous.writeStages | previous.readStages;
+						state.writeAccess = previous.writeAccess;
+					}
+				}
+
+				const bool image = resources[r].image;
+				const bool layoutChange = image && state.layout != use.layout;
+				bool needBarrier = false;
+				VkPipelineStageFlags srcStages = 0;
+				VkAccessFlags srcAccess = 0;
+				if (layoutChange || use.write) {
+					// Writes and layout transitions wait for the readers since the last write, which already waited for that write
+					if (state.readStages) {
+						srcStages = state.readStages;
+					} else if (state.writeStages) {
+						srcStages = state.writeStages;
+						srcAccess = state.writeAccess;
+					}
+					needBarrier = layoutChange || srcStages != 0;
+				} else if (state.writeStages && (use.stages & ~state.visibleStages)) {
+					// Read after write by stages that haven't seen the write yet, reads after reads need nothing
+					srcStages = state.writeStages;
+					srcAccess = state.writeAccess;
+					needBarrier = true;
+				}
+				if (needBarrier) {
+					const VkImageLayout oldLayout = (discard[r] || !state.initialized) ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+					batch.barriers.push_back({ r, srcStages, srcAccess, use.stages, use.access, image ? oldLayout : VK_IMAGE_LAYOUT_UNDEFINED, image ? use.layout : VK_IMAGE_LAYOUT_UNDEFINED });
+					if (image) {
+						statistics.imageBarriers++;
+					} else {
+						statistics.bufferBarriers++;
+					}
+				}
+
+				if (use.write) {
+					state.writeStages = use.stages;
+					state.writeAccess = use.access & writeAccessMask;
+					state.visibleStages = 0;
+					state.readStages = 0;
+					state.initialized = true;
+				} else if (layoutChange) {
+					// The transition counts as a write that the stages of this use have already waited for
+					state.writeStages = use.stages;
+					state.writeAccess = 0;
+					state.visibleStages = use.stages;
+					state.readStages = use.stages;
+				} else {
+					if (needBarrier) {
+						state.visibleStages |= use.stages;
+					}
+					state.readStages |= use.stages;
+				}
+				if (image) {
+					state.layout = use.layout;
+				}
+			}
+
+			if (pass.type == RenderGraphPassType::Graphics && !attachments.empty()) {
+				compiledPass.attachments = attachments;
+				compiledPass.extent = resources[attachments[0]].imageDesc.extent;
+				createRenderPass(compiledPass, loadOps, storeOps);
+			}
+			schedule.push_back(std::move(compiledPass));
+		}
+
+		// Imported images are handed back in the layout the application expects
+		for (uint32_t r = 0; r < resourceCount; r++) {
+			const Resource& resource = resources[r];
+			const ResourceState& state = states[r];
+			if (!resource.imported || !resource.image || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == state.layout) {
+				continue;
+			}
+			// Whatever uses the image after the graph has to see the transition, the layout table knows which stages that is
+			const ImageLayoutAccess finalAccess = getImageLayoutAccess(resource.finalLayout);
+			finalBarriers.barriers.push_back({ r, state.writeStages | state.readStages, state.writeAccess, finalAccess.stages, finalAccess.access, state.layout, resource.finalLayout });
+			statistics.imageBarriers++;
+		}
+	}
+
+	void RenderGraph::createRenderPass(CompiledPass& compiledPass, const std::vector<VkAttachmentLoadOp>& loadOps, const std::vector<VkAttachmentStoreOp>& storeOps)
+	{
+		// Layouts are changed by the barriers in front of the pass, so attachments stay in the same layout throughout
+		const Pass& pass = passes[compiledPass.pass];
+		std::vector<VkAttachmentDescription> descriptions;
+		std::vector<VkAttachmentReference> colorReferences;
+		VkAttachmentReference depthReference = {};
+		for (size_t i = 0; i < compiledPass.attachments.size(); i++) {
+			const RenderGraphImageDesc& desc = resources[compiledPass.attachments[i]].imageDesc;
+			const bool depth = isDepthFormat(desc.format);
+			VkImageLayout layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			if (depth) {
+				layout = pass.depthReadOnly ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			}
+			VkAttachmentDescription description = {};
+			description.format = desc.format;
+			description.samples = desc.samples;
+			description.loadOp = loadOps[i];
+			description.storeOp = storeOps[i];
+			description.stencilLoadOp = hasStencil(desc.format) ? loadOps[i] : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			description.stencilStoreOp = hasStencil(desc.format) ? storeOps[i] : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			description.initialLayout = layout;
+			description.finalLayout = layout;
+			descriptions.push_back(description);
+			if (depth) {
+				depthReference = { static_cast<uint32_t>(i), layout };
+			} else {
+				colorReferences.push_back({ static_cast<uint32_t>(i), layout });
+			}
+		}
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+		subpass.pColorAttachments = colorReferences.data();
+		subpass.pDepthStencilAttachment = pass.depthAttachment.resource != noResource ? &depthReference : nullptr;
+
+		VkRenderPassCreateInfo renderPassInfo = vks::initializers::renderPassCreateInfo();
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+		renderPassInfo.pAttachments = descriptions.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassInfo, allocationCallbacks(HostAllocationScope::Pipeline), &compiledPass.renderPass));
+	}
+
+	void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch)
+	{
+		for (const Barrier& barrier : batch.barriers) {
+			const Resource& resource = resources[barrier.resource];
+			if (resource.image) {
+				barrierBatcher.imageBarrier(resource.imageHandle, { aspectMask(resource.imageDesc.format), 0, resource.imageDesc.mipLevels, 0, 1 }, barrier.oldLayout, barrier.newLayout,
+					barrier.srcStages, barrier.srcAccess, barrier.dstStages, barrier.dstAccess);
+			} else {
+				barrierBatcher.bufferBarrier(resource.buffer, barrier.srcStages, barrier.srcAccess, barrier.dstStages, barrier.dstAccess);
+			}
+		}
+		barrierBatcher.flush(commandBuffer);
+	}
+
+	VkFramebuffer RenderGraph::getFramebuffer(CompiledPass& compiledPass)
+	{
+		std::vector<VkImageView> views;
+		for (uint32_t r : compiledPass.attachments) {
+			views.push_back(resources[r].view);
+		}
+		auto existing = compiledPass.framebuffers.find(views);
+		if (existing != compiledPass.framebuffers.end()) {
+			return existing->second;
+		}
+		VkFramebufferCreateInfo framebufferInfo = vks::initializers::framebufferCreateInfo();
+		framebufferInfo.renderPass = compiledPass.renderPass;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+		framebufferInfo.pAttachments = views.data();
+		framebufferInfo.width = compiledPass.extent.width;
+		framebufferInfo.height = compiledPass.extent.height;
+		framebufferInfo.layers = 1;
+		VkFramebuffer framebuffer;
+		VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferInfo, allocationCallbacks(HostAllocationScope::Resource), &framebuffer));
+		compiledPass.framebuffers[views] = framebuffer;
+		return framebuffer;
+	}
+
+	void RenderGraph::attachTransients()
+	{
+		for (size_t r = 0; r < resources.size() && r < transients.size(); r++) {
+			if (!resources[r].imported) {
+				resources[r].imageHandle = transients[r].image;
+				resources[r].view = transients[r].view;
+				resources[r].buffer = transients[r].buffer;
+			}
+		}
+	}
+
+	void RenderGraph::retire(RetiredResources&& retired)
+	{
+		if (device->deletionQueue) {
+			device->deletionQueue->retire(std::move(retired));
+		} else {
+			retired.release(device->logicalDevice);
+		}
+	}
+
+	RenderGraph::AccessState RenderGraph::getAccessState(RenderGraphAccess access, VkPipelineStageFlags stages, RenderGraphPassType type)
+	{
+		const VkPipelineStageFlags shaderStages = stages ? stages : static_cast<VkPipelineStageFlags>(type == RenderGraphPassType::Graphics ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		AccessState state;
+		state.write = isWrite(access);
+		switch (access) {
+		case RenderGraphAccess::ColorAttachment:
+			state.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			state.access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			break;
+		case RenderGraphAccess::DepthStencilAttachment:
+			state.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			state.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			state.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			break;
+		case RenderGraphAccess::DepthStencilReadOnly:
+			state.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			state.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+			state.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			break;
+		case RenderGraphAccess::SampledImage:
+			state.stages = shaderStages;
+			state.access = VK_ACCESS_SHADER_READ_BIT;
+			state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			break;
+		case RenderGraphAccess::StorageImageRead:
+			state.stages = shaderStages;
+			state.access = VK_ACCESS_SHADER_READ_BIT;
+			state.layout = VK_IMAGE_LAYOUT_GENERAL;
+			break;
+		case RenderGraphAccess::StorageImageWrite:
+			state.stages = shaderStages;
+			state.access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			state.layout = VK_IMAGE_LAYOUT_GENERAL;
+			break;
+		case RenderGraphAccess::TransferSrc:
+			state.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			state.access = VK_ACCESS_TRANSFER_READ_BIT;
+			state.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			break;
+		case RenderGraphAccess::TransferDst:
+			state.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			state.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+			state.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			break;
+		case RenderGraphAccess::UniformBuffer:
+			state.stages = stages ? stages : shaderStages | (type == RenderGraphPassType::Graphics ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT : 0);
+			state.access = VK_ACCESS_UNIFORM_READ_BIT;
+			break;
+		case RenderGraphAccess::StorageBufferRead:
+			state.stages = shaderStages;
+			state.access = VK_ACCESS_SHADER_READ_BIT;
+			break;
+		case RenderGraphAccess::StorageBufferWrite:
+			state.stages = shaderStages;
+			state.access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			break;
+		case RenderGraphAccess::VertexBuffer:
+			state.stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+			state.access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+			break;
+		case RenderGraphAccess::IndexBuffer:
+			state.stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+			state.access = VK_ACCESS_INDEX_READ_BIT;
+			break;
+		case RenderGraphAccess::IndirectBuffer:
+			state.stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+			state.access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+			break;
+		}
+		return state;
+	}
+}
@@ -0,0 +1,307 @@
+/*
+* Render graph
+*
+* Passes declare the images and buffers they read and write instead of placing barriers and render passes by hand.
+* Compiling the graph culls passes whose results are never used, derives the barriers and layout transitions between
+* passes, picks attachment load and store ops, and lets transient resources with disjoint lifetimes share memory.
+* The compiled schedule is kept as long as the graph declared each frame has the same topology.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanDeletionQueue.h"
+#include "VulkanBarrierBatcher.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+	class RenderGraph;
+
+	/** @brief Image or buffer declared in a render graph, only valid for the frame it was declared in */
+	struct RenderGraphResource
+	{
+		uint32_t index = UINT32_MAX;
+		bool valid() const { return index != UINT32_MAX; }
+	};
+
+	/** @brief How a pass uses a resource, determines the pipeline stages, access mask and image layout */
+	enum class RenderGraphAccess : uint32_t
+	{
+		ColorAttachment,
+		DepthStencilAttachment,
+		/** @brief Depth test without depth writes */
+		DepthStencilReadOnly,
+		SampledImage,
+		StorageImageRead,
+		StorageImageWrite,
+		TransferSrc,
+		TransferDst,
+		UniformBuffer,
+		StorageBufferRead,
+		StorageBufferWrite,
+		VertexBuffer,
+		IndexBuffer,
+		IndirectBuffer
+	};
+
+	enum class RenderGraphPassType : uint32_t
+	{
+		/** @brief Draws into a render pass made of the color and depth attachments the pass declares */
+		Graphics,
+		Compute,
+		Transfer
+	};
+
+	struct RenderGraphImageDesc
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = { 0, 0 };
+		uint32_t mipLevels = 1;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	};
+
+	struct RenderGraphBufferDesc
+	{
+		VkDeviceSize size = 0;
+	};
+
+	/** @brief Passed to a pass's execute function, resolves declared resources to the objects used this frame */
+	class RenderGraphContext
+	{
+	public:
+		VkCommandBuffer commandBuffer;
+		/** @brief Render pass the pass is executing in, VK_NULL_HANDLE for passes without attachments */
+		VkRenderPass renderPass;
+		VkExtent2D renderArea;
+
+		VkImage getImage(RenderGraphResource resource) const;
+		VkImageView getImageView(RenderGraphResource resource) const;
+		VkBuffer getBuffer(RenderGraphResource resource) const;
+
+	private:
+		friend class RenderGraph;
+		RenderGraphContext(RenderGraph& graph) : commandBuffer(VK_NULL_HANDLE), renderPass(VK_NULL_HANDLE), renderArea{ 0, 0 }, graph(graph) {}
+		RenderGraph& graph;
+	};
+
+	class RenderGraph
+	{
+	public:
+		using ExecuteFunction = std::function<void(RenderGraphContext& context)>;
+
+		/** @brief Declares what one pass reads and writes, returned by addPass() */
+		class PassBuilder
+		{
+		public:
+			/**
+			* Declare a read
+			* @param (Optional) stages Shader stages reading the resource, defaults to the fragment shader in graphics passes and the compute shader otherwise
+			*/
+			PassBuilder& read(RenderGraphResource resource, RenderGraphAccess access, VkPipelineStageFlags stages = 0);
+			/** @brief Declare a write, the pass is culled unless something reads the result or it is an output */
+			PassBuilder& write(RenderGraphResource resource, RenderGraphAccess access, VkPipelineStageFlags stages = 0);
+			/**
+			* Render into a color attachment, attachments are bound in the order they are declared
+			* @param (Optional) clearValue Clear the attachment when the render pass begins instead of keeping the previous contents
+			*/
+			PassBuilder& colorAttachment(RenderGraphResource resource, const VkClearColorValue* clearValue = nullptr);
+			/**
+			* Render into the depth attachment
+			* @param (Optional) clearValue Clear when the render pass begins
+			* @param (Optional) readOnly Depth test only, another pass has to have written the contents
+			*/
+			PassBuilder& depthAttachment(RenderGraphResource resource, const VkClearDepthStencilValue* clearValue = nullptr, bool readOnly = false);
+			/** @brief Keep the pass even if none of its writes are used, e.g. for readbacks or queries */
+			PassBuilder& sideEffects();
+
+		private:
+			friend class RenderGraph;
+			PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+			RenderGraph& graph;
+			uint32_t pass;
+		};
+
+		explicit RenderGraph(VulkanDevice* device);
+		/** @brief Destroys the compiled resources, the device has to be done with them */
+		~RenderGraph();
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		/** @brief Start declaring the next frame, the compiled schedule is kept until compile() sees a different topology */
+		void reset();
+
+		/** @brief Image owned by the graph that only lives during the frame, its memory can be shared with other transient resources */
+		RenderGraphResource createImage(const std::string& name, const RenderGraphImageDesc& desc);
+		RenderGraphResource createBuffer(const std::string& name, const RenderGraphBufferDesc& desc);
+		/**
+		* Use an image owned elsewhere, e.g. a swap chain image
+		* @param initialLayout Layout the image is in when the graph starts, VK_IMAGE_LAYOUT_UNDEFINED discards the contents
+		* @param finalLayout Layout the image is left in after the graph, VK_IMAGE_LAYOUT_UNDEFINED leaves it in the layout of its last use
+		* @note Only the format, extent and layouts are part of the topology, the image and view may change every frame
+		*/
+		RenderGraphResource importImage(const std::string& name, VkImage image, VkImageView view, const RenderGraphImageDesc& desc, VkImageLayout initialLayout, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+		RenderGraphResource importBuffer(const std::string& name, VkBuffer buffer, VkDeviceSize size);
+		/** @brief Keep the passes contributing to a resource, imported resources written by the graph are outputs too */
+		void markOutput(RenderGraphResource resource);
+
+		/** @brief Add a pass, passes run in the order they are added */
+		PassBuilder addPass(const std::string& name, RenderGraphPassType type, ExecuteFunction execute);
+
+		/** @brief Build the schedule for the declared frame, only does work if the topology differs from the last compiled one */
+		void compile();
+		/** @brief Record the barriers, render passes and pass functions of the compiled schedule */
+		void execute(VkCommandBuffer commandBuffer);
+		/** @brief Destroy the cached framebuffers, call when imported image views are destroyed (e.g. on swap chain recreation) */
+		void releaseFramebuffers();
+
+		struct Statistics
+		{
+			uint32_t declaredPasses = 0;
+			uint32_t culledPasses = 0;
+			uint32_t imageBarriers = 0;
+			uint32_t bufferBarriers = 0;
+			/** @brief Transient resources and the memory blocks they have been packed into */
+			uint32_t transientResources = 0;
+			uint32_t aliasedBlocks = 0;
+			VkDeviceSize transientMemory = 0;
+			/** @brief Number of compile() calls that had to rebuild the schedule */
+			uint32_t compilations = 0;
+		};
+		const Statistics& getStatistics() const { return statistics; }
+
+	private:
+		friend class RenderGraphContext;
+
+		struct ResourceUse
+		{
+			uint32_t resource;
+			RenderGraphAccess access;
+			VkPipelineStageFlags stages;
+			bool write;
+		};
+		struct Attachment
+		{
+			uint32_t resource;
+			bool clear;
+			VkClearValue clearValue;
+		};
+		struct Pass
+		{
+			std::string name;
+			RenderGraphPassType type;
+			ExecuteFunction execute;
+			std::vector<ResourceUse> uses;
+			std::vector<Attachment> colorAttachments;
+			Attachment depthAttachment = { UINT32_MAX, false, {} };
+			bool depthReadOnly = false;
+			bool sideEffects = false;
+		};
+		struct Resource
+		{
+			std::string name;
+			bool image;
+			bool imported;
+			bool output = false;
+			RenderGraphImageDesc imageDesc;
+			VkDeviceSize size = 0;
+			VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			// Set for imported resources every frame, for transient ones by compile()
+			VkImage imageHandle = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkBuffer buffer = VK_NULL_HANDLE;
+		};
+
+		/** @brief Stages, access mask and layout of one use */
+		struct AccessState
+		{
+			VkPipelineStageFlags stages = 0;
+			VkAccessFlags access = 0;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			bool write = false;
+		};
+		/** @brief What a resource's next use has to synchronize with */
+		struct ResourceState
+		{
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			/** @brief Last write not yet made visible to every later reader, stages 0 if there is none */
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			/** @brief Stages the last write has been made visible to */
+			VkPipelineStageFlags visibleStages = 0;
+			/** @brief Stages that have read since the last write, a following write has to wait for them */
+			VkPipelineStageFlags readStages = 0;
+			/** @brief Whether the contents are defined, i.e. written before or imported with a layout */
+			bool initialized = false;
+		};
+		/** @brief Stages are kept per barrier, they are only combined if the device records legacy barriers */
+		struct Barrier
+		{
+			uint32_t resource;
+			VkPipelineStageFlags2 srcStages;
+			VkAccessFlags2 srcAccess;
+			VkPipelineStageFlags2 dstStages;
+			VkAccessFlags2 dstAccess;
+			VkImageLayout oldLayout;
+			VkImageLayout newLayout;
+		};
+		struct BarrierBatch
+		{
+			std::vector<Barrier> barriers;
+		};
+		struct CompiledPass
+		{
+			uint32_t pass;
+			BarrierBatch barriers;
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			/** @brief Resources of the color attachments followed by the depth attachment */
+			std::vector<uint32_t> attachments;
+			VkExtent2D extent = { 0, 0 };
+			/** @brief Framebuffers by attachment views, imported views change from frame to frame */
+			std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+		};
+		/** @brief Transient image or buffer created by compile(), kept with the schedule */
+		struct TransientResource
+		{
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkBuffer buffer = VK_NULL_HANDLE;
+		};
+
+		VulkanDevice* device;
+		BarrierBatcher barrierBatcher;
+		std::vector<Pass> passes;
+		std::vector<Resource> resources;
+
+		uint64_t compiledHash = 0;
+		bool compiled = false;
+		std::vector<CompiledPass> schedule;
+		/** @brief Indexed like resources */
+		std::vector<TransientResource> transients;
+		std::vector<Allocation> aliasedMemory;
+		/** @brief Transitions of imported images to their final layout after the last pass */
+		BarrierBatch finalBarriers;
+		Statistics statistics;
+
+		uint64_t hashTopology() const;
+		void releaseCompiled();
+		std::vector<uint32_t> cullPasses() const;
+		void createTransients(const std::vector<uint32_t>& order, std::vector<uint32_t>& aliasPredecessor);
+		void buildSchedule(const std::vector<uint32_t>& order, const std::vector<uint32_t>& aliasPredecessor);
+		void createRenderPass(CompiledPass& compiledPass, const std::vector<VkAttachmentLoadOp>& loadOps, const std::vector<VkAttachmentStoreOp>& storeOps);
+		void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch);
+		VkFramebuffer getFramebuffer(CompiledPass& compiledPass);
+		void attachTransients();
+		void retire(RetiredResources&& retired);
+		static AccessState getAccessState(RenderGraphAccess access, VkPipelineStageFlags stages, RenderGraphPassType type);
+	};
+}
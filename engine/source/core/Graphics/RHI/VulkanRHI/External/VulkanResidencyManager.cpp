@@ -0,0 +1,248 @@
+/*
+* Video memory residency manager
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanResidencyManager.h"
+#include "VulkanDevice.h"
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+
+namespace vks
+{
+	ResidencyManager::ResidencyManager(VulkanDevice* device, VkQueue queue, uint32_t framesInFlight, VkInstance instance) : device(device), queue(queue), framesInFlight(framesInFlight)
+	{
+		assert(device && device->memoryAllocator);
+		if (device->memoryBudgetSupported && instance != VK_NULL_HANDLE)
+		{
+			getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2"));
+			if (!getMemoryProperties2)
+			{
+				getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+			}
+		}
+		budgets = getBudgets();
+		// Allocation failures are a last resort to make room, trimming is skipped as it needs to allocate itself
+		device->memoryAllocator->setOutOfMemoryHandler([this](uint32_t heapIndex, VkDeviceSize size) {
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			// Resources trimmed so far are referenced by the not yet submitted upload batch and must not be evicted
+			if (trimming)
+			{
+				return false;
+			}
+			return makeRoom(heapIndex, size, false) >= size;
+		});
+	}
+
+	ResidencyManager::~ResidencyManager()
+	{
+		device->memoryAllocator->setOutOfMemoryHandler(nullptr);
+	}
+
+	void ResidencyManager::registerResource(Evictable* resource)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		resource->lastUsedFrame = frameIndex;
+		resources.push_back(resource);
+	}
+
+	void ResidencyManager::unregisterResource(Evictable* resource)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		resources.erase(std::remove(resources.begin(), resources.end(), resource), resources.end());
+		pendingRestores.erase(std::remove(pendingRestores.begin(), pendingRestores.end(), resource), pendingRestores.end());
+	}
+
+	std::vector<ResidencyManager::HeapBudget> ResidencyManager::getBudgets()
+	{
+		const VkPhysicalDeviceMemoryProperties& memoryProperties = device->memoryProperties;
+		std::vector<HeapBudget> budgets(memoryProperties.memoryHeapCount);
+
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		if (getMemoryProperties2)
+		{
+			VkPhysicalDeviceMemoryProperties2 memoryProperties2{};
+			memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			memoryProperties2.pNext = &budgetProperties;
+			getMemoryProperties2(device->physicalDevice, &memoryProperties2);
+		}
+
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+		{
+			HeapBudget& heapBudget = budgets[i];
+			heapBudget.heapIndex = i;
+			heapBudget.deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+			if (getMemoryProperties2 && budgetProperties.heapBudget[i] > 0)
+			{
+				heapBudget.budget = budgetProperties.heapBudget[i];
+				heapBudget.usage = budgetProperties.heapUsage[i];
+			}
+			else
+			{
+				// Without the extension other processes are invisible, so only a part of the heap is assumed to be available
+				heapBudget.budget = memoryProperties.memoryHeaps[i].size / 10 * 8;
+				heapBudget.usage = device->memoryAllocator->getHeapUsage(i);
+			}
+		}
+		return budgets;
+	}
+
+	void ResidencyManager::beginFrame()
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		frameIndex++;
+		budgets = getBudgets();
+		for (const HeapBudget& heapBudget : budgets)
+		{
+			const VkDeviceSize target = static_cast<VkDeviceSize>(heapBudget.budget * targetFraction);
+			if (heapBudget.deviceLocal && heapBudget.usage > target)
+			{
+				makeRoom(heapBudget.heapIndex, heapBudget.usage - target);
+			}
+		}
+		restorePending();
+	}
+
+	bool ResidencyManager::makeResident(Evictable* resource)
+	{
+		resource->lastUsedFrame = frameIndex;
+		if (resource->residency == Evictable::Residency::Resident)
+		{
+			return true;
+		}
+		// Restoring replaces images and buffers the frame's command buffers may already reference, so it waits for the next frame
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		if (std::find(pendingRestores.begin(), pendingRestores.end(), resource) == pendingRestores.end())
+		{
+			pendingRestores.push_back(resource);
+		}
+		return resource->residency == Evictable::Residency::Trimmed;
+	}
+
+	void ResidencyManager::restorePending()
+	{
+		if (pendingRestores.empty())
+		{
+			return;
+		}
+		UploadBatch batch(device, queue);
+		for (Evictable* resource : pendingRestores)
+		{
+			if (resource->residency == Evictable::Residency::Trimmed)
+			{
+				// Trimmed resources stay usable, they are only brought back to full detail if the heap has room for it.
+				// Without a deletion queue the lower detail version is released right away, so it must not be in flight anymore
+				const uint32_t heapIndex = resource->getMemoryHeapIndex();
+				const VkDeviceSize target = static_cast<VkDeviceSize>(budgets[heapIndex].budget * targetFraction);
+				if ((!device->deletionQueue && resource->lastUsedFrame + framesInFlight >= frameIndex) || device->memoryAllocator->getHeapUsage(heapIndex) >= target)
+				{
+					continue;
+				}
+			}
+			if (resource->residency != Evictable::Residency::Resident)
+			{
+				resource->restore(batch);
+				resource->residency = Evictable::Residency::Resident;
+				restoreCount++;
+			}
+		}
+		pendingRestores.clear();
+		batch.submit();
+	}
+
+	VkDeviceSize ResidencyManager::makeRoom(uint32_t heapIndex, VkDeviceSize bytes, bool allowTrim)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		// Only resources the GPU is guaranteed to be done with are candidates, least recently used first
+		std::vector<Evictable*> candidates;
+		for (Evictable* resource : resources)
+		{
+			if (resource->residency != Evictable::Residency::Evicted && resource->lastUsedFrame + framesInFlight < frameIndex && resource->getMemoryHeapIndex() == heapIndex)
+			{
+				candidates.push_back(resource);
+			}
+		}
+		std::stable_sort(candidates.begin(), candidates.end(), [](const Evictable* a, const Evictable* b) { return a->lastUsedFrame < b->lastUsedFrame; });
+
+		VkDeviceSize released = 0;
+		// Dropping detail keeps resources usable, so all candidates are trimmed before anything is evicted
+		if (allowTrim)
+		{
+			UploadBatch batch(device, queue);
+			trimming = true;
+			for (Evictable* resource : candidates)
+			{
+				if (released >= bytes)
+				{
+					break;
+				}
+				if (resource->residency == Evictable::Residency::Resident)
+				{
+					const VkDeviceSize trimmed = resource->trim(queue, batch);
+					if (trimmed > 0)
+					{
+						resource->residency = Evictable::Residency::Trimmed;
+						released += trimmed;
+						trimmedBytes += trimmed;
+					}
+				}
+			}
+			trimming = false;
+			batch.submit();
+		}
+		for (Evictable* resource : candidates)
+		{
+			if (released >= bytes)
+			{
+				break;
+			}
+			// Resources that can't release anything (e.g. pooled geometry) stay drawable
+			const VkDeviceSize evicted = resource->evict(queue);
+			if (evicted == 0)
+			{
+				continue;
+			}
+			resource->residency = Evictable::Residency::Evicted;
+			released += evicted;
+			evictedBytes += evicted;
+		}
+		return released;
+	}
+
+	void ResidencyManager::printStatistics()
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		const double MiB = 1024.0 * 1024.0;
+		uint32_t counts[3] = { 0, 0, 0 };
+		for (const Evictable* resource : resources)
+		{
+			counts[static_cast<uint32_t>(resource->residency)]++;
+		}
+		std::cout << "Residency (frame " << frameIndex << "): "
+			<< counts[0] << " resident, " << counts[1] << " trimmed, " << counts[2] << " evicted, "
+			<< std::fixed << std::setprecision(1) << trimmedBytes / MiB << " MiB trimmed, " << evictedBytes / MiB << " MiB evicted, "
+			<< restoreCount << " restores" << std::endl;
+		for (const HeapBudget& heapBudget : getBudgets())
+		{
+			if (!heapBudget.deviceLocal)
+			{
+				continue;
+			}
+			std::cout << "  heap " << heapBudget.heapIndex << ": " << heapBudget.usage / MiB << " of " << heapBudget.budget / MiB << " MiB budget";
+			for (uint32_t category = 0; category < static_cast<uint32_t>(MemoryCategory::Count); category++)
+			{
+				const VkDeviceSize usage = device->memoryAllocator->getCategoryUsage(heapBudget.heapIndex, static_cast<MemoryCategory>(category));
+				if (usage > 0)
+				{
+					std::cout << ", " << memoryCategoryName(static_cast<MemoryCategory>(category)) << " " << usage / MiB << " MiB";
+				}
+			}
+			std::cout << std::endl;
+		}
+	}
+}
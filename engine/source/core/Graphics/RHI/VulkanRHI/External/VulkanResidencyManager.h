@@ -0,0 +1,131 @@
+/*
+* Video memory residency manager
+*
+* Keeps device local memory usage within the budget reported by the device (VK_EXT_memory_budget if present,
+* a fraction of the heap size otherwise). Resources that have not been used for a while are dropped to lower
+* detail or evicted in least recently used order and restored on demand the next time they are used.
+* Trims and restores are done by beginFrame() before any command buffer of the frame is recorded.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanStagingRing.h"
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	/** @brief Resource whose video memory can be released and restored by the residency manager */
+	class Evictable
+	{
+	public:
+		enum class Residency { Resident, Trimmed, Evicted };
+
+		virtual ~Evictable() {}
+
+		/** @brief Bytes of device memory the resource currently occupies */
+		virtual VkDeviceSize getResidentSize() const = 0;
+		/** @brief Memory heap the resource's device memory lives in */
+		virtual uint32_t getMemoryHeapIndex() const = 0;
+		virtual MemoryCategory getMemoryCategory() const = 0;
+		/**
+		* Drop to a lower detail version (e.g. fewer mip levels), the resource stays usable
+		* @return Number of bytes released, zero if the resource can't be trimmed
+		*/
+		virtual VkDeviceSize trim(VkQueue /*queue*/, UploadBatch& /*batch*/) { return 0; }
+		/**
+		* Release all device memory of the resource, keeping whatever is needed to restore it
+		* @return Number of bytes released
+		*/
+		virtual VkDeviceSize evict(VkQueue queue) = 0;
+		/** @brief Recreate the full detail resource, uploads are recorded to the given batch */
+		virtual void restore(UploadBatch& batch) = 0;
+
+		/** @brief Last frame the resource has been used in, stamped by ResidencyManager::makeResident() */
+		uint64_t lastUsedFrame = 0;
+		Residency residency = Residency::Resident;
+	};
+
+	class ResidencyManager
+	{
+	public:
+		struct HeapBudget
+		{
+			uint32_t heapIndex;
+			bool deviceLocal;
+			/** @brief Bytes this process may use from the heap */
+			VkDeviceSize budget;
+			/** @brief Bytes this process currently uses from the heap */
+			VkDeviceSize usage;
+		};
+
+		/**
+		* Create the residency manager and hook it into the device's memory allocator
+		*
+		* @param device Device whose memory is managed
+		* @param queue Queue used for restore uploads and read backs, has to be the queue the resources are used on
+		* @param (Optional) framesInFlight Number of frames the GPU may lag behind, resources used within that window are never evicted
+		* @param (Optional) instance Instance to load vkGetPhysicalDeviceMemoryProperties2 from, required to query VK_EXT_memory_budget
+		*/
+		ResidencyManager(VulkanDevice* device, VkQueue queue, uint32_t framesInFlight = 2, VkInstance instance = VK_NULL_HANDLE);
+		~ResidencyManager();
+
+		void registerResource(Evictable* resource);
+		void unregisterResource(Evictable* resource);
+
+		/**
+		* Advance the frame counter, refresh the heap budgets, evict until all device local heaps are within budget and restore the resources used while evicted or trimmed
+		* @note Has to be called before recording the frame's command buffers, the replaced images and buffers are handed to the device's deletion queue
+		*/
+		void beginFrame();
+		/**
+		* Stamp the resource as used in the current frame, an evicted or trimmed resource is restored by the next beginFrame()
+		* @return False if the resource is evicted and can't be drawn this frame
+		* @note Trimmed resources are drawn at lower detail until restored, which waits for room in the heap
+		*/
+		bool makeResident(Evictable* resource);
+		/**
+		* Release memory of least recently used resources on the given heap
+		*
+		* @param heapIndex Heap to release memory from
+		* @param bytes Number of bytes to release
+		* @param (Optional) allowTrim Drop resources to lower detail before evicting them, trimming allocates new (smaller) resources
+		*
+		* @return Number of bytes released
+		*/
+		VkDeviceSize makeRoom(uint32_t heapIndex, VkDeviceSize bytes, bool allowTrim = true);
+
+		std::vector<HeapBudget> getBudgets();
+		uint64_t getFrameIndex() const { return frameIndex; }
+		void printStatistics();
+
+		/** @brief Fraction of the heap budget the manager keeps usage under, leaves room for transient allocations */
+		float targetFraction = 0.9f;
+
+	private:
+		VulkanDevice* device;
+		VkQueue queue;
+		uint32_t framesInFlight;
+		PFN_vkGetPhysicalDeviceMemoryProperties2 getMemoryProperties2 = nullptr;
+		std::recursive_mutex mutex;
+		std::vector<Evictable*> resources;
+		/** @brief Resources used while evicted or trimmed, restored by beginFrame() */
+		std::vector<Evictable*> pendingRestores;
+		/** @brief Heap budgets as of the start of the current frame */
+		std::vector<HeapBudget> budgets;
+		uint64_t frameIndex = 0;
+		bool trimming = false;
+
+		void restorePending();
+
+		VkDeviceSize trimmedBytes = 0;
+		VkDeviceSize evictedBytes = 0;
+		uint32_t restoreCount = 0;
+	};
+}
@@ -0,0 +1,514 @@
+/*
+* Persistent staging ring
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanStagingRing.h"
+#include "VulkanBarrierBatcher.h"
+#include "VulkanDevice.h"
+#include "Tools.h"
+#include "VulkanInitializers.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <numeric>
+
+namespace vks
+{
+	StagingRing::StagingRing(VulkanDevice* device, VkDeviceSize size) : device(device), size(size)
+	{
+		assert(device);
+		assert(size > 0);
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, &buffer, &allocation));
+		assert(allocation.mapped);
+	}
+
+	StagingRing::~StagingRing()
+	{
+		waitIdle();
+		vkDestroyBuffer(device->logicalDevice, buffer, allocationCallbacks(HostAllocationScope::Resource));
+		allocation.free();
+	}
+
+	bool StagingRing::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, uint64_t owner, VkDeviceSize* offset)
+	{
+		if (usedBytes == 0) {
+			head = tail = 0;
+		}
+		VkDeviceSize start = (head + alignment - 1) / alignment * alignment;
+		VkDeviceSize consumed;
+		if (head > tail || usedBytes == 0) {
+			// Free space is [head, end) and [0, tail)
+			if (start + size <= this->size) {
+				*offset = start;
+				consumed = start + size - head;
+			} else if (size <= tail) {
+				// Wrap around, the unused space at the end is given back together with this range
+				*offset = 0;
+				consumed = this->size - head + size;
+			} else {
+				return false;
+			}
+		} else {
+			// Free space is [head, tail), head == tail means the ring is full
+			if (start + size > tail) {
+				return false;
+			}
+			*offset = start;
+			consumed = start + size - head;
+		}
+		head = *offset + size;
+		usedBytes += consumed;
+		Range range{};
+		range.end = head;
+		range.bytes = consumed;
+		range.owner = owner;
+		ranges.push_back(range);
+		return true;
+	}
+
+	StagingRegion StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, uint64_t owner)
+	{
+		assert(size <= this->size);
+		StagingRegion region;
+		std::unique_lock<std::mutex> lock(mutex);
+		VkDeviceSize offset;
+		while (true) {
+			collect();
+			if (tryAllocate(size, alignment, owner, &offset)) {
+				break;
+			}
+			// Space is given back in allocation order, so the oldest range decides what can be waited for
+			assert(!ranges.empty());
+			const Range& oldest = ranges.front();
+			if (oldest.submission == 0) {
+				if (oldest.owner == owner) {
+					// Held up by the caller's own work that hasn't been submitted yet
+					return region;
+				}
+				rangesRetired.wait(lock);
+				continue;
+			}
+			Submission* submission = findSubmission(oldest.submission);
+			isComplete(*submission, true);
+			complete(*submission);
+		}
+		region.buffer = buffer;
+		region.offset = offset;
+		region.size = size;
+		region.mapped = static_cast<uint8_t*>(allocation.mapped) + offset;
+		return region;
+	}
+
+	VkCommandBuffer StagingRing::beginCommandBuffer()
+	{
+		VkCommandBuffer commandBuffer = device->commandBufferPools->acquire(device->queueFamilyIndices.graphics);
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+		return commandBuffer;
+	}
+
+	uint64_t StagingRing::createOwner()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return nextOwner++;
+	}
+
+	uint64_t StagingRing::submit(VkCommandBuffer commandBuffer, VkQueue queue, uint64_t owner)
+	{
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+		std::lock_guard<std::mutex> lock(mutex);
+		Submission submission{};
+		submission.fence = device->fencePool->acquire();
+		submission.ownsFence = true;
+		submission.commandBuffer = commandBuffer;
+		QueueSubmission queueSubmission;
+		queueSubmission.commandBuffers.push_back(commandBuffer);
+		queueSubmission.fence = submission.fence;
+		device->getQueueSubmitter(queue)->submit(std::move(queueSubmission));
+		return retireLocked(submission, owner);
+	}
+
+	uint64_t StagingRing::retire(VkFence fence, uint64_t owner)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Submission submission{};
+		submission.fence = fence;
+		return retireLocked(submission, owner);
+	}
+
+	uint64_t StagingRing::retire(VkSemaphore timelineSemaphore, uint64_t value, uint64_t owner)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Submission submission{};
+		submission.timelineSemaphore = timelineSemaphore;
+		submission.timelineValue = value;
+		return retireLocked(submission, owner);
+	}
+
+	uint64_t StagingRing::retireLocked(Submission submission, uint64_t owner)
+	{
+		submission.id = nextId++;
+		// Ranges of other owners may still be written by their recorders and are left pending
+		for (Range& range : ranges) {
+			if (range.owner == owner && range.submission == 0) {
+				range.submission = submission.id;
+				submission.rangeCount++;
+			}
+		}
+		submissions.push_back(submission);
+		rangesRetired.notify_all();
+		return submission.id;
+	}
+
+	StagingRing::Submission* StagingRing::findSubmission(uint64_t id)
+	{
+		auto submission = std::find_if(submissions.begin(), submissions.end(), [id](const Submission& s) { return s.id == id; });
+		assert(submission != submissions.end());
+		return &*submission;
+	}
+
+	bool StagingRing::isComplete(const Submission& submission, bool wait)
+	{
+		if (submission.timelineSemaphore != VK_NULL_HANDLE) {
+			if (wait) {
+				VkSemaphoreWaitInfo waitInfo{};
+				waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+				waitInfo.semaphoreCount = 1;
+				waitInfo.pSemaphores = &submission.timelineSemaphore;
+				waitInfo.pValues = &submission.timelineValue;
+				VK_CHECK_RESULT(vkWaitSemaphores(device->logicalDevice, &waitInfo, UINT64_MAX));
+				return true;
+			}
+			uint64_t value = 0;
+			VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device->logicalDevice, submission.timelineSemaphore, &value));
+			return value >= submission.timelineValue;
+		}
+		if (submission.fence == VK_NULL_HANDLE) {
+			return true;
+		}
+		if (wait) {
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &submission.fence, VK_TRUE, UINT64_MAX));
+			return true;
+		}
+		return vkGetFenceStatus(device->logicalDevice, submission.fence) == VK_SUCCESS;
+	}
+
+	void StagingRing::complete(Submission& submission)
+	{
+		submission.complete = true;
+		if (submission.ownsFence) {
+			device->fencePool->release(submission.fence);
+		}
+		if (submission.commandBuffer != VK_NULL_HANDLE) {
+			device->commandBufferPools->release(submission.commandBuffer);
+		}
+	}
+
+	void StagingRing::collect()
+	{
+		for (Submission& submission : submissions) {
+			if (!submission.complete && isComplete(submission, false)) {
+				complete(submission);
+			}
+		}
+		releaseRanges();
+	}
+
+	void StagingRing::releaseRanges()
+	{
+		while (!ranges.empty() && ranges.front().submission != 0) {
+			Submission* submission = findSubmission(ranges.front().submission);
+			if (!submission->complete) {
+				break;
+			}
+			tail = ranges.front().end;
+			usedBytes -= ranges.front().bytes;
+			submission->rangeCount--;
+			ranges.pop_front();
+		}
+		submissions.erase(std::remove_if(submissions.begin(), submissions.end(), [](const Submission& s) { return s.complete && s.rangeCount == 0; }), submissions.end());
+	}
+
+	void StagingRing::wait(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (Submission& submission : submissions) {
+			if (submission.id <= id && !submission.complete) {
+				isComplete(submission, true);
+				complete(submission);
+			}
+		}
+		releaseRanges();
+	}
+
+	void StagingRing::waitIdle()
+	{
+		wait(UINT64_MAX);
+	}
+
+	void StagingRing::reclaim()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		collect();
+	}
+
+	UploadBatch::UploadBatch(VulkanDevice* device, VkQueue queue) : device(device), ring(device->stagingRing), queue(queue)
+	{
+		assert(ring);
+		owner = ring->createOwner();
+	}
+
+	UploadBatch::~UploadBatch()
+	{
+		if (commandBuffer != VK_NULL_HANDLE || !pendingImages.empty()) {
+			flush();
+		}
+	}
+
+	VkCommandBuffer UploadBatch::getCommandBuffer()
+	{
+		if (commandBuffer == VK_NULL_HANDLE) {
+			commandBuffer = ring->beginCommandBuffer();
+		}
+		return commandBuffer;
+	}
+
+	VkDeviceSize UploadBatch::maxChunkSize() const
+	{
+		// Leave room for the previous chunk to still be in flight while the next one is written
+		return ring->getSize() / 2;
+	}
+
+	StagingRegion UploadBatch::acquire(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		StagingRegion region = ring->allocate(size, alignment, owner);
+		if (!region.valid()) {
+			// The ring is full of our own unsubmitted data, kick it off so the space can be recycled
+			submit();
+			region = ring->allocate(size, alignment, owner);
+		}
+		assert(region.valid());
+		return region;
+	}
+
+	void UploadBatch::copyBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+	{
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+		while (size > 0) {
+			VkDeviceSize chunkSize = std::min(size, maxChunkSize());
+			StagingRegion region = acquire(chunkSize, 16);
+			memcpy(region.mapped, src, static_cast<size_t>(chunkSize));
+			VkBufferCopy copyRegion{ region.offset, dstOffset, chunkSize };
+			vkCmdCopyBuffer(getCommandBuffer(), region.buffer, dstBuffer, 1, &copyRegion);
+			src += chunkSize;
+			dstOffset += chunkSize;
+			size -= chunkSize;
+			uploadedBytes += chunkSize;
+		}
+	}
+
+	void UploadBatch::writeBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, const Allocation& dstAllocation, VkDeviceSize dstOffset)
+	{
+		if (dstAllocation.mapped) {
+			// Host coherent, nothing to flush
+			memcpy(static_cast<uint8_t*>(dstAllocation.mapped) + dstOffset, data, static_cast<size_t>(size));
+			return;
+		}
+		copyBuffer(data, size, dstBuffer, dstOffset);
+	}
+
+	void splitImageCopy(VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions, VkDeviceSize maxChunkSize, uint32_t texelBlockHeight, const std::function<void(VkDeviceSize, VkDeviceSize, std::vector<VkBufferImageCopy>&)>& copyChunk)
+	{
+		// Source size of each region is the distance to the next one in memory
+		std::vector<size_t> order(regions.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&regions](size_t a, size_t b) { return regions[a].bufferOffset < regions[b].bufferOffset; });
+		auto regionSize = [&](size_t i) {
+			VkDeviceSize end = (i + 1 < order.size()) ? regions[order[i + 1]].bufferOffset : size;
+			return end - regions[order[i]].bufferOffset;
+		};
+
+		std::vector<VkBufferImageCopy> chunkRegions;
+		size_t i = 0;
+		while (i < order.size()) {
+			const VkBufferImageCopy& first = regions[order[i]];
+			VkDeviceSize bytes = regionSize(i);
+
+			if (bytes > maxChunkSize) {
+				// Single region too large for one chunk, split it into slabs of texel block rows
+				assert(first.bufferRowLength == 0 && first.bufferImageHeight == 0);
+				assert(first.imageExtent.depth == 1 && first.imageSubresource.layerCount == 1);
+				const uint32_t blockRows = (first.imageExtent.height + texelBlockHeight - 1) / texelBlockHeight;
+				const VkDeviceSize rowBytes = bytes / blockRows;
+				const uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<VkDeviceSize>(1, maxChunkSize / rowBytes));
+				for (uint32_t row = 0; row < blockRows; row += rowsPerChunk) {
+					const uint32_t rows = std::min(rowsPerChunk, blockRows - row);
+					VkBufferImageCopy copyRegion = first;
+					copyRegion.bufferOffset = 0;
+					copyRegion.imageOffset.y += static_cast<int32_t>(row * texelBlockHeight);
+					copyRegion.imageExtent.height = std::min(rows * texelBlockHeight, first.imageExtent.height - row * texelBlockHeight);
+					chunkRegions.assign(1, copyRegion);
+					copyChunk(first.bufferOffset + row * rowBytes, rows * rowBytes, chunkRegions);
+				}
+				i++;
+				continue;
+			}
+
+			// Gather as many consecutive regions as fit into one chunk
+			size_t j = i + 1;
+			VkDeviceSize groupEnd = first.bufferOffset + bytes;
+			while (j < order.size()) {
+				VkDeviceSize end = regions[order[j]].bufferOffset + regionSize(j);
+				if (end - first.bufferOffset > maxChunkSize) {
+					break;
+				}
+				groupEnd = end;
+				j++;
+			}
+			chunkRegions.clear();
+			for (size_t k = i; k < j; k++) {
+				VkBufferImageCopy copyRegion = regions[order[k]];
+				copyRegion.bufferOffset -= first.bufferOffset;
+				chunkRegions.push_back(copyRegion);
+			}
+			copyChunk(first.bufferOffset, groupEnd - first.bufferOffset, chunkRegions);
+			i = j;
+		}
+	}
+
+	void UploadBatch::copyImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, VkImageLayout imageLayout, uint32_t texelBlockHeight)
+	{
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+		splitImageCopy(size, regions, maxChunkSize(), texelBlockHeight, [&](VkDeviceSize srcOffset, VkDeviceSize chunkSize, std::vector<VkBufferImageCopy>& chunkRegions) {
+			StagingRegion region = acquire(chunkSize, 16);
+			memcpy(region.mapped, src + srcOffset, static_cast<size_t>(chunkSize));
+			for (VkBufferImageCopy& copyRegion : chunkRegions) {
+				copyRegion.bufferOffset += region.offset;
+			}
+			vkCmdCopyBufferToImage(getCommandBuffer(), region.buffer, image, imageLayout, static_cast<uint32_t>(chunkRegions.size()), chunkRegions.data());
+			uploadedBytes += chunkSize;
+		});
+	}
+
+	void UploadBatch::uploadImage(const void* data, VkDeviceSize size, VkImage image, VkImageUsageFlags imageUsageFlags, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& subresourceRange, VkImageLayout imageLayout)
+	{
+		if (device->isHostImageUpload(imageUsageFlags)) {
+			device->copyMemoryToImage(data, image, regions, subresourceRange, imageLayout);
+			return;
+		}
+		BarrierBatcher barriers(device);
+		barriers.imageBarrier(image, subresourceRange, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		barriers.flush(getCommandBuffer());
+		copyImage(data, size, image, regions);
+		barriers.imageBarrier(image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout);
+		barriers.flush(getCommandBuffer());
+	}
+
+	void UploadBatch::uploadImageWithMips(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout imageLayout)
+	{
+		PendingImage pendingImage{};
+		pendingImage.image = image;
+		pendingImage.width = width;
+		pendingImage.height = height;
+		pendingImage.mipLevels = mipLevels;
+		pendingImage.imageLayout = imageLayout;
+		pendingImage.copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		pendingImage.copyRegion.imageSubresource.layerCount = 1;
+		pendingImage.copyRegion.imageExtent = { width, height, 1 };
+		if (size > maxChunkSize()) {
+			// Has to be copied in chunks, which may be split across submissions, so only the mip generation can be deferred
+			BarrierBatcher barriers(device);
+			barriers.imageBarrier(image, { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 }, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			barriers.flush(getCommandBuffer());
+			copyImage(data, size, image, { pendingImage.copyRegion });
+			pendingImage.copied = true;
+		} else {
+			// Staged right away, the copy is recorded together with those of the other pending images
+			StagingRegion region = acquire(size, 16);
+			memcpy(region.mapped, data, static_cast<size_t>(size));
+			pendingImage.copyRegion.bufferOffset = region.offset;
+			uploadedBytes += size;
+		}
+		pendingImages.push_back(pendingImage);
+	}
+
+	void UploadBatch::recordPendingImages()
+	{
+		if (pendingImages.empty()) {
+			return;
+		}
+		VkCommandBuffer cmdBuffer = getCommandBuffer();
+		// Stages and accesses follow from the layouts, the final transitions only wait on the stages sampling in the target layout
+		BarrierBatcher barriers(device);
+		auto addBarrier = [&barriers](VkImage image, uint32_t baseMipLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout) {
+			barriers.imageBarrier(image, { VK_IMAGE_ASPECT_COLOR_BIT, baseMipLevel, levelCount, 0, 1 }, oldLayout, newLayout);
+		};
+
+		// All levels of all images become transfer destinations at once, then the top levels are copied
+		uint32_t maxMipLevels = 1;
+		for (const PendingImage& pendingImage : pendingImages) {
+			if (!pendingImage.copied) {
+				addBarrier(pendingImage.image, 0, pendingImage.mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			}
+			maxMipLevels = std::max(maxMipLevels, pendingImage.mipLevels);
+		}
+		barriers.flush(cmdBuffer);
+		for (const PendingImage& pendingImage : pendingImages) {
+			if (!pendingImage.copied) {
+				vkCmdCopyBufferToImage(cmdBuffer, ring->getBuffer(), pendingImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &pendingImage.copyRegion);
+			}
+		}
+
+		// Each level is blitted from the previous one, a single barrier per level covers all images
+		for (uint32_t level = 1; level < maxMipLevels; level++) {
+			for (const PendingImage& pendingImage : pendingImages) {
+				if (level < pendingImage.mipLevels) {
+					addBarrier(pendingImage.image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+				}
+			}
+			barriers.flush(cmdBuffer);
+			for (const PendingImage& pendingImage : pendingImages) {
+				if (level < pendingImage.mipLevels) {
+					VkImageBlit imageBlit{};
+					imageBlit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+					imageBlit.srcOffsets[1] = { static_cast<int32_t>(std::max(1u, pendingImage.width >> (level - 1))), static_cast<int32_t>(std::max(1u, pendingImage.height >> (level - 1))), 1 };
+					imageBlit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+					imageBlit.dstOffsets[1] = { static_cast<int32_t>(std::max(1u, pendingImage.width >> level)), static_cast<int32_t>(std::max(1u, pendingImage.height >> level)), 1 };
+					vkCmdBlitImage(cmdBuffer, pendingImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pendingImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+				}
+			}
+		}
+
+		// Levels that have been blit sources and the last level, which was only written, move to the final layout together
+		for (const PendingImage& pendingImage : pendingImages) {
+			if (pendingImage.mipLevels > 1) {
+				addBarrier(pendingImage.image, 0, pendingImage.mipLevels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pendingImage.imageLayout);
+			}
+			addBarrier(pendingImage.image, pendingImage.mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pendingImage.imageLayout);
+		}
+		barriers.flush(cmdBuffer);
+		pendingImages.clear();
+	}
+
+	void UploadBatch::submit()
+	{
+		recordPendingImages();
+		if (commandBuffer == VK_NULL_HANDLE) {
+			return;
+		}
+		lastSubmission = ring->submit(commandBuffer, queue, owner);
+		commandBuffer = VK_NULL_HANDLE;
+		submitCount++;
+	}
+
+	void UploadBatch::flush()
+	{
+		submit();
+		if (lastSubmission != 0) {
+			ring->wait(lastSubmission);
+		}
+	}
+}
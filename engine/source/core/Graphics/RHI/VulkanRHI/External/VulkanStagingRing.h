@@ -0,0 +1,238 @@
+/*
+* Persistent staging ring
+*
+* A single persistently mapped host visible buffer that all texture and mesh uploads are staged through.
+* Space is handed out in allocation order. Each range belongs to an owner (a recorder like an upload batch) and is
+* retired with the next submission of that owner, it is given back once the fence or timeline semaphore value of that
+* submission has signaled and all ranges allocated before it have been given back.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	/** @brief Range of the staging ring the host can write upload data to */
+	struct StagingRegion
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		bool valid() const { return buffer != VK_NULL_HANDLE; }
+	};
+
+	class StagingRing
+	{
+	public:
+		StagingRing(VulkanDevice* device, VkDeviceSize size);
+		~StagingRing();
+
+		/**
+		* Reserve a range of the ring, waiting for retired submissions to finish if required
+		* @param (Optional) owner Recorder the range belongs to, only a retire by the same owner covers it
+		* @return Invalid region if the request can't be satisfied before the owner's pending (not yet retired) ranges are submitted
+		* @note Blocks if pending ranges of another owner hold up the space, until that owner retires them
+		*/
+		StagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment = 16, uint64_t owner = 0);
+		/** @brief New owner id for a recorder that allocates and retires its ranges independently of other recorders */
+		uint64_t createOwner();
+
+		/** @brief Get a primary command buffer in recording state from the device's pool for the calling thread */
+		VkCommandBuffer beginCommandBuffer();
+		/**
+		* End and submit a command buffer from beginCommandBuffer() and retire the owner's pending ranges with its fence
+		* @return Id of the submission that can be passed to wait()
+		*/
+		uint64_t submit(VkCommandBuffer commandBuffer, VkQueue queue, uint64_t owner = 0);
+		/** @brief Retire the owner's pending ranges with a fence of a submission made by the caller */
+		uint64_t retire(VkFence fence, uint64_t owner = 0);
+		/** @brief Retire the owner's pending ranges with a timeline semaphore value signaled by a submission made by the caller */
+		uint64_t retire(VkSemaphore timelineSemaphore, uint64_t value, uint64_t owner = 0);
+
+		/** @brief Block until the given submission (and all submissions before it) has finished */
+		void wait(uint64_t id);
+		/** @brief Block until everything retired so far has finished */
+		void waitIdle();
+		/** @brief Give back the space of all finished submissions without blocking */
+		void reclaim();
+
+		VkDeviceSize getSize() const { return size; }
+		VkBuffer getBuffer() const { return buffer; }
+
+	private:
+		struct Range
+		{
+			/** @brief Ring offset the range extends to */
+			VkDeviceSize end;
+			/** @brief Bytes the range consumes, including space skipped at the end of the ring when it wrapped around */
+			VkDeviceSize bytes;
+			uint64_t owner;
+			/** @brief Submission the range has been retired with, zero while pending */
+			uint64_t submission = 0;
+		};
+		struct Submission
+		{
+			uint64_t id;
+			VkFence fence = VK_NULL_HANDLE;
+			/** @brief Fence comes from the device's fence pool and is given back on completion */
+			bool ownsFence = false;
+			VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+			uint64_t timelineValue = 0;
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			bool complete = false;
+			/** @brief Ranges retired with the submission that haven't been given back yet */
+			uint32_t rangeCount = 0;
+		};
+
+		VulkanDevice* device;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation allocation;
+		VkDeviceSize size;
+		std::mutex mutex;
+		/** @brief Signaled whenever ranges are retired, allocations held up by another owner's pending ranges wait for it */
+		std::condition_variable rangesRetired;
+
+		VkDeviceSize head = 0;
+		VkDeviceSize tail = 0;
+		VkDeviceSize usedBytes = 0;
+		uint64_t nextId = 1;
+		uint64_t nextOwner = 1;
+		/** @brief Ranges in use in allocation order, the tail only moves past the oldest one */
+		std::deque<Range> ranges;
+		/** @brief Submissions in retire order, kept until they have completed and all their ranges are given back */
+		std::deque<Submission> submissions;
+
+		bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, uint64_t owner, VkDeviceSize* offset);
+		uint64_t retireLocked(Submission submission, uint64_t owner);
+		Submission* findSubmission(uint64_t id);
+		bool isComplete(const Submission& submission, bool wait);
+		void complete(Submission& submission);
+		/** @brief Poll the submissions that haven't completed yet and give back the ranges that are done */
+		void collect();
+		void releaseRanges();
+	};
+
+	/**
+	* Split buffer to image copy regions into chunks whose source data fits into one staging allocation
+	*
+	* @param size Size of the source data, region buffer offsets are relative to its start
+	* @param regions Copy regions, bufferRowLength and bufferImageHeight have to be zero (tightly packed) for regions that need to be split
+	* @param maxChunkSize Maximum number of source bytes per chunk
+	* @param texelBlockHeight Height of a texel block for compressed formats, used when splitting regions by rows
+	* @param copyChunk Called with the source offset and size of each chunk and its regions, whose buffer offsets are relative to the chunk start
+	*/
+	void splitImageCopy(VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions, VkDeviceSize maxChunkSize, uint32_t texelBlockHeight, const std::function<void(VkDeviceSize, VkDeviceSize, std::vector<VkBufferImageCopy>&)>& copyChunk);
+
+	/**
+	* @brief Records uploads through the device's staging ring into one command buffer
+	* @note Uploads that don't fit into the ring are split into chunks, submitting the work recorded so far whenever the ring runs full
+	* @note Each batch is an owner of its own in the ring, so batches can record on several threads at once without retiring each other's ranges
+	* @note A thread must not open a second batch while its first one holds unsubmitted data, the second could wait for the first forever
+	*/
+	class UploadBatch
+	{
+	public:
+		UploadBatch(VulkanDevice* device, VkQueue queue);
+		/** @brief Flushes any work that has not been submitted yet */
+		~UploadBatch();
+
+		/** @brief Command buffer the next upload will be recorded to, used for layout transitions and mip generation around the copies */
+		VkCommandBuffer getCommandBuffer();
+
+		void copyBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+		/**
+		* Write data to a buffer, in place if its memory is mapped (unified memory devices), through the staging ring otherwise
+		* @note The buffer must not be in use by the GPU when it is written in place
+		*/
+		void writeBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, const Allocation& dstAllocation, VkDeviceSize dstOffset = 0);
+		/**
+		* Copy image data to an image in the given layout
+		*
+		* @param data Source data, region buffer offsets are relative to this pointer
+		* @param size Size of the source data
+		* @param image Destination image
+		* @param regions Copy regions, bufferRowLength and bufferImageHeight have to be zero (tightly packed) for regions that need to be split
+		* @param (Optional) imageLayout Layout of the image at the time of the copy (defaults to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		* @param (Optional) texelBlockHeight Height of a texel block for compressed formats, used when splitting regions by rows
+		*/
+		void copyImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t texelBlockHeight = 1);
+
+		/**
+		* Upload the initial contents of an image and transition it from undefined to the layout it is used in
+		*
+		* @param data Source data, region buffer offsets are relative to this pointer
+		* @param size Size of the source data
+		* @param image Destination image, created with the usage from VulkanDevice::getImageUploadUsage()
+		* @param imageUsageFlags Usage flags the image was created with
+		* @param regions Copy regions
+		* @param subresourceRange Subresources of the image the regions cover
+		* @param imageLayout Layout of the image after the upload
+		* @note Images created for host transfer are written right away without recording any commands (VK_EXT_host_image_copy)
+		*/
+		void uploadImage(const void* data, VkDeviceSize size, VkImage image, VkImageUsageFlags imageUsageFlags, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& subresourceRange, VkImageLayout imageLayout);
+
+		/**
+		* Upload the top mip level of an image and generate the remaining levels with blits
+		*
+		* @param data Source data of the top level, tightly packed
+		* @param size Size of the source data
+		* @param image Destination image, created with transfer source and destination usage
+		* @param width Width of the top level
+		* @param height Height of the top level
+		* @param mipLevels Number of mip levels of the image
+		* @param imageLayout Layout of the image after the upload
+		* @note Recording is deferred until the batch is submitted, so the layout transitions and blits of all images in the batch share one barrier per mip level
+		*/
+		void uploadImageWithMips(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout imageLayout);
+
+		/** @brief Submit all recorded work without waiting for it, the staging space is reclaimed once it has finished */
+		void submit();
+		/** @brief Submit all recorded work and wait for everything this batch has submitted */
+		void flush();
+
+		VkDeviceSize getUploadedBytes() const { return uploadedBytes; }
+		uint32_t getSubmitCount() const { return submitCount; }
+
+	private:
+		VulkanDevice* device;
+		StagingRing* ring;
+		VkQueue queue;
+		/** @brief Owner id the batch's staging ranges are allocated and retired with */
+		uint64_t owner;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint64_t lastSubmission = 0;
+		VkDeviceSize uploadedBytes = 0;
+		uint32_t submitCount = 0;
+
+		/** @brief Image whose copy and mip generation are recorded when the batch is submitted */
+		struct PendingImage
+		{
+			VkImage image;
+			uint32_t width;
+			uint32_t height;
+			uint32_t mipLevels;
+			VkImageLayout imageLayout;
+			/** @brief Copy of the top level from the staging ring */
+			VkBufferImageCopy copyRegion;
+			/** @brief Set if the image was too large to be staged in one piece and has been transitioned and copied right away */
+			bool copied;
+		};
+		std::vector<PendingImage> pendingImages;
+
+		VkDeviceSize maxChunkSize() const;
+		StagingRegion acquire(VkDeviceSize size, VkDeviceSize alignment);
+		void recordPendingImages();
+	};
+}
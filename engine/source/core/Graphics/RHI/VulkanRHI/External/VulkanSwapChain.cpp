@@ -9,6 +9,7 @@
 */
 
 #include "VulkanSwapChain.h"
+#include "VulkanHostAllocator.h"
 
 /** @brief Creates the platform specific surface abstraction of the native platform window used for presentation */	
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
@@ -35,26 +36,26 @@ void VulkanSwapChain::initSurface(uint32_t width, uint32_t height)
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 	surfaceCreateInfo.hinstance = (HINSTANCE)platformHandle;
 	surfaceCreateInfo.hwnd = (HWND)platformWindow;
-	err = vkCreateWin32SurfaceKHR(instance, &surfaceCreateInfo, nullptr, &surface);
+	err = vkCreateWin32SurfaceKHR(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
 	VkAndroidSurfaceCreateInfoKHR surfaceCreateInfo = {};
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR;
 	surfaceCreateInfo.window = window;
-	err = vkCreateAndroidSurfaceKHR(instance, &surfaceCreateInfo, NULL, &surface);
+	err = vkCreateAndroidSurfaceKHR(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #elif defined(VK_USE_PLATFORM_IOS_MVK)
 	VkIOSSurfaceCreateInfoMVK surfaceCreateInfo = {};
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_IOS_SURFACE_CREATE_INFO_MVK;
 	surfaceCreateInfo.pNext = NULL;
 	surfaceCreateInfo.flags = 0;
 	surfaceCreateInfo.pView = view;
-	err = vkCreateIOSSurfaceMVK(instance, &surfaceCreateInfo, nullptr, &surface);
+	err = vkCreateIOSSurfaceMVK(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #elif defined(VK_USE_PLATFORM_MACOS_MVK)
 	VkMacOSSurfaceCreateInfoMVK surfaceCreateInfo = {};
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_MACOS_SURFACE_CREATE_INFO_MVK;
 	surfaceCreateInfo.pNext = NULL;
 	surfaceCreateInfo.flags = 0;
 	surfaceCreateInfo.pView = view;
-	err = vkCreateMacOSSurfaceMVK(instance, &surfaceCreateInfo, NULL, &surface);
+	err = vkCreateMacOSSurfaceMVK(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #elif defined(_DIRECT2DISPLAY)
 	createDirect2DisplaySurface(width, height);
 #elif defined(VK_USE_PLATFORM_DIRECTFB_EXT)
@@ -62,19 +63,19 @@ void VulkanSwapChain::initSurface(uint32_t width, uint32_t height)
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_DIRECTFB_SURFACE_CREATE_INFO_EXT;
 	surfaceCreateInfo.dfb = dfb;
 	surfaceCreateInfo.surface = window;
-	err = vkCreateDirectFBSurfaceEXT(instance, &surfaceCreateInfo, nullptr, &surface);
+	err = vkCreateDirectFBSurfaceEXT(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
 	VkWaylandSurfaceCreateInfoKHR surfaceCreateInfo = {};
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
 	surfaceCreateInfo.display = display;
 	surfaceCreateInfo.surface = window;
-	err = vkCreateWaylandSurfaceKHR(instance, &surfaceCreateInfo, nullptr, &surface);
+	err = vkCreateWaylandSurfaceKHR(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
 	VkXcbSurfaceCreateInfoKHR surfaceCreateInfo = {};
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
 	surfaceCreateInfo.connection = connection;
 	surfaceCreateInfo.window = window;
-	err = vkCreateXcbSurfaceKHR(instance, &surfaceCreateInfo, nullptr, &surface);
+	err = vkCreateXcbSurfaceKHR(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
 	VkHeadlessSurfaceCreateInfoEXT surfaceCreateInfo = {};
 	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
@@ -82,7 +83,7 @@ void VulkanSwapChain::initSurface(uint32_t width, uint32_t height)
 	if (!fpCreateHeadlessSurfaceEXT){
 		vks::tools::exitFatal("Could not fetch function pointer for the headless extension!", -1);
 	}
-	err = fpCreateHeadlessSurfaceEXT(instance, &surfaceCreateInfo, nullptr, &surface);
+	err = fpCreateHeadlessSurfaceEXT(instance, &surfaceCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 #endif
 
 	if (err != VK_SUCCESS) {
@@ -352,7 +353,7 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync)
 		swapchainCI.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	}
 
-	VK_CHECK_RESULT(fpCreateSwapchainKHR(device, &swapchainCI, nullptr, &swapChain));
+	VK_CHECK_RESULT(fpCreateSwapchainKHR(device, &swapchainCI, vks::allocationCallbacks(vks::HostAllocationScope::Device), &swapChain));
 
 	// If an existing swap chain is re-created, destroy the old swap chain
 	// This also cleans up all the presentable images
@@ -360,9 +361,9 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync)
 	{ 
 		for (uint32_t i = 0; i < imageCount; i++)
 		{
-			vkDestroyImageView(device, buffers[i].view, nullptr);
+			vkDestroyImageView(device, buffers[i].view, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
 		}
-		fpDestroySwapchainKHR(device, oldSwapchain, nullptr);
+		fpDestroySwapchainKHR(device, oldSwapchain, vks::allocationCallbacks(vks::HostAllocationScope::Device));
 	}
 	VK_CHECK_RESULT(fpGetSwapchainImagesKHR(device, swapChain, &imageCount, NULL));
 
@@ -396,7 +397,7 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync)
 
 		colorAttachmentView.image = buffers[i].image;
 
-		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, nullptr, &buffers[i].view));
+		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &buffers[i].view));
 	}
 }
 
@@ -453,13 +454,13 @@ void VulkanSwapChain::cleanup()
 	{
 		for (uint32_t i = 0; i < imageCount; i++)
 		{
-			vkDestroyImageView(device, buffers[i].view, nullptr);
+			vkDestroyImageView(device, buffers[i].view, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
 		}
 	}
 	if (surface != VK_NULL_HANDLE)
 	{
-		fpDestroySwapchainKHR(device, swapChain, nullptr);
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+		fpDestroySwapchainKHR(device, swapChain, vks::allocationCallbacks(vks::HostAllocationScope::Device));
+		vkDestroySurfaceKHR(instance, surface, vks::allocationCallbacks(vks::HostAllocationScope::Instance));
 	}
 	surface = VK_NULL_HANDLE;
 	swapChain = VK_NULL_HANDLE;
@@ -592,7 +593,7 @@ void VulkanSwapChain::createDirect2DisplaySurface(uint32_t width, uint32_t heigh
 	surfaceInfo.imageExtent.width = width;
 	surfaceInfo.imageExtent.height = height;
 
-	VkResult result = vkCreateDisplayPlaneSurfaceKHR(instance, &surfaceInfo, NULL, &surface);
+	VkResult result = vkCreateDisplayPlaneSurfaceKHR(instance, &surfaceInfo, vks::allocationCallbacks(vks::HostAllocationScope::Instance), &surface);
 	if (result !=VK_SUCCESS) {
 		vks::tools::exitFatal("Failed to create surface!", result);
 	}
@@ -0,0 +1,273 @@
+/*
+* Recycling pools for fences, semaphores and command buffers
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanSyncPools.h"
+#include "VulkanHostAllocator.h"
+#include "Tools.h"
+#include "VulkanInitializers.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+
+namespace vks
+{
+	namespace
+	{
+		std::atomic<uint64_t> createdFences{ 0 };
+		std::atomic<uint64_t> createdBinarySemaphores{ 0 };
+		std::atomic<uint64_t> createdTimelineSemaphores{ 0 };
+		std::atomic<uint64_t> createdCommandPools{ 0 };
+		std::atomic<uint64_t> allocatedCommandBuffers{ 0 };
+		std::atomic<uint64_t> nextCommandBufferPoolsId{ 1 };
+	}
+
+	SyncObjectStatistics SyncObjectStatistics::operator-(const SyncObjectStatistics& other) const
+	{
+		SyncObjectStatistics difference;
+		difference.fences = fences - other.fences;
+		difference.binarySemaphores = binarySemaphores - other.binarySemaphores;
+		difference.timelineSemaphores = timelineSemaphores - other.timelineSemaphores;
+		difference.commandPools = commandPools - other.commandPools;
+		difference.commandBuffers = commandBuffers - other.commandBuffers;
+		return difference;
+	}
+
+	SyncObjectStatistics getSyncObjectStatistics()
+	{
+		SyncObjectStatistics statistics;
+		statistics.fences = createdFences.load(std::memory_order_relaxed);
+		statistics.binarySemaphores = createdBinarySemaphores.load(std::memory_order_relaxed);
+		statistics.timelineSemaphores = createdTimelineSemaphores.load(std::memory_order_relaxed);
+		statistics.commandPools = createdCommandPools.load(std::memory_order_relaxed);
+		statistics.commandBuffers = allocatedCommandBuffers.load(std::memory_order_relaxed);
+		return statistics;
+	}
+
+	void printSyncObjectStatistics(const SyncObjectStatistics& statistics)
+	{
+		std::cout << "Created sync objects: " << statistics.fences << " fences, " << statistics.binarySemaphores << " binary semaphores, "
+			<< statistics.timelineSemaphores << " timeline semaphores, " << statistics.commandPools << " command pools, "
+			<< statistics.commandBuffers << " command buffers" << std::endl;
+	}
+
+	FencePool::FencePool(VkDevice device) : device(device)
+	{
+	}
+
+	FencePool::~FencePool()
+	{
+		for (VkFence fence : freeFences) {
+			vkDestroyFence(device, fence, allocationCallbacks(HostAllocationScope::Command));
+		}
+		for (VkFence fence : pendingFences) {
+			vkDestroyFence(device, fence, allocationCallbacks(HostAllocationScope::Command));
+		}
+	}
+
+	VkFence FencePool::acquire()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// Recycle released fences that have signaled in the meantime
+		for (size_t i = 0; i < pendingFences.size();) {
+			if (vkGetFenceStatus(device, pendingFences[i]) == VK_SUCCESS) {
+				VK_CHECK_RESULT(vkResetFences(device, 1, &pendingFences[i]));
+				freeFences.push_back(pendingFences[i]);
+				pendingFences[i] = pendingFences.back();
+				pendingFences.pop_back();
+			} else {
+				i++;
+			}
+		}
+		if (!freeFences.empty()) {
+			VkFence fence = freeFences.back();
+			freeFences.pop_back();
+			return fence;
+		}
+		VkFence fence;
+		VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(0);
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, allocationCallbacks(HostAllocationScope::Command), &fence));
+		createdFences.fetch_add(1, std::memory_order_relaxed);
+		return fence;
+	}
+
+	void FencePool::release(VkFence fence)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const VkResult status = vkGetFenceStatus(device, fence);
+		if (status == VK_SUCCESS) {
+			VK_CHECK_RESULT(vkResetFences(device, 1, &fence));
+			freeFences.push_back(fence);
+		} else {
+			assert(status == VK_NOT_READY);
+			pendingFences.push_back(fence);
+		}
+	}
+
+	SemaphorePool::SemaphorePool(VkDevice device) : device(device)
+	{
+	}
+
+	SemaphorePool::~SemaphorePool()
+	{
+		for (VkSemaphore semaphore : semaphores) {
+			vkDestroySemaphore(device, semaphore, allocationCallbacks(HostAllocationScope::Command));
+		}
+	}
+
+	VkSemaphore SemaphorePool::acquireBinary()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!freeBinarySemaphores.empty()) {
+			VkSemaphore semaphore = freeBinarySemaphores.back();
+			freeBinarySemaphores.pop_back();
+			return semaphore;
+		}
+		VkSemaphore semaphore;
+		VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks(HostAllocationScope::Command), &semaphore));
+		createdBinarySemaphores.fetch_add(1, std::memory_order_relaxed);
+		semaphores.push_back(semaphore);
+		return semaphore;
+	}
+
+	void SemaphorePool::releaseBinary(VkSemaphore semaphore)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		freeBinarySemaphores.push_back(semaphore);
+	}
+
+	VkSemaphore SemaphorePool::acquireTimeline(uint64_t* value)
+	{
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!freeTimelineSemaphores.empty()) {
+				semaphore = freeTimelineSemaphores.back();
+				freeTimelineSemaphores.pop_back();
+			} else {
+				VkSemaphoreTypeCreateInfo semaphoreTypeInfo{};
+				semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+				semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+				semaphoreTypeInfo.initialValue = 0;
+				VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+				semaphoreInfo.pNext = &semaphoreTypeInfo;
+				VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks(HostAllocationScope::Command), &semaphore));
+				createdTimelineSemaphores.fetch_add(1, std::memory_order_relaxed);
+				semaphores.push_back(semaphore);
+			}
+		}
+		VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device, semaphore, value));
+		return semaphore;
+	}
+
+	void SemaphorePool::releaseTimeline(VkSemaphore semaphore)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		freeTimelineSemaphores.push_back(semaphore);
+	}
+
+	CommandBufferPools::CommandBufferPools(VkDevice device) : device(device), id(nextCommandBufferPoolsId.fetch_add(1, std::memory_order_relaxed))
+	{
+	}
+
+	CommandBufferPools::~CommandBufferPools()
+	{
+		// Destroying the pools frees all of their command buffers
+		for (std::unique_ptr<ThreadPool>& pool : pools) {
+			vkDestroyCommandPool(device, pool->commandPool, allocationCallbacks(HostAllocationScope::Command));
+		}
+	}
+
+	CommandBufferPools::ThreadPool* CommandBufferPools::getThreadPool(uint32_t queueFamilyIndex)
+	{
+		// Pools already used by this thread are found without taking the lock
+		struct CachedPool
+		{
+			uint64_t owner;
+			uint32_t queueFamilyIndex;
+			ThreadPool* pool;
+		};
+		thread_local std::vector<CachedPool> cachedPools;
+		for (const CachedPool& cachedPool : cachedPools) {
+			if (cachedPool.owner == id && cachedPool.queueFamilyIndex == queueFamilyIndex) {
+				return cachedPool.pool;
+			}
+		}
+
+		std::unique_ptr<ThreadPool> pool(new ThreadPool());
+		VkCommandPoolCreateInfo commandPoolInfo = vks::initializers::commandPoolCreateInfo();
+		commandPoolInfo.queueFamilyIndex = queueFamilyIndex;
+		commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		VK_CHECK_RESULT(vkCreateCommandPool(device, &commandPoolInfo, allocationCallbacks(HostAllocationScope::Command), &pool->commandPool));
+		createdCommandPools.fetch_add(1, std::memory_order_relaxed);
+
+		ThreadPool* threadPool = pool.get();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pools.push_back(std::move(pool));
+		}
+		cachedPools.push_back({ id, queueFamilyIndex, threadPool });
+		return threadPool;
+	}
+
+	VkCommandBuffer CommandBufferPools::acquire(uint32_t queueFamilyIndex, VkCommandBufferLevel level)
+	{
+		ThreadPool* pool = getThreadPool(queueFamilyIndex);
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			for (size_t i = 0; i < pool->pendingCommandBuffers.size();) {
+				const PendingCommandBuffer& pending = pool->pendingCommandBuffers[i];
+				if (vkGetFenceStatus(device, pending.fence) == VK_SUCCESS) {
+					pool->freeCommandBuffers[pending.level == VK_COMMAND_BUFFER_LEVEL_SECONDARY ? 1 : 0].push_back(pending.commandBuffer);
+					pool->pendingCommandBuffers[i] = pool->pendingCommandBuffers.back();
+					pool->pendingCommandBuffers.pop_back();
+				} else {
+					i++;
+				}
+			}
+			std::vector<VkCommandBuffer>& freeCommandBuffers = pool->freeCommandBuffers[level == VK_COMMAND_BUFFER_LEVEL_SECONDARY ? 1 : 0];
+			if (!freeCommandBuffers.empty()) {
+				commandBuffer = freeCommandBuffers.back();
+				freeCommandBuffers.pop_back();
+			}
+		}
+		if (commandBuffer != VK_NULL_HANDLE) {
+			// Only the owning thread touches the command pool, so the reset needs no further locking
+			VK_CHECK_RESULT(vkResetCommandBuffer(commandBuffer, 0));
+			return commandBuffer;
+		}
+
+		VkCommandBufferAllocateInfo allocateInfo = vks::initializers::commandBufferAllocateInfo(pool->commandPool, level, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+		allocatedCommandBuffers.fetch_add(1, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(mutex);
+		owners[commandBuffer] = { pool, level };
+		return commandBuffer;
+	}
+
+	void CommandBufferPools::release(VkCommandBuffer commandBuffer)
+	{
+		Owner owner;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			owner = owners.at(commandBuffer);
+		}
+		std::lock_guard<std::mutex> lock(owner.pool->mutex);
+		owner.pool->freeCommandBuffers[owner.level == VK_COMMAND_BUFFER_LEVEL_SECONDARY ? 1 : 0].push_back(commandBuffer);
+	}
+
+	void CommandBufferPools::release(VkCommandBuffer commandBuffer, VkFence fence)
+	{
+		Owner owner;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			owner = owners.at(commandBuffer);
+		}
+		std::lock_guard<std::mutex> lock(owner.pool->mutex);
+		owner.pool->pendingCommandBuffers.push_back({ commandBuffer, fence, owner.level });
+	}
+}
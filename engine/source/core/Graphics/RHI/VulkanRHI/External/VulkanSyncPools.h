@@ -0,0 +1,136 @@
+/*
+* Recycling pools for fences, semaphores and command buffers
+*
+* Objects are created on demand and handed back to their pool instead of being destroyed, so once the pools are warm
+* no Vulkan object creation calls are made at all. Command buffers come from one command pool per thread and queue
+* family, so recording on several threads needs no locking, and are reset on reuse instead of being freed.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vks
+{
+	/** @brief Number of objects created by all pools, the difference between two frames is zero in steady state */
+	struct SyncObjectStatistics
+	{
+		uint64_t fences = 0;
+		uint64_t binarySemaphores = 0;
+		uint64_t timelineSemaphores = 0;
+		uint64_t commandPools = 0;
+		uint64_t commandBuffers = 0;
+
+		uint64_t total() const { return fences + binarySemaphores + timelineSemaphores + commandPools + commandBuffers; }
+		SyncObjectStatistics operator-(const SyncObjectStatistics& other) const;
+	};
+
+	SyncObjectStatistics getSyncObjectStatistics();
+	void printSyncObjectStatistics(const SyncObjectStatistics& statistics);
+
+	class FencePool
+	{
+	public:
+		explicit FencePool(VkDevice device);
+		~FencePool();
+		FencePool(const FencePool&) = delete;
+		FencePool& operator=(const FencePool&) = delete;
+
+		/** @brief Get an unsignaled fence */
+		VkFence acquire();
+		/**
+		* Give a fence back to the pool
+		* @note The fence must either have signaled or have been submitted, a fence still in flight is recycled once it has signaled
+		*/
+		void release(VkFence fence);
+
+	private:
+		VkDevice device;
+		std::mutex mutex;
+		std::vector<VkFence> freeFences;
+		std::vector<VkFence> pendingFences;
+	};
+
+	class SemaphorePool
+	{
+	public:
+		explicit SemaphorePool(VkDevice device);
+		~SemaphorePool();
+		SemaphorePool(const SemaphorePool&) = delete;
+		SemaphorePool& operator=(const SemaphorePool&) = delete;
+
+		/** @brief Get an unsignaled binary semaphore */
+		VkSemaphore acquireBinary();
+		/** @brief Give back a binary semaphore, the wait operation on it must have completed */
+		void releaseBinary(VkSemaphore semaphore);
+		/**
+		* Get a timeline semaphore
+		* @param value Receives the current value of the semaphore, recycled semaphores continue counting from where they were
+		*/
+		VkSemaphore acquireTimeline(uint64_t* value);
+		/** @brief Give back a timeline semaphore, all waits and signals on it must have completed */
+		void releaseTimeline(VkSemaphore semaphore);
+
+	private:
+		VkDevice device;
+		std::mutex mutex;
+		std::vector<VkSemaphore> freeBinarySemaphores;
+		std::vector<VkSemaphore> freeTimelineSemaphores;
+		std::vector<VkSemaphore> semaphores;
+	};
+
+	class CommandBufferPools
+	{
+	public:
+		explicit CommandBufferPools(VkDevice device);
+		~CommandBufferPools();
+		CommandBufferPools(const CommandBufferPools&) = delete;
+		CommandBufferPools& operator=(const CommandBufferPools&) = delete;
+
+		/**
+		* Get a command buffer in initial state from the calling thread's pool for a queue family
+		* @note The command buffer may only be recorded on the calling thread
+		*/
+		VkCommandBuffer acquire(uint32_t queueFamilyIndex, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+		/** @brief Give back a command buffer the GPU has finished with, can be called from any thread */
+		void release(VkCommandBuffer commandBuffer);
+		/** @brief Give back a command buffer that is recycled once the fence of its submission has signaled (the fence must not be reset before) */
+		void release(VkCommandBuffer commandBuffer, VkFence fence);
+
+	private:
+		/** @brief Command pool owned by one thread, the free lists are locked as buffers can be released from other threads */
+		struct PendingCommandBuffer
+		{
+			VkCommandBuffer commandBuffer;
+			VkFence fence;
+			VkCommandBufferLevel level;
+		};
+		struct ThreadPool
+		{
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			std::mutex mutex;
+			std::vector<VkCommandBuffer> freeCommandBuffers[2];
+			std::vector<PendingCommandBuffer> pendingCommandBuffers;
+		};
+		struct Owner
+		{
+			ThreadPool* pool;
+			VkCommandBufferLevel level;
+		};
+
+		VkDevice device;
+		/** @brief Distinguishes pool instances in the per-thread lookup cache */
+		const uint64_t id;
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadPool>> pools;
+		std::unordered_map<VkCommandBuffer, Owner> owners;
+
+		ThreadPool* getThreadPool(uint32_t queueFamilyIndex);
+	};
+}
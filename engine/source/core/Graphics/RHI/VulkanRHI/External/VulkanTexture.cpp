@@ -21,13 +21,78 @@ namespace vks
 
 	void Texture::destroy()
 	{
-		vkDestroyImageView(device->logicalDevice, view, nullptr);
-		vkDestroyImage(device->logicalDevice, image, nullptr);
+		if (device->deletionQueue)
+		{
+			// Frames still in flight may sample the texture
+			RetiredResources retired;
+			retired.imageViews.push_back(view);
+			retired.images.push_back(image);
+			if (sampler)
+			{
+				retired.samplers.push_back(sampler);
+			}
+			retired.allocations.push_back(allocation);
+			allocation = Allocation{};
+			if (uploadTicket.valid() && !device->uploadManager->isComplete(uploadTicket))
+			{
+				// The transfer queue may still be copying into the image, frames using it wait for the copy and are only tagged once it is done
+				DeletionQueue* deletionQueue = device->deletionQueue;
+				RetiredResources afterUpload;
+				afterUpload.callbacks.push_back([deletionQueue, retired]() mutable {
+					deletionQueue->retire(std::move(retired));
+				});
+				deletionQueue->retire(std::move(afterUpload), device->uploadManager->getSemaphore(), uploadTicket.value);
+				uploadTicket = UploadTicket();
+				return;
+			}
+			device->deletionQueue->retire(std::move(retired));
+			return;
+		}
+		if (uploadTicket.valid())
+		{
+			// Only set for async uploads, the transfer queue may still be copying into the image
+			device->uploadManager->wait(uploadTicket);
+			uploadTicket = UploadTicket();
+		}
+		vkDestroyImageView(device->logicalDevice, view, allocationCallbacks(HostAllocationScope::Resource));
+		vkDestroyImage(device->logicalDevice, image, allocationCallbacks(HostAllocationScope::Resource));
 		if (sampler)
 		{
-			vkDestroySampler(device->logicalDevice, sampler, nullptr);
+			vkDestroySampler(device->logicalDevice, sampler, allocationCallbacks(HostAllocationScope::Descriptor));
 		}
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		allocation.free();
+	}
+
+	/**
+	* Upload the initial contents of the texture's image and transition it to the layout it is used in
+	*
+	* @note If the device has an upload manager the copy is recorded onto its transfer queue, otherwise it is submitted to copyQueue through the staging ring
+	* @note Uploads through the upload manager are waited for and their ownership is acquired on copyQueue, unless asyncUpload is set. The ticket is then
+	* stored in uploadTicket and the caller has to acquire it before the texture is used
+	*/
+	void Texture::uploadImage(const void* data, VkDeviceSize size, VkImageUsageFlags imageUsageFlags, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& subresourceRange, VkImageLayout imageLayout, VkQueue copyQueue)
+	{
+		if (device->uploadManager && !device->isHostImageUpload(imageUsageFlags))
+		{
+			uploadTicket = device->uploadManager->uploadImage(data, size, image, regions, subresourceRange, imageLayout);
+			if (asyncUpload)
+			{
+				return;
+			}
+			device->uploadManager->wait(uploadTicket);
+			if (device->uploadManager->needsOwnershipTransfer())
+			{
+				// The copy has finished, so the acquire barrier doesn't need to wait on the upload timeline
+				VkCommandBuffer acquireCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				device->uploadManager->acquire(acquireCmd, uploadTicket);
+				device->flushCommandBuffer(acquireCmd, copyQueue);
+			}
+			uploadTicket = UploadTicket();
+			return;
+		}
+		vks::UploadBatch batch(device, copyQueue);
+		batch.uploadImage(data, size, image, imageUsageFlags, regions, subresourceRange, imageLayout);
+		batch.submit();
 	}
 
 	ktxResult Texture::loadKTXFile(std::string filename, ktxTexture **target)
@@ -93,41 +158,8 @@ namespace vks
 		// limited amount of formats and features (mip maps, cubemaps, arrays, etc.)
 		VkBool32 useStaging = !forceLinear;
 
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 		if (useStaging)
 		{
-			// Create a host-visible staging buffer that contains the raw image data
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-			bufferCreateInfo.size = ktxTextureSize;
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-			// Get memory requirements for the staging buffer (alignment, memory type bits)
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			// Copy texture data into staging buffer
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, ktxTextureData, ktxTextureSize);
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 			// Setup buffer copy regions for each mip level
 			std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -162,21 +194,11 @@ namespace vks
 			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			imageCreateInfo.extent = { width, height, 1 };
-			imageCreateInfo.usage = imageUsageFlags;
-			// Ensure that the TRANSFER_DST bit is set for staging
-			if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-			{
-				imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-			}
-			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+			// Host transfer if the image can be written without a command buffer, transfer destination for the staging copy otherwise
+			imageCreateInfo.usage = imageUsageFlags | device->getImageUploadUsage(format, imageLayout);
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &image));
 
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+			VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation, vks::MemoryCategory::Texture));
 
 			VkImageSubresourceRange subresourceRange = {};
 			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -184,39 +206,9 @@ namespace vks
 			subresourceRange.levelCount = mipLevels;
 			subresourceRange.layerCount = 1;
 
-			// Image barrier for optimal image (target)
-			// Optimal image will be used as destination for the copy
-			EngineBase::Tools::setImageLayout(
-				copyCmd,
-				image,
-				VK_IMAGE_LAYOUT_UNDEFINED,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				subresourceRange);
-
-			// Copy mip levels from staging buffer
-			vkCmdCopyBufferToImage(
-				copyCmd,
-				stagingBuffer,
-				image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				static_cast<uint32_t>(bufferCopyRegions.size()),
-				bufferCopyRegions.data()
-			);
-
-			// Change texture image layout to shader read after all mip levels have been copied
+			// Copy all mip levels and transition the image to its final layout
 			this->imageLayout = imageLayout;
-			EngineBase::Tools::setImageLayout(
-				copyCmd,
-				image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				imageLayout,
-				subresourceRange);
-
-			device->flushCommandBuffer(copyCmd, copyQueue);
-
-			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			uploadImage(ktxTextureData, ktxTextureSize, imageCreateInfo.usage, bufferCopyRegions, subresourceRange, imageLayout, copyQueue);
 		}
 		else
 		{
@@ -228,7 +220,6 @@ namespace vks
 			assert(formatProperties.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 
 			VkImage mappableImage;
-			VkDeviceMemory mappableMemory;
 
 			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -243,22 +234,10 @@ namespace vks
 			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
 			// Load mip map level 0 to linear tiling image
-			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &mappableImage));
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &mappableImage));
 
-			// Get memory requirements for this image 
-			// like size and alignment
-			vkGetImageMemoryRequirements(device->logicalDevice, mappableImage, &memReqs);
-			// Set memory allocation size to required memory size
-			memAllocInfo.allocationSize = memReqs.size;
-
-			// Get memory type that can be mapped to host memory
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-			// Allocate host memory
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &mappableMemory));
-
-			// Bind allocated image for use
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, mappableImage, mappableMemory, 0));
+			// Get memory that can be mapped to host memory from the linear pool and bind it to the image
+			VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(mappableImage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &allocation, vks::MemoryCategory::Texture, VK_IMAGE_TILING_LINEAR));
 
 			// Get sub resource layout
 			// Mip map count, array layer, etc.
@@ -267,27 +246,21 @@ namespace vks
 			subRes.mipLevel = 0;
 
 			VkSubresourceLayout subResLayout;
-			void *data;
 
 			// Get sub resources layout 
 			// Includes row pitch, size offsets, etc.
 			vkGetImageSubresourceLayout(device->logicalDevice, mappableImage, &subRes, &subResLayout);
 
-			// Map image memory
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, mappableMemory, 0, memReqs.size, 0, &data));
-
-			// Copy image data into memory
-			memcpy(data, ktxTextureData, memReqs.size);
-
-			vkUnmapMemory(device->logicalDevice, mappableMemory);
+			// Copy image data into the persistently mapped memory
+			memcpy(allocation.mapped, ktxTextureData, std::min<VkDeviceSize>(allocation.size, ktxTextureSize));
 
 			// Linear tiled images don't need to be staged
 			// and can be directly used as textures
 			image = mappableImage;
-			deviceMemory = mappableMemory;
 			this->imageLayout = imageLayout;
 
 			// Setup image memory barrier
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 			EngineBase::Tools::setImageLayout(copyCmd, image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, imageLayout);
 
 			device->flushCommandBuffer(copyCmd, copyQueue);
@@ -313,7 +286,7 @@ namespace vks
 		samplerCreateInfo.maxAnisotropy = device->enabledFeatures.samplerAnisotropy ? device->properties.limits.maxSamplerAnisotropy : 1.0f;
 		samplerCreateInfo.anisotropyEnable = device->enabledFeatures.samplerAnisotropy;
 		samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, allocationCallbacks(HostAllocationScope::Descriptor), &sampler));
 
 		// Create image view
 		// Textures are not directly accessed by the shaders and
@@ -329,7 +302,7 @@ namespace vks
 		// Only set mip map count if optimal tiling is used
 		viewCreateInfo.subresourceRange.levelCount = (useStaging) ? mipLevels : 1;
 		viewCreateInfo.image = image;
-		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &view));
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
@@ -358,39 +331,6 @@ namespace vks
 		height = texHeight;
 		mipLevels = 1;
 
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = bufferSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		// Get memory requirements for the staging buffer (alignment, memory type bits)
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-		// Get memory type index for a host visible buffer
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t *data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-		memcpy(data, buffer, bufferSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 		VkBufferImageCopy bufferCopyRegion = {};
 		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -413,21 +353,11 @@ namespace vks
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width, height, 1 };
-		imageCreateInfo.usage = imageUsageFlags;
-		// Ensure that the TRANSFER_DST bit is set for staging
-		if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-		{
-			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		}
-		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+		// Host transfer if the image can be written without a command buffer, transfer destination for the staging copy otherwise
+		imageCreateInfo.usage = imageUsageFlags | device->getImageUploadUsage(format, imageLayout);
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &image));
 
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation, vks::MemoryCategory::Texture));
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -435,39 +365,9 @@ namespace vks
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 1;
 
-		// Image barrier for optimal image (target)
-		// Optimal image will be used as destination for the copy
-		EngineBase::Tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			subresourceRange);
-
-		// Copy mip levels from staging buffer
-		vkCmdCopyBufferToImage(
-			copyCmd,
-			stagingBuffer,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&bufferCopyRegion
-		);
-
-		// Change texture image layout to shader read after all mip levels have been copied
+		// Copy all mip levels and transition the image to its final layout
 		this->imageLayout = imageLayout;
-		EngineBase::Tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			imageLayout,
-			subresourceRange);
-
-		device->flushCommandBuffer(copyCmd, copyQueue);
-
-		// Clean up staging resources
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+		uploadImage(buffer, bufferSize, imageCreateInfo.usage, { bufferCopyRegion }, subresourceRange, imageLayout, copyQueue);
 
 		// Create sampler
 		VkSamplerCreateInfo samplerCreateInfo = {};
@@ -483,7 +383,7 @@ namespace vks
 		samplerCreateInfo.minLod = 0.0f;
 		samplerCreateInfo.maxLod = 0.0f;
 		samplerCreateInfo.maxAnisotropy = 1.0f;
-		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, allocationCallbacks(HostAllocationScope::Descriptor), &sampler));
 
 		// Create image view
 		VkImageViewCreateInfo viewCreateInfo = {};
@@ -495,7 +395,7 @@ namespace vks
 		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 		viewCreateInfo.subresourceRange.levelCount = 1;
 		viewCreateInfo.image = image;
-		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &view));
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
@@ -527,37 +427,6 @@ namespace vks
 		ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
 		ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
 
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		// Get memory requirements for the staging buffer (alignment, memory type bits)
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-		// Get memory type index for a host visible buffer
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t *data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		// Setup buffer copy regions for each layer including all of its miplevels
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 
@@ -592,62 +461,26 @@ namespace vks
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width, height, 1 };
-		imageCreateInfo.usage = imageUsageFlags;
-		// Ensure that the TRANSFER_DST bit is set for staging
-		if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-		{
-			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		}
+		// Host transfer if the image can be written without a command buffer, transfer destination for the staging copy otherwise
+		imageCreateInfo.usage = imageUsageFlags | device->getImageUploadUsage(format, imageLayout);
 		imageCreateInfo.arrayLayers = layerCount;
 		imageCreateInfo.mipLevels = mipLevels;
 
-		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &image));
 
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation, vks::MemoryCategory::Texture));
 
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Image barrier for optimal image (target)
-		// Set initial layout for all array layers (faces) of the optimal (target) tiled texture
+		// Set up the subresource range covering all array layers and mip levels
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		subresourceRange.baseMipLevel = 0;
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = layerCount;
 
-		EngineBase::Tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			subresourceRange);
-
-		// Copy the layers and mip levels from the staging buffer to the optimal tiled image
-		vkCmdCopyBufferToImage(
-			copyCmd,
-			stagingBuffer,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			static_cast<uint32_t>(bufferCopyRegions.size()),
-			bufferCopyRegions.data());
-
-		// Change texture image layout to shader read after all faces have been copied
+		// Copy the layers and mip levels and transition the image to its final layout
 		this->imageLayout = imageLayout;
-		EngineBase::Tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			imageLayout,
-			subresourceRange);
-
-		device->flushCommandBuffer(copyCmd, copyQueue);
+		uploadImage(ktxTextureData, ktxTextureSize, imageCreateInfo.usage, bufferCopyRegions, subresourceRange, imageLayout, copyQueue);
 
 		// Create sampler
 		VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
@@ -664,7 +497,7 @@ namespace vks
 		samplerCreateInfo.minLod = 0.0f;
 		samplerCreateInfo.maxLod = (float)mipLevels;
 		samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, allocationCallbacks(HostAllocationScope::Descriptor), &sampler));
 
 		// Create image view
 		VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
@@ -675,12 +508,9 @@ namespace vks
 		viewCreateInfo.subresourceRange.layerCount = layerCount;
 		viewCreateInfo.subresourceRange.levelCount = mipLevels;
 		viewCreateInfo.image = image;
-		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &view));
 
-		// Clean up staging resources
 		ktxTexture_Destroy(ktxTexture);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
@@ -711,37 +541,6 @@ namespace vks
 		ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
 		ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
 
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		// Get memory requirements for the staging buffer (alignment, memory type bits)
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-		// Get memory type index for a host visible buffer
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t *data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		// Setup buffer copy regions for each face including all of its mip levels
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 
@@ -777,65 +576,29 @@ namespace vks
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width, height, 1 };
-		imageCreateInfo.usage = imageUsageFlags;
-		// Ensure that the TRANSFER_DST bit is set for staging
-		if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-		{
-			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		}
+		// Host transfer if the image can be written without a command buffer, transfer destination for the staging copy otherwise
+		imageCreateInfo.usage = imageUsageFlags | device->getImageUploadUsage(format, imageLayout);
 		// Cube faces count as array layers in Vulkan
 		imageCreateInfo.arrayLayers = 6;
 		// This flag is required for cube map images
 		imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 
 
-		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &image));
 
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation, vks::MemoryCategory::Texture));
 
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Image barrier for optimal image (target)
-		// Set initial layout for all array layers (faces) of the optimal (target) tiled texture
+		// Set up the subresource range covering all array layers and mip levels
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		subresourceRange.baseMipLevel = 0;
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 6;
 
-		EngineBase::Tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			subresourceRange);
-
-		// Copy the cube map faces from the staging buffer to the optimal tiled image
-		vkCmdCopyBufferToImage(
-			copyCmd,
-			stagingBuffer,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			static_cast<uint32_t>(bufferCopyRegions.size()),
-			bufferCopyRegions.data());
-
-		// Change texture image layout to shader read after all faces have been copied
+		// Copy the cube map faces and transition the image to its final layout
 		this->imageLayout = imageLayout;
-		EngineBase::Tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			imageLayout,
-			subresourceRange);
-
-		device->flushCommandBuffer(copyCmd, copyQueue);
+		uploadImage(ktxTextureData, ktxTextureSize, imageCreateInfo.usage, bufferCopyRegions, subresourceRange, imageLayout, copyQueue);
 
 		// Create sampler
 		VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
@@ -852,7 +615,7 @@ namespace vks
 		samplerCreateInfo.minLod = 0.0f;
 		samplerCreateInfo.maxLod = (float)mipLevels;
 		samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, allocationCallbacks(HostAllocationScope::Descriptor), &sampler));
 
 		// Create image view
 		VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
@@ -863,12 +626,9 @@ namespace vks
 		viewCreateInfo.subresourceRange.layerCount = 6;
 		viewCreateInfo.subresourceRange.levelCount = mipLevels;
 		viewCreateInfo.image = image;
-		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, allocationCallbacks(HostAllocationScope::Resource), &view));
 
-		// Clean up staging resources
 		ktxTexture_Destroy(ktxTexture);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
@@ -46,13 +46,17 @@ class Texture
 	vks::VulkanDevice *   device;
 	VkImage               image;
 	VkImageLayout         imageLayout;
-	VkDeviceMemory        deviceMemory;
+	vks::Allocation       allocation;
 	VkImageView           view;
 	uint32_t              width, height;
 	uint32_t              mipLevels;
 	uint32_t              layerCount;
 	VkDescriptorImageInfo descriptor;
 	VkSampler             sampler;
+	/** @brief Upload of the image's contents if it went through the device's upload manager with asyncUpload set, acquire it before the first use */
+	vks::UploadTicket     uploadTicket;
+	/** @brief Set before loading to return while the upload manager is still copying, the caller then waits for or acquires uploadTicket */
+	bool                  asyncUpload = false;
 	void*    m_pixels {nullptr};
 	uint32_t datasize;
 	
@@ -71,6 +75,9 @@ class Texture
 	void      updateDescriptor();
 	void      destroy();
 	ktxResult loadKTXFile(std::string filename, ktxTexture **target);
+
+  protected:
+	void uploadImage(const void *data, VkDeviceSize size, VkImageUsageFlags imageUsageFlags, const std::vector<VkBufferImageCopy> &regions, const VkImageSubresourceRange &subresourceRange, VkImageLayout imageLayout, VkQueue copyQueue);
 };
 
 class Texture2D : public Texture
@@ -0,0 +1,94 @@
+/*
+* Worker thread pool
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanThreadPool.h"
+#include <algorithm>
+
+namespace vks
+{
+	ThreadPool::ThreadPool(uint32_t workerCount)
+	{
+		if (workerCount == 0) {
+			workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+		workers.reserve(workerCount);
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.emplace_back(&ThreadPool::workerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		workAvailable.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t index)>& function)
+	{
+		if (count == 0) {
+			return;
+		}
+		// Not worth waking the workers for a single call
+		if (count == 1 || workers.empty()) {
+			for (uint32_t i = 0; i < count; i++) {
+				function(i);
+			}
+			return;
+		}
+
+		std::lock_guard<std::mutex> submitLock(submitMutex);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			this->function = &function;
+			this->count = count;
+			nextIndex.store(0, std::memory_order_relaxed);
+			busyWorkers = static_cast<uint32_t>(workers.size());
+			generation++;
+		}
+		workAvailable.notify_all();
+
+		runIndices();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		workFinished.wait(lock, [this] { return busyWorkers == 0; });
+		this->function = nullptr;
+	}
+
+	void ThreadPool::runIndices()
+	{
+		// Indices are handed out one at a time, so uneven work per index still keeps all threads busy
+		for (uint32_t index = nextIndex.fetch_add(1, std::memory_order_relaxed); index < count; index = nextIndex.fetch_add(1, std::memory_order_relaxed)) {
+			(*function)(index);
+		}
+	}
+
+	void ThreadPool::workerLoop()
+	{
+		uint64_t finishedGeneration = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				workAvailable.wait(lock, [&] { return stop || generation != finishedGeneration; });
+				if (stop) {
+					return;
+				}
+				finishedGeneration = generation;
+			}
+			runIndices();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				busyWorkers--;
+			}
+			workFinished.notify_one();
+		}
+	}
+}
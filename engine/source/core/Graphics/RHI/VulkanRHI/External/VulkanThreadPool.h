@@ -0,0 +1,63 @@
+/*
+* Worker thread pool
+*
+* A fixed set of worker threads that split indexed work between them and the calling thread. Workers live as long as
+* the pool, so everything they keep per thread (command pools, linear arenas) is created once and then reused.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vks
+{
+	class ThreadPool
+	{
+	public:
+		/**
+		* Start the worker threads
+		* @param (Optional) workerCount Number of worker threads, defaults to one less than the number of hardware threads as the calling thread takes part in the work
+		*/
+		explicit ThreadPool(uint32_t workerCount = 0);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/**
+		* Call a function for every index in [0, count) on the workers and the calling thread
+		* @note Returns once all calls have finished, calls from several threads are run one after another
+		*/
+		void parallelFor(uint32_t count, const std::function<void(uint32_t index)>& function);
+
+		/** @brief Number of threads working on a parallelFor(), including the calling thread */
+		uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+	private:
+		std::vector<std::thread> workers;
+		/** @brief Serializes parallelFor() calls */
+		std::mutex submitMutex;
+		std::mutex mutex;
+		std::condition_variable workAvailable;
+		std::condition_variable workFinished;
+		bool stop = false;
+		/** @brief Incremented for every parallelFor(), wakes the workers */
+		uint64_t generation = 0;
+		/** @brief Workers that haven't finished the current generation yet */
+		uint32_t busyWorkers = 0;
+
+		const std::function<void(uint32_t)>* function = nullptr;
+		uint32_t count = 0;
+		std::atomic<uint32_t> nextIndex{ 0 };
+
+		void workerLoop();
+		void runIndices();
+	};
+}
@@ -0,0 +1,258 @@
+/*
+* Asynchronous upload manager
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanUploadManager.h"
+#include "VulkanDevice.h"
+#include "Tools.h"
+#include "VulkanInitializers.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace vks
+{
+	UploadManager::UploadManager(VulkanDevice* device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize stagingSize)
+		: device(device), queue(queue), queueFamilyIndex(queueFamilyIndex), dstQueueFamilyIndex(device->queueFamilyIndices.graphics), ring(device, stagingSize)
+	{
+		assert(queue);
+		commandPool = device->createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+		VkSemaphoreTypeCreateInfo semaphoreTypeInfo{};
+		semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		semaphoreTypeInfo.initialValue = 0;
+		VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+		semaphoreInfo.pNext = &semaphoreTypeInfo;
+		VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreInfo, allocationCallbacks(HostAllocationScope::Command), &semaphore));
+	}
+
+	UploadManager::~UploadManager()
+	{
+		wait(submit());
+		ring.waitIdle();
+		vkDestroyCommandPool(device->logicalDevice, commandPool, allocationCallbacks(HostAllocationScope::Command));
+		vkDestroySemaphore(device->logicalDevice, semaphore, allocationCallbacks(HostAllocationScope::Command));
+	}
+
+	VkCommandBuffer UploadManager::getCommandBuffer()
+	{
+		if (commandBuffer != VK_NULL_HANDLE) {
+			return commandBuffer;
+		}
+		// Recycle the command buffers of finished submissions
+		const uint64_t completed = getCompletedValue();
+		while (!inFlight.empty() && inFlight.front().value <= completed) {
+			freeCommandBuffers.push_back(inFlight.front().commandBuffer);
+			inFlight.pop_front();
+		}
+		if (!freeCommandBuffers.empty()) {
+			commandBuffer = freeCommandBuffers.back();
+			freeCommandBuffers.pop_back();
+			VK_CHECK_RESULT(vkResetCommandBuffer(commandBuffer, 0));
+		} else {
+			commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandPool, false);
+		}
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+		return commandBuffer;
+	}
+
+	StagingRegion UploadManager::allocate(VkDeviceSize size)
+	{
+		StagingRegion region = ring.allocate(size, 16);
+		if (!region.valid()) {
+			// The ring is full of data recorded but not submitted yet, kick it off so the space can be recycled
+			submitLocked();
+			region = ring.allocate(size, 16);
+		}
+		assert(region.valid());
+		return region;
+	}
+
+	void UploadManager::submitLocked()
+	{
+		if (commandBuffer == VK_NULL_HANDLE) {
+			return;
+		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		QueueSubmission submission;
+		submission.commandBuffers.push_back(commandBuffer);
+		submission.signalSemaphores.push_back(semaphore);
+		submission.signalValues.push_back(nextValue);
+		device->getQueueSubmitter(queue)->submit(std::move(submission));
+
+		// Staging space of this submission is handed back once its value has been signaled
+		ring.retire(semaphore, nextValue);
+		inFlight.push_back({ nextValue, commandBuffer });
+		if (!pending.bufferBarriers.empty() || !pending.imageBarriers.empty()) {
+			pending.value = nextValue;
+			releases.push_back(std::move(pending));
+			pending = Release();
+		}
+		submittedValue = nextValue++;
+		commandBuffer = VK_NULL_HANDLE;
+	}
+
+	void UploadManager::submitIfPending(UploadTicket ticket)
+	{
+		if (ticket.value > submittedValue) {
+			submitLocked();
+		}
+	}
+
+	UploadTicket UploadManager::currentTicket() const
+	{
+		UploadTicket ticket;
+		ticket.value = commandBuffer != VK_NULL_HANDLE ? nextValue : submittedValue;
+		return ticket;
+	}
+
+	UploadTicket UploadManager::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+		const VkDeviceSize maxChunkSize = ring.getSize() / 2;
+		VkDeviceSize copied = 0;
+		while (copied < size) {
+			VkDeviceSize chunkSize = std::min(size - copied, maxChunkSize);
+			StagingRegion region = allocate(chunkSize);
+			memcpy(region.mapped, src + copied, static_cast<size_t>(chunkSize));
+			VkBufferCopy copyRegion{ region.offset, dstOffset + copied, chunkSize };
+			vkCmdCopyBuffer(getCommandBuffer(), region.buffer, dstBuffer, 1, &copyRegion);
+			copied += chunkSize;
+		}
+
+		if (needsOwnershipTransfer()) {
+			// Release on the transfer queue, the matching acquire is recorded on the graphics queue by acquire()
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = queueFamilyIndex;
+			barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+			barrier.buffer = dstBuffer;
+			barrier.offset = dstOffset;
+			barrier.size = size;
+			vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			pending.bufferBarriers.push_back(barrier);
+		}
+		return currentTicket();
+	}
+
+	UploadTicket UploadManager::uploadImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& subresourceRange, VkImageLayout imageLayout, uint32_t texelBlockHeight)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Only transfer stages and accesses are valid on a transfer queue, so the barriers are set up by hand instead of using Tools::setImageLayout
+		VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+		barrier.image = image;
+		barrier.subresourceRange = subresourceRange;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+		splitImageCopy(size, regions, ring.getSize() / 2, texelBlockHeight, [&](VkDeviceSize srcOffset, VkDeviceSize chunkSize, std::vector<VkBufferImageCopy>& chunkRegions) {
+			StagingRegion region = allocate(chunkSize);
+			memcpy(region.mapped, src + srcOffset, static_cast<size_t>(chunkSize));
+			for (VkBufferImageCopy& copyRegion : chunkRegions) {
+				copyRegion.bufferOffset += region.offset;
+			}
+			vkCmdCopyBufferToImage(getCommandBuffer(), region.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(chunkRegions.size()), chunkRegions.data());
+		});
+
+		// Transition to the final layout, as part of the release if the image changes queue family
+		// Visibility for the graphics queue is provided by its wait on the timeline semaphore
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = imageLayout;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		if (needsOwnershipTransfer()) {
+			barrier.srcQueueFamilyIndex = queueFamilyIndex;
+			barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+		}
+		vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		if (needsOwnershipTransfer()) {
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			pending.imageBarriers.push_back(barrier);
+		}
+		return currentTicket();
+	}
+
+	UploadTicket UploadManager::submit()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		submitLocked();
+		return currentTicket();
+	}
+
+	uint64_t UploadManager::getCompletedValue()
+	{
+		uint64_t value = 0;
+		VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device->logicalDevice, semaphore, &value));
+		return value;
+	}
+
+	bool UploadManager::isComplete(UploadTicket ticket)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			submitIfPending(ticket);
+		}
+		return getCompletedValue() >= ticket.value;
+	}
+
+	void UploadManager::wait(UploadTicket ticket)
+	{
+		if (!ticket.valid()) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			submitIfPending(ticket);
+		}
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &semaphore;
+		waitInfo.pValues = &ticket.value;
+		VK_CHECK_RESULT(vkWaitSemaphores(device->logicalDevice, &waitInfo, UINT64_MAX));
+		// Resources retired on this timeline are released right away instead of with the next frame, e.g. while loading
+		if (device->deletionQueue) {
+			device->deletionQueue->collect();
+		}
+	}
+
+	uint64_t UploadManager::acquire(VkCommandBuffer commandBuffer, UploadTicket required)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		submitIfPending(required);
+
+		// Everything that already finished is acquired along with the required uploads, waiting for it costs nothing
+		const uint64_t target = std::max(getCompletedValue(), required.value);
+		uint64_t waitValue = required.value;
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		while (!releases.empty() && releases.front().value <= target) {
+			const Release& release = releases.front();
+			bufferBarriers.insert(bufferBarriers.end(), release.bufferBarriers.begin(), release.bufferBarriers.end());
+			imageBarriers.insert(imageBarriers.end(), release.imageBarriers.begin(), release.imageBarriers.end());
+			waitValue = std::max(waitValue, release.value);
+			releases.pop_front();
+		}
+		if (!bufferBarriers.empty() || !imageBarriers.empty()) {
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+		}
+		return waitValue;
+	}
+}
@@ -0,0 +1,126 @@
+/*
+* Asynchronous upload manager
+*
+* Accepts buffer and image uploads from any thread and records them onto the transfer queue, staged through a ring
+* of its own. Every submission signals the next value of a timeline semaphore, uploads return a ticket holding that
+* value so callers can poll or wait for it, and rendering only waits for the values it actually needs. If the transfer
+* queue belongs to another family than the graphics queue, ownership of the uploaded resources is released on the
+* transfer queue and acquired on the graphics queue through acquire().
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "VulkanStagingRing.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	/** @brief Timeline semaphore value signaled once an upload has finished on the GPU */
+	struct UploadTicket
+	{
+		uint64_t value = 0;
+		bool valid() const { return value > 0; }
+	};
+
+	class UploadManager
+	{
+	public:
+		/**
+		* Create the manager for a transfer queue
+		*
+		* @param device Device the uploads are made on
+		* @param queue Queue the uploads are submitted to, must not be used by anyone else
+		* @param queueFamilyIndex Family of the transfer queue
+		* @param stagingSize Size of the manager's staging ring
+		*/
+		UploadManager(VulkanDevice* device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize stagingSize);
+		~UploadManager();
+		UploadManager(const UploadManager&) = delete;
+		UploadManager& operator=(const UploadManager&) = delete;
+
+		UploadTicket uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+		/**
+		* Upload the initial contents of an image and transition it from undefined to the layout it is used in
+		*
+		* @param data Source data, region buffer offsets are relative to this pointer
+		* @param size Size of the source data
+		* @param image Destination image, created with VK_IMAGE_USAGE_TRANSFER_DST_BIT
+		* @param regions Copy regions
+		* @param subresourceRange Subresources of the image the regions cover
+		* @param imageLayout Layout of the image after the upload
+		* @param (Optional) texelBlockHeight Height of a texel block for compressed formats, used when splitting regions by rows
+		*/
+		UploadTicket uploadImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& subresourceRange, VkImageLayout imageLayout, uint32_t texelBlockHeight = 1);
+
+		/**
+		* Submit everything recorded so far
+		* @note Uploads are also submitted when the staging ring runs full, or when a ticket of them is polled, waited for or acquired
+		* @return Ticket covering all uploads made before the call
+		*/
+		UploadTicket submit();
+		/** @brief Check if an upload has finished without blocking */
+		bool isComplete(UploadTicket ticket);
+		/** @brief Block until an upload has finished */
+		void wait(UploadTicket ticket);
+
+		/**
+		* Record the ownership acquire barriers for uploads into a graphics command buffer
+		*
+		* @param commandBuffer Command buffer submitted to the graphics queue before the uploaded resources are used
+		* @param (Optional) required Upload that has to be usable by the command buffer, all uploads that already finished are acquired as well
+		*
+		* @return Value of the timeline semaphore the command buffer's submission has to wait for at VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0 if none
+		*/
+		uint64_t acquire(VkCommandBuffer commandBuffer, UploadTicket required = UploadTicket());
+
+		VkSemaphore getSemaphore() const { return semaphore; }
+		uint64_t getCompletedValue();
+		/** @brief True if resources change queue family, uploaded resources may then only be used after acquire() */
+		bool needsOwnershipTransfer() const { return queueFamilyIndex != dstQueueFamilyIndex; }
+
+	private:
+		/** @brief Acquire barriers matching the release barriers of one submission */
+		struct Release
+		{
+			uint64_t value = 0;
+			std::vector<VkBufferMemoryBarrier> bufferBarriers;
+			std::vector<VkImageMemoryBarrier> imageBarriers;
+		};
+		struct InFlight
+		{
+			uint64_t value;
+			VkCommandBuffer commandBuffer;
+		};
+
+		VulkanDevice* device;
+		VkQueue queue;
+		uint32_t queueFamilyIndex;
+		uint32_t dstQueueFamilyIndex;
+		StagingRing ring;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		std::mutex mutex;
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		/** @brief Value the submission currently being recorded will signal */
+		uint64_t nextValue = 1;
+		uint64_t submittedValue = 0;
+		Release pending;
+		std::deque<Release> releases;
+		std::deque<InFlight> inFlight;
+		std::vector<VkCommandBuffer> freeCommandBuffers;
+
+		VkCommandBuffer getCommandBuffer();
+		StagingRegion allocate(VkDeviceSize size);
+		void submitLocked();
+		void submitIfPending(UploadTicket ticket);
+		UploadTicket currentTicket() const;
+	};
+}
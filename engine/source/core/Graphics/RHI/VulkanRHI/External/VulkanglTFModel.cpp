@@ -12,11 +12,16 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "VulkanBarrierBatcher.h"
 
 #include "VulkanInitializers.hpp"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
+VkDescriptorSetLayout vkglTF::descriptorSetLayoutUboDynamic = VK_NULL_HANDLE;
 VkMemoryPropertyFlags vkglTF::memoryPropertyFlags = 0;
 uint32_t vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor;
 
@@ -55,16 +60,244 @@ void vkglTF::Texture::updateDescriptor()
 
 void vkglTF::Texture::destroy()
 {
-	if (device)
+	if (device && device->deletionQueue)
 	{
-		vkDestroyImageView(device->logicalDevice, view, nullptr);
-		vkDestroyImage(device->logicalDevice, image, nullptr);
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
-		vkDestroySampler(device->logicalDevice, sampler, nullptr);
+		// Frames still in flight may sample the texture
+		vks::RetiredResources retired;
+		retired.imageViews.push_back(view);
+		retired.images.push_back(image);
+		if (allocation.valid())
+		{
+			retired.allocations.push_back(allocation);
+		}
+		retired.samplers.push_back(sampler);
+		device->deletionQueue->retire(std::move(retired));
+		allocation = vks::Allocation{};
+	}
+	else if (device)
+	{
+		vkDestroyImageView(device->logicalDevice, view, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
+		vkDestroyImage(device->logicalDevice, image, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
+		allocation.free();
+		vkDestroySampler(device->logicalDevice, sampler, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor));
+	}
+}
+
+VkDeviceSize vkglTF::Texture::getResidentSize() const
+{
+	return allocation.valid() ? allocation.size : 0;
+}
+
+uint32_t vkglTF::Texture::getMemoryHeapIndex() const
+{
+	return device->memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex;
+}
+
+// Offset of a mip level in the tightly packed host copy of the mip chain
+VkDeviceSize vkglTF::Texture::mipOffset(uint32_t level) const
+{
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; i < level; i++) {
+		offset += static_cast<VkDeviceSize>(std::max(1u, width >> i)) * std::max(1u, height >> i) * 4;
+	}
+	return offset;
+}
+
+void vkglTF::Texture::readBackup(VkQueue queue)
+{
+	if (!backup.empty()) {
+		return;
+	}
+	assert(baseMipLevel == 0);
+	const VkDeviceSize size = mipOffset(mipLevels);
+
+	VkBuffer readbackBuffer;
+	vks::Allocation readbackAllocation;
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, &readbackBuffer, &readbackAllocation));
+
+	std::vector<VkBufferImageCopy> regions(mipLevels);
+	for (uint32_t i = 0; i < mipLevels; i++) {
+		regions[i] = {};
+		regions[i].bufferOffset = mipOffset(i);
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageExtent = { std::max(1u, width >> i), std::max(1u, height >> i), 1 };
+	}
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.levelCount = mipLevels;
+	subresourceRange.layerCount = 1;
+
+	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	vks::BarrierBatcher barriers(device);
+	barriers.imageBarrier(image, subresourceRange, imageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	barriers.flush(copyCmd);
+	vkCmdCopyImageToBuffer(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+	barriers.imageBarrier(image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageLayout);
+	barriers.flush(copyCmd);
+	device->flushCommandBuffer(copyCmd, queue);
+
+	const unsigned char* mapped = static_cast<const unsigned char*>(readbackAllocation.mapped);
+	backup.assign(mapped, mapped + size);
+	vkDestroyBuffer(device->logicalDevice, readbackBuffer, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
+	readbackAllocation.free();
+}
+
+void vkglTF::Texture::releaseImage()
+{
+	// Frames still in flight may sample the image through the material descriptor sets written for it
+	if (device->deletionQueue) {
+		vks::RetiredResources retired;
+		retired.imageViews.push_back(view);
+		retired.images.push_back(image);
+		retired.allocations.push_back(allocation);
+		device->deletionQueue->retire(std::move(retired));
+	} else {
+		vkDestroyImageView(device->logicalDevice, view, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
+		vkDestroyImage(device->logicalDevice, image, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
+		allocation.free();
+	}
+	allocation = vks::Allocation{};
+	view = VK_NULL_HANDLE;
+	image = VK_NULL_HANDLE;
+	updateDescriptor();
+	descriptorVersion++;
+}
+
+// Create an empty image (and its memory) for the mip levels of the full chain starting at the given level
+void vkglTF::Texture::allocateImage(uint32_t baseMip)
+{
+	baseMipLevel = baseMip;
+	VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = format;
+	imageCreateInfo.mipLevels = mipLevels - baseMip;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.extent = { std::max(1u, width >> baseMip), std::max(1u, height >> baseMip), 1 };
+	// Transfer destination is always needed to relocate the image, host transfer is added if the device can write it without a command buffer
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | device->getImageUploadUsage(format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &image));
+	VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation, vks::MemoryCategory::Texture));
+}
+
+// Create the view for the current image, the model writes new descriptor sets for it before they are bound again
+void vkglTF::Texture::createView()
+{
+	VkImageViewCreateInfo viewInfo = vks::initializers::imageViewCreateInfo();
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = mipLevels - baseMipLevel;
+	viewInfo.subresourceRange.layerCount = 1;
+	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &view));
+	updateDescriptor();
+	descriptorVersion++;
+}
+
+// Recreate the image from the host copy, starting at the given mip level of the full chain
+void vkglTF::Texture::createImage(uint32_t baseMip, vks::UploadBatch& batch)
+{
+	allocateImage(baseMip);
+	const uint32_t levels = mipLevels - baseMip;
+
+	std::vector<VkBufferImageCopy> regions(levels);
+	for (uint32_t i = 0; i < levels; i++) {
+		regions[i] = {};
+		regions[i].bufferOffset = mipOffset(baseMip + i);
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageExtent = { std::max(1u, width >> (baseMip + i)), std::max(1u, height >> (baseMip + i)), 1 };
+	}
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.levelCount = levels;
+	subresourceRange.layerCount = 1;
+
+	batch.uploadImage(backup.data(), backup.size(), image, device->getImageUploadUsage(format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), regions, subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	createView();
+}
+
+VkDeviceSize vkglTF::Texture::trim(VkQueue queue, vks::UploadBatch& batch)
+{
+	// Dropping the two largest levels releases roughly 15/16 of the memory
+	const uint32_t trimmedBaseMip = std::min(2u, mipLevels - 1);
+	if (trimmedBaseMip == 0 || baseMipLevel != 0) {
+		return 0;
+	}
+	readBackup(queue);
+	const VkDeviceSize residentSize = getResidentSize();
+	releaseImage();
+	createImage(trimmedBaseMip, batch);
+	return residentSize - std::min(residentSize, getResidentSize());
+}
+
+VkDeviceSize vkglTF::Texture::evict(VkQueue queue)
+{
+	readBackup(queue);
+	const VkDeviceSize residentSize = getResidentSize();
+	releaseImage();
+	return residentSize;
+}
+
+void vkglTF::Texture::restore(vks::UploadBatch& batch)
+{
+	if (image != VK_NULL_HANDLE) {
+		releaseImage();
+	}
+	createImage(0, batch);
+}
+
+bool vkglTF::Texture::needsRelocation() const
+{
+	return image != VK_NULL_HANDLE && device->memoryAllocator->isCompacting(allocation);
+}
+
+void vkglTF::Texture::relocate(VkCommandBuffer commandBuffer, vks::RetiredResources& retired)
+{
+	VkImage oldImage = image;
+	retired.images.push_back(image);
+	retired.imageViews.push_back(view);
+	retired.allocations.push_back(allocation);
+	allocateImage(baseMipLevel);
+
+	const uint32_t levels = mipLevels - baseMipLevel;
+	std::vector<VkImageCopy> regions(levels);
+	for (uint32_t i = 0; i < levels; i++) {
+		regions[i] = {};
+		regions[i].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+		regions[i].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+		regions[i].extent = { std::max(1u, width >> (baseMipLevel + i)), std::max(1u, height >> (baseMipLevel + i)), 1 };
 	}
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.levelCount = levels;
+	subresourceRange.layerCount = 1;
+
+	// Both images are prepared for the copy with one barrier command
+	vks::BarrierBatcher barriers(device);
+	barriers.imageBarrier(oldImage, subresourceRange, imageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	barriers.imageBarrier(image, subresourceRange, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	barriers.flush(commandBuffer);
+	vkCmdCopyImage(commandBuffer, oldImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	barriers.imageBarrier(image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	barriers.flush(commandBuffer);
+	imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	createView();
 }
 
-void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device, VkQueue copyQueue)
+void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device, vks::UploadBatch &batch)
 {
 	this->device = device;
 
@@ -76,8 +309,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		}
 	}
 
-	VkFormat format;
-
 	if (!isKtx) {
 		// Texture was loaded using STB_Image
 
@@ -117,30 +348,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
 		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
 
-		VkMemoryAllocateInfo memAllocInfo{};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		VkMemoryRequirements memReqs{};
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.size = bufferSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, buffer, bufferSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		VkImageCreateInfo imageCreateInfo{};
 		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -154,128 +361,16 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width, height, 1 };
 		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
-
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &image));
+		VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation, vks::MemoryCategory::Texture));
 
-		VkImageSubresourceRange subresourceRange = {};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.levelCount = 1;
-		subresourceRange.layerCount = 1;
-
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = 0;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-		}
-
-		VkBufferImageCopy bufferCopyRegion = {};
-		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		bufferCopyRegion.imageSubresource.mipLevel = 0;
-		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-		bufferCopyRegion.imageSubresource.layerCount = 1;
-		bufferCopyRegion.imageExtent.width = width;
-		bufferCopyRegion.imageExtent.height = height;
-		bufferCopyRegion.imageExtent.depth = 1;
-
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-		}
-
-		device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-
-		// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-		VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		for (uint32_t i = 1; i < mipLevels; i++) {
-			VkImageBlit imageBlit{};
-
-			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.srcSubresource.layerCount = 1;
-			imageBlit.srcSubresource.mipLevel = i - 1;
-			imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-			imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
-			imageBlit.srcOffsets[1].z = 1;
-
-			imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.dstSubresource.layerCount = 1;
-			imageBlit.dstSubresource.mipLevel = i;
-			imageBlit.dstOffsets[1].x = int32_t(width >> i);
-			imageBlit.dstOffsets[1].y = int32_t(height >> i);
-			imageBlit.dstOffsets[1].z = 1;
-
-			VkImageSubresourceRange mipSubRange = {};
-			mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			mipSubRange.baseMipLevel = i;
-			mipSubRange.levelCount = 1;
-			mipSubRange.layerCount = 1;
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-
-			vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-		}
-
-		subresourceRange.levelCount = mipLevels;
+		// Copy and mip generation (glTF uses jpg and png, so the chain is created manually) are recorded with those of the model's other images
+		batch.uploadImageWithMips(buffer, bufferSize, image, width, height, mipLevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 		imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		// The data has been copied to the staging ring, so the converted RGBA copy is no longer needed
+		if (deleteBuffer) {
+			delete[] buffer;
 		}
-
-		device->flushCommandBuffer(blitCmd, copyQueue, true);
 	}
 	else {
 		// Texture is stored in an external ktx file
@@ -318,30 +413,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		VkFormatProperties formatProperties;
 		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
 
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 		for (uint32_t i = 0; i < mipLevels; i++)
 		{
@@ -371,14 +442,11 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width, height, 1 };
-		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+		// Transfer source is required to read the image back when it is evicted, mips are complete so the host can write them directly if supported
+		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | device->getImageUploadUsage(format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &image));
 
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation, vks::MemoryCategory::Texture));
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -386,15 +454,9 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 1;
 
-		EngineBase::Tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-		EngineBase::Tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-		device->flushCommandBuffer(copyCmd, copyQueue);
+		batch.uploadImage(ktxTextureData, ktxTextureSize, image, imageCreateInfo.usage, bufferCopyRegions, subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 		this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-
 		ktxTexture_Destroy(ktxTexture);
 	}
 
@@ -413,7 +475,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 	samplerInfo.maxLod = (float)mipLevels;
 	samplerInfo.maxAnisotropy = 8.0f;
 	samplerInfo.anisotropyEnable = VK_TRUE;
-	VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &sampler));
+	VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor), &sampler));
 
 	VkImageViewCreateInfo viewInfo{};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -424,7 +486,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	viewInfo.subresourceRange.layerCount = 1;
 	viewInfo.subresourceRange.levelCount = mipLevels;
-	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &view));
+	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &view));
 
 	descriptor.sampler = sampler;
 	descriptor.imageView = view;
@@ -434,8 +496,11 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 /*
 	glTF material
 */
-void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags)
+void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags, const vkglTF::Texture* fallbackTexture)
 {
+	auto imageDescriptor = [fallbackTexture](const vkglTF::Texture* texture) {
+		return (texture->view == VK_NULL_HANDLE && fallbackTexture) ? &fallbackTexture->descriptor : &texture->descriptor;
+	};
 	VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
 	descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	descriptorSetAllocInfo.descriptorPool = descriptorPool;
@@ -452,7 +517,7 @@ void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDe
 		writeDescriptorSet.descriptorCount = 1;
 		writeDescriptorSet.dstSet = descriptorSet;
 		writeDescriptorSet.dstBinding = static_cast<uint32_t>(writeDescriptorSets.size());
-		writeDescriptorSet.pImageInfo = &baseColorTexture->descriptor;
+		writeDescriptorSet.pImageInfo = imageDescriptor(baseColorTexture);
 		writeDescriptorSets.push_back(writeDescriptorSet);
 	}
 	if (normalTexture && descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
@@ -463,7 +528,7 @@ void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDe
 		writeDescriptorSet.descriptorCount = 1;
 		writeDescriptorSet.dstSet = descriptorSet;
 		writeDescriptorSet.dstBinding = static_cast<uint32_t>(writeDescriptorSets.size());
-		writeDescriptorSet.pImageInfo = &normalTexture->descriptor;
+		writeDescriptorSet.pImageInfo = imageDescriptor(normalTexture);
 		writeDescriptorSets.push_back(writeDescriptorSet);
 	}
 	vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
@@ -484,29 +549,62 @@ void vkglTF::Primitive::setDimensions(glm::vec3 min, glm::vec3 max) {
 /*
 	glTF mesh
 */
-vkglTF::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
+vkglTF::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix, bool createUniformBuffer) {
 	this->device = device;
 	this->uniformBlock.matrix = matrix;
+	if (!createUniformBuffer) {
+		// Uniforms are sourced from a per-frame ring buffer
+		return;
+	}
+	// Each frame in flight gets its own copy of the uniform block, so the CPU never overwrites one the GPU may still read
+	const uint32_t framesInFlight = device->framesInFlight;
+	assert(framesInFlight > 0 && framesInFlight <= 32);
+	const VkDeviceSize alignment = std::max<VkDeviceSize>(device->properties.limits.minUniformBufferOffsetAlignment, 1);
+	uniformBuffer.stride = (sizeof(uniformBlock) + alignment - 1) / alignment * alignment;
 	VK_CHECK_RESULT(device->createBuffer(
 		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		sizeof(uniformBlock),
+		uniformBuffer.stride * framesInFlight,
 		&uniformBuffer.buffer,
-		&uniformBuffer.memory,
-		&uniformBlock));
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
+		&uniformBuffer.allocation));
+	// Uniform buffers live in persistently mapped host visible memory
+	uniformBuffer.mapped = uniformBuffer.allocation.mapped;
 	uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
+	for (uint32_t i = 0; i < framesInFlight; i++) {
+		memcpy(static_cast<uint8_t*>(uniformBuffer.mapped) + i * uniformBuffer.stride, &uniformBlock, sizeof(uniformBlock));
+	}
 };
 
 vkglTF::Mesh::~Mesh() {
-	vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
+	if (uniformBuffer.buffer != VK_NULL_HANDLE && device->deletionQueue) {
+		vks::RetiredResources retired;
+		retired.buffers.push_back(uniformBuffer.buffer);
+		retired.allocations.push_back(uniformBuffer.allocation);
+		device->deletionQueue->retire(std::move(retired));
+	} else if (uniformBuffer.buffer != VK_NULL_HANDLE) {
+		vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
+		uniformBuffer.allocation.free();
+	}
     for(auto primitive : primitives)
     {
         delete primitive;
     }
 }
 
+void vkglTF::Mesh::writeUniforms(uint32_t frameIndex) {
+	const uint32_t frameBit = 1u << frameIndex;
+	if (!uniformBuffer.mapped || !(uniformBuffer.staleFrames & frameBit)) {
+		return;
+	}
+	uint8_t* dst = static_cast<uint8_t*>(uniformBuffer.mapped) + frameIndex * uniformBuffer.stride;
+	if (uniformBlock.jointcount > 0.0f) {
+		memcpy(dst, &uniformBlock, sizeof(uniformBlock));
+	} else {
+		memcpy(dst, &uniformBlock.matrix, sizeof(glm::mat4));
+	}
+	uniformBuffer.staleFrames &= ~frameBit;
+}
+
 /*
 	glTF node
 */
@@ -527,8 +625,8 @@ glm::mat4 vkglTF::Node::getMatrix() {
 void vkglTF::Node::update() {
 	if (mesh) {
 		glm::mat4 m = getMatrix();
+		mesh->uniformBlock.matrix = m;
 		if (skin) {
-			mesh->uniformBlock.matrix = m;
 			// Update join matrices
 			glm::mat4 inverseTransform = glm::inverse(m);
 			for (size_t i = 0; i < skin->joints.size(); i++) {
@@ -538,10 +636,10 @@ void vkglTF::Node::update() {
 				mesh->uniformBlock.jointMatrix[i] = jointMat;
 			}
 			mesh->uniformBlock.jointcount = (float)skin->joints.size();
-			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-		} else {
-			memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
 		}
+		// Frames still in flight keep their copy, every frame's copy is brought up to date when it is recorded next
+		const uint32_t framesInFlight = mesh->device->framesInFlight;
+		mesh->uniformBuffer.staleFrames = (framesInFlight == 32) ? ~0u : (1u << framesInFlight) - 1;
 	}
 
 	for (auto& child : children) {
@@ -591,8 +689,9 @@ VkVertexInputAttributeDescription vkglTF::Vertex::inputAttributeDescription(uint
 	}
 }
 
-std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components) {
+std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent>& components) {
 	std::vector<VkVertexInputAttributeDescription> result;
+	result.reserve(components.size());
 	uint32_t location = 0;
 	for (VertexComponent component : components) {
 		result.push_back(Vertex::inputAttributeDescription(binding, location, component));
@@ -602,9 +701,15 @@ std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::inputAttributeDes
 }
 
 /** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
-VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputState(const std::vector<VertexComponent> components) {
+VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputState(const std::vector<VertexComponent>& components) {
 	vertexInputBindingDescription = Vertex::inputBindingDescription(0);
-	Vertex::vertexInputAttributeDescriptions = Vertex::inputAttributeDescriptions(0, components);
+	// Filled in place, so the storage is only allocated the first time and reused for every pipeline after that
+	Vertex::vertexInputAttributeDescriptions.clear();
+	uint32_t location = 0;
+	for (VertexComponent component : components) {
+		Vertex::vertexInputAttributeDescriptions.push_back(Vertex::inputAttributeDescription(0, location, component));
+		location++;
+	}
 	pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
 	pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &Vertex::vertexInputBindingDescription;
@@ -622,7 +727,7 @@ vkglTF::Texture* vkglTF::Model::getTexture(uint32_t index)
 	return nullptr;
 }
 
-void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
+void vkglTF::Model::createEmptyTexture(vks::UploadBatch &batch)
 {
 	emptyTexture.device = device;
 	emptyTexture.width = 1;
@@ -634,36 +739,6 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	unsigned char* buffer = new unsigned char[bufferSize];
 	memset(buffer, 0, bufferSize);
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingMemory;
-	VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-	bufferCreateInfo.size = bufferSize;
-	// This buffer is used as a transfer source for the buffer copy
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
-	vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-	VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-	// Copy texture data into staging buffer
-	uint8_t* data;
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-	memcpy(data, buffer, bufferSize);
-	vkUnmapMemory(device->logicalDevice, stagingMemory);
-
-	VkBufferImageCopy bufferCopyRegion = {};
-	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	bufferCopyRegion.imageSubresource.layerCount = 1;
-	bufferCopyRegion.imageExtent.width = emptyTexture.width;
-	bufferCopyRegion.imageExtent.height = emptyTexture.height;
-	bufferCopyRegion.imageExtent.depth = 1;
-
 	// Create optimal tiled target image
 	VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
 	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -676,30 +751,14 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageCreateInfo.extent = { emptyTexture.width, emptyTexture.height, 1 };
 	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &emptyTexture.image));
-
-	vkGetImageMemoryRequirements(device->logicalDevice, emptyTexture.image, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &emptyTexture.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, emptyTexture.image, emptyTexture.deviceMemory, 0));
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &emptyTexture.image));
 
-	VkImageSubresourceRange subresourceRange{};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = 1;
-	subresourceRange.layerCount = 1;
+	VK_CHECK_RESULT(device->memoryAllocator->allocateImageMemory(emptyTexture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &emptyTexture.allocation, vks::MemoryCategory::Texture));
 
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	EngineBase::Tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-	EngineBase::Tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-	device->flushCommandBuffer(copyCmd, transferQueue);
+	// Recorded with the other images of the model
+	batch.uploadImageWithMips(buffer, bufferSize, emptyTexture.image, emptyTexture.width, emptyTexture.height, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	emptyTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-	// Clean up staging resources
-	vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+	delete[] buffer;
 
 	VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
 	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
@@ -710,7 +769,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
 	samplerCreateInfo.maxAnisotropy = 1.0f;
-	VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &emptyTexture.sampler));
+	VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor), &emptyTexture.sampler));
 
 	VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
 	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -719,7 +778,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 	viewCreateInfo.subresourceRange.levelCount = 1;
 	viewCreateInfo.image = emptyTexture.image;
-	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &emptyTexture.view));
+	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &emptyTexture.view));
 
 	emptyTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	emptyTexture.descriptor.imageView = emptyTexture.view;
@@ -731,10 +790,45 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 */
 vkglTF::Model::~Model()
 {
-	vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
+	// The prewarm threads read the model's permutations and write its pipelines
+	waitForPipelines();
+	if (residencyManager) {
+		residencyManager->unregisterResource(this);
+		for (auto& texture : textures) {
+			residencyManager->unregisterResource(&texture);
+		}
+	}
+	if (defragmenter) {
+		defragmenter->unregisterResource(this);
+		for (auto& texture : textures) {
+			defragmenter->unregisterResource(&texture);
+		}
+	}
+	// Frames still in flight may draw the model, so with a deletion queue its objects are released once the GPU has finished them
+	vks::RetiredResources retired;
+	std::vector<VkCommandBuffer> commandBuffers;
+	for (auto& frameCommandBuffers : secondaryCommandBuffers) {
+		commandBuffers.insert(commandBuffers.end(), frameCommandBuffers.begin(), frameCommandBuffers.end());
+	}
+	for (auto& cachedDraw : cachedDraws) {
+		commandBuffers.insert(commandBuffers.end(), cachedDraw.commandBuffers.begin(), cachedDraw.commandBuffers.end());
+	}
+	if (!commandBuffers.empty()) {
+		vks::CommandBufferPools* commandBufferPools = device->commandBufferPools;
+		retired.callbacks.push_back([commandBufferPools, commandBuffers]() {
+			for (VkCommandBuffer commandBuffer : commandBuffers) {
+				commandBufferPools->release(commandBuffer);
+			}
+		});
+	}
+	if (geometryRange.valid()) {
+		geometryPool->retire(geometryRange);
+	} else {
+		retired.buffers.push_back(vertices.buffer);
+		retired.allocations.push_back(vertices.allocation);
+		retired.buffers.push_back(indices.buffer);
+		retired.allocations.push_back(indices.allocation);
+	}
 	for (auto texture : textures) {
 		texture.destroy();
 	}
@@ -745,14 +839,26 @@ vkglTF::Model::~Model()
         delete skin;
     }
 	if (descriptorSetLayoutUbo != VK_NULL_HANDLE) {
-		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutUbo, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutUbo, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor));
 		descriptorSetLayoutUbo = VK_NULL_HANDLE;
 	}
+	if (descriptorSetLayoutUboDynamic != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutUboDynamic, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor));
+		descriptorSetLayoutUboDynamic = VK_NULL_HANDLE;
+	}
 	if (descriptorSetLayoutImage != VK_NULL_HANDLE) {
-		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutImage, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutImage, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor));
 		descriptorSetLayoutImage = VK_NULL_HANDLE;
 	}
-	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+	retired.descriptorPools.push_back(descriptorPool);
+	if (materialDescriptorPool != VK_NULL_HANDLE) {
+		retired.descriptorPools.push_back(materialDescriptorPool);
+	}
+	if (device->deletionQueue) {
+		device->deletionQueue->retire(std::move(retired));
+	} else {
+		retired.release(device->logicalDevice);
+	}
 	emptyTexture.destroy();
 }
 
@@ -798,7 +904,7 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 	// Node contains mesh data
 	if (node.mesh > -1) {
 		const tinygltf::Mesh mesh = model.meshes[node.mesh];
-		Mesh *newMesh = new Mesh(device, newNode->matrix);
+		Mesh *newMesh = new Mesh(device, newNode->matrix, !dynamicNodeUniforms);
 		newMesh->name = mesh.name;
 		for (size_t j = 0; j < mesh.primitives.size(); j++) {
 			const tinygltf::Primitive &primitive = mesh.primitives[j];
@@ -812,6 +918,7 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 			glm::vec3 posMin{};
 			glm::vec3 posMax{};
 			bool hasSkin = false;
+			uint32_t vertexComponents = 0;
 			// Vertices
 			{
 				const float *bufferPos = nullptr;
@@ -876,6 +983,13 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 
 				hasSkin = (bufferJoints && bufferWeights);
 
+				vertexComponents = 1u << static_cast<uint32_t>(VertexComponent::Position);
+				vertexComponents |= bufferNormals ? 1u << static_cast<uint32_t>(VertexComponent::Normal) : 0;
+				vertexComponents |= bufferTexCoords ? 1u << static_cast<uint32_t>(VertexComponent::UV) : 0;
+				vertexComponents |= bufferColors ? 1u << static_cast<uint32_t>(VertexComponent::Color) : 0;
+				vertexComponents |= bufferTangents ? 1u << static_cast<uint32_t>(VertexComponent::Tangent) : 0;
+				vertexComponents |= hasSkin ? (1u << static_cast<uint32_t>(VertexComponent::Joint0)) | (1u << static_cast<uint32_t>(VertexComponent::Weight0)) : 0;
+
 				vertexCount = static_cast<uint32_t>(posAccessor.count);
 
 				for (size_t v = 0; v < posAccessor.count; v++) {
@@ -902,6 +1016,8 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 			}
 			// Indices
 			{
+				// Staging copies of the accessor data only live until the indices have been appended
+				vks::ArenaScope arenaScope;
 				const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
 				const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
 				const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
@@ -910,30 +1026,27 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 
 				switch (accessor.componentType) {
 				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-					uint32_t *buf = new uint32_t[accessor.count];
+					uint32_t *buf = arenaScope.arena.allocate<uint32_t>(accessor.count);
 					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
 					for (size_t index = 0; index < accessor.count; index++) {
 						indexBuffer.push_back(buf[index] + vertexStart);
 					}
-                    delete[] buf;
 					break;
 				}
 				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-					uint16_t *buf = new uint16_t[accessor.count];
+					uint16_t *buf = arenaScope.arena.allocate<uint16_t>(accessor.count);
 					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
 					for (size_t index = 0; index < accessor.count; index++) {
 						indexBuffer.push_back(buf[index] + vertexStart);
 					}
-                    delete[] buf;
                     break;
 				}
 				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-					uint8_t *buf = new uint8_t[accessor.count];
+					uint8_t *buf = arenaScope.arena.allocate<uint8_t>(accessor.count);
 					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
 					for (size_t index = 0; index < accessor.count; index++) {
 						indexBuffer.push_back(buf[index] + vertexStart);
 					}
-                    delete[] buf;
                     break;
 				}
 				default:
@@ -944,6 +1057,7 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 			Primitive *newPrimitive = new Primitive(indexStart, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
 			newPrimitive->firstVertex = vertexStart;
 			newPrimitive->vertexCount = vertexCount;
+			newPrimitive->vertexComponents = vertexComponents;
 			newPrimitive->setDimensions(posMin, posMax);
 			newMesh->primitives.push_back(newPrimitive);
 		}
@@ -989,15 +1103,15 @@ void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
 	}
 }
 
-void vkglTF::Model::loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue)
+void vkglTF::Model::loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, vks::UploadBatch &batch)
 {
 	for (tinygltf::Image &image : gltfModel.images) {
 		vkglTF::Texture texture;
-		texture.fromglTfImage(image, path, device, transferQueue);
+		texture.fromglTfImage(image, path, device, batch);
 		textures.push_back(texture);
 	}
 	// Create an empty texture to be used for empty material images
-	createEmptyTexture(transferQueue);
+	createEmptyTexture(batch);
 }
 
 void vkglTF::Model::loadMaterials(tinygltf::Model &gltfModel)
@@ -1043,6 +1157,7 @@ void vkglTF::Model::loadMaterials(tinygltf::Model &gltfModel)
 		if (mat.additionalValues.find("alphaCutoff") != mat.additionalValues.end()) {
 			material.alphaCutoff = static_cast<float>(mat.additionalValues["alphaCutoff"].Factor());
 		}
+		material.doubleSided = mat.doubleSided;
 
 		materials.push_back(material);
 	}
@@ -1075,18 +1190,19 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 
 			// Read sampler input time values
 			{
+				vks::ArenaScope arenaScope;
 				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
 				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
 				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
-				float *buf = new float[accessor.count];
+				float *buf = arenaScope.arena.allocate<float>(accessor.count);
 				memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
+				sampler.inputs.reserve(accessor.count);
 				for (size_t index = 0; index < accessor.count; index++) {
 					sampler.inputs.push_back(buf[index]);
 				}
-                delete[] buf;
 				for (auto input : sampler.inputs) {
 					if (input < animation.start) {
 						animation.start = input;
@@ -1099,29 +1215,29 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 
 			// Read sampler output T/R/S values 
 			{
+				vks::ArenaScope arenaScope;
 				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.output];
 				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
 				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
+				sampler.outputsVec4.reserve(accessor.count);
 				switch (accessor.type) {
 				case TINYGLTF_TYPE_VEC3: {
-					glm::vec3 *buf = new glm::vec3[accessor.count];
+					glm::vec3 *buf = arenaScope.arena.allocate<glm::vec3>(accessor.count);
 					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec3));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
 					}
-                    delete[] buf;
                     break;
 				}
 				case TINYGLTF_TYPE_VEC4: {
-					glm::vec4 *buf = new glm::vec4[accessor.count];
+					glm::vec4 *buf = arenaScope.arena.allocate<glm::vec4>(accessor.count);
 					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec4));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(buf[index]);
 					}
-                    delete[] buf;
                     break;
 				}
 				default: {
@@ -1166,6 +1282,7 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 
 void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
 {
+	const auto loadStart = std::chrono::high_resolution_clock::now();
 	tinygltf::Model gltfModel;
 	tinygltf::TinyGLTF gltfContext;
 	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
@@ -1184,6 +1301,7 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	std::string error, warning;
 
 	this->device = device;
+	dynamicNodeUniforms = (fileLoadingFlags & FileLoadingFlags::DynamicNodeUniforms) != 0;
 
 #if defined(__ANDROID__)
 	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
@@ -1195,9 +1313,12 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	std::vector<uint32_t> indexBuffer;
 	std::vector<Vertex> vertexBuffer;
 
+	// All copies, layout transitions and mip generation of the model are recorded into one batch that is submitted once at the end
+	vks::UploadBatch batch(device, transferQueue);
+
 	if (fileLoaded) {
 		if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
-			loadImages(gltfModel, device, transferQueue);
+			loadImages(gltfModel, device, batch);
 		}
 		loadMaterials(gltfModel);
 		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
@@ -1218,6 +1339,9 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 			// Initial pose
 			if (node->mesh) {
 				node->update();
+				for (uint32_t i = 0; i < device->framesInFlight; i++) {
+					node->mesh->writeUniforms(i);
+				}
 			}
 		}
 	}
@@ -1227,6 +1351,46 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		return;
 	}
 
+	// Descriptor set layouts are global, so only create them if they haven't been created before. Pipeline layouts are built from
+	// them, so they have to exist before the prewarm threads start
+	if (dynamicNodeUniforms) {
+		if (descriptorSetLayoutUboDynamic == VK_NULL_HANDLE) {
+			VkDescriptorSetLayoutBinding setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0);
+			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorLayoutCI.bindingCount = 1;
+			descriptorLayoutCI.pBindings = &setLayoutBinding;
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor), &descriptorSetLayoutUboDynamic));
+		}
+	}
+	else if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+		descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+		descriptorLayoutCI.pBindings = setLayoutBindings.data();
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor), &descriptorSetLayoutUbo));
+	}
+	if (descriptorSetLayoutImage == VK_NULL_HANDLE) {
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+		if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
+			setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
+		}
+		if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
+			setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
+		}
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+		descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+		descriptorLayoutCI.pBindings = setLayoutBindings.data();
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor), &descriptorSetLayoutImage));
+	}
+
+	// Materials and vertex attributes are known, pipelines are built while the rest of the model is uploaded
+	startPipelinePrewarm();
+
 	// Pre-Calculations for requested features
 	if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
 		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
@@ -1272,184 +1436,698 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 
 	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
 
-	struct StagingBuffer {
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} vertexStaging, indexStaging;
-
-	// Create staging buffers
-	// Vertex data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize,
-		&vertexStaging.buffer,
-		&vertexStaging.memory,
-		vertexBuffer.data()));
-	// Index data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize,
-		&indexStaging.buffer,
-		&indexStaging.memory,
-		indexBuffer.data()));
-
-	// Create device local buffers
-	// Vertex buffer
-	VK_CHECK_RESULT(device->createBuffer(
-	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		vertexBufferSize,
-		&vertices.buffer,
-		&vertices.memory));
-	// Index buffer
-	VK_CHECK_RESULT(device->createBuffer(
-	    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		indexBufferSize,
-		&indices.buffer,
-		&indices.memory));
-
-	// Copy from staging buffers
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-	VkBufferCopy copyRegion = {};
-
-	copyRegion.size = vertexBufferSize;
-	vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-	copyRegion.size = indexBufferSize;
-	vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+	if (geometryPool && geometryPool->allocate(vertices.count, indices.count, &geometryRange)) {
+		// Primitives are rebased into the pool, index values stay relative to the model and are offset by the first vertex when drawing
+		vertices.buffer = geometryPool->getVertexBuffer();
+		indices.buffer = geometryPool->getIndexBuffer();
+		for (Node* node : linearNodes) {
+			if (node->mesh) {
+				for (Primitive* primitive : node->mesh->primitives) {
+					primitive->firstIndex += geometryRange.firstIndex;
+					primitive->firstVertex += geometryRange.firstVertex;
+				}
+			}
+		}
+	} else {
+		if (geometryPool) {
+			std::cerr << "Geometry pool is full, \"" << filename << "\" uses buffers of its own" << std::endl;
+		}
+		// Create device local buffers (also host visible on unified memory), transfer source is required to read them back when the model is evicted
+		bufferUsageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | memoryPropertyFlags;
+		// Vertex buffer
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | bufferUsageFlags,
+			device->getStaticMemoryFlags(),
+			vertexBufferSize,
+			&vertices.buffer,
+			&vertices.allocation));
+		// Index buffer
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | bufferUsageFlags,
+			device->getStaticMemoryFlags(),
+			indexBufferSize,
+			&indices.buffer,
+			&indices.allocation));
+	}
 
-	device->flushCommandBuffer(copyCmd, transferQueue, true);
+	// Write vertex and index data in place if the buffers are mapped, through the staging ring otherwise
+	if (geometryRange.valid()) {
+		batch.writeBuffer(vertexBuffer.data(), vertexBufferSize, vertices.buffer, geometryPool->getVertexAllocation(), geometryPool->getVertexOffset(geometryRange));
+		batch.writeBuffer(indexBuffer.data(), indexBufferSize, indices.buffer, geometryPool->getIndexAllocation(), geometryPool->getIndexOffset(geometryRange));
+	} else {
+		batch.writeBuffer(vertexBuffer.data(), vertexBufferSize, vertices.buffer, vertices.allocation);
+		batch.writeBuffer(indexBuffer.data(), indexBufferSize, indices.buffer, indices.allocation);
+	}
 
-	vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+	// Submit and wait once for the whole model, the batch only submits earlier if the staging ring runs full
+	batch.flush();
+	const double loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	std::cout << "Loaded \"" << filename << "\" in " << std::fixed << std::setprecision(1) << loadTime << " ms: " << textures.size() << " images, "
+		<< batch.getUploadedBytes() / (1024.0 * 1024.0) << " MiB uploaded in " << batch.getSubmitCount() << " submission(s)" << std::endl;
 
 	getSceneDimensions();
 
 	// Setup descriptors
 	uint32_t uboCount{ 0 };
-	uint32_t imageCount{ 0 };
 	for (auto node : linearNodes) {
 		if (node->mesh) {
 			uboCount++;
 		}
 	}
-	for (auto material : materials) {
-		if (material.baseColorTexture != nullptr) {
-			imageCount++;
-		}
+	if (dynamicNodeUniforms) {
+		// All nodes share one dynamic uniform buffer descriptor into the frame ring buffer
+		uboCount = 1;
+	} else {
+		uboCount *= device->framesInFlight;
 	}
 	std::vector<VkDescriptorPoolSize> poolSizes = {
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uboCount },
+		{ dynamicNodeUniforms ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uboCount },
 	};
-	if (imageCount > 0) {
-		if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
-			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
-		}
-		if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
-			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
-		}
-	}
 	VkDescriptorPoolCreateInfo descriptorPoolCI{};
 	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	descriptorPoolCI.pPoolSizes = poolSizes.data();
-	descriptorPoolCI.maxSets = uboCount + imageCount;
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+	descriptorPoolCI.maxSets = uboCount;
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor), &descriptorPool));
 
 	// Descriptors for per-node uniform buffers
 	{
-		// Layout is global, so only create if it hasn't already been created before
-		if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
-			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
-			};
-			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-			descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-			descriptorLayoutCI.pBindings = setLayoutBindings.data();
-			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutUbo));
+		if (dynamicNodeUniforms) {
+			// The descriptor set itself is written by writeUniforms() once the ring buffer is known
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = descriptorPool;
+			descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayoutUboDynamic;
+			descriptorSetAllocInfo.descriptorSetCount = 1;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &dynamicUniformSet));
 		}
-		for (auto node : nodes) {
-			prepareNodeDescriptor(node, descriptorSetLayoutUbo);
+		if (!dynamicNodeUniforms) {
+			for (auto node : nodes) {
+				prepareNodeDescriptor(node, descriptorSetLayoutUbo);
+			}
 		}
 	}
 
-	// Descriptors for per-material images
-	{
-		// Layout is global, so only create if it hasn't already been created before
-		if (descriptorSetLayoutImage == VK_NULL_HANDLE) {
-			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
-			if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
-				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
+	// Descriptors for per-material images, in a pool of their own as they are written again when textures are trimmed, evicted or relocated
+	createMaterialDescriptorSets();
+}
+
+void vkglTF::Model::createMaterialDescriptorSets()
+{
+	uint32_t imageCount{ 0 };
+	for (auto& material : materials) {
+		if (material.baseColorTexture != nullptr) {
+			imageCount++;
+		}
+	}
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+	}
+	if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+	}
+	materialDescriptorVersion = getTextureDescriptorVersion();
+	if (imageCount == 0 || poolSizes.empty()) {
+		return;
+	}
+	VkDescriptorPoolCreateInfo descriptorPoolCI{};
+	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	descriptorPoolCI.pPoolSizes = poolSizes.data();
+	descriptorPoolCI.maxSets = imageCount;
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor), &materialDescriptorPool));
+	for (auto& material : materials) {
+		if (material.baseColorTexture != nullptr) {
+			material.createDescriptorSet(materialDescriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags, &emptyTexture);
+		}
+	}
+}
+
+void vkglTF::Model::updateMaterialDescriptorSets()
+{
+	if (materialDescriptorPool == VK_NULL_HANDLE || getTextureDescriptorVersion() == materialDescriptorVersion) {
+		return;
+	}
+	// Sets bound by frames in flight must not be written, so all of them are allocated from a new pool and the old one is retired
+	if (device->deletionQueue) {
+		vks::RetiredResources retired;
+		retired.descriptorPools.push_back(materialDescriptorPool);
+		device->deletionQueue->retire(std::move(retired));
+	} else {
+		vkDestroyDescriptorPool(device->logicalDevice, materialDescriptorPool, vks::allocationCallbacks(vks::HostAllocationScope::Descriptor));
+	}
+	materialDescriptorPool = VK_NULL_HANDLE;
+	createMaterialDescriptorSets();
+}
+
+void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
+{
+	// Evicted buffers are restored by the residency manager's next beginFrame(), drawNode() skips the model until then
+	if (residencyManager && !residencyManager->makeResident(this)) {
+		return;
+	}
+	updateMaterialDescriptorSets();
+	if (geometryRange.valid()) {
+		geometryPool->bind(commandBuffer);
+	} else {
+		const VkDeviceSize offsets[1] = {0};
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+	buffersBound = true;
+}
+
+/*
+	Alpha mode filter of the render flags, the last matching flag wins
+*/
+static bool isFilteredOut(const vkglTF::Material& material, uint32_t renderFlags)
+{
+	bool skip = false;
+	if (renderFlags & vkglTF::RenderFlags::RenderOpaqueNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_OPAQUE);
+	}
+	if (renderFlags & vkglTF::RenderFlags::RenderAlphaMaskedNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_MASK);
+	}
+	if (renderFlags & vkglTF::RenderFlags::RenderAlphaBlendedNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_BLEND);
+	}
+	return skip;
+}
+
+void vkglTF::Model::bindGeometry(vks::CommandRecorder& recorder)
+{
+	if (geometryRange.valid()) {
+		geometryPool->bind(recorder);
+	} else {
+		const VkDeviceSize offsets[1] = {0};
+		recorder.bindVertexBuffers(0, 1, &vertices.buffer, offsets);
+		recorder.bindIndexBuffer(indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+}
+
+void vkglTF::Model::drawNode(Node *node, vks::CommandRecorder& recorder, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindUniformSet)
+{
+	if (!isRenderReady() || residency == Residency::Evicted) {
+		return;
+	}
+	// The subtree is walked with an explicit stack from the thread's arena, children are pushed in reverse to keep the draw order
+	vks::ArenaScope arenaScope;
+	vks::ArenaVector<Node*> stack(arenaScope.arena);
+	stack.reserve(linearNodes.size());
+	stack.push_back(node);
+	while (!stack.empty()) {
+		node = stack.back();
+		stack.pop_back();
+		if (node->mesh) {
+			if (renderFlags & RenderFlags::BindNodeUniforms) {
+				if (dynamicNodeUniforms) {
+					recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindUniformSet, 1, &dynamicUniformSet, 1, &node->mesh->uniformBuffer.dynamicOffset);
+				} else {
+					recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindUniformSet, 1, &node->mesh->uniformBuffer.descriptorSets[frameIndex]);
+				}
 			}
-			if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
-				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, static_cast<uint32_t>(setLayoutBindings.size())));
+			for (Primitive* primitive : node->mesh->primitives) {
+				const vkglTF::Material& material = primitive->material;
+				if (!isFilteredOut(material, renderFlags)) {
+					if (renderFlags & RenderFlags::BindImages) {
+						// Only stamps usage, evicted or trimmed textures are restored before the next frame is recorded
+						if (residencyManager) {
+							if (material.baseColorTexture) {
+								residencyManager->makeResident(material.baseColorTexture);
+							}
+							if (material.normalTexture) {
+								residencyManager->makeResident(material.normalTexture);
+							}
+						}
+						recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet);
+					}
+					if (renderFlags & RenderFlags::BindPrewarmedPipelines) {
+						recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(*primitive));
+					}
+					recorder.drawIndexed(primitive->indexCount, 1, primitive->firstIndex, static_cast<int32_t>(geometryRange.firstVertex), 0);
+				}
 			}
-			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-			descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-			descriptorLayoutCI.pBindings = setLayoutBindings.data();
-			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutImage));
 		}
-		for (auto& material : materials) {
-			if (material.baseColorTexture != nullptr) {
-				material.createDescriptorSet(descriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags);
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+	}
+}
+
+void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindUniformSet)
+{
+	// Skipped while prewarm threads are still building pipelines, so the render thread never compiles one
+	if (!isRenderReady()) {
+		return;
+	}
+	if (residencyManager && !residencyManager->makeResident(this)) {
+		return;
+	}
+	updateMaterialDescriptorSets();
+	vks::CommandRecorder recorder(commandBuffer);
+	if (!buffersBound && !geometryRange.valid()) {
+		bindGeometry(recorder);
+	}
+	for (auto& node : nodes) {
+		drawNode(node, recorder, renderFlags, pipelineLayout, bindImageSet, bindUniformSet);
+	}
+}
+
+void vkglTF::Model::draw(vks::CommandRecorder& recorder, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindUniformSet)
+{
+	if (!isRenderReady()) {
+		return;
+	}
+	if (residencyManager && !residencyManager->makeResident(this)) {
+		return;
+	}
+	updateMaterialDescriptorSets();
+	bindGeometry(recorder);
+	for (auto& node : nodes) {
+		drawNode(node, recorder, renderFlags, pipelineLayout, bindImageSet, bindUniformSet);
+	}
+}
+
+const std::vector<vkglTF::Model::DrawItem>& vkglTF::Model::getDrawList(uint32_t renderFlags)
+{
+	const uint32_t filterFlags = renderFlags & (RenderFlags::RenderOpaqueNodes | RenderFlags::RenderAlphaMaskedNodes | RenderFlags::RenderAlphaBlendedNodes);
+	if (filterFlags == drawListFlags) {
+		return drawList;
+	}
+	// Same traversal as drawNode(), done once so the chunks can be recorded independently
+	drawList.clear();
+	std::vector<Node*> stack(nodes.rbegin(), nodes.rend());
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		if (node->mesh) {
+			for (Primitive* primitive : node->mesh->primitives) {
+				if (!isFilteredOut(primitive->material, filterFlags)) {
+					drawList.push_back({ node, primitive });
+				}
 			}
 		}
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
 	}
+	drawListFlags = filterFlags;
+	return drawList;
 }
 
-void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
+bool vkglTF::Model::makeDrawResident(uint32_t renderFlags)
 {
-	const VkDeviceSize offsets[1] = {0};
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-	buffersBound = true;
+	// Done on the calling thread, the chunks only read the material descriptor sets
+	updateMaterialDescriptorSets();
+	if (!residencyManager) {
+		return true;
+	}
+	if (!residencyManager->makeResident(this)) {
+		return false;
+	}
+	if (renderFlags & RenderFlags::BindImages) {
+		for (Material& material : materials) {
+			if (isFilteredOut(material, renderFlags)) {
+				continue;
+			}
+			if (material.baseColorTexture) {
+				residencyManager->makeResident(material.baseColorTexture);
+			}
+			if (material.normalTexture) {
+				residencyManager->makeResident(material.normalTexture);
+			}
+		}
+	}
+	return true;
 }
 
-void vkglTF::Model::drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
+void vkglTF::Model::recordChunks(const VkCommandBufferInheritanceInfo& inheritanceInfo, vks::ThreadPool& threadPool, const std::function<void(VkCommandBuffer)>& bindState, VkCommandBufferUsageFlags usageFlags, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindUniformSet, std::vector<VkCommandBuffer>& commandBuffers)
 {
-	if (node->mesh) {
-		for (Primitive* primitive : node->mesh->primitives) {
-			bool skip = false;
-			const vkglTF::Material& material = primitive->material;
-			if (renderFlags & RenderFlags::RenderOpaqueNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_OPAQUE);
+	const std::vector<DrawItem>& items = getDrawList(renderFlags);
+	const uint32_t chunkSize = std::max(parallelDrawChunkSize, 1u);
+	const uint32_t chunkCount = static_cast<uint32_t>((items.size() + chunkSize - 1) / chunkSize);
+	commandBuffers.assign(chunkCount, VK_NULL_HANDLE);
+	threadPool.parallelFor(chunkCount, [&](uint32_t chunk) {
+		// Taken from the recording thread's own command pool, so no locking is needed while recording
+		VkCommandBuffer secondary = device->commandBufferPools->acquire(device->queueFamilyIndices.graphics, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | usageFlags;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(secondary, &beginInfo));
+		bindState(secondary);
+		vks::CommandRecorder recorder(secondary);
+		bindGeometry(recorder);
+		const size_t end = std::min(items.size(), static_cast<size_t>(chunk + 1) * chunkSize);
+		for (size_t i = static_cast<size_t>(chunk) * chunkSize; i < end; i++) {
+			const DrawItem& item = items[i];
+			if (renderFlags & RenderFlags::BindNodeUniforms) {
+				if (dynamicNodeUniforms) {
+					recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindUniformSet, 1, &dynamicUniformSet, 1, &item.node->mesh->uniformBuffer.dynamicOffset);
+				} else {
+					recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindUniformSet, 1, &item.node->mesh->uniformBuffer.descriptorSets[frameIndex]);
+				}
 			}
-			if (renderFlags & RenderFlags::RenderAlphaMaskedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_MASK);
+			if (renderFlags & RenderFlags::BindImages) {
+				recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &item.primitive->material.descriptorSet);
 			}
-			if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
+			if (renderFlags & RenderFlags::BindPrewarmedPipelines) {
+				recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(*item.primitive));
 			}
-			if (!skip) {
-				if (renderFlags & RenderFlags::BindImages) {
-					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+			recorder.drawIndexed(item.primitive->indexCount, 1, item.primitive->firstIndex, static_cast<int32_t>(geometryRange.firstVertex), 0);
+		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(secondary));
+		commandBuffers[chunk] = secondary;
+	});
+}
+
+void vkglTF::Model::drawParallel(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo, vks::ThreadPool& threadPool, const std::function<void(VkCommandBuffer)>& bindState, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindUniformSet)
+{
+	if (!isRenderReady() || getDrawList(renderFlags).empty() || !makeDrawResident(renderFlags)) {
+		return;
+	}
+
+	std::vector<VkCommandBuffer> chunkCommandBuffers;
+	recordChunks(inheritanceInfo, threadPool, bindState, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, renderFlags, pipelineLayout, bindImageSet, bindUniformSet, chunkCommandBuffers);
+
+	// Chunks are executed in list order, so the result matches draw()
+	vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(chunkCommandBuffers.size()), chunkCommandBuffers.data());
+	if (secondaryCommandBuffers.size() < device->framesInFlight) {
+		secondaryCommandBuffers.resize(device->framesInFlight);
+	}
+	secondaryCommandBuffers[frameIndex].insert(secondaryCommandBuffers[frameIndex].end(), chunkCommandBuffers.begin(), chunkCommandBuffers.end());
+}
+
+void vkglTF::Model::drawCached(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo, vks::ThreadPool& threadPool, VkPipeline pipeline, const std::function<void(VkCommandBuffer)>& bindState, const VkViewport& viewport, const VkRect2D& scissor, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindUniformSet)
+{
+	auto bindCachedState = [&](VkCommandBuffer secondary) {
+		bindState(secondary);
+		vkCmdSetViewport(secondary, 0, 1, &viewport);
+		vkCmdSetScissor(secondary, 0, 1, &scissor);
+	};
+	// Dynamic offsets into the frame ring buffer change every frame, so there is nothing to reuse
+	if (dynamicNodeUniforms && (renderFlags & RenderFlags::BindNodeUniforms)) {
+		drawParallel(commandBuffer, inheritanceInfo, threadPool, bindCachedState, renderFlags, pipelineLayout, bindImageSet, bindUniformSet);
+		return;
+	}
+	// Still stamps usage, and replacing a texture's image changes the content version
+	if (!isRenderReady() || getDrawList(renderFlags).empty() || !makeDrawResident(renderFlags)) {
+		return;
+	}
+
+	CachedDraw* cachedDraw = nullptr;
+	for (CachedDraw& entry : cachedDraws) {
+		if (entry.renderPass == inheritanceInfo.renderPass && entry.subpass == inheritanceInfo.subpass && entry.renderFlags == renderFlags && entry.frameIndex == frameIndex
+			&& entry.pipelineLayout == pipelineLayout && entry.bindImageSet == bindImageSet && entry.bindUniformSet == bindUniformSet) {
+			cachedDraw = &entry;
+			break;
+		}
+	}
+	if (!cachedDraw) {
+		CachedDraw entry;
+		entry.renderPass = inheritanceInfo.renderPass;
+		entry.subpass = inheritanceInfo.subpass;
+		entry.renderFlags = renderFlags;
+		entry.frameIndex = frameIndex;
+		entry.pipelineLayout = pipelineLayout;
+		entry.bindImageSet = bindImageSet;
+		entry.bindUniformSet = bindUniformSet;
+		cachedDraws.push_back(entry);
+		cachedDraw = &cachedDraws.back();
+	}
+
+	const uint64_t version = getContentVersion();
+	// Viewport and scissor usually change together with the framebuffer on a resize, so they replace the entry's buffers instead of adding an entry
+	const bool upToDate = !cachedDraw->commandBuffers.empty() && cachedDraw->framebuffer == inheritanceInfo.framebuffer && cachedDraw->pipeline == pipeline && cachedDraw->contentVersion == version
+		&& memcmp(&cachedDraw->viewport, &viewport, sizeof(VkViewport)) == 0 && memcmp(&cachedDraw->scissor, &scissor, sizeof(VkRect2D)) == 0;
+	if (!upToDate) {
+		// setFrameIndex() has waited for the frame that last executed this copy, so its buffers can be given back
+		for (VkCommandBuffer secondary : cachedDraw->commandBuffers) {
+			device->commandBufferPools->release(secondary);
+		}
+		recordChunks(inheritanceInfo, threadPool, bindCachedState, 0, renderFlags, pipelineLayout, bindImageSet, bindUniformSet, cachedDraw->commandBuffers);
+		cachedDraw->framebuffer = inheritanceInfo.framebuffer;
+		cachedDraw->pipeline = pipeline;
+		cachedDraw->viewport = viewport;
+		cachedDraw->scissor = scissor;
+		cachedDraw->contentVersion = version;
+	}
+	vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(cachedDraw->commandBuffers.size()), cachedDraw->commandBuffers.data());
+}
+
+uint64_t vkglTF::Model::getContentVersion() const
+{
+	// Replacing a texture's image replaces the material descriptor sets, which invalidates every command buffer binding them
+	return contentVersion + getTextureDescriptorVersion();
+}
+
+uint64_t vkglTF::Model::getTextureDescriptorVersion() const
+{
+	uint64_t version = 0;
+	for (const Texture& texture : textures) {
+		version += texture.descriptorVersion;
+	}
+	return version;
+}
+
+void vkglTF::Model::setResidencyManager(vks::ResidencyManager* residencyManager)
+{
+	assert(!this->residencyManager);
+	this->residencyManager = residencyManager;
+	residencyManager->registerResource(this);
+	for (auto& texture : textures) {
+		residencyManager->registerResource(&texture);
+	}
+}
+
+VkDeviceSize vkglTF::Model::getResidentSize() const
+{
+	return vertices.allocation.size + indices.allocation.size;
+}
+
+uint32_t vkglTF::Model::getMemoryHeapIndex() const
+{
+	if (geometryRange.valid()) {
+		return geometryPool->getHeapIndex();
+	}
+	return device->memoryProperties.memoryTypes[vertices.allocation.memoryTypeIndex].heapIndex;
+}
+
+VkDeviceSize vkglTF::Model::evict(VkQueue queue)
+{
+	// Freeing a range of the geometry pool wouldn't release any memory, pooled geometry stays resident
+	if (geometryRange.valid()) {
+		return 0;
+	}
+
+	const VkDeviceSize vertexBufferSize = vertices.count * sizeof(Vertex);
+	const VkDeviceSize indexBufferSize = indices.count * sizeof(uint32_t);
+
+	// Geometry never changes after loading, so the buffers only need to be read back once
+	if (vertexBackup.empty()) {
+		VkBuffer readbackBuffer;
+		vks::Allocation readbackAllocation;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexBufferSize + indexBufferSize, &readbackBuffer, &readbackAllocation));
+		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = { 0, 0, vertexBufferSize };
+		vkCmdCopyBuffer(copyCmd, vertices.buffer, readbackBuffer, 1, &copyRegion);
+		copyRegion = { 0, vertexBufferSize, indexBufferSize };
+		vkCmdCopyBuffer(copyCmd, indices.buffer, readbackBuffer, 1, &copyRegion);
+		device->flushCommandBuffer(copyCmd, queue);
+		const unsigned char* mapped = static_cast<const unsigned char*>(readbackAllocation.mapped);
+		vertexBackup.assign(mapped, mapped + vertexBufferSize);
+		indexBackup.assign(mapped + vertexBufferSize, mapped + vertexBufferSize + indexBufferSize);
+		vkDestroyBuffer(device->logicalDevice, readbackBuffer, vks::allocationCallbacks(vks::HostAllocationScope::Resource));
+		readbackAllocation.free();
+	}
+
+	const VkDeviceSize residentSize = getResidentSize();
+	// Frames still in flight may draw from the buffers
+	vks::RetiredResources retired;
+	retired.buffers.push_back(vertices.buffer);
+	retired.allocations.push_back(vertices.allocation);
+	retired.buffers.push_back(indices.buffer);
+	retired.allocations.push_back(indices.allocation);
+	if (device->deletionQueue) {
+		device->deletionQueue->retire(std::move(retired));
+	} else {
+		retired.release(device->logicalDevice);
+	}
+	vertices.allocation = vks::Allocation{};
+	vertices.buffer = VK_NULL_HANDLE;
+	indices.allocation = vks::Allocation{};
+	indices.buffer = VK_NULL_HANDLE;
+	contentVersion++;
+	return residentSize;
+}
+
+void vkglTF::Model::restore(vks::UploadBatch& batch)
+{
+	if (geometryRange.valid()) {
+		return;
+	}
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | bufferUsageFlags, device->getStaticMemoryFlags(), vertexBackup.size(), &vertices.buffer, &vertices.allocation));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | bufferUsageFlags, device->getStaticMemoryFlags(), indexBackup.size(), &indices.buffer, &indices.allocation));
+	batch.writeBuffer(vertexBackup.data(), vertexBackup.size(), vertices.buffer, vertices.allocation);
+	batch.writeBuffer(indexBackup.data(), indexBackup.size(), indices.buffer, indices.allocation);
+	contentVersion++;
+}
+
+void vkglTF::Model::setGeometryPool(vks::GeometryPool* geometryPool)
+{
+	assert(geometryPool->getVertexStride() == sizeof(Vertex));
+	this->geometryPool = geometryPool;
+}
+
+void vkglTF::Model::setPipelinePrewarm(vks::PipelineCache* pipelineCache, const PipelineBuilder& builder, uint32_t threadCount)
+{
+	assert(pipelineCache && builder);
+	prewarmPipelineCache = pipelineCache;
+	pipelineBuilder = builder;
+	prewarmThreadCount = threadCount;
+}
+
+vkglTF::PipelinePermutation vkglTF::Model::getPipelinePermutation(const Primitive& primitive) const
+{
+	const Material& material = primitive.material;
+	PipelinePermutation permutation;
+	permutation.alphaMode = material.alphaMode;
+	permutation.doubleSided = material.doubleSided;
+	permutation.textures |= material.baseColorTexture ? PipelinePermutation::BaseColorTexture : 0;
+	permutation.textures |= material.metallicRoughnessTexture ? PipelinePermutation::MetallicRoughnessTexture : 0;
+	// Materials without a normal map point at the empty texture
+	permutation.textures |= (material.normalTexture && material.normalTexture != &emptyTexture) ? PipelinePermutation::NormalTexture : 0;
+	permutation.textures |= material.occlusionTexture ? PipelinePermutation::OcclusionTexture : 0;
+	permutation.textures |= material.emissiveTexture ? PipelinePermutation::EmissiveTexture : 0;
+	permutation.vertexComponents = primitive.vertexComponents;
+	return permutation;
+}
+
+void vkglTF::Model::startPipelinePrewarm()
+{
+	if (!pipelineBuilder) {
+		renderReady = true;
+		return;
+	}
+	for (Node* node : linearNodes) {
+		if (node->mesh) {
+			for (Primitive* primitive : node->mesh->primitives) {
+				const PipelinePermutation permutation = getPipelinePermutation(*primitive);
+				auto existing = std::find(pipelinePermutations.begin(), pipelinePermutations.end(), permutation);
+				primitive->pipelinePermutation = static_cast<uint32_t>(existing - pipelinePermutations.begin());
+				if (existing == pipelinePermutations.end()) {
+					pipelinePermutations.push_back(permutation);
 				}
-				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
 			}
 		}
 	}
-	for (auto& child : node->children) {
-		drawNode(child, commandBuffer, renderFlags);
+	permutationPipelines.assign(pipelinePermutations.size(), VK_NULL_HANDLE);
+	if (pipelinePermutations.empty()) {
+		renderReady = true;
+		return;
+	}
+
+	uint32_t threadCount = prewarmThreadCount;
+	if (threadCount == 0) {
+		threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+	threadCount = std::min(threadCount, static_cast<uint32_t>(pipelinePermutations.size()));
+	// Threads of their own, a parallelFor() on a shared pool would hold up the render thread's recording until every pipeline is built
+	for (uint32_t i = 0; i < threadCount; i++) {
+		prewarmThreads.emplace_back([this]() {
+			for (uint32_t index = nextPermutation++; index < pipelinePermutations.size(); index = nextPermutation++) {
+				permutationPipelines[index] = pipelineBuilder(pipelinePermutations[index], *prewarmPipelineCache);
+				if (++compiledPermutations == pipelinePermutations.size()) {
+					renderReady.store(true, std::memory_order_release);
+				}
+			}
+		});
 	}
 }
 
-void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
+VkPipeline vkglTF::Model::getPipeline(const Primitive& primitive) const
 {
-	if (!buffersBound) {
-		const VkDeviceSize offsets[1] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	if (!isRenderReady() || primitive.pipelinePermutation >= permutationPipelines.size()) {
+		return VK_NULL_HANDLE;
 	}
-	for (auto& node : nodes) {
-		drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+	return permutationPipelines[primitive.pipelinePermutation];
+}
+
+vkglTF::Model::PipelinePrewarmProgress vkglTF::Model::getPipelinePrewarmProgress() const
+{
+	return { compiledPermutations.load(), static_cast<uint32_t>(pipelinePermutations.size()) };
+}
+
+void vkglTF::Model::waitForPipelines()
+{
+	for (std::thread& thread : prewarmThreads) {
+		thread.join();
+	}
+	prewarmThreads.clear();
+}
+
+void vkglTF::Model::setDefragmenter(vks::Defragmenter* defragmenter)
+{
+	assert(!this->defragmenter);
+	this->defragmenter = defragmenter;
+	defragmenter->registerResource(this);
+	for (auto& texture : textures) {
+		defragmenter->registerResource(&texture);
+	}
+}
+
+bool vkglTF::Model::needsRelocation() const
+{
+	if (geometryRange.valid()) {
+		return false;
+	}
+	return device->memoryAllocator->isCompacting(vertices.allocation) || device->memoryAllocator->isCompacting(indices.allocation);
+}
+
+void vkglTF::Model::relocate(VkCommandBuffer commandBuffer, vks::RetiredResources& retired)
+{
+	auto relocateBuffer = [&](VkBuffer& buffer, vks::Allocation& allocation, VkBufferUsageFlags usageFlags, VkDeviceSize size) {
+		retired.buffers.push_back(buffer);
+		retired.allocations.push_back(allocation);
+		VkBuffer oldBuffer = buffer;
+		VK_CHECK_RESULT(device->createBuffer(usageFlags, device->getStaticMemoryFlags(), size, &buffer, &allocation));
+		VkBufferCopy copyRegion = { 0, 0, size };
+		vkCmdCopyBuffer(commandBuffer, oldBuffer, buffer, 1, &copyRegion);
+	};
+	relocateBuffer(vertices.buffer, vertices.allocation, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | bufferUsageFlags, vertices.count * sizeof(Vertex));
+	relocateBuffer(indices.buffer, indices.allocation, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | bufferUsageFlags, indices.count * sizeof(uint32_t));
+	contentVersion++;
+}
+
+void vkglTF::Model::writeUniforms(vks::FrameRingBuffer& ringBuffer)
+{
+	assert(dynamicNodeUniforms);
+	if (dynamicUniformBuffer != ringBuffer.getBuffer()) {
+		// Point the shared descriptor at the ring buffer, the per-node part is selected with the dynamic offset
+		VkDescriptorBufferInfo bufferInfo = ringBuffer.descriptor(sizeof(Mesh::UniformBlock));
+		VkWriteDescriptorSet writeDescriptorSet{};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writeDescriptorSet.descriptorCount = 1;
+		writeDescriptorSet.dstSet = dynamicUniformSet;
+		writeDescriptorSet.dstBinding = 0;
+		writeDescriptorSet.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+		dynamicUniformBuffer = ringBuffer.getBuffer();
+	}
+	for (auto node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		Mesh::UniformBlock& uniformBlock = node->mesh->uniformBlock;
+		vks::RingAllocation allocation = ringBuffer.allocateUniform(sizeof(Mesh::UniformBlock));
+		assert(allocation.valid());
+		uint8_t* dst = static_cast<uint8_t*>(allocation.mapped);
+		// Joint matrices are only read by the shader if jointcount is non-zero, so skip them for static meshes
+		if (uniformBlock.jointcount > 0.0f) {
+			memcpy(dst, &uniformBlock, sizeof(Mesh::UniformBlock));
+		} else {
+			memcpy(dst + offsetof(Mesh::UniformBlock, matrix), &uniformBlock.matrix, sizeof(glm::mat4));
+			memcpy(dst + offsetof(Mesh::UniformBlock, jointcount), &uniformBlock.jointcount, sizeof(float));
+		}
+		node->mesh->uniformBuffer.dynamicOffset = allocation.dynamicOffset();
 	}
 }
 
@@ -1538,6 +2216,29 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 		for (auto &node : nodes) {
 			node->update();
 		}
+		for (auto node : linearNodes) {
+			if (node->mesh) {
+				node->mesh->writeUniforms(frameIndex);
+			}
+		}
+	}
+}
+
+void vkglTF::Model::setFrameIndex(uint32_t index)
+{
+	assert(index < device->framesInFlight);
+	frameIndex = index;
+	// The GPU has finished the frame that last used this index, so its secondary command buffers can be recorded again
+	if (frameIndex < secondaryCommandBuffers.size()) {
+		for (VkCommandBuffer secondary : secondaryCommandBuffers[frameIndex]) {
+			device->commandBufferPools->release(secondary);
+		}
+		secondaryCommandBuffers[frameIndex].clear();
+	}
+	for (auto node : linearNodes) {
+		if (node->mesh) {
+			node->mesh->writeUniforms(frameIndex);
+		}
 	}
 }
 
@@ -1571,22 +2272,30 @@ vkglTF::Node* vkglTF::Model::nodeFromIndex(uint32_t index) {
 
 void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout) {
 	if (node->mesh) {
+		Mesh::UniformBuffer& uniformBuffer = node->mesh->uniformBuffer;
+		const uint32_t framesInFlight = device->framesInFlight;
+		std::vector<VkDescriptorSetLayout> setLayouts(framesInFlight, descriptorSetLayout);
+		uniformBuffer.descriptorSets.resize(framesInFlight);
 		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
 		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 		descriptorSetAllocInfo.descriptorPool = descriptorPool;
-		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-		descriptorSetAllocInfo.descriptorSetCount = 1;
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
-
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-		writeDescriptorSet.dstBinding = 0;
-		writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptor;
+		descriptorSetAllocInfo.pSetLayouts = setLayouts.data();
+		descriptorSetAllocInfo.descriptorSetCount = framesInFlight;
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, uniformBuffer.descriptorSets.data()));
+
+		std::vector<VkDescriptorBufferInfo> bufferInfos(framesInFlight, uniformBuffer.descriptor);
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets(framesInFlight);
+		for (uint32_t i = 0; i < framesInFlight; i++) {
+			bufferInfos[i].offset = i * uniformBuffer.stride;
+			writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			writeDescriptorSets[i].descriptorCount = 1;
+			writeDescriptorSets[i].dstSet = uniformBuffer.descriptorSets[i];
+			writeDescriptorSets[i].dstBinding = 0;
+			writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+		}
 
-		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+		vkUpdateDescriptorSets(device->logicalDevice, framesInFlight, writeDescriptorSets.data(), 0, nullptr);
 	}
 	for (auto& child : node->children) {
 		prepareNodeDescriptor(child, descriptorSetLayout);
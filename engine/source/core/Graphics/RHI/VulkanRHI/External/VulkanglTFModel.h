@@ -15,6 +15,14 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "VulkanFrameRingBuffer.h"
+#include "VulkanResidencyManager.h"
+#include "VulkanDefragmenter.h"
+#include "VulkanLinearArena.h"
+#include "VulkanGeometryPool.h"
+#include "VulkanThreadPool.h"
+#include "VulkanCommandRecorder.h"
+#include "VulkanPipelineCache.h"
 #include "Tools.h"
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -44,6 +52,7 @@ namespace vkglTF
 
 	extern VkDescriptorSetLayout descriptorSetLayoutImage;
 	extern VkDescriptorSetLayout descriptorSetLayoutUbo;
+	extern VkDescriptorSetLayout descriptorSetLayoutUboDynamic;
 	extern VkMemoryPropertyFlags memoryPropertyFlags;
 	extern uint32_t descriptorBindingFlags;
 
@@ -52,20 +61,45 @@ namespace vkglTF
 	/*
 		glTF texture loading class
 	*/
-	struct Texture {
+	struct Texture : public vks::Evictable, public vks::Relocatable {
 		vks::VulkanDevice* device = nullptr;
 		VkImage image;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
+		vks::Allocation allocation;
 		VkImageView view;
+		VkFormat format;
 		uint32_t width, height;
 		uint32_t mipLevels;
 		uint32_t layerCount;
 		VkDescriptorImageInfo descriptor;
 		VkSampler sampler;
+		/** @brief First mip level of the full chain present in the image, non-zero while trimmed */
+		uint32_t baseMipLevel = 0;
+		/** @brief Incremented whenever the image or view is replaced, descriptor sets written for the old one are replaced and command buffers binding them recorded again */
+		uint32_t descriptorVersion = 0;
+		/** @brief Host copy of the full mip chain, read back the first time the texture is trimmed or evicted */
+		std::vector<unsigned char> backup;
 		void updateDescriptor();
 		void destroy();
-		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue);
+		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, vks::UploadBatch& batch);
+
+		VkDeviceSize getResidentSize() const override;
+		uint32_t getMemoryHeapIndex() const override;
+		vks::MemoryCategory getMemoryCategory() const override { return vks::MemoryCategory::Texture; }
+		VkDeviceSize trim(VkQueue queue, vks::UploadBatch& batch) override;
+		VkDeviceSize evict(VkQueue queue) override;
+		void restore(vks::UploadBatch& batch) override;
+
+		bool needsRelocation() const override;
+		VkDeviceSize getRelocationSize() const override { return getResidentSize(); }
+		void relocate(VkCommandBuffer commandBuffer, vks::RetiredResources& retired) override;
+	private:
+		VkDeviceSize mipOffset(uint32_t level) const;
+		void readBackup(VkQueue queue);
+		void releaseImage();
+		void allocateImage(uint32_t baseMip);
+		void createView();
+		void createImage(uint32_t baseMip, vks::UploadBatch& batch);
 	};
 
 	/*
@@ -76,6 +110,7 @@ namespace vkglTF
 		enum AlphaMode { ALPHAMODE_OPAQUE, ALPHAMODE_MASK, ALPHAMODE_BLEND };
 		AlphaMode alphaMode = ALPHAMODE_OPAQUE;
 		float alphaCutoff = 1.0f;
+		bool doubleSided = false;
 		float metallicFactor = 1.0f;
 		float roughnessFactor = 1.0f;
 		glm::vec4 baseColorFactor = glm::vec4(1.0f);
@@ -91,7 +126,8 @@ namespace vkglTF
 		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 
 		Material(vks::VulkanDevice* device) : device(device) {};
-		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
+		/** @brief Allocate and write the material's image descriptor set, textures without an image (e.g. evicted ones) are replaced by the fallback texture */
+		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags, const vkglTF::Texture* fallbackTexture = nullptr);
 	};
 
 	/*
@@ -102,6 +138,10 @@ namespace vkglTF
 		uint32_t indexCount;
 		uint32_t firstVertex;
 		uint32_t vertexCount;
+		/** @brief Bits (1 << VertexComponent) of the vertex attributes present in the glTF data, the others are zero in the vertex buffer */
+		uint32_t vertexComponents = 0;
+		/** @brief Index of the primitive's pipeline permutation, only set if a pipeline prewarm has been set up */
+		uint32_t pipelinePermutation = UINT32_MAX;
 		Material& material;
 
 		struct Dimensions {
@@ -126,11 +166,18 @@ namespace vkglTF
 		std::string name;
 
 		struct UniformBuffer {
-			VkBuffer buffer;
-			VkDeviceMemory memory;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			vks::Allocation allocation;
 			VkDescriptorBufferInfo descriptor;
-			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-			void* mapped;
+			/** @brief One descriptor set per frame in flight, each pointing at that frame's copy of the uniform block */
+			std::vector<VkDescriptorSet> descriptorSets;
+			void* mapped = nullptr;
+			/** @brief Distance between the per-frame copies of the uniform block in the buffer */
+			VkDeviceSize stride = 0;
+			/** @brief Bit mask of the frames whose copy doesn't contain the current uniform block yet */
+			uint32_t staleFrames = 0;
+			/** @brief Offset of this frame's copy of the uniform block in the frame ring buffer (DynamicNodeUniforms only) */
+			uint32_t dynamicOffset = 0;
 		} uniformBuffer;
 
 		struct UniformBlock {
@@ -139,8 +186,10 @@ namespace vkglTF
 			float jointcount{ 0 };
 		} uniformBlock;
 
-		Mesh(vks::VulkanDevice* device, glm::mat4 matrix);
+		Mesh(vks::VulkanDevice* device, glm::mat4 matrix, bool createUniformBuffer = true);
 		~Mesh();
+		/** @brief Copy the uniform block into a frame's part of the uniform buffer if it changed since that frame was last written */
+		void writeUniforms(uint32_t frameIndex);
 	};
 
 	/*
@@ -223,9 +272,33 @@ namespace vkglTF
 		static VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo;
 		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding);
 		static VkVertexInputAttributeDescription inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component);
-		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components);
+		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent>& components);
 		/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
-		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components);
+		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent>& components);
+	};
+
+	/*
+		Pipeline state a primitive needs, known as soon as the materials and meshes of a model have been read
+	*/
+	struct PipelinePermutation {
+		enum TextureBits {
+			BaseColorTexture = 0x00000001,
+			MetallicRoughnessTexture = 0x00000002,
+			NormalTexture = 0x00000004,
+			OcclusionTexture = 0x00000008,
+			EmissiveTexture = 0x00000010
+		};
+		Material::AlphaMode alphaMode = Material::ALPHAMODE_OPAQUE;
+		bool doubleSided = false;
+		/** @brief TextureBits of the textures the material has */
+		uint32_t textures = 0;
+		/** @brief Bits (1 << VertexComponent) of the vertex attributes the primitive provides */
+		uint32_t vertexComponents = 0;
+
+		bool operator==(const PipelinePermutation& other) const
+		{
+			return alphaMode == other.alphaMode && doubleSided == other.doubleSided && textures == other.textures && vertexComponents == other.vertexComponents;
+		}
 	};
 
 	enum FileLoadingFlags {
@@ -233,24 +306,94 @@ namespace vkglTF
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		DynamicNodeUniforms = 0x00000010
 	};
 
 	enum RenderFlags {
 		BindImages = 0x00000001,
 		RenderOpaqueNodes = 0x00000002,
 		RenderAlphaMaskedNodes = 0x00000004,
-		RenderAlphaBlendedNodes = 0x00000008
+		RenderAlphaBlendedNodes = 0x00000008,
+		BindNodeUniforms = 0x00000010,
+		BindPrewarmedPipelines = 0x00000020
 	};
 
 	/*
 		glTF model loading and rendering class
 	*/
-	class Model {
+	class Model : public vks::Evictable, public vks::Relocatable {
 	private:
 		vkglTF::Texture* getTexture(uint32_t index);
 		vkglTF::Texture emptyTexture;
-		void createEmptyTexture(VkQueue transferQueue);
+		void createEmptyTexture(vks::UploadBatch& batch);
+		vks::ResidencyManager* residencyManager = nullptr;
+		vks::Defragmenter* defragmenter = nullptr;
+		/** @brief Host copies of the vertex and index data, read back the first time the model is evicted */
+		std::vector<unsigned char> vertexBackup;
+		std::vector<unsigned char> indexBackup;
+		VkBufferUsageFlags bufferUsageFlags = 0;
+		vks::GeometryPool* geometryPool = nullptr;
+		/** @brief Range of the geometry pool holding the model's vertices and indices, invalid if the model owns its buffers */
+		vks::GeometryRange geometryRange;
+		/** @brief Primitive of the flattened node hierarchy, in the order drawNode() draws them */
+		struct DrawItem
+		{
+			Node* node;
+			Primitive* primitive;
+		};
+		std::vector<DrawItem> drawList;
+		/** @brief Alpha mode flags the draw list has been built for */
+		uint32_t drawListFlags = UINT32_MAX;
+		/** @brief Secondary command buffers recorded by drawParallel() for each frame in flight, given back when that frame index is selected again */
+		std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffers;
+		/** @brief Secondary command buffers kept by drawCached() for one render pass, binding and dynamic state and frame in flight, with the state they were recorded for */
+		struct CachedDraw
+		{
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			uint32_t subpass = 0;
+			uint32_t renderFlags = 0;
+			uint32_t frameIndex = 0;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			uint32_t bindImageSet = 0;
+			uint32_t bindUniformSet = 0;
+			VkViewport viewport = {};
+			VkRect2D scissor = {};
+			VkFramebuffer framebuffer = VK_NULL_HANDLE;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			uint64_t contentVersion = 0;
+			std::vector<VkCommandBuffer> commandBuffers;
+		};
+		std::vector<CachedDraw> cachedDraws;
+		/** @brief Incremented when buffers or materials change, see getContentVersion() */
+		uint64_t contentVersion = 0;
+		const std::vector<DrawItem>& getDrawList(uint32_t renderFlags);
+		/** @brief Stamp usage of the model and the textures the draws bind, false if the model is evicted and can't be drawn this frame */
+		bool makeDrawResident(uint32_t renderFlags);
+		void bindGeometry(vks::CommandRecorder& recorder);
+		void recordChunks(const VkCommandBufferInheritanceInfo& inheritanceInfo, vks::ThreadPool& threadPool, const std::function<void(VkCommandBuffer)>& bindState, VkCommandBufferUsageFlags usageFlags, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindUniformSet, std::vector<VkCommandBuffer>& commandBuffers);
+		uint64_t getContentVersion() const;
+		/** @brief Pool of the material image descriptor sets, replaced as a whole when a texture's image changes */
+		VkDescriptorPool materialDescriptorPool = VK_NULL_HANDLE;
+		/** @brief Sum of the textures' descriptor versions the material descriptor sets have been written for */
+		uint64_t materialDescriptorVersion = 0;
+		uint64_t getTextureDescriptorVersion() const;
+		void createMaterialDescriptorSets();
+		/** @brief Write new material descriptor sets if a texture's image has changed, the old sets may be bound by frames in flight and are retired with their pool */
+		void updateMaterialDescriptorSets();
+		/** @brief Pipeline prewarm set by setPipelinePrewarm() */
+		vks::PipelineCache* prewarmPipelineCache = nullptr;
+		std::function<VkPipeline(const PipelinePermutation&, vks::PipelineCache&)> pipelineBuilder;
+		uint32_t prewarmThreadCount = 0;
+		/** @brief Distinct permutations of the model's primitives, fixed before the prewarm threads start */
+		std::vector<PipelinePermutation> pipelinePermutations;
+		/** @brief Indexed like pipelinePermutations, each written by the thread that built it and read once the model is render ready */
+		std::vector<VkPipeline> permutationPipelines;
+		std::vector<std::thread> prewarmThreads;
+		std::atomic<uint32_t> nextPermutation{ 0 };
+		std::atomic<uint32_t> compiledPermutations{ 0 };
+		std::atomic<bool> renderReady{ false };
+		void startPipelinePrewarm();
 	public:
 		vks::VulkanDevice* device;
 		VkDescriptorPool descriptorPool;
@@ -258,12 +401,12 @@ namespace vkglTF
 		struct Vertices {
 			int count;
 			VkBuffer buffer;
-			VkDeviceMemory memory;
+			vks::Allocation allocation;
 		} vertices;
 		struct Indices {
 			int count;
 			VkBuffer buffer;
-			VkDeviceMemory memory;
+			vks::Allocation allocation;
 		} indices;
 
 		std::vector<Node*> nodes;
@@ -287,22 +430,124 @@ namespace vkglTF
 		bool buffersBound = false;
 		std::string path;
 
+		/** @brief Node uniforms are written to a frame ring buffer each frame instead of one buffer per mesh */
+		bool dynamicNodeUniforms = false;
+		/** @brief Single dynamic uniform buffer descriptor shared by all nodes if dynamicNodeUniforms is set */
+		VkDescriptorSet dynamicUniformSet = VK_NULL_HANDLE;
+		VkBuffer dynamicUniformBuffer = VK_NULL_HANDLE;
+		/** @brief Frame in flight whose copy of the node uniforms is updated and bound */
+		uint32_t frameIndex = 0;
+		/** @brief Number of primitives drawParallel() records into each secondary command buffer */
+		uint32_t parallelDrawChunkSize = 256;
+
 		Model() {};
 		~Model();
 		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale);
 		void loadSkins(tinygltf::Model& gltfModel);
-		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue);
+		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, vks::UploadBatch& batch);
 		void loadMaterials(tinygltf::Model& gltfModel);
 		void loadAnimations(tinygltf::Model& gltfModel);
 		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
 		void bindBuffers(VkCommandBuffer commandBuffer);
-		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
-		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		/** @brief Draw a node and its children, descriptor sets shared by consecutive primitives are only bound once */
+		void drawNode(Node* node, vks::CommandRecorder& recorder, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, uint32_t bindUniformSet = 0);
+		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, uint32_t bindUniformSet = 0);
+		/**
+		* Draw the model through a recorder shared with the rest of the pass
+		* @note Always binds the model's buffers (or its geometry pool), the recorder drops the binds if they are bound already
+		*/
+		void draw(vks::CommandRecorder& recorder, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, uint32_t bindUniformSet = 0);
+		/**
+		* Record the model's draws in chunks of parallelDrawChunkSize primitives into secondary command buffers on the threads of a pool
+		*
+		* @param commandBuffer Primary command buffer, the render pass has to be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+		* @param inheritanceInfo Render pass, subpass and framebuffer the secondary command buffers are executed in
+		* @param threadPool Threads the chunks are recorded on
+		* @param bindState Called at the start of every secondary command buffer to bind the pipeline and set dynamic state, which aren't inherited from the primary command buffer
+		*
+		* @note The secondary command buffers are reused once setFrameIndex() selects the same frame in flight again
+		*/
+		void drawParallel(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo, vks::ThreadPool& threadPool, const std::function<void(VkCommandBuffer)>& bindState, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, uint32_t bindUniformSet = 0);
+		/**
+		* Execute the model's draws from secondary command buffers that are only recorded again when something they depend on has changed
+		*
+		* @param commandBuffer Primary command buffer, the render pass has to be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+		* @param inheritanceInfo Render pass, subpass and framebuffer, the buffers are cached per render pass and subpass and recorded again if the framebuffer changes
+		* @param threadPool Threads the chunks are recorded on when the cache is out of date
+		* @param pipeline Pipeline bound by bindState, a different pipeline records the buffers again
+		* @param bindState Called at the start of every secondary command buffer to bind the pipeline and set dynamic state other than viewport and scissor
+		* @param viewport Viewport set in every secondary command buffer, a different viewport or scissor records the buffers again
+		* @param scissor Scissor set in every secondary command buffer
+		*
+		* @note The buffers are also cached per pipeline layout and descriptor set indices
+		* @note Each frame in flight has its own copy, as it binds that frame's node uniforms. Per frame only the uniforms are updated and the copy is executed
+		* @note Changes to materials or the node hierarchy aren't detected, call invalidateCommandBuffers() after making them
+		*/
+		void drawCached(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo, vks::ThreadPool& threadPool, VkPipeline pipeline, const std::function<void(VkCommandBuffer)>& bindState, const VkViewport& viewport, const VkRect2D& scissor, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, uint32_t bindUniformSet = 0);
+		/** @brief Record the buffers of drawCached() again the next time each frame in flight uses them */
+		void invalidateCommandBuffers() { contentVersion++; }
+		/** @brief Write this frame's node uniforms into the ring buffer, has to be called once per frame before recording draws when using DynamicNodeUniforms */
+		void writeUniforms(vks::FrameRingBuffer& ringBuffer);
+		/**
+		* Select the frame in flight that is recorded next, has to be called once per frame before updating animations and recording draws
+		* @note Node uniforms changed while the GPU was reading another frame's copy are written to this frame's copy
+		*/
+		void setFrameIndex(uint32_t index);
+		uint32_t getFrameIndex() const { return frameIndex; }
 		void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
 		void getSceneDimensions();
 		void updateAnimation(uint32_t index, float time);
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
 		void prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
+		/**
+		* Load the model's geometry into a shared pool instead of buffers of its own, has to be called before loadFromFile
+		* @note Models in the pool don't bind buffers in draw(VkCommandBuffer), bind the pool once (GeometryPool::bind or bindBuffers) before drawing them
+		*/
+		void setGeometryPool(vks::GeometryPool* geometryPool);
+		const vks::GeometryRange& getGeometryRange() const { return geometryRange; }
+		/**
+		* Let the residency manager evict the model's buffers and textures, usage is stamped while drawing
+		* @note An evicted model is skipped by the draw functions until the residency manager's next beginFrame() has restored it, evicted textures are drawn with the empty texture
+		*/
+		void setResidencyManager(vks::ResidencyManager* residencyManager);
+
+		VkDeviceSize getResidentSize() const override;
+		uint32_t getMemoryHeapIndex() const override;
+		vks::MemoryCategory getMemoryCategory() const override { return vks::MemoryCategory::Geometry; }
+		VkDeviceSize evict(VkQueue queue) override;
+		void restore(vks::UploadBatch& batch) override;
+
+		using PipelineBuilder = std::function<VkPipeline(const PipelinePermutation& permutation, vks::PipelineCache& pipelineCache)>;
+		/**
+		* Build the pipelines of all the model's permutations on background threads, has to be called before loadFromFile
+		* @param pipelineCache Cache the pipelines are created through and owned by, lookups from the render path are then hits
+		* @param builder Fills in the pipeline state of a permutation and returns the pipeline from the cache, called from several threads at once
+		* @param (Optional) threadCount Threads building pipelines, defaults to one less than the number of hardware threads
+		* @note Prewarming starts as soon as loadFromFile has read the materials and meshes, so compilation overlaps with the uploads
+		*/
+		void setPipelinePrewarm(vks::PipelineCache* pipelineCache, const PipelineBuilder& builder, uint32_t threadCount = 0);
+		/** @brief Permutation the material and vertex attributes of a primitive map to */
+		PipelinePermutation getPipelinePermutation(const Primitive& primitive) const;
+		const std::vector<PipelinePermutation>& getPipelinePermutations() const { return pipelinePermutations; }
+		/** @brief Prewarmed pipeline of a primitive, VK_NULL_HANDLE until the model is render ready, RenderFlags::BindPrewarmedPipelines binds it for each primitive */
+		VkPipeline getPipeline(const Primitive& primitive) const;
+		/** @brief Set once the pipelines of all permutations exist, right after loading if no pipeline prewarm has been set up. The draw functions record nothing before that */
+		bool isRenderReady() const { return renderReady.load(std::memory_order_acquire); }
+		struct PipelinePrewarmProgress
+		{
+			uint32_t compiled;
+			uint32_t total;
+		};
+		PipelinePrewarmProgress getPipelinePrewarmProgress() const;
+		/** @brief Block until the prewarm threads have finished */
+		void waitForPipelines();
+
+		/** @brief Let the defragmenter move the model's buffers and textures */
+		void setDefragmenter(vks::Defragmenter* defragmenter);
+
+		bool needsRelocation() const override;
+		VkDeviceSize getRelocationSize() const override { return getResidentSize(); }
+		void relocate(VkCommandBuffer commandBuffer, vks::RetiredResources& retired) override;
 	};
 }
\ No newline at end of file
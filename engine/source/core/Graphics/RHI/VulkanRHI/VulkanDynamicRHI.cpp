@@ -1,4 +1,69 @@
 ﻿#include "VulkanDynamicRHI.h"
+#include "External/VulkanDeletionQueue.h"
+#include "External/VulkanHostAllocator.h"
+#include "External/VulkanInitializers.hpp"
+#include "External/Tools.h"
+#include <cassert>
+#include <iostream>
+
+namespace
+{
+    VkFormat ToVkFormat(RHIFormat Format)
+    {
+        switch (Format)
+        {
+        case RHIFormat::R8G8B8A8_UNORM: return VK_FORMAT_R8G8B8A8_UNORM;
+        case RHIFormat::R8G8B8A8_SRGB: return VK_FORMAT_R8G8B8A8_SRGB;
+        case RHIFormat::B8G8R8A8_UNORM: return VK_FORMAT_B8G8R8A8_UNORM;
+        case RHIFormat::R16G16B16A16_SFLOAT: return VK_FORMAT_R16G16B16A16_SFLOAT;
+        case RHIFormat::R32G32B32A32_SFLOAT: return VK_FORMAT_R32G32B32A32_SFLOAT;
+        case RHIFormat::D32_SFLOAT: return VK_FORMAT_D32_SFLOAT;
+        case RHIFormat::D24_UNORM_S8_UINT: return VK_FORMAT_D24_UNORM_S8_UINT;
+        default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    VkBufferUsageFlags ToVkBufferUsage(uint32_t Usage)
+    {
+        VkBufferUsageFlags Flags = 0;
+        if (Usage & RHIBufferUsage::Vertex) Flags |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        if (Usage & RHIBufferUsage::Index) Flags |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        if (Usage & RHIBufferUsage::Uniform) Flags |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        if (Usage & RHIBufferUsage::Storage) Flags |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        if (Usage & RHIBufferUsage::TransferSrc) Flags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        if (Usage & RHIBufferUsage::TransferDst) Flags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        return Flags;
+    }
+
+    VkImageUsageFlags ToVkImageUsage(uint32_t Usage)
+    {
+        VkImageUsageFlags Flags = 0;
+        if (Usage & RHITextureUsage::Sampled) Flags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+        if (Usage & RHITextureUsage::Storage) Flags |= VK_IMAGE_USAGE_STORAGE_BIT;
+        if (Usage & RHITextureUsage::ColorAttachment) Flags |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (Usage & RHITextureUsage::DepthStencilAttachment) Flags |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if (Usage & RHITextureUsage::TransferSrc) Flags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        if (Usage & RHITextureUsage::TransferDst) Flags |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        return Flags;
+    }
+
+    vks::MemoryCategory ToMemoryCategory(uint32_t Usage)
+    {
+        if (Usage & (RHIBufferUsage::Vertex | RHIBufferUsage::Index)) return vks::MemoryCategory::Geometry;
+        if (Usage & RHIBufferUsage::Uniform) return vks::MemoryCategory::Uniform;
+        return vks::MemoryCategory::Other;
+    }
+}
+
+VulkanDynamicRHI::VulkanDynamicRHI(vks::VulkanDevice* InDevice)
+    : Device(InDevice)
+    , Buffers(Resources.GetBuffers().GetCapacity(), VK_NULL_HANDLE)
+    , BufferAllocations(Resources.GetBuffers().GetCapacity())
+    , Images(Resources.GetTextures().GetCapacity(), VK_NULL_HANDLE)
+    , ImageViews(Resources.GetTextures().GetCapacity(), VK_NULL_HANDLE)
+    , ImageAllocations(Resources.GetTextures().GetCapacity())
+{
+}
 
 void VulkanDynamicRHI::Init()
 {
@@ -11,4 +76,200 @@ void VulkanDynamicRHI::PostInit()
 
 void VulkanDynamicRHI::ShutDown()
 {
+    // Resources the application hasn't destroyed, the device has to be idle
+    vks::RetiredResources Retired;
+    for (size_t Index = 0; Index < Buffers.size(); Index++)
+    {
+        if (Buffers[Index] != VK_NULL_HANDLE)
+        {
+            Retired.buffers.push_back(Buffers[Index]);
+            Retired.allocations.push_back(BufferAllocations[Index]);
+            Buffers[Index] = VK_NULL_HANDLE;
+        }
+    }
+    for (size_t Index = 0; Index < Images.size(); Index++)
+    {
+        if (Images[Index] != VK_NULL_HANDLE)
+        {
+            Retired.imageViews.push_back(ImageViews[Index]);
+            Retired.images.push_back(Images[Index]);
+            Retired.allocations.push_back(ImageAllocations[Index]);
+            Images[Index] = VK_NULL_HANDLE;
+            ImageViews[Index] = VK_NULL_HANDLE;
+        }
+    }
+    Retired.release(Device->logicalDevice);
+}
+
+RHIBufferHandle VulkanDynamicRHI::CreateBuffer(const RHIBufferDesc& Desc)
+{
+    RHIBufferHandle Handle = Resources.AllocateBuffer(Desc);
+    if (!Handle.IsValid())
+    {
+        return Handle;
+    }
+    // The slot is only visible to this thread until the handle is returned
+    const uint32_t Index = Handle.GetIndex();
+    const VkMemoryPropertyFlags MemoryProperties = (Desc.Usage & RHIBufferUsage::HostVisible) ? (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    VkBufferCreateInfo BufferInfo = vks::initializers::bufferCreateInfo(ToVkBufferUsage(Desc.Usage), Desc.Size);
+    BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult Result = vkCreateBuffer(Device->logicalDevice, &BufferInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &Buffers[Index]);
+    if (Result != VK_SUCCESS)
+    {
+        Buffers[Index] = VK_NULL_HANDLE;
+    }
+    else
+    {
+        Result = Device->memoryAllocator->allocateBufferMemory(Buffers[Index], MemoryProperties, &BufferAllocations[Index], ToMemoryCategory(Desc.Usage));
+    }
+    if (Result != VK_SUCCESS)
+    {
+        // Running out of memory is expected here, the caller gets an invalid handle instead of the process being aborted
+        std::cerr << "Failed to create buffer of " << Desc.Size << " bytes: " << EngineBase::Tools::errorString(Result) << std::endl;
+        // Never used by the GPU, so the partial objects are destroyed right away
+        vks::RetiredResources Partial;
+        Partial.buffers.push_back(Buffers[Index]);
+        if (BufferAllocations[Index].valid())
+        {
+            Partial.allocations.push_back(BufferAllocations[Index]);
+        }
+        Partial.release(Device->logicalDevice);
+        Buffers[Index] = VK_NULL_HANDLE;
+        BufferAllocations[Index] = vks::Allocation();
+        Resources.ReleaseBuffer(Handle);
+        return RHIBufferHandle();
+    }
+    return Handle;
+}
+
+void VulkanDynamicRHI::DestroyBuffer(RHIBufferHandle Handle)
+{
+    vks::RetiredResources Retired;
+    const bool Released = Resources.ReleaseBuffer(Handle, [&](uint32_t Index)
+    {
+        Retired.buffers.push_back(Buffers[Index]);
+        Retired.allocations.push_back(BufferAllocations[Index]);
+        Buffers[Index] = VK_NULL_HANDLE;
+        BufferAllocations[Index] = vks::Allocation();
+    });
+    if (Released)
+    {
+        Retire(std::move(Retired));
+    }
+}
+
+RHITextureHandle VulkanDynamicRHI::CreateTexture(const RHITextureDesc& Desc)
+{
+    const VkFormat Format = ToVkFormat(Desc.Format);
+    assert(Format != VK_FORMAT_UNDEFINED);
+    RHITextureHandle Handle = Resources.AllocateTexture(Desc);
+    if (!Handle.IsValid())
+    {
+        return Handle;
+    }
+    const uint32_t Index = Handle.GetIndex();
+    const bool IsDepth = Desc.Format == RHIFormat::D32_SFLOAT || Desc.Format == RHIFormat::D24_UNORM_S8_UINT;
+
+    VkImageCreateInfo ImageInfo = vks::initializers::imageCreateInfo();
+    ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+    ImageInfo.format = Format;
+    ImageInfo.extent = { Desc.Width, Desc.Height, 1 };
+    ImageInfo.mipLevels = Desc.MipLevels;
+    ImageInfo.arrayLayers = 1;
+    ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ImageInfo.usage = ToVkImageUsage(Desc.Usage);
+    ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult Result = vkCreateImage(Device->logicalDevice, &ImageInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &Images[Index]);
+    if (Result != VK_SUCCESS)
+    {
+        Images[Index] = VK_NULL_HANDLE;
+    }
+    else
+    {
+        const vks::MemoryCategory Category = (Desc.Usage & (RHITextureUsage::ColorAttachment | RHITextureUsage::DepthStencilAttachment)) ? vks::MemoryCategory::Attachment : vks::MemoryCategory::Texture;
+        Result = Device->memoryAllocator->allocateImageMemory(Images[Index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ImageAllocations[Index], Category);
+    }
+    if (Result == VK_SUCCESS)
+    {
+        VkImageViewCreateInfo ViewInfo = vks::initializers::imageViewCreateInfo();
+        ViewInfo.image = Images[Index];
+        ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        ViewInfo.format = Format;
+        ViewInfo.subresourceRange = { IsDepth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT, 0, Desc.MipLevels, 0, 1 };
+        Result = vkCreateImageView(Device->logicalDevice, &ViewInfo, vks::allocationCallbacks(vks::HostAllocationScope::Resource), &ImageViews[Index]);
+        if (Result != VK_SUCCESS)
+        {
+            ImageViews[Index] = VK_NULL_HANDLE;
+        }
+    }
+    if (Result != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create " << Desc.Width << "x" << Desc.Height << " texture: " << EngineBase::Tools::errorString(Result) << std::endl;
+        vks::RetiredResources Partial;
+        Partial.imageViews.push_back(ImageViews[Index]);
+        Partial.images.push_back(Images[Index]);
+        if (ImageAllocations[Index].valid())
+        {
+            Partial.allocations.push_back(ImageAllocations[Index]);
+        }
+        Partial.release(Device->logicalDevice);
+        ImageViews[Index] = VK_NULL_HANDLE;
+        Images[Index] = VK_NULL_HANDLE;
+        ImageAllocations[Index] = vks::Allocation();
+        Resources.ReleaseTexture(Handle);
+        return RHITextureHandle();
+    }
+    return Handle;
+}
+
+void VulkanDynamicRHI::DestroyTexture(RHITextureHandle Handle)
+{
+    vks::RetiredResources Retired;
+    const bool Released = Resources.ReleaseTexture(Handle, [&](uint32_t Index)
+    {
+        Retired.imageViews.push_back(ImageViews[Index]);
+        Retired.images.push_back(Images[Index]);
+        Retired.allocations.push_back(ImageAllocations[Index]);
+        ImageViews[Index] = VK_NULL_HANDLE;
+        Images[Index] = VK_NULL_HANDLE;
+        ImageAllocations[Index] = vks::Allocation();
+    });
+    if (Released)
+    {
+        Retire(std::move(Retired));
+    }
+}
+
+VkBuffer VulkanDynamicRHI::GetBuffer(RHIBufferHandle Handle) const
+{
+    return Resources.IsAlive(Handle) ? Buffers[Handle.GetIndex()] : VK_NULL_HANDLE;
+}
+
+void* VulkanDynamicRHI::GetMappedData(RHIBufferHandle Handle) const
+{
+    return Resources.IsAlive(Handle) ? BufferAllocations[Handle.GetIndex()].mapped : nullptr;
+}
+
+VkImage VulkanDynamicRHI::GetImage(RHITextureHandle Handle) const
+{
+    return Resources.IsAlive(Handle) ? Images[Handle.GetIndex()] : VK_NULL_HANDLE;
+}
+
+VkImageView VulkanDynamicRHI::GetImageView(RHITextureHandle Handle) const
+{
+    return Resources.IsAlive(Handle) ? ImageViews[Handle.GetIndex()] : VK_NULL_HANDLE;
+}
+
+void VulkanDynamicRHI::Retire(vks::RetiredResources&& Retired)
+{
+    if (Device->deletionQueue)
+    {
+        Device->deletionQueue->retire(std::move(Retired));
+    }
+    else
+    {
+        Retired.release(Device->logicalDevice);
+    }
 }
@@ -1,12 +1,14 @@
 ﻿#pragma once
 #include "../DynamicRHI.h"
 #include "VulkanRHI.h"
+#include "External/VulkanDevice.h"
+#include <vector>
 
 class VulkanDynamicRHI:public DynamicRHI
 {
 public:
-    /** Initialization constructor. */
-    VulkanDynamicRHI();
+    /** Initialization constructor, resources are created on InDevice */
+    explicit VulkanDynamicRHI(vks::VulkanDevice* InDevice);
 
     /** Destructor */
     ~VulkanDynamicRHI() {}
@@ -18,7 +20,31 @@ public:
     virtual void ShutDown() final override;
     virtual const char* GetName() final override { return ("Vulkan"); }
 
+    virtual RHIBufferHandle CreateBuffer(const RHIBufferDesc& Desc) final override;
+    virtual void DestroyBuffer(RHIBufferHandle Handle) final override;
+    virtual RHITextureHandle CreateTexture(const RHITextureDesc& Desc) final override;
+    virtual void DestroyTexture(RHITextureHandle Handle) final override;
+
+    /** Native objects behind a handle, VK_NULL_HANDLE / nullptr if the handle is stale */
+    VkBuffer GetBuffer(RHIBufferHandle Handle) const;
+    void* GetMappedData(RHIBufferHandle Handle) const;
+    VkImage GetImage(RHITextureHandle Handle) const;
+    VkImageView GetImageView(RHITextureHandle Handle) const;
+
     void InitInstance();
 
     /* todo : more Vulkan Function*/
+
+private:
+    vks::VulkanDevice* Device;
+
+    // Native objects, indexed by the handle's slot like the metadata columns in Resources
+    std::vector<VkBuffer> Buffers;
+    std::vector<vks::Allocation> BufferAllocations;
+    std::vector<VkImage> Images;
+    std::vector<VkImageView> ImageViews;
+    std::vector<vks::Allocation> ImageAllocations;
+
+    /** Destroy the objects now, or once the frames in flight are done with them if the device has a deletion queue */
+    void Retire(vks::RetiredResources&& Retired);
 };